@@ -0,0 +1,53 @@
+#pragma once
+#include <glm/glm.hpp>
+
+/*
+** AXIS ALIGNED BOUNDING BOX
+*/
+struct AABB
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	AABB() {}
+	AABB(const glm::vec3 &lower, const glm::vec3 &upper) : min(lower), max(upper) {}
+
+	glm::vec3 getCenter() const { return 0.5f * (min + max); }
+	glm::vec3 getExtents() const { return 0.5f * (max - min); }
+
+	// surface area, used as the cost metric when building trees
+	float getSurfaceArea() const {
+		glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// true if the two boxes touch or intersect
+	bool overlaps(const AABB &b) const {
+		return min.x <= b.max.x && max.x >= b.min.x
+			&& min.y <= b.max.y && max.y >= b.min.y
+			&& min.z <= b.max.z && max.z >= b.min.z;
+	}
+
+	// true if b lies completely inside this box
+	bool contains(const AABB &b) const {
+		return min.x <= b.min.x && min.y <= b.min.y && min.z <= b.min.z
+			&& b.max.x <= max.x && b.max.y <= max.y && b.max.z <= max.z;
+	}
+
+	// grow the box by a margin in every direction
+	void fatten(float margin) {
+		min -= glm::vec3(margin);
+		max += glm::vec3(margin);
+	}
+
+	// grow the box to include a point
+	void extend(const glm::vec3 &p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	// smallest box that contains both a and b
+	static AABB combine(const AABB &a, const AABB &b) {
+		return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+};
@@ -0,0 +1,586 @@
+#include <cmath>
+
+#include "ArticulatedSystem.h"
+#include "Parallel.h"
+
+
+// inverse of a small symmetric positive definite matrix (d <= 6, row-major) by Gauss-Jordan
+// elimination, which needs no pivoting for such matrices
+static void invertSymmetric(const float *D, float *inv, int d)
+{
+	float a[36];
+	for (int k = 0; k < d * d; k++)
+	{
+		a[k] = D[k];
+		inv[k] = 0.0f;
+	}
+	for (int k = 0; k < d; k++)
+	{
+		inv[k * d + k] = 1.0f;
+	}
+	for (int k = 0; k < d; k++)
+	{
+		float pivot = 1.0f / a[k * d + k];
+		for (int j = 0; j < d; j++)
+		{
+			a[k * d + j] *= pivot;
+			inv[k * d + j] *= pivot;
+		}
+		for (int i = 0; i < d; i++)
+		{
+			if (i == k)
+			{
+				continue;
+			}
+			float f = a[i * d + k];
+			for (int j = 0; j < d; j++)
+			{
+				a[i * d + j] -= f * a[k * d + j];
+				inv[i * d + j] -= f * inv[k * d + j];
+			}
+		}
+	}
+}
+
+// rotation by the angle |w| about w
+static glm::quat rotationOf(const glm::vec3 &w)
+{
+	float angle = glm::length(w);
+	if (angle < 1e-12f)
+	{
+		return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+	return glm::angleAxis(angle, w / angle);
+}
+
+// cross product matrix: skew(r) v = r x v
+static glm::mat3 skew(const glm::vec3 &r)
+{
+	return glm::mat3(0.0f, r.z, -r.y, -r.z, 0.0f, r.x, r.y, -r.x, 0.0f);
+}
+
+
+ArticulatedSystem::ArticulatedSystem()
+{
+	m_gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	m_damping = 0.0f;
+	m_substeps = 1;
+	m_articulationStart.push_back(0);
+	m_dofStart.push_back(0);
+	m_dinvStart.push_back(0);
+}
+
+
+ArticulatedSystem::~ArticulatedSystem()
+{
+}
+
+int ArticulatedSystem::addLink(int parent, JointType type, const glm::vec3 &parentAnchor, const glm::vec3 &childAnchor,
+	const glm::vec3 &axis, float mass, const glm::mat3 &inertia)
+{
+	int link = getLinkCount();
+	if (parent < 0)
+	{
+		m_articulationStart.push_back(link);
+	}
+	// links of the last articulation only, which keeps every articulation contiguous
+	else if (parent >= link || parent < m_articulationStart[getArticulationCount() - 1] || type == FREE_JOINT)
+	{
+		return -1;
+	}
+	m_articulationStart.back() = link + 1;
+
+	int dof = type == FREE_JOINT ? 6 : type == SPHERICAL_JOINT ? 3 : 1;
+	m_type.push_back(type);
+	m_parent.push_back(parent);
+	m_parentAnchor.push_back(parentAnchor);
+	m_childAnchor.push_back(childAnchor);
+	m_axis.push_back(glm::length(axis) > 0.0f ? glm::normalize(axis) : glm::vec3(1.0f, 0.0f, 0.0f));
+	m_mass.push_back(mass);
+	m_inertia.push_back(inertia);
+	m_dofStart.push_back(m_dofStart.back() + dof);
+	m_dinvStart.push_back(m_dinvStart.back() + dof * dof);
+
+	m_angle.push_back(0.0f);
+	m_jointRotation.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	m_qd.resize(m_dofStart.back(), 0.0f);
+	m_qdd.resize(m_dofStart.back(), 0.0f);
+	m_tau.resize(m_dofStart.back(), 0.0f);
+
+	// a free root starts at its anchor
+	m_pos.push_back(parentAnchor);
+	m_vel.push_back(glm::vec3(0.0f));
+	m_omega.push_back(glm::vec3(0.0f));
+	m_rotation.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	m_jointPos.push_back(parentAnchor);
+	m_force.push_back(glm::vec3(0.0f));
+	m_torque.push_back(glm::vec3(0.0f));
+
+	m_Sw.resize(m_dofStart.back());
+	m_Sv.resize(m_dofStart.back());
+	m_Uw.resize(m_dofStart.back());
+	m_Uv.resize(m_dofStart.back());
+	m_u.resize(m_dofStart.back());
+	m_Dinv.resize(m_dinvStart.back());
+	m_IA.resize(link + 1);
+	m_pAw.resize(link + 1);
+	m_pAv.resize(link + 1);
+	m_cw.resize(link + 1);
+	m_cv.resize(link + 1);
+	m_aw.resize(link + 1);
+	m_av.resize(link + 1);
+	m_startAngle.resize(link + 1);
+	m_startRotation.resize(link + 1);
+	m_startPos.resize(link + 1);
+	m_theta.resize(link + 1);
+	m_startVel.resize(m_dofStart.back());
+	m_rate.resize(m_dofStart.back());
+	m_rateSum.resize(m_dofStart.back());
+	m_accSum.resize(m_dofStart.back());
+
+	kinematics(link, link + 1, false);
+	return link;
+}
+
+int ArticulatedSystem::createChain(const glm::vec3 &anchor, const glm::vec3 &direction, int count, float length, float mass, JointType type)
+{
+	glm::vec3 d = glm::normalize(direction);
+	// hinges across the direction and, if they can be, horizontal
+	glm::vec3 axis = glm::cross(d, glm::vec3(0.0f, 1.0f, 0.0f));
+	if (glm::length(axis) < 1e-3f)
+	{
+		axis = glm::cross(d, glm::vec3(1.0f, 0.0f, 0.0f));
+	}
+	if (type == PRISMATIC_JOINT)
+	{
+		axis = d;
+	}
+	if (type == FREE_JOINT)
+	{
+		type = SPHERICAL_JOINT;
+	}
+
+	// rod of radius length / 20 about its centre; the turn about its own axis keeps spherical joints
+	// from being singular
+	glm::mat3 inertia = mass * length * length / 12.0f * (glm::mat3(1.0f) - glm::outerProduct(d, d))
+		+ mass * length * length / 800.0f * glm::outerProduct(d, d);
+	glm::vec3 half = 0.5f * length * d;
+
+	int root = addLink(-1, type, anchor, -half, axis, mass, inertia);
+	int parent = root;
+	for (int k = 1; k < count; k++)
+	{
+		parent = addLink(parent, type, half, -half, axis, mass, inertia);
+	}
+	return root;
+}
+
+void ArticulatedSystem::addForceAtPoint(int link, const glm::vec3 &force, const glm::vec3 &point)
+{
+	m_force[link] += force;
+	m_torque[link] += glm::cross(point - m_pos[link], force);
+}
+
+// move a spatial inertia, in world axes, to a new point, r = old point - new point:
+// A' = A - B r~ + r~ B^T - r~ M r~, B' = B + r~ M (as torque' = torque + r x force)
+static void shiftInertia(glm::mat3 &A, glm::mat3 &B, const glm::mat3 &M, const glm::vec3 &r)
+{
+	glm::mat3 rx = skew(r);
+	glm::mat3 rxM = rx * M;
+	A += rx * glm::transpose(B) - B * rx - rxM * rx;
+	B += rxM;
+}
+
+void ArticulatedSystem::kinematics(int first, int last, bool bias)
+{
+	for (int i = first; i < last; i++)
+	{
+		int s = m_dofStart[i];
+		const float *qd = &m_qd[s];
+
+		if (m_type[i] == FREE_JOINT)
+		{
+			// the joint coordinates are the world pose, the dofs the world velocities
+			m_rotation[i] = m_jointRotation[i];
+			m_jointPos[i] = m_pos[i];
+			m_omega[i] = glm::vec3(qd[0], qd[1], qd[2]);
+			m_vel[i] = glm::vec3(qd[3], qd[4], qd[5]);
+			for (int k = 0; k < 3; k++)
+			{
+				glm::vec3 e(0.0f);
+				e[k] = 1.0f;
+				m_Sw[s + k] = e;
+				m_Sv[s + k] = glm::vec3(0.0f);
+				m_Sw[s + 3 + k] = glm::vec3(0.0f);
+				m_Sv[s + 3 + k] = e;
+			}
+			m_cw[i] = glm::vec3(0.0f);
+			m_cv[i] = glm::vec3(0.0f);
+			continue;
+		}
+
+		// the world is a parent at rest with its centre at the anchor
+		int p = m_parent[i];
+		glm::quat parentRotation = p < 0 ? glm::quat(1.0f, 0.0f, 0.0f, 0.0f) : m_rotation[p];
+		glm::vec3 parentPos = p < 0 ? m_parentAnchor[i] : m_pos[p];
+		glm::vec3 parentOmega = p < 0 ? glm::vec3(0.0f) : m_omega[p];
+		glm::vec3 parentVel = p < 0 ? glm::vec3(0.0f) : m_vel[p];
+		glm::vec3 joint = p < 0 ? m_parentAnchor[i] : parentPos + parentRotation * m_parentAnchor[i];
+
+		// motion subspace at the joint
+		glm::quat rotation;
+		glm::vec3 pos;
+		if (m_type[i] == REVOLUTE_JOINT)
+		{
+			rotation = parentRotation * glm::angleAxis(m_angle[i], m_axis[i]);
+			pos = joint - rotation * m_childAnchor[i];
+			m_Sw[s] = rotation * m_axis[i];
+			m_Sv[s] = glm::vec3(0.0f);
+		}
+		else if (m_type[i] == PRISMATIC_JOINT)
+		{
+			rotation = parentRotation;
+			pos = joint + rotation * (m_angle[i] * m_axis[i] - m_childAnchor[i]);
+			m_Sw[s] = glm::vec3(0.0f);
+			m_Sv[s] = rotation * m_axis[i];
+		}
+		else
+		{
+			rotation = parentRotation * m_jointRotation[i];
+			pos = joint - rotation * m_childAnchor[i];
+			glm::mat3 axes = glm::mat3_cast(rotation);
+			for (int k = 0; k < 3; k++)
+			{
+				m_Sw[s + k] = axes[k];
+				m_Sv[s + k] = glm::vec3(0.0f);
+			}
+		}
+
+		glm::vec3 r = pos - joint;
+		glm::vec3 omegaRel(0.0f), velRel(0.0f);
+		for (int k = s; k < m_dofStart[i + 1]; k++)
+		{
+			omegaRel += m_Sw[k] * m_qd[k];
+			velRel += m_Sv[k] * m_qd[k];
+		}
+		glm::vec3 omega = parentOmega + omegaRel;
+
+		m_rotation[i] = rotation;
+		m_pos[i] = pos;
+		m_jointPos[i] = joint;
+		m_omega[i] = omega;
+		m_vel[i] = parentVel + glm::cross(parentOmega, pos - parentPos) + velRel + glm::cross(omegaRel, r);
+
+		if (bias)
+		{
+			// accelerations the velocities cause at the joint with no joint acceleration, on top of
+			// the parent's acceleration shifted there (centripetal terms of the parent and the link,
+			// Coriolis term of a slide)
+			m_cw[i] = glm::cross(parentOmega, omegaRel);
+			m_cv[i] = glm::cross(parentOmega, glm::cross(parentOmega, joint - parentPos)) + glm::cross(omega, glm::cross(omega, r))
+				+ 2.0f * glm::cross(omega, velRel);
+		}
+	}
+}
+
+void ArticulatedSystem::inwardPass(int first, int last)
+{
+	// rigid body inertias and bias forces: gyroscopic torque, gravity and the applied loads
+	for (int i = first; i < last; i++)
+	{
+		glm::mat3 R = glm::mat3_cast(m_rotation[i]);
+		glm::mat3 inertia = R * m_inertia[i] * glm::transpose(R);
+		m_IA[i].A = inertia;
+		m_IA[i].B = glm::mat3(0.0f);
+		m_IA[i].M = glm::mat3(m_mass[i]);
+		m_pAw[i] = glm::cross(m_omega[i], inertia * m_omega[i]) - m_torque[i];
+		m_pAv[i] = -m_mass[i] * m_gravity - m_force[i];
+	}
+
+	// children come after their parents, so a link has all of its subtree when it is reached;
+	// the joint is handled at its own point, where its motion subspace is a pure rotation or
+	// translation
+	for (int i = last - 1; i >= first; i--)
+	{
+		int s = m_dofStart[i], d = m_dofStart[i + 1] - s;
+		glm::vec3 r = m_pos[i] - m_jointPos[i];
+		SpatialInertia I = m_IA[i];
+		shiftInertia(I.A, I.B, I.M, r);
+		glm::vec3 pAw = m_pAw[i] + glm::cross(r, m_pAv[i]), pAv = m_pAv[i];
+
+		float D[36];
+		for (int k = 0; k < d; k++)
+		{
+			const glm::vec3 &sw = m_Sw[s + k], &sv = m_Sv[s + k];
+			m_Uw[s + k] = I.A * sw + I.B * sv;
+			m_Uv[s + k] = glm::transpose(I.B) * sw + I.M * sv;
+			m_u[s + k] = m_tau[s + k] - m_damping * m_qd[s + k] - glm::dot(sw, pAw) - glm::dot(sv, pAv);
+		}
+		for (int k = 0; k < d; k++)
+		{
+			for (int l = 0; l < d; l++)
+			{
+				D[k * d + l] = glm::dot(m_Sw[s + k], m_Uw[s + l]) + glm::dot(m_Sv[s + k], m_Uv[s + l]);
+			}
+		}
+		float *Dinv = &m_Dinv[m_dinvStart[i]];
+		invertSymmetric(D, Dinv, d);
+
+		int p = m_parent[i];
+		if (p < 0)
+		{
+			continue;
+		}
+
+		// what the parent feels through the joint: Ia = I^A - U D^-1 U^T, pa = p^A + Ia c + U D^-1 u
+		SpatialInertia Ia;
+		glm::vec3 pw, pv;
+		if (m_type[i] == SPHERICAL_JOINT)
+		{
+			// a ball joint passes on no torque and the subtree only as a mass matrix at the joint;
+			// written so directly, since the subtraction would leave rounding errors in the rotation
+			// block that the next joints up amplify
+			glm::mat3 Ainv = glm::inverse(I.A);
+			glm::mat3 M = I.M - glm::transpose(I.B) * Ainv * I.B;
+			Ia.A = glm::mat3(0.0f);
+			Ia.B = glm::mat3(0.0f);
+			Ia.M = 0.5f * (M + glm::transpose(M));
+			glm::vec3 u(0.0f);
+			pw = glm::vec3(0.0f);
+			for (int k = 0; k < 3; k++)
+			{
+				u += m_u[s + k] * m_Sw[s + k];
+				pw += (m_tau[s + k] - m_damping * m_qd[s + k]) * m_Sw[s + k];
+			}
+			pv = pAv + Ia.M * m_cv[i] + glm::transpose(I.B) * (Ainv * u);
+		}
+		else
+		{
+			Ia = I;
+			pw = pAw;
+			pv = pAv;
+			for (int k = 0; k < d; k++)
+			{
+				glm::vec3 w(0.0f), v(0.0f);
+				float Du = 0.0f;
+				for (int l = 0; l < d; l++)
+				{
+					w += Dinv[k * d + l] * m_Uw[s + l];
+					v += Dinv[k * d + l] * m_Uv[s + l];
+					Du += Dinv[k * d + l] * m_u[s + l];
+				}
+				Ia.A -= glm::outerProduct(m_Uw[s + k], w);
+				Ia.B -= glm::outerProduct(m_Uw[s + k], v);
+				Ia.M -= glm::outerProduct(m_Uv[s + k], v);
+				pw += Du * m_Uw[s + k];
+				pv += Du * m_Uv[s + k];
+			}
+			pw += Ia.A * m_cw[i] + Ia.B * m_cv[i];
+			pv += glm::transpose(Ia.B) * m_cw[i] + Ia.M * m_cv[i];
+		}
+
+		// shifted from the joint to the parent's centre
+		glm::vec3 rp = m_jointPos[i] - m_pos[p];
+		shiftInertia(Ia.A, Ia.B, Ia.M, rp);
+		m_IA[p].A += Ia.A;
+		m_IA[p].B += Ia.B;
+		m_IA[p].M += Ia.M;
+		m_pAw[p] += pw + glm::cross(rp, pv);
+		m_pAv[p] += pv;
+	}
+}
+
+void ArticulatedSystem::outwardPass(int first, int last)
+{
+	for (int i = first; i < last; i++)
+	{
+		int s = m_dofStart[i], d = m_dofStart[i + 1] - s;
+		int p = m_parent[i];
+
+		// acceleration at the joint with no joint acceleration
+		glm::vec3 aw = m_cw[i], av = m_cv[i];
+		if (p >= 0)
+		{
+			aw += m_aw[p];
+			av += m_av[p] + glm::cross(m_aw[p], m_jointPos[i] - m_pos[p]);
+		}
+
+		// qdd = D^-1 (u - U^T a')
+		float y[6];
+		for (int k = 0; k < d; k++)
+		{
+			y[k] = m_u[s + k] - glm::dot(m_Uw[s + k], aw) - glm::dot(m_Uv[s + k], av);
+		}
+		const float *Dinv = &m_Dinv[m_dinvStart[i]];
+		for (int k = 0; k < d; k++)
+		{
+			float qdd = 0.0f;
+			for (int l = 0; l < d; l++)
+			{
+				qdd += Dinv[k * d + l] * y[l];
+			}
+			m_qdd[s + k] = qdd;
+			aw += qdd * m_Sw[s + k];
+			av += qdd * m_Sv[s + k];
+		}
+		m_aw[i] = aw;
+		m_av[i] = av + glm::cross(aw, m_pos[i] - m_jointPos[i]);
+	}
+}
+
+void ArticulatedSystem::accelerations(int first, int last)
+{
+	kinematics(first, last, true);
+	inwardPass(first, last);
+	outwardPass(first, last);
+}
+
+void ArticulatedSystem::rates(int first, int last)
+{
+	for (int i = first; i < last; i++)
+	{
+		int s = m_dofStart[i];
+		for (int k = s; k < m_dofStart[i + 1]; k++)
+		{
+			m_rate[k] = m_qd[k];
+		}
+		if (m_type[i] == SPHERICAL_JOINT || m_type[i] == FREE_JOINT)
+		{
+			// rate of the rotation vector from the start of the step (inverse of the derivative of the
+			// exponential map, to second order as fourth order Runge-Kutta needs); the sign of the
+			// first order term is + for velocities in the link axes and - in world axes
+			glm::vec3 w(m_qd[s], m_qd[s + 1], m_qd[s + 2]);
+			const glm::vec3 &theta = m_theta[i];
+			float sign = m_type[i] == SPHERICAL_JOINT ? 0.5f : -0.5f;
+			glm::vec3 rate = w + sign * glm::cross(theta, w) + glm::cross(theta, glm::cross(theta, w)) / 12.0f;
+			m_rate[s] = rate.x;
+			m_rate[s + 1] = rate.y;
+			m_rate[s + 2] = rate.z;
+		}
+	}
+}
+
+void ArticulatedSystem::advance(int first, int last, float h)
+{
+	for (int i = first; i < last; i++)
+	{
+		const float *rate = &m_rate[m_dofStart[i]];
+		switch (m_type[i])
+		{
+		case REVOLUTE_JOINT:
+		case PRISMATIC_JOINT:
+			m_angle[i] = m_startAngle[i] + h * rate[0];
+			break;
+		case SPHERICAL_JOINT:
+			// rotation in the link axes
+			m_theta[i] = h * glm::vec3(rate[0], rate[1], rate[2]);
+			m_jointRotation[i] = glm::normalize(m_startRotation[i] * rotationOf(m_theta[i]));
+			break;
+		case FREE_JOINT:
+			// rotation in world axes
+			m_theta[i] = h * glm::vec3(rate[0], rate[1], rate[2]);
+			m_jointRotation[i] = glm::normalize(rotationOf(m_theta[i]) * m_startRotation[i]);
+			m_pos[i] = m_startPos[i] + h * glm::vec3(rate[3], rate[4], rate[5]);
+			break;
+		}
+	}
+}
+
+void ArticulatedSystem::integrate(int first, int last, float dt)
+{
+	int s = m_dofStart[first], e = m_dofStart[last];
+	for (int i = first; i < last; i++)
+	{
+		m_startAngle[i] = m_angle[i];
+		m_startRotation[i] = m_jointRotation[i];
+		m_startPos[i] = m_pos[i];
+		m_theta[i] = glm::vec3(0.0f);
+	}
+	for (int k = s; k < e; k++)
+	{
+		m_startVel[k] = m_qd[k];
+		m_rateSum[k] = 0.0f;
+		m_accSum[k] = 0.0f;
+	}
+
+	// classical Runge-Kutta: the stages evaluate the accelerations at the start, twice at the middle
+	// and at the end of the step, each from the rates and accelerations of the one before; rotations
+	// are integrated as rotation vectors from the start of the step (Munthe-Kaas), which keeps the
+	// method fourth order on quaternions
+	const float fraction[4] = { 0.0f, 0.5f, 0.5f, 1.0f };
+	const float weight[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+	for (int stage = 0; stage < 4; stage++)
+	{
+		if (stage > 0)
+		{
+			float h = fraction[stage] * dt;
+			advance(first, last, h);
+			for (int k = s; k < e; k++)
+			{
+				m_qd[k] = m_startVel[k] + h * m_qdd[k];
+			}
+		}
+		accelerations(first, last);
+		rates(first, last);
+		for (int k = s; k < e; k++)
+		{
+			m_rateSum[k] += weight[stage] * m_rate[k];
+			m_accSum[k] += weight[stage] * m_qdd[k];
+		}
+	}
+
+	for (int k = s; k < e; k++)
+	{
+		m_rate[k] = m_rateSum[k] / 6.0f;
+	}
+	advance(first, last, dt);
+	for (int k = s; k < e; k++)
+	{
+		m_qd[k] = m_startVel[k] + dt / 6.0f * m_accSum[k];
+	}
+}
+
+void ArticulatedSystem::updateKinematics()
+{
+	int articulations = getArticulationCount();
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int a = 0; a < articulations; a++)
+	{
+		kinematics(m_articulationStart[a], m_articulationStart[a + 1], false);
+	}
+}
+
+float ArticulatedSystem::getEnergy() const
+{
+	float energy = 0.0f;
+	for (int i = 0; i < getLinkCount(); i++)
+	{
+		glm::mat3 R = glm::mat3_cast(m_rotation[i]);
+		glm::vec3 L = R * (m_inertia[i] * (glm::transpose(R) * m_omega[i]));
+		energy += 0.5f * m_mass[i] * glm::dot(m_vel[i], m_vel[i]) + 0.5f * glm::dot(m_omega[i], L) - m_mass[i] * glm::dot(m_gravity, m_pos[i]);
+	}
+	return energy;
+}
+
+void ArticulatedSystem::step(float dt)
+{
+	// every articulation is independent: small dynamic batches balance chains of different sizes,
+	// and a thread takes all the substeps of an articulation while its links are in cache
+	int articulations = getArticulationCount();
+	float h = dt / m_substeps;
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int a = 0; a < articulations; a++)
+	{
+		int first = m_articulationStart[a], last = m_articulationStart[a + 1];
+		for (int substep = 0; substep < m_substeps; substep++)
+		{
+			integrate(first, last, h);
+		}
+		kinematics(first, last, false);
+		for (int i = first; i < last; i++)
+		{
+			m_force[i] = glm::vec3(0.0f);
+			m_torque[i] = glm::vec3(0.0f);
+		}
+	}
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+enum JointType
+{
+	FREE_JOINT, // 6 dofs: angular velocity and centre of mass velocity in world axes (roots only)
+	REVOLUTE_JOINT, // 1 dof: angle about the axis
+	PRISMATIC_JOINT, // 1 dof: slide along the axis
+	SPHERICAL_JOINT // 3 dofs: rotation, angular velocity in the link axes
+};
+
+/*
+** ARTICULATED SYSTEM
+** Chains and trees of rigid links connected by joints, simulated in reduced
+** (joint) coordinates with Featherstone's articulated-body algorithm: one pass out
+** from the root for the kinematics, one pass in to build the articulated inertia of
+** every subtree and one pass out for the joint accelerations, so a step is O(n) in
+** the links and the joints can never drift apart; there are no constraints to iterate.
+** Spatial quantities are kept in world axes at the centre of mass of every link
+** (angular part first), with classical accelerations, so moving between a link and
+** its parent is a shift by the vector between their centres and no rotations.
+** Links of one articulation are stored contiguously, parents before children, and
+** the articulations are independent, so they are shared among the threads in small
+** dynamic batches: many ragdolls or pendulums cost linear time overall.
+** The joints are integrated with classical Runge-Kutta, since the explicit Euler
+** methods of the particle systems drift and blow up on whipping chains; rotations
+** are integrated as rotation vectors and applied to the quaternions exactly.
+** The root joint attaches an articulation to the world (a fixed base), unless it is
+** a free joint (a floating base).
+*/
+class ArticulatedSystem
+{
+public:
+	ArticulatedSystem();
+	~ArticulatedSystem();
+
+	/*
+	** GET METHODS
+	*/
+	int getArticulationCount() const { return (int)m_articulationStart.size() - 1; }
+	int getLinkCount() const { return (int)m_type.size(); }
+	// first link (the root) and number of links of an articulation
+	int getArticulationRoot(int articulation) const { return m_articulationStart[articulation]; }
+	int getArticulationSize(int articulation) const { return m_articulationStart[articulation + 1] - m_articulationStart[articulation]; }
+	int getParent(int link) const { return m_parent[link]; }
+	JointType getJointType(int link) const { return m_type[link]; }
+	int getDofCount(int link) const { return m_dofStart[link + 1] - m_dofStart[link]; }
+
+	// world state of the links at their centres of mass
+	const glm::vec3& getLinkPos(int link) const { return m_pos[link]; }
+	const glm::quat& getLinkRotation(int link) const { return m_rotation[link]; }
+	const glm::vec3& getLinkVel(int link) const { return m_vel[link]; }
+	const glm::vec3& getLinkAngularVel(int link) const { return m_omega[link]; }
+	// world position of the joint connecting a link to its parent
+	const glm::vec3& getJointPos(int link) const { return m_jointPos[link]; }
+	float getLinkMass(int link) const { return m_mass[link]; }
+
+	// joint coordinates
+	float getJointAngle(int link) const { return m_angle[link]; }
+	const glm::quat& getJointRotation(int link) const { return m_jointRotation[link]; }
+	float getJointVel(int link, int dof) const { return m_qd[m_dofStart[link] + dof]; }
+	float getJointAcc(int link, int dof) const { return m_qdd[m_dofStart[link] + dof]; }
+
+	const glm::vec3& getGravity() const { return m_gravity; }
+	int getSubsteps() const { return m_substeps; }
+
+	/*
+	** SET METHODS
+	*/
+	void setGravity(const glm::vec3 &gravity) { m_gravity = gravity; }
+	// viscous damping of every joint dof (N m s / rad or N s / m)
+	void setDamping(float damping) { m_damping = damping; }
+	// Runge-Kutta steps per step; fast whipping chains of many light links need a few
+	void setSubsteps(int substeps) { m_substeps = substeps; }
+
+	// joint coordinates: angle or slide of 1 dof joints, rotation of spherical and free joints
+	// (the free joint rotation is the world rotation of the link); call updateKinematics after
+	void setJointAngle(int link, float q) { m_angle[link] = q; }
+	void setJointRotation(int link, const glm::quat &q) { m_jointRotation[link] = glm::normalize(q); }
+	void setJointVel(int link, int dof, float v) { m_qd[m_dofStart[link] + dof] = v; }
+	// motor torque or force of a joint dof, kept until changed
+	void setJointForce(int link, int dof, float f) { m_tau[m_dofStart[link] + dof] = f; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a link of the given mass and inertia tensor (about its centre, in its own axes) to the last
+	// articulation, joined to the parent link at parentAnchor in the parent's axes and
+	// childAnchor in its own axes, both relative to the centres of mass; at zero joint
+	// coordinates the link has the axes of its parent. A parent of -1 starts a new articulation
+	// whose root is joined to the world at parentAnchor, or placed there by a free joint.
+	// The axis of revolute and prismatic joints is in the link's axes. Returns the link index.
+	int addLink(int parent, JointType type, const glm::vec3 &parentAnchor, const glm::vec3 &childAnchor,
+		const glm::vec3 &axis, float mass, const glm::mat3 &inertia);
+	// a new articulation of count rods of the given length and mass hanging from anchor along
+	// direction, joined by joints of the given type; returns the root link
+	int createChain(const glm::vec3 &anchor, const glm::vec3 &direction, int count, float length, float mass, JointType type);
+
+	// external force at the centre of mass of a link and torque, in world axes, held over the
+	// substeps and cleared by step
+	void addForce(int link, const glm::vec3 &force) { m_force[link] += force; }
+	void addTorque(int link, const glm::vec3 &torque) { m_torque[link] += torque; }
+	// force at a world point of a link
+	void addForceAtPoint(int link, const glm::vec3 &force, const glm::vec3 &point);
+
+	// world poses and velocities of the links from the joint coordinates
+	void updateKinematics();
+
+	// kinetic and potential energy of all the links
+	float getEnergy() const;
+
+	void step(float dt);
+
+private:
+	// symmetric 6x6 inertia [A B; B^T M]: torque = A alpha + B a, force = B^T alpha + M a
+	struct SpatialInertia
+	{
+		glm::mat3 A, B, M;
+	};
+
+	// one pass out from the root: poses, velocities and (if bias) velocity-product accelerations
+	void kinematics(int first, int last, bool bias);
+	void inwardPass(int first, int last);
+	void outwardPass(int first, int last);
+	// joint accelerations at the current joint coordinates and velocities
+	void accelerations(int first, int last);
+	// rates of the joint coordinates from the velocities
+	void rates(int first, int last);
+	// joint coordinates of the start of the step moved by h times the rates
+	void advance(int first, int last, float h);
+	// one Runge-Kutta step
+	void integrate(int first, int last, float dt);
+
+	glm::vec3 m_gravity;
+	float m_damping;
+	int m_substeps;
+
+	std::vector<int> m_articulationStart;
+
+	// links
+	std::vector<JointType> m_type;
+	std::vector<int> m_parent;
+	std::vector<glm::vec3> m_parentAnchor, m_childAnchor, m_axis;
+	std::vector<float> m_mass;
+	std::vector<glm::mat3> m_inertia; // in the link axes
+	std::vector<int> m_dofStart; // dofs of link i at [m_dofStart[i], m_dofStart[i + 1])
+	std::vector<int> m_dinvStart; // inverse of D of link i at m_dinvStart[i], d x d
+
+	// joint coordinates
+	std::vector<float> m_angle;
+	std::vector<glm::quat> m_jointRotation;
+	std::vector<float> m_qd, m_qdd, m_tau;
+
+	// world state
+	std::vector<glm::vec3> m_pos, m_vel, m_omega;
+	std::vector<glm::quat> m_rotation;
+	std::vector<glm::vec3> m_jointPos;
+	std::vector<glm::vec3> m_force, m_torque;
+
+	// algorithm working arrays
+	std::vector<glm::vec3> m_Sw, m_Sv; // motion subspace, one column per dof
+	std::vector<glm::vec3> m_Uw, m_Uv; // U = I^A S, per dof
+	std::vector<float> m_u; // tau - S^T p^A, per dof
+	std::vector<float> m_Dinv;
+	std::vector<SpatialInertia> m_IA; // articulated inertia
+	std::vector<glm::vec3> m_pAw, m_pAv; // articulated bias force
+	std::vector<glm::vec3> m_cw, m_cv; // velocity-product acceleration
+	std::vector<glm::vec3> m_aw, m_av; // acceleration
+
+	// integrator: state at the start of the step, rotation vectors from it, rates and weighted
+	// sums of the stages
+	std::vector<float> m_startAngle;
+	std::vector<glm::quat> m_startRotation;
+	std::vector<glm::vec3> m_startPos;
+	std::vector<glm::vec3> m_theta;
+	std::vector<float> m_startVel, m_rate, m_rateSum, m_accSum;
+};
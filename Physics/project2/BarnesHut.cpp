@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "BarnesHut.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+
+// bits per axis of the Morton code, also the maximum depth of the tree
+static const int MORTON_BITS = 10;
+
+
+// spread the lower 10 bits of v so that there are two zero bits between each of them
+static unsigned int expandBits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+
+BarnesHut::BarnesHut()
+{
+	m_theta = 0.5f;
+	m_G = 1.0f;
+	m_softening = 0.01f;
+	m_leafSize = 32;
+	m_origin = glm::vec3(0.0f);
+	m_size = 1.0f;
+}
+
+
+BarnesHut::~BarnesHut()
+{
+}
+
+
+/*
+** TREE CONSTRUCTION
+*/
+
+// compute the bounding cube, the Morton codes and sort the particles along the curve
+void BarnesHut::sortParticles(const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<float> &mass = ps.getMass();
+	int n = ps.getCount();
+
+	// bounds, reduced through per thread partial results
+	int threads = getMaxThreads();
+	std::vector<glm::vec3> lo(threads, glm::vec3(FLT_MAX));
+	std::vector<glm::vec3> hi(threads, glm::vec3(-FLT_MAX));
+
+	#pragma omp parallel num_threads(threads)
+	{
+		int t = getThreadNum();
+		#pragma omp for
+		for (int i = 0; i < n; i++)
+		{
+			lo[t] = glm::min(lo[t], pos[i]);
+			hi[t] = glm::max(hi[t], pos[i]);
+		}
+	}
+
+	glm::vec3 bmin = lo[0];
+	glm::vec3 bmax = hi[0];
+	for (int t = 1; t < threads; t++)
+	{
+		bmin = glm::min(bmin, lo[t]);
+		bmax = glm::max(bmax, hi[t]);
+	}
+
+	glm::vec3 extent = bmax - bmin;
+	m_size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 1.0001f;
+	m_origin = bmin;
+
+	m_codes.resize(n);
+	m_order.resize(n);
+	float scale = (float)(1 << MORTON_BITS) / m_size;
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		glm::vec3 q = (pos[i] - m_origin) * scale;
+		unsigned int x = std::min((unsigned int)q.x, (1u << MORTON_BITS) - 1);
+		unsigned int y = std::min((unsigned int)q.y, (1u << MORTON_BITS) - 1);
+		unsigned int z = std::min((unsigned int)q.z, (1u << MORTON_BITS) - 1);
+		m_codes[i] = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+		m_order[i] = i;
+	}
+
+	radixSort(m_codes, m_order, 3 * MORTON_BITS);
+
+	// gather the sorted particles into flat arrays
+	m_px.resize(n);
+	m_py.resize(n);
+	m_pz.resize(n);
+	m_pm.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		int p = m_order[i];
+		m_px[i] = pos[p].x;
+		m_py[i] = pos[p].y;
+		m_pz[i] = pos[p].z;
+		m_pm[i] = mass[p];
+	}
+}
+
+// split the nodes of each level in parallel, children of a node are the runs of equal octant digits
+void BarnesHut::buildTree()
+{
+	int n = (int)m_codes.size();
+
+	m_nodeBegin.assign(1, 0);
+	m_nodeEnd.assign(1, n);
+	m_nodeSize.assign(1, m_size);
+	m_nodeFirstChild.assign(1, -1);
+	m_nodeChildCount.assign(1, 0);
+	m_levelStart.assign(1, 0);
+	m_leaves.clear();
+
+	std::vector<int> childCount;
+	std::vector<int> childOffset;
+
+	int levelBegin = 0;
+	int levelEnd = 1;
+	for (int level = 0; levelBegin < levelEnd; level++)
+	{
+		int count = levelEnd - levelBegin;
+		childCount.assign(count, 0);
+		int shift = 3 * (MORTON_BITS - 1 - level);
+
+		// count the non empty octants of every node of the level
+		#pragma omp parallel for schedule(dynamic, 64)
+		for (int k = 0; k < count; k++)
+		{
+			int node = levelBegin + k;
+			int b = m_nodeBegin[node];
+			int e = m_nodeEnd[node];
+			if (e - b <= m_leafSize || level >= MORTON_BITS)
+			{
+				continue;
+			}
+
+			int c = 0;
+			unsigned int last = 8;
+			for (int i = b; i < e; )
+			{
+				unsigned int digit = (m_codes[i] >> shift) & 7;
+				if (digit != last)
+				{
+					c++;
+					last = digit;
+				}
+				// jump to the end of the run with a binary search
+				unsigned int key = ((m_codes[i] >> shift) + 1) << shift;
+				i = (int)(std::lower_bound(m_codes.begin() + i, m_codes.begin() + e, key) - m_codes.begin());
+			}
+			childCount[k] = c;
+		}
+
+		// allocate the children of the level contiguously
+		childOffset.resize(count);
+		int total = 0;
+		for (int k = 0; k < count; k++)
+		{
+			childOffset[k] = levelEnd + total;
+			total += childCount[k];
+		}
+
+		int size = levelEnd + total;
+		m_nodeBegin.resize(size);
+		m_nodeEnd.resize(size);
+		m_nodeSize.resize(size);
+		m_nodeFirstChild.resize(size);
+		m_nodeChildCount.resize(size);
+
+		#pragma omp parallel for schedule(dynamic, 64)
+		for (int k = 0; k < count; k++)
+		{
+			int node = levelBegin + k;
+			m_nodeChildCount[node] = childCount[k];
+			if (childCount[k] == 0)
+			{
+				m_nodeFirstChild[node] = -1;
+				continue;
+			}
+			m_nodeFirstChild[node] = childOffset[k];
+
+			int b = m_nodeBegin[node];
+			int e = m_nodeEnd[node];
+			int child = childOffset[k];
+			for (int i = b; i < e; child++)
+			{
+				unsigned int key = ((m_codes[i] >> shift) + 1) << shift;
+				int runEnd = (int)(std::lower_bound(m_codes.begin() + i, m_codes.begin() + e, key) - m_codes.begin());
+				m_nodeBegin[child] = i;
+				m_nodeEnd[child] = runEnd;
+				m_nodeSize[child] = 0.5f * m_nodeSize[node];
+				i = runEnd;
+			}
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			if (childCount[k] == 0)
+			{
+				m_leaves.push_back(levelBegin + k);
+			}
+		}
+
+		levelBegin = levelEnd;
+		levelEnd = size;
+		m_levelStart.push_back(levelBegin);
+	}
+
+	int nodes = (int)m_nodeBegin.size();
+	m_nodeMass.resize(nodes);
+	m_nodeX.resize(nodes);
+	m_nodeY.resize(nodes);
+	m_nodeZ.resize(nodes);
+}
+
+// masses and centres of mass, from the deepest level up
+void BarnesHut::computeMoments()
+{
+	int nodes = (int)m_nodeBegin.size();
+	for (int level = (int)m_levelStart.size() - 1; level >= 0; level--)
+	{
+		int begin = m_levelStart[level];
+		int end = level + 1 < (int)m_levelStart.size() ? m_levelStart[level + 1] : nodes;
+
+		#pragma omp parallel for schedule(dynamic, 64)
+		for (int node = begin; node < end; node++)
+		{
+			float m = 0.0f, x = 0.0f, y = 0.0f, z = 0.0f;
+			if (m_nodeChildCount[node] == 0)
+			{
+				for (int i = m_nodeBegin[node]; i < m_nodeEnd[node]; i++)
+				{
+					m += m_pm[i];
+					x += m_pm[i] * m_px[i];
+					y += m_pm[i] * m_py[i];
+					z += m_pm[i] * m_pz[i];
+				}
+			}
+			else
+			{
+				int first = m_nodeFirstChild[node];
+				for (int c = first; c < first + m_nodeChildCount[node]; c++)
+				{
+					m += m_nodeMass[c];
+					x += m_nodeMass[c] * m_nodeX[c];
+					y += m_nodeMass[c] * m_nodeY[c];
+					z += m_nodeMass[c] * m_nodeZ[c];
+				}
+			}
+
+			m_nodeMass[node] = m;
+			if (m > 0.0f)
+			{
+				m_nodeX[node] = x / m;
+				m_nodeY[node] = y / m;
+				m_nodeZ[node] = z / m;
+			}
+			else
+			{
+				int i = m_nodeBegin[node];
+				m_nodeX[node] = m_px[i];
+				m_nodeY[node] = m_py[i];
+				m_nodeZ[node] = m_pz[i];
+			}
+		}
+	}
+}
+
+
+/*
+** FORCE EVALUATION
+*/
+
+void BarnesHut::computeForces(ParticleSystem &ps)
+{
+	std::vector<glm::vec3> &force = ps.getForce();
+	int leafCount = (int)m_leaves.size();
+	float theta2 = m_theta * m_theta;
+	float eps2 = m_softening * m_softening;
+
+	#pragma omp parallel
+	{
+		std::vector<int> stack;
+		std::vector<float> lx, ly, lz, lm; // interaction list shared by the particles of a leaf
+
+		#pragma omp for schedule(dynamic, 16)
+		for (int l = 0; l < leafCount; l++)
+		{
+			int leaf = m_leaves[l];
+			int b = m_nodeBegin[leaf];
+			int e = m_nodeEnd[leaf];
+
+			// tight bounds of the leaf particles
+			glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+			for (int i = b; i < e; i++)
+			{
+				glm::vec3 p(m_px[i], m_py[i], m_pz[i]);
+				bmin = glm::min(bmin, p);
+				bmax = glm::max(bmax, p);
+			}
+
+			lx.clear();
+			ly.clear();
+			lz.clear();
+			lm.clear();
+
+			stack.clear();
+			stack.push_back(0);
+			while (!stack.empty())
+			{
+				int node = stack.back();
+				stack.pop_back();
+
+				// distance from the centre of mass to the closest point of the leaf
+				glm::vec3 com(m_nodeX[node], m_nodeY[node], m_nodeZ[node]);
+				glm::vec3 d = com - glm::clamp(com, bmin, bmax);
+				float dist2 = glm::dot(d, d);
+
+				if (m_nodeSize[node] * m_nodeSize[node] < theta2 * dist2)
+				{
+					lx.push_back(com.x);
+					ly.push_back(com.y);
+					lz.push_back(com.z);
+					lm.push_back(m_nodeMass[node]);
+				}
+				else if (m_nodeChildCount[node] == 0)
+				{
+					for (int i = m_nodeBegin[node]; i < m_nodeEnd[node]; i++)
+					{
+						lx.push_back(m_px[i]);
+						ly.push_back(m_py[i]);
+						lz.push_back(m_pz[i]);
+						lm.push_back(m_pm[i]);
+					}
+				}
+				else
+				{
+					int first = m_nodeFirstChild[node];
+					for (int c = first; c < first + m_nodeChildCount[node]; c++)
+					{
+						stack.push_back(c);
+					}
+				}
+			}
+
+			// flat loop over the interaction list, self interaction vanishes because d = 0
+			int count = (int)lm.size();
+			const float *x = lx.data();
+			const float *y = ly.data();
+			const float *z = lz.data();
+			const float *m = lm.data();
+			for (int i = b; i < e; i++)
+			{
+				float xi = m_px[i], yi = m_py[i], zi = m_pz[i];
+				float ax = 0.0f, ay = 0.0f, az = 0.0f;
+				for (int k = 0; k < count; k++)
+				{
+					float dx = x[k] - xi;
+					float dy = y[k] - yi;
+					float dz = z[k] - zi;
+					float r2 = dx * dx + dy * dy + dz * dz + eps2;
+					float inv = 1.0f / std::sqrt(r2);
+					float s = m[k] * inv * inv * inv;
+					ax += dx * s;
+					ay += dy * s;
+					az += dz * s;
+				}
+
+				force[m_order[i]] += m_G * m_pm[i] * glm::vec3(ax, ay, az);
+			}
+		}
+	}
+}
+
+void BarnesHut::applyForce(ParticleSystem &ps)
+{
+	if (ps.getCount() < 2)
+	{
+		return;
+	}
+
+	sortParticles(ps);
+	buildTree();
+	computeMoments();
+	computeForces(ps);
+}
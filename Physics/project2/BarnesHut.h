@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+
+/*
+** BARNES-HUT GRAVITY
+** Self gravitation of the particles in O(n log n). The octree is built each step
+** from the Morton sorted particles: the levels are split in parallel from the top,
+** then the masses and centres of mass are accumulated bottom-up, one level at a
+** time. Forces are evaluated per leaf: one interaction list is built for all the
+** particles of a leaf and then summed in a flat loop that the compiler vectorises.
+*/
+class BarnesHut : public ForceGenerator
+{
+public:
+	BarnesHut();
+	~BarnesHut();
+
+	/*
+	** GET METHODS
+	*/
+	float getTheta() const { return m_theta; }
+	float getG() const { return m_G; }
+	float getSoftening() const { return m_softening; }
+	int getNodeCount() const { return (int)m_nodeMass.size(); }
+
+	/*
+	** SET METHODS
+	*/
+	// opening angle: a node is approximated by its centre of mass when size / distance < theta
+	void setTheta(float theta) { m_theta = theta; }
+	// gravitational constant
+	void setG(float G) { m_G = G; }
+	// Plummer softening length, avoids the singularity when particles get close
+	void setSoftening(float eps) { m_softening = eps; }
+	// maximum number of particles in a leaf
+	void setLeafSize(int size) { m_leafSize = size; }
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	void sortParticles(const ParticleSystem &ps);
+	void buildTree();
+	void computeMoments();
+	void computeForces(ParticleSystem &ps);
+
+	float m_theta;
+	float m_G;
+	float m_softening;
+	int m_leafSize;
+
+	// bounding cube of the particles
+	glm::vec3 m_origin;
+	float m_size;
+
+	// particles in Morton order
+	std::vector<unsigned int> m_codes;
+	std::vector<int> m_order;
+	std::vector<float> m_px, m_py, m_pz, m_pm;
+
+	// octree nodes (structure of arrays), children of a node are contiguous
+	std::vector<int> m_nodeBegin, m_nodeEnd; // range of sorted particles
+	std::vector<int> m_nodeFirstChild, m_nodeChildCount;
+	std::vector<float> m_nodeMass, m_nodeX, m_nodeY, m_nodeZ;
+	std::vector<float> m_nodeSize; // edge length of the node cell
+	std::vector<int> m_levelStart; // first node of every level
+	std::vector<int> m_leaves;
+};
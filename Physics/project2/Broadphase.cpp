@@ -0,0 +1,16 @@
+#include "Broadphase.h"
+#include "DynamicTree.h"
+#include "SweepAndPrune.h"
+
+
+std::unique_ptr<Broadphase> createBroadphase(BroadphaseType type)
+{
+	switch (type)
+	{
+	case SWEEP_AND_PRUNE:
+		return std::unique_ptr<Broadphase>(new SweepAndPrune());
+	case DYNAMIC_TREE:
+	default:
+		return std::unique_ptr<Broadphase>(new DynamicTree());
+	}
+}
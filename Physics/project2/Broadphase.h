@@ -0,0 +1,54 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// candidate pair of bodies reported by the broadphase (bodyA < bodyB)
+struct BodyPair
+{
+	int bodyA;
+	int bodyB;
+
+	bool operator<(const BodyPair &p) const { return bodyA < p.bodyA || (bodyA == p.bodyA && bodyB < p.bodyB); }
+	bool operator==(const BodyPair &p) const { return bodyA == p.bodyA && bodyB == p.bodyB; }
+};
+
+// available broadphase implementations
+enum BroadphaseType
+{
+	DYNAMIC_TREE,
+	SWEEP_AND_PRUNE
+};
+
+/*
+** BROADPHASE INTERFACE
+** Common interface so that the broadphase used by a scene can be chosen at runtime.
+*/
+class Broadphase
+{
+public:
+	virtual ~Broadphase() {}
+
+	// name of the implementation, to label which broadphase a scene runs (e.g. in a window title)
+	virtual const char* getName() const = 0;
+	virtual int getProxyCount() const = 0;
+
+	// add a proxy for the body with the given handle, returns the proxy id
+	virtual int createProxy(const AABB &aabb, int bodyId) = 0;
+	// remove a proxy
+	virtual void destroyProxy(int proxyId) = 0;
+	// update the bounds of a proxy after its body moved by displacement
+	virtual bool moveProxy(int proxyId, const AABB &aabb, const glm::vec3 &displacement) = 0;
+	// bounds a proxy is tested with: the fat box of the tree, the box itself for SAP; pairs whose
+	// proxies stop overlapping are the ones to drop from a pair cache
+	virtual const AABB& getFatAABB(int proxyId) const = 0;
+	// collect the pairs that started overlapping since the last update (pairs of moved proxies
+	// may be reported again); the caller keeps the pairs in a pair cache until getFatAABB of
+	// their proxies stops overlapping
+	virtual void updatePairs(std::vector<BodyPair> &pairs) = 0;
+};
+
+// create a broadphase of the requested type
+std::unique_ptr<Broadphase> createBroadphase(BroadphaseType type);
@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+#include "ChainSolver.h"
+#include "Parallel.h"
+
+
+// orders chains by decreasing length, so the chains of a batch need little padding
+struct ChainLonger
+{
+	const std::vector<int> *start;
+
+	bool operator()(int a, int b) const { return (*start)[a + 1] - (*start)[a] > (*start)[b + 1] - (*start)[b]; }
+};
+
+
+ChainSolver::ChainSolver()
+{
+	m_compliance = 0.0f;
+	m_iterations = 20;
+	m_substeps = 4;
+	m_tolerance = 1e-3f;
+	m_maxStretch = 0.0f;
+	m_iterationCount = 0;
+	m_chainStart.push_back(0);
+	m_batchesValid = false;
+}
+
+
+ChainSolver::~ChainSolver()
+{
+}
+
+int ChainSolver::addChain(const std::vector<int> &particles, const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int count = (int)particles.size();
+	for (int k = 0; k < count; k++)
+	{
+		m_chainParticles.push_back(particles[k]);
+		m_chainRest.push_back(k + 1 < count ? glm::length(pos[particles[k + 1]] - pos[particles[k]]) : 0.0f);
+	}
+	m_chainStart.push_back((int)m_chainParticles.size());
+	m_batchesValid = false;
+	return getChainCount() - 1;
+}
+
+int ChainSolver::createChain(ParticleSystem &ps, const glm::vec3 &start, const glm::vec3 &end, int count, float mass)
+{
+	std::vector<int> particles(count);
+	for (int k = 0; k < count; k++)
+	{
+		float t = count > 1 ? (float)k / (count - 1) : 0.0f;
+		particles[k] = ps.addParticle(start + t * (end - start), glm::vec3(0.0f), mass / count);
+	}
+	return addChain(particles, ps);
+}
+
+void ChainSolver::buildBatches()
+{
+	int chains = getChainCount();
+	std::vector<int> order(chains);
+	for (int c = 0; c < chains; c++)
+	{
+		order[c] = c;
+	}
+	ChainLonger longer;
+	longer.start = &m_chainStart;
+	std::stable_sort(order.begin(), order.end(), longer);
+
+	int batches = (chains + 3) / 4;
+	m_nodeRow.resize(batches + 1);
+	m_linkRow.resize(batches + 1);
+	m_batchLinks.resize(batches);
+	m_laneLinks.assign(4 * batches, -1);
+	m_batchStretch.assign(batches, 0.0f);
+	m_batchIterations.assign(batches, 0);
+	m_nodeRow[0] = 0;
+	m_linkRow[0] = 0;
+	for (int b = 0; b < batches; b++)
+	{
+		// the first chain of a batch is its longest
+		int c = order[4 * b];
+		int links = std::max(m_chainStart[c + 1] - m_chainStart[c] - 1, 0);
+		m_batchLinks[b] = links;
+		m_nodeRow[b + 1] = m_nodeRow[b] + links + 1;
+		m_linkRow[b + 1] = m_linkRow[b] + links;
+	}
+
+	m_node.assign(4 * m_nodeRow[batches], 0);
+	m_nodeMask.assign(4 * m_nodeRow[batches], 0.0f);
+	m_rest.assign(4 * m_linkRow[batches], 0.0f);
+	m_linkMask.assign(4 * m_linkRow[batches], 0.0f);
+	m_lambda.assign(4 * m_linkRow[batches], 0.0f);
+
+	for (int b = 0; b < batches; b++)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			// an empty lane repeats a particle of the first chain, without mass
+			int c = 4 * b + lane < chains ? order[4 * b + lane] : -1;
+			int first = c >= 0 ? m_chainStart[c] : m_chainStart[order[4 * b]];
+			int nodes = c >= 0 ? m_chainStart[c + 1] - m_chainStart[c] : 0;
+			m_laneLinks[4 * b + lane] = nodes - 1;
+			for (int r = 0; r <= m_batchLinks[b]; r++)
+			{
+				int k = std::min(r, std::max(nodes - 1, 0));
+				m_node[4 * (m_nodeRow[b] + r) + lane] = m_chainParticles[first + k];
+				m_nodeMask[4 * (m_nodeRow[b] + r) + lane] = r < nodes ? 1.0f : 0.0f;
+			}
+			for (int r = 0; r < nodes - 1; r++)
+			{
+				m_rest[4 * (m_linkRow[b] + r) + lane] = m_chainRest[first + r];
+				m_linkMask[4 * (m_linkRow[b] + r) + lane] = 1.0f;
+			}
+		}
+	}
+
+	m_batchesValid = true;
+}
+
+// Newton iterations of (J W J^T + alpha~) dlambda = -C - alpha~ lambda, x += W J^T dlambda. With
+// n_k the direction of link k, the matrix has w_k + w_k+1 + alpha~ on the diagonal and
+// -w_k+1 n_k.n_k+1 beside it, and dx_j = w_j (n_j-1 dlambda_j-1 - n_j dlambda_j).
+void ChainSolver::solveBatch(int batch, float alpha, Scratch &s)
+{
+	int links = m_batchLinks[batch];
+	int nodeRow = m_nodeRow[batch];
+	int linkRow = m_linkRow[batch];
+	const int *node = &m_node[4 * nodeRow];
+	const float *rest = &m_rest[4 * linkRow];
+	const float *linkMask = &m_linkMask[4 * linkRow];
+	float *lambda = &m_lambda[4 * linkRow];
+
+	s.x.resize(4 * (links + 1)); s.y.resize(4 * (links + 1)); s.z.resize(4 * (links + 1)); s.w.resize(4 * (links + 1));
+	s.nx.resize(4 * links); s.ny.resize(4 * links); s.nz.resize(4 * links);
+	s.C.resize(4 * links); s.cp.resize(4 * links); s.dp.resize(4 * links);
+
+	// gather the predicted positions of the four chains
+	for (int r = 0; r <= links; r++)
+	{
+		const int *i = &node[4 * r];
+		const float *mask = &m_nodeMask[4 * (nodeRow + r)];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			const glm::vec3 &p = m_predicted[i[lane]];
+			s.x[4 * r + lane] = p.x;
+			s.y[4 * r + lane] = p.y;
+			s.z[4 * r + lane] = p.z;
+			s.w[4 * r + lane] = mask[lane] * m_w[i[lane]];
+		}
+	}
+
+	__m128 tiny = _mm_set1_ps(1e-12f);
+	__m128 alphav = _mm_set1_ps(alpha);
+	__m128 signMask = _mm_set1_ps(-0.0f);
+
+	int it = 0;
+	for (; it < m_iterations; it++)
+	{
+		// link directions and errors
+		__m128 stretch = _mm_setzero_ps();
+		for (int r = 0; r < links; r++)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(&s.x[4 * r + 4]), _mm_loadu_ps(&s.x[4 * r]));
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(&s.y[4 * r + 4]), _mm_loadu_ps(&s.y[4 * r]));
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(&s.z[4 * r + 4]), _mm_loadu_ps(&s.z[4 * r]));
+			__m128 length = _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), tiny));
+			__m128 inv = _mm_div_ps(_mm_loadu_ps(&linkMask[4 * r]), length);
+			_mm_storeu_ps(&s.nx[4 * r], _mm_mul_ps(dx, inv));
+			_mm_storeu_ps(&s.ny[4 * r], _mm_mul_ps(dy, inv));
+			_mm_storeu_ps(&s.nz[4 * r], _mm_mul_ps(dz, inv));
+			__m128 C = _mm_mul_ps(_mm_sub_ps(length, _mm_loadu_ps(&rest[4 * r])), _mm_loadu_ps(&linkMask[4 * r]));
+			_mm_storeu_ps(&s.C[4 * r], C);
+			stretch = _mm_max_ps(stretch, _mm_div_ps(_mm_andnot_ps(signMask, C), _mm_max_ps(_mm_loadu_ps(&rest[4 * r]), tiny)));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, stretch);
+		if (std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])) < m_tolerance)
+		{
+			break;
+		}
+
+		// forward elimination (Thomas)
+		__m128 prevOff = _mm_setzero_ps(), prevCp = _mm_setzero_ps(), prevDp = _mm_setzero_ps();
+		for (int r = 0; r < links; r++)
+		{
+			__m128 diag = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&s.w[4 * r]), _mm_loadu_ps(&s.w[4 * r + 4])), alphav);
+			__m128 off = _mm_setzero_ps();
+			if (r + 1 < links)
+			{
+				__m128 dot = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(&s.nx[4 * r]), _mm_loadu_ps(&s.nx[4 * r + 4])),
+					_mm_mul_ps(_mm_loadu_ps(&s.ny[4 * r]), _mm_loadu_ps(&s.ny[4 * r + 4]))),
+					_mm_mul_ps(_mm_loadu_ps(&s.nz[4 * r]), _mm_loadu_ps(&s.nz[4 * r + 4])));
+				off = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_loadu_ps(&s.w[4 * r + 4]), dot));
+			}
+			__m128 rhs = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&s.C[4 * r])), _mm_mul_ps(alphav, _mm_loadu_ps(&lambda[4 * r])));
+
+			__m128 pivot = _mm_max_ps(_mm_sub_ps(diag, _mm_mul_ps(prevOff, prevCp)), tiny);
+			__m128 cp = _mm_div_ps(off, pivot);
+			__m128 dp = _mm_div_ps(_mm_sub_ps(rhs, _mm_mul_ps(prevOff, prevDp)), pivot);
+			_mm_storeu_ps(&s.cp[4 * r], cp);
+			_mm_storeu_ps(&s.dp[4 * r], dp);
+			prevOff = off;
+			prevCp = cp;
+			prevDp = dp;
+		}
+
+		// back substitution, dlambda is left in dp
+		__m128 next = _mm_setzero_ps();
+		for (int r = links - 1; r >= 0; r--)
+		{
+			next = _mm_sub_ps(_mm_loadu_ps(&s.dp[4 * r]), _mm_mul_ps(_mm_loadu_ps(&s.cp[4 * r]), next));
+			_mm_storeu_ps(&s.dp[4 * r], next);
+			_mm_storeu_ps(&lambda[4 * r], _mm_add_ps(_mm_loadu_ps(&lambda[4 * r]), next));
+		}
+
+		// position corrections
+		for (int r = 0; r <= links; r++)
+		{
+			__m128 cx = _mm_setzero_ps(), cy = _mm_setzero_ps(), cz = _mm_setzero_ps();
+			if (r > 0)
+			{
+				__m128 d = _mm_loadu_ps(&s.dp[4 * r - 4]);
+				cx = _mm_mul_ps(_mm_loadu_ps(&s.nx[4 * r - 4]), d);
+				cy = _mm_mul_ps(_mm_loadu_ps(&s.ny[4 * r - 4]), d);
+				cz = _mm_mul_ps(_mm_loadu_ps(&s.nz[4 * r - 4]), d);
+			}
+			if (r < links)
+			{
+				__m128 d = _mm_loadu_ps(&s.dp[4 * r]);
+				cx = _mm_sub_ps(cx, _mm_mul_ps(_mm_loadu_ps(&s.nx[4 * r]), d));
+				cy = _mm_sub_ps(cy, _mm_mul_ps(_mm_loadu_ps(&s.ny[4 * r]), d));
+				cz = _mm_sub_ps(cz, _mm_mul_ps(_mm_loadu_ps(&s.nz[4 * r]), d));
+			}
+			__m128 w = _mm_loadu_ps(&s.w[4 * r]);
+			_mm_storeu_ps(&s.x[4 * r], _mm_add_ps(_mm_loadu_ps(&s.x[4 * r]), _mm_mul_ps(w, cx)));
+			_mm_storeu_ps(&s.y[4 * r], _mm_add_ps(_mm_loadu_ps(&s.y[4 * r]), _mm_mul_ps(w, cy)));
+			_mm_storeu_ps(&s.z[4 * r], _mm_add_ps(_mm_loadu_ps(&s.z[4 * r]), _mm_mul_ps(w, cz)));
+		}
+	}
+
+	// scatter the real nodes of every lane and measure the stretch left
+	float stretch = 0.0f;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		int laneLinks = m_laneLinks[4 * batch + lane];
+		for (int r = 0; r <= laneLinks; r++)
+		{
+			m_predicted[node[4 * r + lane]] = glm::vec3(s.x[4 * r + lane], s.y[4 * r + lane], s.z[4 * r + lane]);
+			if (r > 0)
+			{
+				float length = glm::length(m_predicted[node[4 * r + lane]] - m_predicted[node[4 * r - 4 + lane]]);
+				float restLength = rest[4 * r - 4 + lane];
+				stretch = std::max(stretch, std::fabs(length - restLength) / std::max(restLength, 1e-12f));
+			}
+		}
+	}
+	m_batchStretch[batch] = stretch;
+	m_batchIterations[batch] = it;
+}
+
+void ChainSolver::step(ParticleSystem &ps, float dt)
+{
+	int n = ps.getCount();
+	if (n == 0)
+	{
+		return;
+	}
+	if (!m_batchesValid)
+	{
+		buildBatches();
+	}
+
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &invMass = ps.getInvMass();
+	m_w.assign(invMass.begin(), invMass.end());
+	m_predicted.resize(n);
+
+	// the external forces are evaluated once per step
+	ps.clearForces();
+	ps.applyForces();
+
+	int batches = (int)m_batchLinks.size();
+	m_scratch.resize(getMaxThreads());
+	float h = dt / m_substeps;
+	float alpha = m_compliance / (h * h);
+
+	for (int s = 0; s < m_substeps; s++)
+	{
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			vel[i] += force[i] * invMass[i] * h;
+			m_predicted[i] = pos[i] + vel[i] * h;
+		}
+
+		std::fill(m_lambda.begin(), m_lambda.end(), 0.0f);
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int b = 0; b < batches; b++)
+		{
+			solveBatch(b, alpha, m_scratch[getThreadNum()]);
+		}
+
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			vel[i] = (m_predicted[i] - pos[i]) / h;
+			pos[i] = m_predicted[i];
+		}
+	}
+
+	m_maxStretch = 0.0f;
+	m_iterationCount = 0;
+	for (int b = 0; b < batches; b++)
+	{
+		m_maxStretch = std::max(m_maxStretch, m_batchStretch[b]);
+		m_iterationCount = std::max(m_iterationCount, m_batchIterations[b]);
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+
+/*
+** CHAIN SOLVER
+** Chains and ropes of distance constraints between consecutive particles, solved
+** directly instead of iteratively. The system J W J^T dlambda = -C of a chain is
+** tridiagonal (a link only shares a particle with its neighbours), so every Newton
+** iteration is one O(n) Thomas solve and the links keep their lengths however long
+** the chain is, where Gauss-Seidel would need more iterations the longer it gets.
+** A batch stops iterating once all its links are within the tolerance, which with
+** the default substeps usually takes one or two solves.
+** Independent chains are sorted by length and packed four to a batch, one chain per
+** SSE lane, so a batch runs the forward and back substitutions of four chains at
+** once; the batches are solved in parallel. Shorter chains of a batch are padded
+** with links that have no length and no mass, which decouple from the rest.
+** Chains must not share particles.
+*/
+class ChainSolver
+{
+public:
+	ChainSolver();
+	~ChainSolver();
+
+	/*
+	** GET METHODS
+	*/
+	int getChainCount() const { return (int)m_chainStart.size() - 1; }
+	int getLinkCount() const { return (int)m_chainParticles.size() - getChainCount(); }
+	int getIterations() const { return m_iterations; }
+	int getSubsteps() const { return m_substeps; }
+	// largest |length - rest length| / rest length after the last substep
+	float getMaxStretch() const { return m_maxStretch; }
+	// most Newton iterations a batch needed in the last substep
+	int getIterationCount() const { return m_iterationCount; }
+
+	/*
+	** SET METHODS
+	*/
+	// compliance = inverse stiffness (m/N) of every link, 0 is inextensible
+	void setCompliance(float compliance) { m_compliance = compliance; }
+	// most Newton iterations per step, each a direct solve; a batch stops early once the
+	// stretch of all its links is below the tolerance
+	void setIterations(int iterations) { m_iterations = iterations; }
+	void setTolerance(float tolerance) { m_tolerance = tolerance; }
+	// Newton converges in a couple of iterations while the particles move less than a link
+	// per substep; fast heavy chains of many short links need a few substeps
+	void setSubsteps(int substeps) { m_substeps = substeps; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// a chain through the given particles in order, the rest lengths are the current distances;
+	// returns its index
+	int addChain(const std::vector<int> &particles, const ParticleSystem &ps);
+	// add a chain of count particles of the given total mass from start to end to the system
+	int createChain(ParticleSystem &ps, const glm::vec3 &start, const glm::vec3 &end, int count, float mass);
+	// particle k of a chain
+	int getChainParticle(int chain, int k) const { return m_chainParticles[m_chainStart[chain] + k]; }
+
+	void step(ParticleSystem &ps, float dt);
+
+private:
+	// per thread working arrays of a batch, four lanes per row
+	struct Scratch
+	{
+		std::vector<float> x, y, z, w; // nodes
+		std::vector<float> nx, ny, nz, C, cp, dp; // links
+	};
+
+	void buildBatches();
+	void solveBatch(int batch, float alpha, Scratch &s);
+
+	float m_compliance;
+	int m_iterations;
+	int m_substeps;
+	float m_tolerance;
+	float m_maxStretch;
+	int m_iterationCount;
+
+	// chains as added
+	std::vector<int> m_chainParticles;
+	std::vector<float> m_chainRest; // rest length of the link to the next particle
+	std::vector<int> m_chainStart;
+	bool m_batchesValid;
+
+	// batches of four chains, row by row: nodes row r of batch b at 4 (m_nodeRow[b] + r) and
+	// links at 4 (m_linkRow[b] + r)
+	std::vector<int> m_nodeRow, m_linkRow, m_batchLinks;
+	std::vector<int> m_node;
+	std::vector<float> m_nodeMask; // 0 for padding
+	std::vector<float> m_rest;
+	std::vector<float> m_linkMask;
+	std::vector<float> m_lambda;
+	std::vector<int> m_laneLinks; // links of every lane, -1 for an empty lane
+	std::vector<float> m_batchStretch;
+	std::vector<int> m_batchIterations;
+
+	std::vector<glm::vec3> m_predicted;
+	std::vector<float> m_w; // inverse masses
+	std::vector<Scratch> m_scratch;
+};
@@ -0,0 +1,63 @@
+#include "ClosestPoint.h"
+
+
+glm::vec3 closestPointTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f);
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return glm::vec3(0.0f, 1.0f, 0.0f);
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		float v = d1 / (d1 - d3);
+		return glm::vec3(1.0f - v, v, 0.0f);
+	}
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return glm::vec3(0.0f, 0.0f, 1.0f);
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		float w = d2 / (d2 - d6);
+		return glm::vec3(1.0f - w, 0.0f, w);
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return glm::vec3(0.0f, 1.0f - w, w);
+	}
+
+	float denom = 1.0f / (va + vb + vc);
+	float v = vb * denom, w = vc * denom;
+	return glm::vec3(1.0f - v - w, v, w);
+}
+
+void closestSegmentSegment(const glm::vec3 &p1, const glm::vec3 &q1, const glm::vec3 &p2, const glm::vec3 &q2, float &s, float &t)
+{
+	glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+	float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+	float c = glm::dot(d1, r), b = glm::dot(d1, d2);
+	float denom = a * e - b * b;
+
+	s = denom > 1e-12f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+	t = e > 1e-12f ? (b * s + f) / e : 0.0f;
+	if (t < 0.0f)
+	{
+		t = 0.0f;
+		s = a > 1e-12f ? glm::clamp(-c / a, 0.0f, 1.0f) : 0.0f;
+	}
+	else if (t > 1.0f)
+	{
+		t = 1.0f;
+		s = a > 1e-12f ? glm::clamp((b - c) / a, 0.0f, 1.0f) : 0.0f;
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// Closest point queries of Ericson, Real-Time Collision Detection (2005).
+
+// barycentric weights of the point of triangle abc closest to p (5.1.5)
+glm::vec3 closestPointTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+
+// parameters s, t in [0, 1] of the closest points p1 + s (q1 - p1) and p2 + t (q2 - p2) of two segments (5.1.9)
+void closestSegmentSegment(const glm::vec3 &p1, const glm::vec3 &q1, const glm::vec3 &p2, const glm::vec3 &q2, float &s, float &t);
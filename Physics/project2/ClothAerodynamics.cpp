@@ -0,0 +1,259 @@
+#include <cmath>
+#include <xmmintrin.h>
+
+#include "ClothAerodynamics.h"
+
+
+ClothAerodynamics::ClothAerodynamics()
+{
+	m_density = 1.225f;
+	m_drag = 1.0f;
+	m_lift = 0.5f;
+
+	m_mode = CONSTANT_WIND;
+	m_wind = glm::vec3(0.0f);
+	m_amplitude = 0.0f;
+	m_frequency = 1.0f;
+	m_rate = 1.0f;
+	m_time = 0.0f;
+
+	m_gridOrigin = glm::vec3(0.0f);
+	m_gridCell = 1.0f;
+	m_gridDims = glm::ivec3(0);
+
+	m_first = 0;
+	m_count = 0;
+}
+
+
+ClothAerodynamics::~ClothAerodynamics()
+{
+}
+
+void ClothAerodynamics::setNoise(const glm::vec3 &wind, float amplitude, float frequency, float rate)
+{
+	m_wind = wind;
+	m_amplitude = amplitude;
+	m_frequency = frequency;
+	m_rate = rate;
+	m_mode = NOISE_WIND;
+}
+
+void ClothAerodynamics::setGrid(const glm::vec3 &origin, float cellSize, const glm::ivec3 &dims, const std::vector<glm::vec3> &velocities)
+{
+	m_gridOrigin = origin;
+	m_gridCell = cellSize;
+	m_gridDims = dims;
+	m_gridVelocity = velocities;
+	m_mode = GRID_WIND;
+}
+
+void ClothAerodynamics::bakeGrid(const SmokeGrid &smoke)
+{
+	glm::ivec3 dims = smoke.getDims();
+	float h = smoke.getCellSize();
+	std::vector<glm::vec3> velocities(dims.x * dims.y * dims.z);
+
+	#pragma omp parallel for
+	for (int k = 0; k < dims.z; k++)
+	{
+		for (int j = 0; j < dims.y; j++)
+		{
+			for (int i = 0; i < dims.x; i++)
+			{
+				glm::vec3 c = smoke.getOrigin() + h * glm::vec3(i + 0.5f, j + 0.5f, k + 0.5f);
+				velocities[(k * dims.y + j) * dims.x + i] = smoke.sampleVelocity(c);
+			}
+		}
+	}
+
+	setGrid(smoke.getOrigin() + glm::vec3(0.5f * h), h, dims, velocities);
+}
+
+void ClothAerodynamics::setMesh(const ClothMesh &mesh)
+{
+	m_first = mesh.getFirstVertex();
+	m_count = mesh.getVertexCount();
+
+	const std::vector<glm::ivec3> &triangles = mesh.getTriangles();
+	int m = (int)triangles.size();
+	int padded = (m + 3) & ~3;
+
+	m_a.resize(m);
+	m_b.resize(m);
+	m_c.resize(m);
+	for (int t = 0; t < m; t++)
+	{
+		m_a[t] = triangles[t].x;
+		m_b[t] = triangles[t].y;
+		m_c[t] = triangles[t].z;
+	}
+
+	// the padding triangles keep zero edges, so they get no force
+	m_e1x.assign(padded, 0.0f); m_e1y.assign(padded, 0.0f); m_e1z.assign(padded, 0.0f);
+	m_e2x.assign(padded, 0.0f); m_e2y.assign(padded, 0.0f); m_e2z.assign(padded, 0.0f);
+	m_vx.assign(padded, 0.0f); m_vy.assign(padded, 0.0f); m_vz.assign(padded, 0.0f);
+	m_fx.assign(padded, 0.0f); m_fy.assign(padded, 0.0f); m_fz.assign(padded, 0.0f);
+
+	// triangles of every vertex by counting sort
+	m_vertexStart.assign(m_count + 1, 0);
+	for (int t = 0; t < m; t++)
+	{
+		m_vertexStart[m_a[t] - m_first + 1]++;
+		m_vertexStart[m_b[t] - m_first + 1]++;
+		m_vertexStart[m_c[t] - m_first + 1]++;
+	}
+	for (int i = 0; i < m_count; i++)
+	{
+		m_vertexStart[i + 1] += m_vertexStart[i];
+	}
+
+	std::vector<int> fill(m_vertexStart.begin(), m_vertexStart.end() - 1);
+	m_vertexTriangle.resize(3 * m);
+	for (int t = 0; t < m; t++)
+	{
+		m_vertexTriangle[fill[m_a[t] - m_first]++] = t;
+		m_vertexTriangle[fill[m_b[t] - m_first]++] = t;
+		m_vertexTriangle[fill[m_c[t] - m_first]++] = t;
+	}
+}
+
+glm::vec3 ClothAerodynamics::noise(const glm::vec3 &p) const
+{
+	// value noise: one hash per lattice corner gives all three components in [-1, 1]
+	// (ten bits each), smoothstep interpolated
+	glm::vec3 f = glm::floor(p);
+	glm::ivec3 c(f);
+	glm::vec3 u = p - f;
+	u = u * u * (3.0f - 2.0f * u);
+
+	glm::vec3 corner[8];
+	for (int k = 0; k < 8; k++)
+	{
+		unsigned int h = (unsigned int)(c.x + (k & 1)) * 73856093u ^ (unsigned int)(c.y + ((k >> 1) & 1)) * 19349663u ^ (unsigned int)(c.z + (k >> 2)) * 83492791u;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		corner[k] = glm::vec3((float)(h & 1023), (float)((h >> 10) & 1023), (float)((h >> 20) & 1023)) / 511.5f - 1.0f;
+	}
+
+	glm::vec3 x00 = glm::mix(corner[0], corner[1], u.x);
+	glm::vec3 x10 = glm::mix(corner[2], corner[3], u.x);
+	glm::vec3 x01 = glm::mix(corner[4], corner[5], u.x);
+	glm::vec3 x11 = glm::mix(corner[6], corner[7], u.x);
+	return glm::mix(glm::mix(x00, x10, u.y), glm::mix(x01, x11, u.y), u.z);
+}
+
+glm::vec3 ClothAerodynamics::sampleWind(const glm::vec3 &p) const
+{
+	switch (m_mode)
+	{
+	case NOISE_WIND:
+	{
+		// the gusts are carried along by the mean wind and change as the field slides along its diagonal
+		glm::vec3 q = m_frequency * (p - m_time * m_wind) + glm::vec3(m_rate * m_time);
+		return m_wind + m_amplitude * noise(q);
+	}
+	case GRID_WIND:
+	{
+		if (m_gridVelocity.empty())
+		{
+			return glm::vec3(0.0f);
+		}
+		glm::vec3 g = glm::clamp((p - m_gridOrigin) / m_gridCell, glm::vec3(0.0f), glm::vec3(m_gridDims - 1));
+		glm::ivec3 i0 = glm::min(glm::ivec3(g), glm::max(m_gridDims - 2, glm::ivec3(0)));
+		glm::ivec3 i1 = glm::min(i0 + 1, m_gridDims - 1);
+		glm::vec3 u = g - glm::vec3(i0);
+
+		int nx = m_gridDims.x, ny = m_gridDims.y;
+		const glm::vec3 *v = m_gridVelocity.data();
+		glm::vec3 x00 = glm::mix(v[(i0.z * ny + i0.y) * nx + i0.x], v[(i0.z * ny + i0.y) * nx + i1.x], u.x);
+		glm::vec3 x10 = glm::mix(v[(i0.z * ny + i1.y) * nx + i0.x], v[(i0.z * ny + i1.y) * nx + i1.x], u.x);
+		glm::vec3 x01 = glm::mix(v[(i1.z * ny + i0.y) * nx + i0.x], v[(i1.z * ny + i0.y) * nx + i1.x], u.x);
+		glm::vec3 x11 = glm::mix(v[(i1.z * ny + i1.y) * nx + i0.x], v[(i1.z * ny + i1.y) * nx + i1.x], u.x);
+		return glm::mix(glm::mix(x00, x10, u.y), glm::mix(x01, x11, u.y), u.z);
+	}
+	default:
+		return m_wind;
+	}
+}
+
+void ClothAerodynamics::applyForce(ParticleSystem &ps)
+{
+	int m = (int)m_a.size();
+	if (m == 0)
+	{
+		return;
+	}
+	int padded = (int)m_fx.size();
+
+	const glm::vec3 *pos = ps.getPos().data();
+	const glm::vec3 *vel = ps.getVel().data();
+	std::vector<glm::vec3> &force = ps.getForce();
+
+	// gather: edges from the first vertex and the wind at the centroid relative to the triangle
+	#pragma omp parallel for
+	for (int t = 0; t < m; t++)
+	{
+		glm::vec3 pa = pos[m_a[t]], pb = pos[m_b[t]], pc = pos[m_c[t]];
+		glm::vec3 v = sampleWind((pa + pb + pc) / 3.0f) - (vel[m_a[t]] + vel[m_b[t]] + vel[m_c[t]]) / 3.0f;
+		m_e1x[t] = pb.x - pa.x; m_e1y[t] = pb.y - pa.y; m_e1z[t] = pb.z - pa.z;
+		m_e2x[t] = pc.x - pa.x; m_e2y[t] = pc.y - pa.y; m_e2z[t] = pc.z - pa.z;
+		m_vx[t] = v.x; m_vy[t] = v.y; m_vz[t] = v.z;
+	}
+
+	// forces four triangles at a time; with the cross product n = 2 A n^ and d = n.v,
+	// 1/2 rho A |v|^2 cos(theta) = rho |d| |v| / 4, so per vertex
+	// F / 3 = rho |d| |v| / 12 ((Cd - Cl |d| / (|n| |v|)) v / |v| + Cl sign(d) n / |n|)
+	int batches = padded / 4;
+	#pragma omp parallel for
+	for (int b = 0; b < batches; b++)
+	{
+		int t = 4 * b;
+		__m128 tiny = _mm_set1_ps(1e-12f);
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 scale = _mm_set1_ps(m_density / 12.0f);
+		__m128 cd = _mm_set1_ps(m_drag);
+		__m128 cl = _mm_set1_ps(m_lift);
+
+		__m128 e1x = _mm_loadu_ps(&m_e1x[t]), e1y = _mm_loadu_ps(&m_e1y[t]), e1z = _mm_loadu_ps(&m_e1z[t]);
+		__m128 e2x = _mm_loadu_ps(&m_e2x[t]), e2y = _mm_loadu_ps(&m_e2y[t]), e2z = _mm_loadu_ps(&m_e2z[t]);
+		__m128 vx = _mm_loadu_ps(&m_vx[t]), vy = _mm_loadu_ps(&m_vy[t]), vz = _mm_loadu_ps(&m_vz[t]);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+		__m128 nLength = _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)), tiny));
+		__m128 vLength = _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)), tiny));
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz));
+		__m128 absD = _mm_andnot_ps(signMask, d);
+		__m128 signD = _mm_or_ps(_mm_and_ps(signMask, d), one);
+
+		__m128 k = _mm_mul_ps(scale, _mm_mul_ps(absD, vLength));
+		__m128 cosTheta = _mm_div_ps(absD, _mm_mul_ps(nLength, vLength));
+		__m128 sv = _mm_div_ps(_mm_mul_ps(k, _mm_sub_ps(cd, _mm_mul_ps(cl, cosTheta))), vLength);
+		__m128 sn = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(k, cl), signD), nLength);
+
+		_mm_storeu_ps(&m_fx[t], _mm_add_ps(_mm_mul_ps(sv, vx), _mm_mul_ps(sn, nx)));
+		_mm_storeu_ps(&m_fy[t], _mm_add_ps(_mm_mul_ps(sv, vy), _mm_mul_ps(sn, ny)));
+		_mm_storeu_ps(&m_fz[t], _mm_add_ps(_mm_mul_ps(sv, vz), _mm_mul_ps(sn, nz)));
+	}
+
+	// every vertex sums its triangles, so no two threads write the same particle
+	const float *fx = m_fx.data();
+	const float *fy = m_fy.data();
+	const float *fz = m_fz.data();
+	#pragma omp parallel for
+	for (int i = 0; i < m_count; i++)
+	{
+		glm::vec3 f(0.0f);
+		for (int r = m_vertexStart[i]; r < m_vertexStart[i + 1]; r++)
+		{
+			int t = m_vertexTriangle[r];
+			f += glm::vec3(fx[t], fy[t], fz[t]);
+		}
+		force[m_first + i] += f;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+#include "SmokeGrid.h"
+
+/*
+** CLOTH AERODYNAMICS
+** Drag and lift on the triangles of a cloth from the wind relative to the triangle
+** velocity: with v the relative wind, n the unit normal turned along it and A the area,
+**   F = 1/2 rho A |v|^2 cos(theta) (Cd v^ + Cl (n - cos(theta) v^))
+** so drag follows the projected area and lift acts across the wind, largest at 45
+** degrees. The triangles are processed as structure of arrays: a gather pass
+** fills edge vectors and relative wind per triangle, an SSE pass evaluates the
+** force four triangles at a time, and every vertex sums a third of the forces of
+** its triangles through a precomputed vertex -> triangle table (no atomics).
+** The wind is a constant, a constant plus a gusting value noise field, or a grid
+** of velocities baked e.g. from a smoke simulation.
+*/
+class ClothAerodynamics : public ForceGenerator
+{
+public:
+	ClothAerodynamics();
+	~ClothAerodynamics();
+
+	enum WindMode { CONSTANT_WIND, NOISE_WIND, GRID_WIND };
+
+	/*
+	** GET METHODS
+	*/
+	WindMode getWindMode() const { return m_mode; }
+	const glm::vec3& getWind() const { return m_wind; }
+	int getTriangleCount() const { return (int)m_a.size(); }
+
+	/*
+	** SET METHODS
+	*/
+	// air density (kg/m^3) and the drag and lift coefficients of the cloth
+	void setDensity(float density) { m_density = density; }
+	void setDrag(float cd) { m_drag = cd; }
+	void setLift(float cl) { m_lift = cl; }
+	// mean wind, used by the constant and the noise modes
+	void setWind(const glm::vec3 &wind) { m_wind = wind; m_mode = CONSTANT_WIND; }
+	// gusts of the given amplitude (m/s) over features of about 1 / frequency metres, changing rate times a second
+	void setNoise(const glm::vec3 &wind, float amplitude, float frequency, float rate);
+	// wind sampled trilinearly from velocities at the nodes of a grid (x fastest), clamped at its border
+	void setGrid(const glm::vec3 &origin, float cellSize, const glm::ivec3 &dims, const std::vector<glm::vec3> &velocities);
+	// grid baked from the cell centres of a smoke simulation
+	void bakeGrid(const SmokeGrid &smoke);
+
+	/*
+	** OTHER METHODS
+	*/
+	void setMesh(const ClothMesh &mesh);
+
+	// move the noise field on in time
+	void advance(float dt) { m_time += dt; }
+
+	glm::vec3 sampleWind(const glm::vec3 &p) const;
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	glm::vec3 noise(const glm::vec3 &p) const;
+
+	float m_density;
+	float m_drag;
+	float m_lift;
+
+	WindMode m_mode;
+	glm::vec3 m_wind;
+	float m_amplitude, m_frequency, m_rate;
+	float m_time;
+
+	glm::vec3 m_gridOrigin;
+	float m_gridCell;
+	glm::ivec3 m_gridDims;
+	std::vector<glm::vec3> m_gridVelocity;
+
+	// triangles, padded to a multiple of four
+	int m_first, m_count;
+	std::vector<int> m_a, m_b, m_c;
+
+	// per triangle SoA: the two edges from the first vertex, the relative wind and the force per vertex
+	std::vector<float> m_e1x, m_e1y, m_e1z;
+	std::vector<float> m_e2x, m_e2y, m_e2z;
+	std::vector<float> m_vx, m_vy, m_vz;
+	std::vector<float> m_fx, m_fy, m_fz;
+
+	// triangles of every vertex (vertex i - first), CSR
+	std::vector<int> m_vertexStart;
+	std::vector<int> m_vertexTriangle;
+};
@@ -0,0 +1,695 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ClothCCD.h"
+#include "ClosestPoint.h"
+#include "RadixSort.h"
+#include "Parallel.h"
+
+
+// coefficients of the cubic f(t) = det(x1 - x0, x2 - x0, x3 - x0) of four points moving linearly from
+// start to end, which is zero when they are coplanar. Returns false when the Bernstein coefficients
+// of f on [0, 1] all have the same strict sign, as f then has no root in the step.
+static bool coplanarityCubic(const glm::vec3 start[4], const glm::vec3 end[4], double c[4])
+{
+	glm::dvec3 a(start[1] - start[0]), b(start[2] - start[0]), p(start[3] - start[0]);
+	glm::dvec3 da = glm::dvec3(end[1] - end[0]) - a;
+	glm::dvec3 db = glm::dvec3(end[2] - end[0]) - b;
+	glm::dvec3 dp = glm::dvec3(end[3] - end[0]) - p;
+
+	glm::dvec3 ab = glm::cross(a, b);
+	glm::dvec3 mixed = glm::cross(a, db) + glm::cross(da, b);
+	glm::dvec3 dadb = glm::cross(da, db);
+
+	c[0] = glm::dot(p, ab);
+	c[1] = glm::dot(dp, ab) + glm::dot(p, mixed);
+	c[2] = glm::dot(dp, mixed) + glm::dot(p, dadb);
+	c[3] = glm::dot(dp, dadb);
+
+	double b0 = c[0];
+	double b1 = c[0] + c[1] / 3.0;
+	double b2 = c[0] + (2.0 * c[1] + c[2]) / 3.0;
+	double b3 = c[0] + c[1] + c[2] + c[3];
+	bool positive = b0 > 0.0 && b1 > 0.0 && b2 > 0.0 && b3 > 0.0;
+	bool negative = b0 < 0.0 && b1 < 0.0 && b2 < 0.0 && b3 < 0.0;
+	return !positive && !negative;
+}
+
+
+// false when two moving spheres, whose radii are the larger of their start and end values, stay
+// more than a gap apart over the whole step. The distance of a point of a linearly moving feature
+// from its centre is convex in time, so the spheres bound the features during the step.
+static bool spheresMeet(const glm::vec3 &c0, const glm::vec3 &c1, float r, const glm::vec3 &d0, const glm::vec3 &d1, float s, float gap)
+{
+	glm::vec3 from = c0 - d0, motion = (c1 - d1) - from;
+	float t = glm::dot(motion, motion) > 0.0f ? glm::clamp(-glm::dot(from, motion) / glm::dot(motion, motion), 0.0f, 1.0f) : 0.0f;
+	return glm::length(from + t * motion) <= r + s + gap;
+}
+
+// centre (the centroid) and radius of a triangle or an edge
+static float boundingSphere(const glm::vec3 *x, int count, glm::vec3 &centre)
+{
+	centre = glm::vec3(0.0f);
+	for (int k = 0; k < count; k++)
+	{
+		centre += x[k];
+	}
+	centre /= (float)count;
+	float radius = 0.0f;
+	for (int k = 0; k < count; k++)
+	{
+		radius = std::max(radius, glm::length(x[k] - centre));
+	}
+	return radius;
+}
+
+
+ClothCCD::ClothCCD()
+{
+	m_thickness = 1e-3f;
+	m_maxPasses = 4;
+	m_trianglePairCount = 0;
+	m_featureCount = 0;
+	m_sphereSurvivorCount = 0;
+	m_filteredCount = 0;
+	m_collisionCount = 0;
+	m_passCount = 0;
+	m_frozenCount = 0;
+	m_first = 0;
+	m_count = 0;
+}
+
+
+ClothCCD::~ClothCCD()
+{
+}
+
+int ClothCCD::solveCubic(const double c[4], double roots[3])
+{
+	double scale = std::max(std::max(std::fabs(c[0]), std::fabs(c[1])), std::max(std::fabs(c[2]), std::fabs(c[3])));
+	if (scale == 0.0)
+	{
+		// coplanar over the whole step, the contact is at its start
+		roots[0] = 0.0;
+		return 1;
+	}
+	double c0 = c[0] / scale, c1 = c[1] / scale, c2 = c[2] / scale, c3 = c[3] / scale;
+	const double eps = 1e-12;
+
+	// the critical points split [0, 1] into intervals on which the cubic is monotonic
+	double split[4];
+	int splits = 0;
+	split[splits++] = 0.0;
+	double qa = 3.0 * c3, qb = 2.0 * c2, qc = c1;
+	double critical[2];
+	int criticals = 0;
+	if (std::fabs(qa) < eps)
+	{
+		if (std::fabs(qb) > eps)
+		{
+			critical[criticals++] = -qc / qb;
+		}
+	}
+	else
+	{
+		double disc = qb * qb - 4.0 * qa * qc;
+		if (disc >= 0.0)
+		{
+			// without cancellation (Numerical Recipes 5.6)
+			double q = -0.5 * (qb + (qb < 0.0 ? -std::sqrt(disc) : std::sqrt(disc)));
+			critical[criticals++] = q / qa;
+			if (q != 0.0)
+			{
+				critical[criticals++] = qc / q;
+			}
+		}
+	}
+	if (criticals == 2 && critical[0] > critical[1])
+	{
+		std::swap(critical[0], critical[1]);
+	}
+	for (int k = 0; k < criticals; k++)
+	{
+		if (critical[k] > 0.0 && critical[k] < 1.0)
+		{
+			split[splits++] = critical[k];
+		}
+	}
+	split[splits++] = 1.0;
+
+	int count = 0;
+	for (int k = 0; k + 1 < splits && count < 3; k++)
+	{
+		double lo = split[k], hi = split[k + 1];
+		double flo = ((c3 * lo + c2) * lo + c1) * lo + c0;
+		double fhi = ((c3 * hi + c2) * hi + c1) * hi + c0;
+
+		// a root at the start of the interval, which also catches grazing double roots at critical points
+		if (std::fabs(flo) <= eps)
+		{
+			if (count == 0 || lo - roots[count - 1] > 1e-9)
+			{
+				roots[count++] = lo;
+			}
+			continue;
+		}
+		if (flo * fhi > 0.0 || std::fabs(fhi) <= eps)
+		{
+			continue;
+		}
+
+		// Newton safeguarded by bisection inside the bracket
+		double t = 0.5 * (lo + hi);
+		for (int it = 0; it < 60 && hi - lo > 1e-12; it++)
+		{
+			double f = ((c3 * t + c2) * t + c1) * t + c0;
+			if (f == 0.0)
+			{
+				break;
+			}
+			if ((f < 0.0) == (flo < 0.0))
+			{
+				lo = t;
+			}
+			else
+			{
+				hi = t;
+			}
+			double df = (3.0 * c3 * t + 2.0 * c2) * t + c1;
+			double next = df != 0.0 ? t - f / df : lo;
+			t = next > lo && next < hi ? next : 0.5 * (lo + hi);
+		}
+		roots[count++] = t;
+	}
+
+	double f1 = c3 + c2 + c1 + c0;
+	if (count < 3 && std::fabs(f1) <= eps && (count == 0 || 1.0 - roots[count - 1] > 1e-9))
+	{
+		roots[count++] = 1.0;
+	}
+	return count;
+}
+
+void ClothCCD::setMesh(const ClothMesh &mesh, const ParticleSystem &ps)
+{
+	m_first = mesh.getFirstVertex();
+	m_count = mesh.getVertexCount();
+	m_triangles = mesh.getTriangles();
+	m_edges = mesh.getEdges();
+	m_triangleEdges = mesh.getTriangleEdges();
+	m_edgeOwner = mesh.getEdgeOwners();
+	m_vertexOwner = mesh.getVertexOwners();
+
+	// the topology of the tree follows the rest shape and never changes
+	m_tree.build(m_triangles, ps.getPos());
+	m_bounds.resize(m_triangles.size());
+}
+
+/*
+** CULLING STAGES
+*/
+
+void ClothCCD::refit(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int triangles = (int)m_triangles.size();
+
+	// leaves bound the triangles over the whole step
+	#pragma omp parallel for
+	for (int t = 0; t < triangles; t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		AABB box(startPos[tri.x], startPos[tri.x]);
+		box.extend(startPos[tri.y]);
+		box.extend(startPos[tri.z]);
+		box.extend(pos[tri.x]);
+		box.extend(pos[tri.y]);
+		box.extend(pos[tri.z]);
+		box.fatten(m_thickness);
+		m_bounds[t] = box;
+	}
+	m_tree.refit(m_bounds);
+}
+
+void ClothCCD::findTrianglePairs()
+{
+	int triangles = (int)m_triangles.size();
+
+	#pragma omp parallel
+	{
+		std::vector<glm::ivec2> &result = m_threadPairs[getThreadNum()];
+		std::vector<int> candidates, stack;
+
+		#pragma omp for schedule(dynamic, 64)
+		for (int t = 0; t < triangles; t++)
+		{
+			candidates.clear();
+			m_tree.query(m_tree.getBox(t), candidates, stack);
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				// every pair once, from its lower triangle
+				if (candidates[c] > t)
+				{
+					result.push_back(glm::ivec2(t, candidates[c]));
+				}
+			}
+		}
+	}
+}
+
+void ClothCCD::findFeatures(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int pairs = (int)m_trianglePairs.size();
+
+	// a triangle pair tests the vertices and edges owned by one triangle against the other, so
+	// every vertex-face and edge-edge feature comes from exactly one pair
+	#pragma omp parallel
+	{
+		std::vector<Feature> &result = m_threadFeatures[getThreadNum()];
+
+		#pragma omp for schedule(dynamic, 256)
+		for (int p = 0; p < pairs; p++)
+		{
+			int tu[2] = { m_trianglePairs[p].x, m_trianglePairs[p].y };
+
+			for (int side = 0; side < 2; side++)
+			{
+				int t = tu[side], u = tu[1 - side];
+				const glm::ivec3 &tri = m_triangles[t];
+				const AABB &box = m_tree.getBox(t);
+				for (int k = 0; k < 3; k++)
+				{
+					int v = m_triangles[u][k];
+					if (m_vertexOwner[v - m_first] != u || v == tri.x || v == tri.y || v == tri.z)
+					{
+						continue;
+					}
+					AABB path(startPos[v], startPos[v]);
+					path.extend(pos[v]);
+					if (box.overlaps(path))
+					{
+						Feature feature = { v, t, false };
+						result.push_back(feature);
+					}
+				}
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				int e = m_triangleEdges[tu[0]][k];
+				if (m_edgeOwner[e] != tu[0])
+				{
+					continue;
+				}
+				const glm::ivec2 &edge = m_edges[e];
+				AABB box(startPos[edge.x], startPos[edge.x]);
+				box.extend(startPos[edge.y]);
+				box.extend(pos[edge.x]);
+				box.extend(pos[edge.y]);
+				box.fatten(m_thickness);
+
+				for (int l = 0; l < 3; l++)
+				{
+					int f = m_triangleEdges[tu[1]][l];
+					const glm::ivec2 &other = m_edges[f];
+					if (m_edgeOwner[f] != tu[1] || other.x == edge.x || other.x == edge.y || other.y == edge.x || other.y == edge.y)
+					{
+						continue;
+					}
+					AABB path(startPos[other.x], startPos[other.x]);
+					path.extend(startPos[other.y]);
+					path.extend(pos[other.x]);
+					path.extend(pos[other.y]);
+					if (box.overlaps(path))
+					{
+						Feature feature = { e, f, true };
+						result.push_back(feature);
+					}
+				}
+			}
+		}
+	}
+}
+
+void ClothCCD::featureParticles(const Feature &feature, int v[4]) const
+{
+	if (feature.edgeEdge)
+	{
+		v[0] = m_edges[feature.a].x; v[1] = m_edges[feature.a].y;
+		v[2] = m_edges[feature.b].x; v[3] = m_edges[feature.b].y;
+	}
+	else
+	{
+		const glm::ivec3 &tri = m_triangles[feature.b];
+		v[0] = feature.a; v[1] = tri.x; v[2] = tri.y; v[3] = tri.z;
+	}
+}
+
+bool ClothCCD::contact(const Feature &feature, const int v[4], const glm::vec3 x0[4], const glm::vec3 x1[4], float t, Impact &impact) const
+{
+	glm::vec3 x[4];
+	for (int k = 0; k < 4; k++)
+	{
+		x[k] = glm::mix(x0[k], x1[k], t);
+		impact.v[k] = v[k];
+	}
+
+	glm::vec3 normal;
+	if (feature.edgeEdge)
+	{
+		float s, u;
+		closestSegmentSegment(x[0], x[1], x[2], x[3], s, u);
+		glm::vec3 d = glm::mix(x[0], x[1], s) - glm::mix(x[2], x[3], u);
+		if (glm::length(d) > m_thickness)
+		{
+			return false;
+		}
+		impact.w[0] = 1.0f - s; impact.w[1] = s; impact.w[2] = u - 1.0f; impact.w[3] = -u;
+		normal = glm::cross(x[1] - x[0], x[3] - x[2]);
+		if (glm::length(normal) < 1e-12f)
+		{
+			normal = d;
+		}
+	}
+	else
+	{
+		glm::vec3 w = closestPointTriangle(x[0], x[1], x[2], x[3]);
+		glm::vec3 q = w.x * x[1] + w.y * x[2] + w.z * x[3];
+		if (glm::length(x[0] - q) > m_thickness)
+		{
+			return false;
+		}
+		impact.w[0] = 1.0f; impact.w[1] = -w.x; impact.w[2] = -w.y; impact.w[3] = -w.z;
+		normal = glm::cross(x[2] - x[1], x[3] - x[1]);
+	}
+
+	float length = glm::length(normal);
+	if (length < 1e-12f)
+	{
+		return false;
+	}
+	normal /= length;
+
+	// towards the side the pair started on, or against the approach when it started in contact
+	glm::vec3 start(0.0f), motion(0.0f);
+	for (int k = 0; k < 4; k++)
+	{
+		start += impact.w[k] * x0[k];
+		motion += impact.w[k] * (x1[k] - x0[k]);
+	}
+	float side = glm::dot(start, normal);
+	if (side < 0.0f || (side == 0.0f && glm::dot(motion, normal) > 0.0f))
+	{
+		normal = -normal;
+	}
+	impact.n = normal;
+
+	// pairs that separate are no collision
+	return glm::dot(motion, normal) < 0.0f;
+}
+
+void ClothCCD::findImpacts(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int features = (int)m_features.size();
+	int sphereSurvivors = 0, filtered = 0;
+
+	#pragma omp parallel reduction(+:sphereSurvivors, filtered)
+	{
+		std::vector<Impact> &result = m_threadImpacts[getThreadNum()];
+
+		#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < features; i++)
+		{
+			const Feature &feature = m_features[i];
+			int v[4];
+			featureParticles(feature, v);
+			glm::vec3 x0[4], x1[4];
+			for (int k = 0; k < 4; k++)
+			{
+				x0[k] = startPos[v[k]];
+				x1[k] = pos[v[k]];
+			}
+
+			// features whose bounding spheres stay apart, mostly neighbours in the same layer of cloth
+			glm::vec3 a0, a1, b0, b1;
+			int first = feature.edgeEdge ? 2 : 1;
+			float ra = std::max(boundingSphere(x0, first, a0), boundingSphere(x1, first, a1));
+			float rb = std::max(boundingSphere(x0 + first, 4 - first, b0), boundingSphere(x1 + first, 4 - first, b1));
+			if (!spheresMeet(a0, a1, ra, b0, b1, rb, m_thickness))
+			{
+				continue;
+			}
+			sphereSurvivors++;
+
+			double c[4];
+			if (!coplanarityCubic(x0, x1, c))
+			{
+				continue;
+			}
+			filtered++;
+
+			// the first coplanar time at which the pair really touches
+			double roots[3];
+			int count = solveCubic(c, roots);
+			Impact impact;
+			for (int r = 0; r < count; r++)
+			{
+				if (contact(feature, v, x0, x1, (float)roots[r], impact))
+				{
+					result.push_back(impact);
+					break;
+				}
+			}
+		}
+	}
+
+	m_sphereSurvivorCount += sphereSurvivors;
+	m_filteredCount += filtered;
+}
+
+
+/*
+** RESPONSE
+*/
+
+void ClothCCD::respond(ParticleSystem &ps, float dt)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &invMass = ps.getInvMass();
+	int m = (int)m_impacts.size();
+	int n = ps.getCount();
+
+	// inelastic impulse: the pair ends the step the thickness apart along the normal instead of
+	// passing through, so it does not collide again at rest
+	m_dx.resize(4 * m);
+	m_entryParticle.resize(4 * m);
+	m_entry.resize(4 * m);
+
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		const Impact &impact = m_impacts[c];
+		glm::vec3 end(0.0f);
+		float denom = 0.0f;
+		for (int k = 0; k < 4; k++)
+		{
+			end += impact.w[k] * pos[impact.v[k]];
+			denom += impact.w[k] * impact.w[k] * invMass[impact.v[k]];
+		}
+
+		float depth = m_thickness - glm::dot(end, impact.n);
+		float impulse = denom > 0.0f && depth > 0.0f ? depth / denom : 0.0f;
+
+		for (int k = 0; k < 4; k++)
+		{
+			m_dx[4 * c + k] = impact.w[k] * invMass[impact.v[k]] * impulse * impact.n;
+			m_entryParticle[4 * c + k] = (unsigned int)impact.v[k];
+			m_entry[4 * c + k] = 4 * c + k;
+		}
+	}
+
+	// corrections sorted by particle, which keep the largest one, so no atomics are needed
+	int keyBits = 1;
+	while ((1 << keyBits) < n)
+	{
+		keyBits++;
+	}
+	radixSort(m_entryParticle, m_entry, keyBits);
+
+	int entries = 4 * m;
+	m_entryStart.assign(n + 1, entries);
+	#pragma omp parallel for
+	for (int e = 0; e < entries; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_entryParticle[e - 1] + 1;
+		for (int p = first; p <= (int)m_entryParticle[e]; p++)
+		{
+			m_entryStart[p] = e;
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		int begin = m_entryStart[i], end = m_entryStart[i + 1];
+		if (begin == end)
+		{
+			continue;
+		}
+		// averaging would dilute a full correction with the partial ones of the edge impacts
+		glm::vec3 dx = m_dx[m_entry[begin]];
+		for (int e = begin + 1; e < end; e++)
+		{
+			if (glm::dot(m_dx[m_entry[e]], m_dx[m_entry[e]]) > glm::dot(dx, dx))
+			{
+				dx = m_dx[m_entry[e]];
+			}
+		}
+		pos[i] += dx;
+		vel[i] += dx / dt;
+	}
+}
+
+void ClothCCD::detect(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos, bool search)
+{
+	int threads = (int)m_threadImpacts.size();
+	m_passCount++;
+
+	for (int t = 0; t < threads; t++)
+	{
+		m_threadPairs[t].clear();
+		m_threadFeatures[t].clear();
+		m_threadImpacts[t].clear();
+	}
+
+	if (search)
+	{
+		refit(ps, startPos);
+		findTrianglePairs();
+		m_trianglePairs.clear();
+		for (int t = 0; t < threads; t++)
+		{
+			m_trianglePairs.insert(m_trianglePairs.end(), m_threadPairs[t].begin(), m_threadPairs[t].end());
+		}
+		m_trianglePairCount += (int)m_trianglePairs.size();
+
+		findFeatures(ps, startPos);
+		m_features.clear();
+		for (int t = 0; t < threads; t++)
+		{
+			m_features.insert(m_features.end(), m_threadFeatures[t].begin(), m_threadFeatures[t].end());
+		}
+	}
+	m_featureCount += (int)m_features.size();
+
+	findImpacts(ps, startPos);
+	m_impacts.clear();
+	for (int t = 0; t < threads; t++)
+	{
+		m_impacts.insert(m_impacts.end(), m_threadImpacts[t].begin(), m_threadImpacts[t].end());
+	}
+	m_collisionCount += (int)m_impacts.size();
+}
+
+int ClothCCD::freeze(ParticleSystem &ps, const std::vector<glm::vec3> &startPos)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &invMass = ps.getInvMass();
+
+	// few particles get here, and they are shared between impacts
+	int frozen = 0;
+	for (size_t c = 0; c < m_impacts.size(); c++)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			int i = m_impacts[c].v[k];
+			if (invMass[i] > 0.0f && pos[i] != startPos[i])
+			{
+				pos[i] = startPos[i];
+				vel[i] = glm::vec3(0.0f);
+				frozen++;
+			}
+		}
+	}
+	m_frozenCount += frozen;
+	return frozen;
+}
+
+void ClothCCD::resolve(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt, bool search)
+{
+	int threads = getMaxThreads();
+	m_threadPairs.resize(threads);
+	m_threadFeatures.resize(threads);
+	m_threadImpacts.resize(threads);
+
+	// impulses until the step is free of collisions; if they have not managed that in the given
+	// passes, the particles still colliding keep their start positions (which were collision free)
+	for (int pass = 0; ; pass++)
+	{
+		detect(ps, startPos, search);
+		if (m_impacts.empty())
+		{
+			break;
+		}
+		if (pass < m_maxPasses)
+		{
+			respond(ps, dt);
+		}
+		else if (freeze(ps, startPos) == 0)
+		{
+			break;
+		}
+	}
+}
+
+void ClothCCD::apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt)
+{
+	m_trianglePairCount = 0;
+	m_featureCount = 0;
+	m_sphereSurvivorCount = 0;
+	m_filteredCount = 0;
+	m_collisionCount = 0;
+	m_passCount = 0;
+	m_frozenCount = 0;
+	if (m_tree.isEmpty())
+	{
+		return;
+	}
+
+	resolve(ps, startPos, dt, true);
+}
+
+void ClothCCD::apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt,
+	const std::vector<glm::ivec2> &vertexTriangles, const std::vector<glm::ivec2> &edgeEdges)
+{
+	m_trianglePairCount = 0;
+	m_featureCount = 0;
+	m_sphereSurvivorCount = 0;
+	m_filteredCount = 0;
+	m_collisionCount = 0;
+	m_passCount = 0;
+	m_frozenCount = 0;
+	if (m_triangles.empty())
+	{
+		return;
+	}
+
+	// the candidates stand in for the features of the BVH stages, in every pass
+	m_features.clear();
+	for (size_t c = 0; c < vertexTriangles.size(); c++)
+	{
+		Feature feature = { vertexTriangles[c].x, vertexTriangles[c].y, false };
+		m_features.push_back(feature);
+	}
+	for (size_t c = 0; c < edgeEdges.size(); c++)
+	{
+		Feature feature = { edgeEdges[c].x, edgeEdges[c].y, true };
+		m_features.push_back(feature);
+	}
+
+	resolve(ps, startPos, dt, false);
+}
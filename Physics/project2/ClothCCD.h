@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "TriangleTree.h"
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+
+/*
+** CLOTH CCD
+** Continuous collision detection for cloth: vertex-face and edge-edge pairs are
+** tested for contact over the whole step, with the vertices moving linearly from
+** their start to their end positions (Provot 1997, Bridson et al. 2002).
+** A BVH over the triangles is built once from the mesh and only refitted to the
+** swept triangle bounds every step. Candidates are culled in stages, each run in
+** parallel over the survivors of the previous one:
+**   1. triangle pairs with overlapping swept bounds (BVH)
+**   2. vertex-face / edge-edge features with overlapping swept bounds
+**   3. features whose moving bounding spheres meet
+**   4. features whose coplanarity cubic can have a root in the step (Bernstein sign test)
+**   5. features whose cubic root is a real contact (robust cubic solve + distance test)
+** Contacts get an inelastic impulse and detection repeats, since the response can
+** cause new collisions; when the impulses do not converge in a few passes, the
+** particles still colliding are stopped at their start positions as a fail-safe.
+** Fixed particles (the trampoline frame) simply take no part of the impulse.
+*/
+class ClothCCD
+{
+public:
+	ClothCCD();
+	~ClothCCD();
+
+	/*
+	** GET METHODS
+	*/
+	// survivors of every culling stage, summed over the passes of the last call
+	int getTrianglePairCount() const { return m_trianglePairCount; }
+	int getFeatureCount() const { return m_featureCount; }
+	int getSphereSurvivorCount() const { return m_sphereSurvivorCount; }
+	int getFilteredCount() const { return m_filteredCount; }
+	int getCollisionCount() const { return m_collisionCount; }
+	// detection passes the last call needed, and the particles it had to stop at their start positions
+	int getPassCount() const { return m_passCount; }
+	int getFrozenCount() const { return m_frozenCount; }
+
+	/*
+	** SET METHODS
+	*/
+	// distance at which a root of the cubic counts as a contact
+	void setThickness(float thickness) { m_thickness = thickness; }
+	// impulse passes per step before colliding particles are stopped
+	void setMaxPasses(int passes) { m_maxPasses = passes; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// build the BVH over the mesh triangles at the current positions
+	void setMesh(const ClothMesh &mesh, const ParticleSystem &ps);
+
+	// resolve the collisions of a step of length dt that moved the particles from startPos to
+	// their current positions; the end positions and velocities are corrected
+	void apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt);
+	// the same for the given candidates only, (vertex, triangle) pairs and pairs of mesh edges
+	// (e.g. those of ClothSelfCollision), which skips the BVH stages
+	void apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt,
+		const std::vector<glm::ivec2> &vertexTriangles, const std::vector<glm::ivec2> &edgeEdges);
+
+	// robust roots of c0 + c1 t + c2 t^2 + c3 t^3 in [0, 1], ascending; returns their number
+	static int solveCubic(const double c[4], double roots[3]);
+
+private:
+	struct Feature
+	{
+		int a, b; // vertex and triangle, or two edges
+		bool edgeEdge;
+	};
+
+	struct Impact
+	{
+		int v[4];
+		float w[4]; // relative position = sum_k w_k x_k
+		glm::vec3 n; // points to the side the pair started on
+	};
+
+	void refit(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos);
+	void findTrianglePairs();
+	void findFeatures(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos);
+	void findImpacts(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos);
+	// the four particles of a feature: vertex and triangle, or the two edges
+	void featureParticles(const Feature &feature, int v[4]) const;
+	// is the feature in contact at time t of the step?
+	bool contact(const Feature &feature, const int v[4], const glm::vec3 x0[4], const glm::vec3 x1[4], float t, Impact &impact) const;
+	// all stages, or with search false only those after the features; fills m_impacts
+	void detect(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos, bool search);
+	void respond(ParticleSystem &ps, float dt);
+	// returns the number of particles stopped
+	int freeze(ParticleSystem &ps, const std::vector<glm::vec3> &startPos);
+	// the passes of impulses and the fail-safe
+	void resolve(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt, bool search);
+
+	float m_thickness;
+	int m_maxPasses;
+	int m_trianglePairCount;
+	int m_featureCount;
+	int m_sphereSurvivorCount;
+	int m_filteredCount;
+	int m_collisionCount;
+	int m_passCount;
+	int m_frozenCount;
+
+	// mesh
+	int m_first, m_count;
+	std::vector<glm::ivec3> m_triangles;
+	std::vector<glm::ivec2> m_edges;
+	std::vector<glm::ivec3> m_triangleEdges;
+	std::vector<int> m_edgeOwner;
+	std::vector<int> m_vertexOwner;
+
+	TriangleTree m_tree;
+	std::vector<AABB> m_bounds; // swept triangle bounds
+
+	// candidates of the stages, per thread and merged
+	std::vector<std::vector<glm::ivec2> > m_threadPairs;
+	std::vector<glm::ivec2> m_trianglePairs;
+	std::vector<std::vector<Feature> > m_threadFeatures;
+	std::vector<Feature> m_features;
+	std::vector<std::vector<Impact> > m_threadImpacts;
+	std::vector<Impact> m_impacts;
+
+	// position change of every impact corner, gathered per particle
+	std::vector<glm::vec3> m_dx;
+	std::vector<unsigned int> m_entryParticle;
+	std::vector<int> m_entry;
+	std::vector<int> m_entryStart;
+};
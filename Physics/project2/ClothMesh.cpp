@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <iostream>
+
+#include "ClothMesh.h"
+
+
+ClothMesh::ClothMesh()
+{
+	m_first = 0;
+	m_count = 0;
+	m_rows = 0;
+	m_columns = 0;
+}
+
+
+ClothMesh::~ClothMesh()
+{
+}
+
+bool ClothMesh::createGrid(ParticleSystem &ps, const glm::vec3 &corner, const glm::vec3 &u, const glm::vec3 &v,
+	int rows, int columns, float areaDensity)
+{
+	if (rows < 2 || columns < 2)
+	{
+		std::cerr << "Cloth grid needs at least 2 x 2 vertices: " << rows << " x " << columns << std::endl;
+		return false;
+	}
+
+	m_first = ps.getCount();
+	m_count = rows * columns;
+	m_rows = rows;
+	m_columns = columns;
+
+	// lumped masses: a third of every triangle's area to each of its corners
+	float triangleArea = 0.5f * glm::length(glm::cross(u, v)) / ((rows - 1) * (columns - 1));
+	std::vector<float> mass(m_count, 0.0f);
+
+	m_triangles.clear();
+	for (int r = 0; r < rows - 1; r++)
+	{
+		for (int c = 0; c < columns - 1; c++)
+		{
+			int i00 = r * columns + c, i01 = i00 + 1;
+			int i10 = i00 + columns, i11 = i10 + 1;
+
+			// alternate the diagonals so the cloth has no preferred shear direction
+			if ((r + c) & 1)
+			{
+				m_triangles.push_back(glm::ivec3(i00, i10, i11) + m_first);
+				m_triangles.push_back(glm::ivec3(i00, i11, i01) + m_first);
+			}
+			else
+			{
+				m_triangles.push_back(glm::ivec3(i00, i10, i01) + m_first);
+				m_triangles.push_back(glm::ivec3(i01, i10, i11) + m_first);
+			}
+		}
+	}
+	for (size_t t = 0; t < m_triangles.size(); t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			mass[m_triangles[t][k] - m_first] += areaDensity * triangleArea / 3.0f;
+		}
+	}
+
+	ps.reserve(m_first + m_count);
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < columns; c++)
+		{
+			glm::vec3 p = corner + u * ((float)c / (columns - 1)) + v * ((float)r / (rows - 1));
+			ps.addParticle(p, glm::vec3(0.0f), mass[r * columns + c]);
+		}
+	}
+
+	buildEdges();
+	return true;
+}
+
+void ClothMesh::setTriangles(int first, int count, const std::vector<glm::ivec3> &triangles)
+{
+	m_first = first;
+	m_count = count;
+	m_rows = 0;
+	m_columns = 0;
+	m_triangles = triangles;
+
+	buildEdges();
+}
+
+// order half edges by their (sorted) end points
+static bool halfEdgeLess(const glm::ivec3 &a, const glm::ivec3 &b)
+{
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+static bool edgeLess(const glm::ivec2 &a, const glm::ivec2 &b)
+{
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+void ClothMesh::buildEdges()
+{
+	// every half edge with its opposite vertex, sorted so the two halves of an edge are adjacent
+	std::vector<glm::ivec3> halfEdges;
+	halfEdges.reserve(3 * m_triangles.size());
+	for (size_t t = 0; t < m_triangles.size(); t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		for (int k = 0; k < 3; k++)
+		{
+			int a = tri[k], b = tri[(k + 1) % 3], o = tri[(k + 2) % 3];
+			halfEdges.push_back(glm::ivec3(std::min(a, b), std::max(a, b), o));
+		}
+	}
+	std::sort(halfEdges.begin(), halfEdges.end(), halfEdgeLess);
+
+	m_edges.clear();
+	m_bendEdges.clear();
+	for (size_t i = 0; i < halfEdges.size(); i++)
+	{
+		const glm::ivec3 &e = halfEdges[i];
+		if (i > 0 && halfEdges[i - 1].x == e.x && halfEdges[i - 1].y == e.y)
+		{
+			m_bendEdges.push_back(glm::ivec4(e.x, e.y, halfEdges[i - 1].z, e.z));
+			continue;
+		}
+		m_edges.push_back(glm::ivec2(e.x, e.y));
+	}
+
+	// edges of every triangle by binary search in the sorted edges; every vertex and edge is
+	// owned by the first triangle containing it
+	m_triangleEdges.resize(m_triangles.size());
+	m_edgeOwners.assign(m_edges.size(), -1);
+	m_vertexOwners.assign(m_count, -1);
+	for (int t = 0; t < (int)m_triangles.size(); t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		for (int k = 0; k < 3; k++)
+		{
+			int a = tri[k], b = tri[(k + 1) % 3];
+			glm::ivec2 key(std::min(a, b), std::max(a, b));
+			int e = (int)(std::lower_bound(m_edges.begin(), m_edges.end(), key, edgeLess) - m_edges.begin());
+			m_triangleEdges[t][k] = e;
+			if (m_edgeOwners[e] == -1)
+			{
+				m_edgeOwners[e] = t;
+			}
+			if (m_vertexOwners[a - m_first] == -1)
+			{
+				m_vertexOwners[a - m_first] = t;
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+
+/*
+** CLOTH MESH
+** Triangle mesh topology of a piece of cloth whose vertices are particles of a
+** particle system (the indices are particle indices). Besides the triangles it
+** keeps the unique edges and, for every inner edge, the two vertices opposite to
+** it, which the cloth solvers use for stretch and bending.
+*/
+class ClothMesh
+{
+public:
+	ClothMesh();
+	~ClothMesh();
+
+	/*
+	** GET METHODS
+	*/
+	int getFirstVertex() const { return m_first; }
+	int getVertexCount() const { return m_count; }
+	const std::vector<glm::ivec3>& getTriangles() const { return m_triangles; }
+	const std::vector<glm::ivec2>& getEdges() const { return m_edges; }
+	// inner edges (x, y) with their opposite vertices (z, w)
+	const std::vector<glm::ivec4>& getBendEdges() const { return m_bendEdges; }
+	// edges of every triangle, opposite to its vertices z, x and y
+	const std::vector<glm::ivec3>& getTriangleEdges() const { return m_triangleEdges; }
+	// first triangle containing every edge and every vertex (vertex i - first), so that
+	// triangle pair tests can visit each vertex and edge once
+	const std::vector<int>& getEdgeOwners() const { return m_edgeOwners; }
+	const std::vector<int>& getVertexOwners() const { return m_vertexOwners; }
+	// particle at row r and column c of a grid made by createGrid
+	int getGridVertex(int r, int c) const { return m_first + r * m_columns + c; }
+	int getRows() const { return m_rows; }
+	int getColumns() const { return m_columns; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a rectangular cloth of rows x columns vertices spanning corner + [0, 1] u + [0, 1] v to the
+	// system, the vertex masses come from the area density (kg per square metre); returns false
+	// and adds nothing for a grid smaller than 2 x 2
+	bool createGrid(ParticleSystem &ps, const glm::vec3 &corner, const glm::vec3 &u, const glm::vec3 &v,
+		int rows, int columns, float areaDensity);
+
+	// use an arbitrary triangle mesh over the particles [first, first + count) of the system
+	void setTriangles(int first, int count, const std::vector<glm::ivec3> &triangles);
+
+private:
+	// unique edges and bending edges from the triangles
+	void buildEdges();
+
+	int m_first;
+	int m_count;
+	int m_rows;
+	int m_columns;
+
+	std::vector<glm::ivec3> m_triangles;
+	std::vector<glm::ivec2> m_edges;
+	std::vector<glm::ivec4> m_bendEdges;
+	std::vector<glm::ivec3> m_triangleEdges;
+	std::vector<int> m_edgeOwners;
+	std::vector<int> m_vertexOwners;
+};
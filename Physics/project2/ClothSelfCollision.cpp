@@ -0,0 +1,883 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "ClothSelfCollision.h"
+#include "ClosestPoint.h"
+#include "RadixSort.h"
+#include "Parallel.h"
+
+
+// beyond this fraction of the vertices moved more than the skin, a new search is cheaper than
+// finding their pairs again
+static const float MAX_MOVED_FRACTION = 0.25f;
+
+ClothSelfCollision::ClothSelfCollision()
+{
+	m_thickness = 0.01f;
+	m_skin = 0.01f;
+	m_iterations = 4;
+	m_continuous = false;
+	m_searchDistance = 0.0f;
+	m_vertexTriangles = 0;
+	m_edgeEdges = 0;
+	m_searches = 0;
+	m_searchAge = 0;
+	m_movedCount = 0;
+	m_first = 0;
+	m_count = 0;
+}
+
+
+ClothSelfCollision::~ClothSelfCollision()
+{
+}
+
+void ClothSelfCollision::setMesh(const ClothMesh &mesh, const ParticleSystem &ps)
+{
+	m_first = mesh.getFirstVertex();
+	m_count = mesh.getVertexCount();
+	m_triangles = mesh.getTriangles();
+	m_edges = mesh.getEdges();
+	m_searchPos.clear();
+	m_searches = 0;
+	m_ccd.setThickness(m_thickness);
+	m_ccd.setMesh(mesh, ps);
+}
+
+
+/*
+** DETECTION
+*/
+
+// cells of the motion grid, hashed like those of SpatialHash
+static unsigned int hashCell(const glm::ivec3 &c, unsigned int mask)
+{
+	return ((unsigned int)c.x + (unsigned int)c.y * 19349663u + (unsigned int)c.z * 83492791u) & mask;
+}
+
+// the distance of two points of a pair changes by at most the difference of the motions of its
+// vertices, and the vertices of a pair closer than the thickness are in neighbouring cells of a
+// grid as wide as two edges and the thickness, plus the motion of the step when it is swept. The
+// motion of every vertex is compared with the box of the motions in the cells around it, at the
+// end of the step and, separately, at its start; buckets shared by several cells only make the
+// boxes larger. A vertex within half the skin of the mean motion of its bucket is compared only with
+// the others that are, so the few that moved on their own (e.g. pushed by a collision) don't make
+// all those around them count as moved; their own pairs are found again.
+float ClothSelfCollision::relativeMotion(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos, float skin)
+{
+	if ((int)m_searchPos.size() != m_count)
+	{
+		return FLT_MAX;
+	}
+
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int edges = (int)m_edges.size();
+	int threads = getMaxThreads();
+
+	m_threadMaximum.assign(2 * threads, 0.0f);
+	#pragma omp parallel
+	{
+		float *maximum = &m_threadMaximum[2 * getThreadNum()];
+
+		#pragma omp for
+		for (int e = 0; e < edges; e++)
+		{
+			const glm::ivec2 &edge = m_edges[e];
+			glm::vec3 d = pos[edge.y] - pos[edge.x];
+			maximum[0] = glm::max(maximum[0], glm::dot(d, d));
+			if (startPos)
+			{
+				d = (*startPos)[edge.y] - (*startPos)[edge.x];
+				maximum[0] = glm::max(maximum[0], glm::dot(d, d));
+			}
+		}
+
+		if (startPos)
+		{
+			#pragma omp for
+			for (int i = 0; i < m_count; i++)
+			{
+				glm::vec3 d = pos[m_first + i] - (*startPos)[m_first + i];
+				maximum[1] = glm::max(maximum[1], glm::dot(d, d));
+			}
+		}
+	}
+	float edge = 0.0f, step = 0.0f;
+	for (int t = 0; t < threads; t++)
+	{
+		edge = glm::max(edge, m_threadMaximum[2 * t]);
+		step = glm::max(step, m_threadMaximum[2 * t + 1]);
+	}
+	float cellSize = glm::max(m_thickness + 2.0f * std::sqrt(edge) + 2.0f * std::sqrt(step), 1e-6f);
+
+	int keyBits = 1;
+	while ((1 << keyBits) < 2 * m_count)
+	{
+		keyBits++;
+	}
+	unsigned int mask = (1u << keyBits) - 1;
+	m_cellKeys.resize(m_count);
+	m_cellVertices.resize(m_count);
+	#pragma omp parallel for
+	for (int i = 0; i < m_count; i++)
+	{
+		m_cellKeys[i] = hashCell(glm::ivec3(glm::floor(pos[m_first + i] / cellSize)), mask);
+		m_cellVertices[i] = i;
+	}
+	radixSort(m_cellKeys, m_cellVertices, keyBits);
+
+	int buckets = (int)mask + 1;
+	m_bucketStart.assign(buckets + 1, m_count);
+	#pragma omp parallel for
+	for (int e = 0; e < m_count; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_cellKeys[e - 1] + 1;
+		for (int k = first; k <= (int)m_cellKeys[e]; k++)
+		{
+			m_bucketStart[k] = e;
+		}
+	}
+
+	// motions since the search at the end of the step, and at its start after them; in the step of
+	// the search its start positions were swept already, so only their later motion counts. Every
+	// bucket has the box of all its motions, then the box of those within half the skin of their mean.
+	int samples = startPos ? 2 : 1;
+	const std::vector<glm::vec3> &startFrom = m_searchAge == 0 && startPos ? m_searchStart : m_searchPos;
+	m_bucketMotion.resize(2 * samples * buckets);
+	m_regular.resize(m_count);
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for (int k = 0; k < buckets; k++)
+	{
+		int begin = m_bucketStart[k], end = m_bucketStart[k + 1];
+		if (begin == end)
+		{
+			continue;
+		}
+		for (int s = 0; s < samples; s++)
+		{
+			const std::vector<glm::vec3> &p = s == 0 ? pos : *startPos;
+			const std::vector<glm::vec3> &from = s == 0 ? m_searchPos : startFrom;
+			glm::vec3 mean(0.0f);
+			for (int e = begin; e < end; e++)
+			{
+				int i = m_cellVertices[e];
+				mean += p[m_first + i] - from[i];
+			}
+			mean /= (float)(end - begin);
+
+			AABB box(glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)), regular = box;
+			for (int e = begin; e < end; e++)
+			{
+				int i = m_cellVertices[e];
+				glm::vec3 d = p[m_first + i] - from[i];
+				box.extend(d);
+				bool near = glm::dot(d - mean, d - mean) <= 0.25f * skin * skin;
+				if (near)
+				{
+					regular.extend(d);
+				}
+				m_regular[i] = (s == 0 || m_regular[i]) && near;
+			}
+			m_bucketMotion[s * buckets + k] = box;
+			m_bucketMotion[(samples + s) * buckets + k] = regular;
+		}
+	}
+
+	m_motion.resize(m_count);
+	m_shift.resize(samples * m_count);
+	m_spread.resize(m_count);
+	m_threadMaximum.assign(threads, 0.0f);
+	#pragma omp parallel
+	{
+		float &maximum = m_threadMaximum[getThreadNum()];
+		glm::ivec3 cell;
+		AABB around[4];
+		bool found = false;
+
+		#pragma omp for schedule(dynamic, 1024)
+		for (int e = 0; e < m_count; e++)
+		{
+			int i = m_cellVertices[e];
+			glm::ivec3 c(glm::floor(pos[m_first + i] / cellSize));
+			if (!found || c != cell)
+			{
+				// the bucket of the cell holds this vertex, so the boxes start from its motions
+				cell = c;
+				for (int s = 0; s < 2 * samples; s++)
+				{
+					around[s] = m_bucketMotion[s * buckets + hashCell(cell, mask)];
+				}
+				for (int z = -1; z <= 1; z++)
+				{
+					for (int y = -1; y <= 1; y++)
+					{
+						for (int x = -1; x <= 1; x++)
+						{
+							unsigned int k = hashCell(cell + glm::ivec3(x, y, z), mask);
+							if (m_bucketStart[k] < m_bucketStart[k + 1])
+							{
+								for (int s = 0; s < 2 * samples; s++)
+								{
+									around[s] = AABB::combine(around[s], m_bucketMotion[s * buckets + k]);
+								}
+							}
+						}
+					}
+				}
+				found = true;
+			}
+
+			// the farthest corner of the box from the motion of the vertex, and the centre and
+			// half diagonal of the box of all the motions for the queries of the vertices that
+			// moved too far
+			float motion = 0.0f, spread = 0.0f;
+			for (int s = 0; s < samples; s++)
+			{
+				const std::vector<glm::vec3> &p = s == 0 ? pos : *startPos;
+				const std::vector<glm::vec3> &from = s == 0 ? m_searchPos : startFrom;
+				const AABB &box = m_regular[i] ? around[samples + s] : around[s];
+				glm::vec3 d = p[m_first + i] - from[i];
+				glm::vec3 far = glm::max(glm::abs(d - box.min), glm::abs(box.max - d));
+				motion = glm::max(motion, glm::length(far));
+				spread = glm::max(spread, 0.5f * glm::length(around[s].max - around[s].min));
+				m_shift[s * m_count + i] = 0.5f * (around[s].min + around[s].max);
+			}
+			m_motion[i] = motion;
+			m_spread[i] = spread;
+			maximum = glm::max(maximum, motion);
+		}
+	}
+
+	float motion = 0.0f;
+	for (int t = 0; t < threads; t++)
+	{
+		motion = glm::max(motion, m_threadMaximum[t]);
+	}
+	return motion;
+}
+
+// the vertex boxes go into one hash with the triangles and the edge boxes into another, grown
+// so that two boxes overlap when their elements may be within the search distance; given startPos
+// the boxes are swept over the step
+void ClothSelfCollision::buildHashes(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	float distance = m_searchDistance;
+	int triangles = (int)m_triangles.size();
+	int edges = (int)m_edges.size();
+
+	m_bounds.resize(m_count + triangles);
+	#pragma omp parallel for
+	for (int k = 0; k < m_count; k++)
+	{
+		AABB box(pos[m_first + k], pos[m_first + k]);
+		if (startPos)
+		{
+			box.extend((*startPos)[m_first + k]);
+		}
+		box.fatten(distance);
+		m_bounds[k] = box;
+	}
+	#pragma omp parallel for
+	for (int t = 0; t < triangles; t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		AABB box(pos[tri.x], pos[tri.x]);
+		box.extend(pos[tri.y]);
+		box.extend(pos[tri.z]);
+		if (startPos)
+		{
+			box.extend((*startPos)[tri.x]);
+			box.extend((*startPos)[tri.y]);
+			box.extend((*startPos)[tri.z]);
+		}
+		m_bounds[m_count + t] = box;
+	}
+	m_triangleHash.build(m_bounds, m_count);
+
+	m_bounds.resize(edges);
+	#pragma omp parallel for
+	for (int e = 0; e < edges; e++)
+	{
+		const glm::ivec2 &edge = m_edges[e];
+		AABB box(pos[edge.x], pos[edge.x]);
+		box.extend(pos[edge.y]);
+		if (startPos)
+		{
+			box.extend((*startPos)[edge.x]);
+			box.extend((*startPos)[edge.y]);
+		}
+		box.fatten(0.5f * distance);
+		m_bounds[e] = box;
+	}
+	m_edgeHash.build(m_bounds, 0);
+}
+
+bool ClothSelfCollision::vertexTriangleNear(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> *startPos, int i, const glm::ivec3 &tri, float distance) const
+{
+	const glm::vec3 &p = pos[i];
+	glm::vec3 w = closestPointTriangle(p, pos[tri.x], pos[tri.y], pos[tri.z]);
+	glm::vec3 d = p - (w.x * pos[tri.x] + w.y * pos[tri.y] + w.z * pos[tri.z]);
+	float reach = distance;
+	if (startPos)
+	{
+		const std::vector<glm::vec3> &start = *startPos;
+		glm::vec3 step = start[i] - p;
+		float motion = glm::length(step - (start[tri.x] - pos[tri.x]));
+		motion = glm::max(motion, glm::length(step - (start[tri.y] - pos[tri.y])));
+		motion = glm::max(motion, glm::length(step - (start[tri.z] - pos[tri.z])));
+		reach += motion;
+	}
+	return glm::dot(d, d) < reach * reach;
+}
+
+bool ClothSelfCollision::edgeEdgeNear(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> *startPos, const glm::ivec2 &e, const glm::ivec2 &f, float distance) const
+{
+	float s, u;
+	closestSegmentSegment(pos[e.x], pos[e.y], pos[f.x], pos[f.y], s, u);
+	glm::vec3 d = glm::mix(pos[e.x], pos[e.y], s) - glm::mix(pos[f.x], pos[f.y], u);
+	float reach = distance;
+	if (startPos)
+	{
+		const std::vector<glm::vec3> &start = *startPos;
+		glm::vec3 ex = start[e.x] - pos[e.x], ey = start[e.y] - pos[e.y];
+		glm::vec3 fx = start[f.x] - pos[f.x], fy = start[f.y] - pos[f.y];
+		float motion = glm::max(glm::length(ex - fx), glm::length(ex - fy));
+		motion = glm::max(motion, glm::max(glm::length(ey - fx), glm::length(ey - fy)));
+		reach += motion;
+	}
+	return glm::dot(d, d) < reach * reach;
+}
+
+// pairs within the thickness plus the skin: none of the others can come within the thickness
+// before the vertices have moved the skin relative to each other. Given startPos the pairs are
+// also kept while the relative motion of their vertices over the step could bring them within
+// that distance, for the continuous pass.
+void ClothSelfCollision::findCandidates(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos, float skin)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	m_searchPos.assign(pos.begin() + m_first, pos.begin() + m_first + m_count);
+	if (startPos)
+	{
+		m_searchStart.assign(startPos->begin() + m_first, startPos->begin() + m_first + m_count);
+	}
+	m_searchDistance = m_thickness + skin;
+	m_searchAge = 0;
+	float distance = m_searchDistance;
+
+	buildHashes(ps, startPos);
+
+	int threads = getMaxThreads();
+	m_threadVertexTriangles.resize(threads);
+	m_threadEdgeEdges.resize(threads);
+
+	// vertex boxes against triangle boxes, then the distance of every pair
+	m_triangleHash.findPairs(m_threadPairs);
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < threads; t++)
+	{
+		const std::vector<glm::ivec2> &pairs = m_threadPairs[t];
+		std::vector<glm::ivec2> &result = m_threadVertexTriangles[t];
+		result.clear();
+		for (size_t c = 0; c < pairs.size(); c++)
+		{
+			int i = m_first + pairs[c].x;
+			int triangle = pairs[c].y - m_count;
+			const glm::ivec3 &tri = m_triangles[triangle];
+			if (i != tri.x && i != tri.y && i != tri.z && vertexTriangleNear(pos, startPos, i, tri, distance))
+			{
+				result.push_back(glm::ivec2(i, triangle));
+			}
+		}
+	}
+
+	// edge boxes against each other
+	m_edgeHash.findPairs(m_threadPairs);
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < threads; t++)
+	{
+		const std::vector<glm::ivec2> &pairs = m_threadPairs[t];
+		std::vector<glm::ivec2> &result = m_threadEdgeEdges[t];
+		result.clear();
+		for (size_t c = 0; c < pairs.size(); c++)
+		{
+			const glm::ivec2 &e = m_edges[pairs[c].x], &f = m_edges[pairs[c].y];
+			if (f.x != e.x && f.x != e.y && f.y != e.x && f.y != e.y && edgeEdgeNear(pos, startPos, e, f, distance))
+			{
+				result.push_back(pairs[c]);
+			}
+		}
+	}
+
+	m_vertexTriangleCandidates.clear();
+	m_edgeEdgeCandidates.clear();
+	for (int t = 0; t < threads; t++)
+	{
+		m_vertexTriangleCandidates.insert(m_vertexTriangleCandidates.end(), m_threadVertexTriangles[t].begin(), m_threadVertexTriangles[t].end());
+		m_edgeEdgeCandidates.insert(m_edgeEdgeCandidates.end(), m_threadEdgeEdges[t].begin(), m_threadEdgeEdges[t].end());
+	}
+
+	m_searches++;
+}
+
+// the pairs with a vertex that moved more than the skin are found again in the hashes of the last
+// search, with the motion of the vertices around them undone: a vertex moved back by the centre of
+// the box of their motions is within the thickness and the half diagonal of that box of where the
+// elements near it were at the search. The moved vertices are queried against the triangles, the
+// triangles with a moved vertex against the other vertices, and the edges with one against the
+// edges. The pairs found are only those within the thickness for this step, as they are found
+// again in the next; the pairs without a moved vertex keep their candidates.
+void ClothSelfCollision::findMovedPairs(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int triangles = (int)m_triangles.size();
+	int edges = (int)m_edges.size();
+	int moved = (int)m_movedVertices.size();
+	int threads = getMaxThreads();
+
+	m_movedVertex.assign(m_count, 0);
+	for (int k = 0; k < moved; k++)
+	{
+		m_movedVertex[m_movedVertices[k]] = 1;
+	}
+	m_movedTriangle.resize(triangles);
+	m_movedTriangles.clear();
+	for (int t = 0; t < triangles; t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		m_movedTriangle[t] = m_movedVertex[tri.x - m_first] | m_movedVertex[tri.y - m_first] | m_movedVertex[tri.z - m_first];
+		if (m_movedTriangle[t])
+		{
+			m_movedTriangles.push_back(t);
+		}
+	}
+	int movedTriangles = (int)m_movedTriangles.size();
+	m_movedEdge.resize(edges);
+	m_movedEdges.clear();
+	for (int e = 0; e < edges; e++)
+	{
+		m_movedEdge[e] = m_movedVertex[m_edges[e].x - m_first] | m_movedVertex[m_edges[e].y - m_first];
+		if (m_movedEdge[e])
+		{
+			m_movedEdges.push_back(e);
+		}
+	}
+	int movedEdges = (int)m_movedEdges.size();
+
+	m_vertexTrianglePairs.clear();
+	for (size_t c = 0; c < m_vertexTriangleCandidates.size(); c++)
+	{
+		const glm::ivec2 &pair = m_vertexTriangleCandidates[c];
+		if (!m_movedVertex[pair.x - m_first] && !m_movedTriangle[pair.y])
+		{
+			m_vertexTrianglePairs.push_back(m_vertexTriangleCandidates[c]);
+		}
+	}
+	m_edgeEdgePairs.clear();
+	for (size_t c = 0; c < m_edgeEdgeCandidates.size(); c++)
+	{
+		const glm::ivec2 &pair = m_edgeEdgeCandidates[c];
+		if (!m_movedEdge[pair.x] && !m_movedEdge[pair.y])
+		{
+			m_edgeEdgePairs.push_back(pair);
+		}
+	}
+
+	m_threadVertexTriangles.resize(threads);
+	m_threadEdgeEdges.resize(threads);
+	m_threadFound.resize(threads);
+	#pragma omp parallel
+	{
+		std::vector<glm::ivec2> &vertexTriangles = m_threadVertexTriangles[getThreadNum()];
+		std::vector<glm::ivec2> &edgeEdges = m_threadEdgeEdges[getThreadNum()];
+		std::vector<int> &found = m_threadFound[getThreadNum()];
+		vertexTriangles.clear();
+		edgeEdges.clear();
+
+		#pragma omp for schedule(dynamic, 64)
+		for (int k = 0; k < moved; k++)
+		{
+			int v = m_movedVertices[k];
+			int i = m_first + v;
+			AABB box(pos[i] - m_shift[v], pos[i] - m_shift[v]);
+			if (startPos)
+			{
+				box.extend((*startPos)[i] - m_shift[m_count + v]);
+			}
+			box.fatten(m_thickness + m_spread[v]);
+
+			found.clear();
+			m_triangleHash.query(box, 1, found);
+			for (size_t c = 0; c < found.size(); c++)
+			{
+				int triangle = found[c] - m_count;
+				const glm::ivec3 &tri = m_triangles[triangle];
+				if (i != tri.x && i != tri.y && i != tri.z && vertexTriangleNear(pos, startPos, i, tri, m_thickness))
+				{
+					vertexTriangles.push_back(glm::ivec2(i, triangle));
+				}
+			}
+		}
+
+		// the moved vertices found their pairs with these triangles already
+		#pragma omp for schedule(dynamic, 64)
+		for (int k = 0; k < movedTriangles; k++)
+		{
+			int triangle = m_movedTriangles[k];
+			const glm::ivec3 &tri = m_triangles[triangle];
+			AABB box(pos[tri.x] - m_shift[tri.x - m_first], pos[tri.x] - m_shift[tri.x - m_first]);
+			float spread = 0.0f;
+			for (int j = 0; j < 3; j++)
+			{
+				int v = tri[j] - m_first;
+				box.extend(pos[tri[j]] - m_shift[v]);
+				if (startPos)
+				{
+					box.extend((*startPos)[tri[j]] - m_shift[m_count + v]);
+				}
+				spread = glm::max(spread, m_spread[v]);
+			}
+			box.fatten(m_thickness + spread);
+
+			found.clear();
+			m_triangleHash.query(box, 0, found);
+			for (size_t c = 0; c < found.size(); c++)
+			{
+				int v = found[c];
+				int i = m_first + v;
+				if (!m_movedVertex[v] && i != tri.x && i != tri.y && i != tri.z
+					&& vertexTriangleNear(pos, startPos, i, tri, m_thickness))
+				{
+					vertexTriangles.push_back(glm::ivec2(i, triangle));
+				}
+			}
+		}
+
+		#pragma omp for schedule(dynamic, 64)
+		for (int k = 0; k < movedEdges; k++)
+		{
+			int e = m_movedEdges[k];
+			const glm::ivec2 &edge = m_edges[e];
+			int v = edge.x - m_first;
+			AABB box(pos[edge.x] - m_shift[v], pos[edge.x] - m_shift[v]);
+			box.extend(pos[edge.y] - m_shift[v]);
+			if (startPos)
+			{
+				box.extend((*startPos)[edge.x] - m_shift[m_count + v]);
+				box.extend((*startPos)[edge.y] - m_shift[m_count + v]);
+			}
+			box.fatten(m_thickness + m_spread[v]);
+
+			// a pair of moved edges is found from either, and kept from the first
+			found.clear();
+			m_edgeHash.query(box, 0, found);
+			for (size_t c = 0; c < found.size(); c++)
+			{
+				int g = found[c];
+				const glm::ivec2 &f = m_edges[g];
+				if ((g > e || !m_movedEdge[g]) && f.x != edge.x && f.x != edge.y && f.y != edge.x && f.y != edge.y
+					&& edgeEdgeNear(pos, startPos, edge, f, m_thickness))
+				{
+					edgeEdges.push_back(glm::ivec2(e, g));
+				}
+			}
+		}
+	}
+
+	for (int t = 0; t < threads; t++)
+	{
+		m_vertexTrianglePairs.insert(m_vertexTrianglePairs.end(), m_threadVertexTriangles[t].begin(), m_threadVertexTriangles[t].end());
+		m_edgeEdgePairs.insert(m_edgeEdgePairs.end(), m_threadEdgeEdges[t].begin(), m_threadEdgeEdges[t].end());
+	}
+}
+
+// the candidates of this step: those of the last search while no vertex has moved more than the skin
+// relative to the vertices around it, those of the vertices that did found again while they are
+// few, and a new search otherwise. The skin is sized to the speed of the cloth: when a list lasted
+// a single step and too many vertices moved the whole skin within it, the next list won't last
+// either, and the search keeps only the pairs within the thickness, which costs much less.
+void ClothSelfCollision::updateCandidates(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos)
+{
+	float skin = m_searchDistance - m_thickness;
+	float motion = relativeMotion(ps, startPos, skin);
+
+	m_movedVertices.clear();
+	int fast = 0;
+	if (motion > skin && motion != FLT_MAX)
+	{
+		for (int i = 0; i < m_count; i++)
+		{
+			if (m_motion[i] > skin)
+			{
+				m_movedVertices.push_back(i);
+			}
+			if (m_motion[i] > m_skin)
+			{
+				fast++;
+			}
+		}
+	}
+	m_movedCount = (int)m_movedVertices.size();
+
+	int limit = (int)(MAX_MOVED_FRACTION * m_count);
+	if (motion == FLT_MAX || m_movedCount > limit)
+	{
+		findCandidates(ps, startPos, m_searchAge == 1 && fast > limit ? 0.0f : m_skin);
+	}
+	else if (m_movedCount > 0)
+	{
+		findMovedPairs(ps, startPos);
+		return;
+	}
+	m_vertexTrianglePairs = m_vertexTriangleCandidates;
+	m_edgeEdgePairs = m_edgeEdgeCandidates;
+}
+
+bool ClothSelfCollision::vertexTriangle(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> &startPos, int i, const glm::ivec3 &tri, Proximity &prox) const
+{
+	const glm::vec3 &p = pos[i];
+	const glm::vec3 &a = pos[tri.x], &b = pos[tri.y], &c = pos[tri.z];
+
+	glm::vec3 w = closestPointTriangle(p, a, b, c);
+	glm::vec3 q = w.x * a + w.y * b + w.z * c;
+	float dist = glm::length(p - q);
+	if (dist >= m_thickness)
+	{
+		return false;
+	}
+
+	// the vertex belongs on the side of the triangle it started the step on
+	const glm::vec3 &a0 = startPos[tri.x], &b0 = startPos[tri.y], &c0 = startPos[tri.z];
+	glm::vec3 normal = glm::cross(b - a, c - a);
+	float area = glm::length(normal);
+	if (area < 1e-12f)
+	{
+		return false;
+	}
+	normal /= area;
+	float d0 = glm::dot(startPos[i] - a0, glm::cross(b0 - a0, c0 - a0));
+	glm::vec3 side = d0 < 0.0f ? -normal : normal;
+
+	// push out along the closest direction unless that is through the triangle
+	prox.n = dist > 1e-6f ? (p - q) / dist : side;
+	if (glm::dot(prox.n, side) < 0.0f)
+	{
+		prox.n = side;
+	}
+
+	prox.v[0] = i; prox.v[1] = tri.x; prox.v[2] = tri.y; prox.v[3] = tri.z;
+	prox.w[0] = 1.0f; prox.w[1] = -w.x; prox.w[2] = -w.y; prox.w[3] = -w.z;
+	return true;
+}
+
+bool ClothSelfCollision::edgeEdge(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> &startPos, const glm::ivec2 &e, const glm::ivec2 &f, Proximity &prox) const
+{
+	float s, u;
+	closestSegmentSegment(pos[e.x], pos[e.y], pos[f.x], pos[f.y], s, u);
+	// closest points at an end point are vertex-triangle proximities
+	if (s <= 0.0f || s >= 1.0f || u <= 0.0f || u >= 1.0f)
+	{
+		return false;
+	}
+
+	glm::vec3 d = glm::mix(pos[e.x], pos[e.y], s) - glm::mix(pos[f.x], pos[f.y], u);
+	float dist = glm::length(d);
+	if (dist >= m_thickness || dist < 1e-6f)
+	{
+		return false;
+	}
+
+	// keep the edges on the sides they started the step on
+	glm::vec3 d0 = glm::mix(startPos[e.x], startPos[e.y], s) - glm::mix(startPos[f.x], startPos[f.y], u);
+
+	prox.v[0] = e.x; prox.v[1] = e.y; prox.v[2] = f.x; prox.v[3] = f.y;
+	prox.w[0] = 1.0f - s; prox.w[1] = s; prox.w[2] = u - 1.0f; prox.w[3] = -u;
+	prox.n = glm::dot(d, d0) < 0.0f ? -d / dist : d / dist;
+	return true;
+}
+
+void ClothSelfCollision::findProximities(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int vertexTrianglePairs = (int)m_vertexTrianglePairs.size();
+	int edgeEdgePairs = (int)m_edgeEdgePairs.size();
+	int vertexTriangles = 0, edgeEdges = 0;
+
+	#pragma omp parallel reduction(+:vertexTriangles, edgeEdges)
+	{
+		std::vector<Proximity> &result = m_threadProximities[getThreadNum()];
+		Proximity prox;
+
+		#pragma omp for schedule(dynamic, 1024)
+		for (int c = 0; c < vertexTrianglePairs; c++)
+		{
+			const glm::ivec2 &pair = m_vertexTrianglePairs[c];
+			if (vertexTriangle(pos, startPos, pair.x, m_triangles[pair.y], prox))
+			{
+				result.push_back(prox);
+				vertexTriangles++;
+			}
+		}
+
+		#pragma omp for schedule(dynamic, 1024)
+		for (int c = 0; c < edgeEdgePairs; c++)
+		{
+			const glm::ivec2 &pair = m_edgeEdgePairs[c];
+			if (edgeEdge(pos, startPos, m_edges[pair.x], m_edges[pair.y], prox))
+			{
+				result.push_back(prox);
+				edgeEdges++;
+			}
+		}
+	}
+
+	m_vertexTriangles = vertexTriangles;
+	m_edgeEdges = edgeEdges;
+}
+
+
+/*
+** RESPONSE
+*/
+
+// proximity corners sorted by particle so every particle gathers a contiguous range
+void ClothSelfCollision::sortEntries(int particleCount)
+{
+	int m = (int)m_proximities.size();
+	m_dx.resize(4 * m);
+	m_dv.resize(4 * m);
+	m_entryParticle.resize(4 * m);
+	m_entry.resize(4 * m);
+
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			m_entryParticle[4 * c + k] = (unsigned int)m_proximities[c].v[k];
+			m_entry[4 * c + k] = 4 * c + k;
+		}
+	}
+
+	int keyBits = 1;
+	while ((1 << keyBits) < particleCount)
+	{
+		keyBits++;
+	}
+	radixSort(m_entryParticle, m_entry, keyBits);
+
+	int entries = 4 * m;
+	m_entryStart.assign(particleCount + 1, entries);
+	#pragma omp parallel for
+	for (int e = 0; e < entries; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_entryParticle[e - 1] + 1;
+		for (int p = first; p <= (int)m_entryParticle[e]; p++)
+		{
+			m_entryStart[p] = e;
+		}
+	}
+}
+
+void ClothSelfCollision::respond(ParticleSystem &ps)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &invMass = ps.getInvMass();
+	int m = (int)m_proximities.size();
+
+	for (int it = 0; it < m_iterations; it++)
+	{
+		// push every pair out to the thickness and remove its approaching velocity
+		#pragma omp parallel for
+		for (int c = 0; c < m; c++)
+		{
+			const Proximity &prox = m_proximities[c];
+			glm::vec3 r(0.0f), v(0.0f);
+			float denom = 0.0f;
+			for (int k = 0; k < 4; k++)
+			{
+				r += prox.w[k] * pos[prox.v[k]];
+				v += prox.w[k] * vel[prox.v[k]];
+				denom += prox.w[k] * prox.w[k] * invMass[prox.v[k]];
+			}
+
+			float depth = m_thickness - glm::dot(r, prox.n);
+			float vn = glm::dot(v, prox.n);
+			float positionImpulse = denom > 0.0f && depth > 0.0f ? depth / denom : 0.0f;
+			float velocityImpulse = denom > 0.0f && vn < 0.0f ? -vn / denom : 0.0f;
+
+			for (int k = 0; k < 4; k++)
+			{
+				float s = prox.w[k] * invMass[prox.v[k]];
+				m_dx[4 * c + k] = s * positionImpulse * prox.n;
+				m_dv[4 * c + k] = s * velocityImpulse * prox.n;
+			}
+		}
+
+		// average the corrections of the proximities sharing a particle
+		int n = (int)m_entryStart.size() - 1;
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			int begin = m_entryStart[i], end = m_entryStart[i + 1];
+			if (begin == end)
+			{
+				continue;
+			}
+			glm::vec3 dx(0.0f), dv(0.0f);
+			for (int e = begin; e < end; e++)
+			{
+				dx += m_dx[m_entry[e]];
+				dv += m_dv[m_entry[e]];
+			}
+			float inv = 1.0f / (end - begin);
+			pos[i] += dx * inv;
+			vel[i] += dv * inv;
+		}
+	}
+}
+
+void ClothSelfCollision::apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt)
+{
+	if (m_triangles.empty())
+	{
+		return;
+	}
+
+	const std::vector<glm::vec3> *sweep = m_continuous ? &startPos : NULL;
+	m_searchAge++;
+	updateCandidates(ps, sweep);
+
+	m_threadProximities.resize(getMaxThreads());
+	for (size_t t = 0; t < m_threadProximities.size(); t++)
+	{
+		m_threadProximities[t].clear();
+	}
+
+	findProximities(ps, startPos);
+
+	m_proximities.clear();
+	for (size_t t = 0; t < m_threadProximities.size(); t++)
+	{
+		m_proximities.insert(m_proximities.end(), m_threadProximities[t].begin(), m_threadProximities[t].end());
+	}
+
+	if (!m_proximities.empty())
+	{
+		sortEntries(ps.getCount());
+		respond(ps);
+	}
+
+	if (m_continuous)
+	{
+		// the response moved the vertices, which the candidates may no longer cover
+		if (!m_proximities.empty())
+		{
+			updateCandidates(ps, sweep);
+		}
+		m_ccd.apply(ps, startPos, dt, m_vertexTrianglePairs, m_edgeEdgePairs);
+	}
+}
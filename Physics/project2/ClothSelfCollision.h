@@ -0,0 +1,171 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+#include "SpatialHash.h"
+#include "ClothCCD.h"
+
+/*
+** CLOTH SELF COLLISION
+** Keeps the cloth at least a thickness away from itself after a solver step
+** (Bridson et al. 2002). The vertex boxes, grown by the thickness plus a skin, are
+** hashed with the triangle boxes, and the edge boxes, grown by half as much, on
+** their own, in cells about the size of the boxes, so every vertex and edge is
+** tested only against the elements in the cells around it. The pairs within that
+** distance are kept between steps like a Verlet list. A pair can only have come
+** closer by as much as its vertices moved relative to each other, so the list is
+** kept while no vertex has moved more than the skin relative to the vertices in the
+** grid cells around it; cloth that swings or falls as a whole keeps its list, and
+** the few vertices that moved on their own are left out of the motion the others
+** are compared with. The pairs of the vertices that moved are found again in the
+** hashes of the search, with the motion around them undone, and only when more
+** than a quarter of the vertices did is there a new search. The skin is sized to the speed: when a list
+** lasted one step because that many vertices moved the whole skin within it, the
+** next search is for the thickness alone, which costs much less.
+** Every proximity is written as a relative position sum_k w_k x_k along a normal,
+** so both kinds share one response: repulsion impulses that remove the
+** approaching velocity and push the pair apart, computed per proximity and
+** gathered per vertex (Jacobi with averaging) from a list sorted by vertex, so no
+** atomics are needed.
+** This is a discrete pass. The optional continuous pass runs ClothCCD on the
+** candidate pairs, over the motion from the start of the step, for the pairs that
+** pass through each other within it; the boxes of a search are then swept over the
+** step, and every pair is kept while the relative motion of its own vertices over
+** the step could bring it within the search distance.
+*/
+class ClothSelfCollision
+{
+public:
+	ClothSelfCollision();
+	~ClothSelfCollision();
+
+	/*
+	** GET METHODS
+	*/
+	// proximities found by the last call
+	int getVertexTriangleCount() const { return m_vertexTriangles; }
+	int getEdgeEdgeCount() const { return m_edgeEdges; }
+	// candidate pairs of the last call, the searches for them since setMesh, and the vertices whose
+	// pairs the last call found again
+	int getCandidateCount() const { return (int)(m_vertexTrianglePairs.size() + m_edgeEdgePairs.size()); }
+	int getSearchCount() const { return m_searches; }
+	int getMovedCount() const { return m_movedCount; }
+	// collisions the continuous pass found, and the particles it stopped at their start positions
+	int getCollisionCount() const { return m_ccd.getCollisionCount(); }
+	int getFrozenCount() const { return m_ccd.getFrozenCount(); }
+
+	/*
+	** SET METHODS
+	*/
+	void setThickness(float thickness) { m_thickness = thickness; m_ccd.setThickness(thickness); m_searchPos.clear(); }
+	// distance past the thickness within which candidates are kept
+	void setSkin(float skin) { m_skin = skin; m_searchPos.clear(); }
+	// response passes over the proximities
+	void setIterations(int iterations) { m_iterations = iterations; }
+	// also resolve the pairs passing through each other within the step
+	void setContinuous(bool continuous) { m_continuous = continuous; m_searchPos.clear(); }
+
+	/*
+	** OTHER METHODS
+	*/
+	void setMesh(const ClothMesh &mesh, const ParticleSystem &ps);
+
+	// resolve the self collisions of a step of length dt that moved the particles from startPos to
+	// their current positions
+	void apply(ParticleSystem &ps, const std::vector<glm::vec3> &startPos, float dt);
+
+private:
+	struct Proximity
+	{
+		int v[4];
+		float w[4]; // relative position = sum_k w_k x_k
+		glm::vec3 n;
+	};
+
+	// largest motion of a vertex relative to the vertices around it since the candidates were
+	// found, at the end of the step and, given startPos, during it, leaving out those more than half
+	// the skin from the mean motion of their cell; the motion of every vertex and the box of those
+	// around it are kept
+	float relativeMotion(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos, float skin);
+	void buildHashes(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos);
+	// is the pair within the distance, or could its relative motion over the step from startPos have
+	// brought it within?
+	bool vertexTriangleNear(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> *startPos, int i, const glm::ivec3 &tri, float distance) const;
+	bool edgeEdgeNear(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> *startPos, const glm::ivec2 &e, const glm::ivec2 &f, float distance) const;
+	void findCandidates(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos, float skin);
+	void findMovedPairs(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos);
+	void updateCandidates(const ParticleSystem &ps, const std::vector<glm::vec3> *startPos);
+	bool vertexTriangle(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> &startPos, int i, const glm::ivec3 &tri, Proximity &prox) const;
+	bool edgeEdge(const std::vector<glm::vec3> &pos, const std::vector<glm::vec3> &startPos, const glm::ivec2 &e, const glm::ivec2 &f, Proximity &prox) const;
+	void findProximities(const ParticleSystem &ps, const std::vector<glm::vec3> &startPos);
+	void sortEntries(int particleCount);
+	void respond(ParticleSystem &ps);
+
+	float m_thickness;
+	float m_skin;
+	int m_iterations;
+	bool m_continuous;
+	int m_vertexTriangles;
+	int m_edgeEdges;
+	int m_searches;
+	int m_searchAge; // steps since the search
+	int m_movedCount;
+
+	// mesh
+	int m_first, m_count;
+	std::vector<glm::ivec3> m_triangles;
+	std::vector<glm::ivec2> m_edges;
+
+	// vertex boxes with the triangle boxes, and the edge boxes
+	SpatialHash m_triangleHash;
+	SpatialHash m_edgeHash;
+	std::vector<AABB> m_bounds;
+	std::vector<std::vector<glm::ivec2> > m_threadPairs;
+
+	// candidate pairs (vertex, triangle) and (edge, edge), and the positions they were found at
+	std::vector<std::vector<glm::ivec2> > m_threadVertexTriangles;
+	std::vector<std::vector<glm::ivec2> > m_threadEdgeEdges;
+	std::vector<glm::ivec2> m_vertexTriangleCandidates;
+	std::vector<glm::ivec2> m_edgeEdgeCandidates;
+	std::vector<glm::vec3> m_searchPos;
+	std::vector<glm::vec3> m_searchStart; // start of the step of the search, when swept
+	float m_searchDistance;
+
+	// pairs of the step: the candidates, less those of the moved vertices, which are found again
+	std::vector<glm::ivec2> m_vertexTrianglePairs;
+	std::vector<glm::ivec2> m_edgeEdgePairs;
+	std::vector<int> m_movedVertices;
+	std::vector<int> m_movedTriangles;
+	std::vector<int> m_movedEdges;
+	std::vector<char> m_movedVertex;
+	std::vector<char> m_movedTriangle;
+	std::vector<char> m_movedEdge;
+	std::vector<std::vector<int> > m_threadFound;
+
+	// vertices hashed into grid cells, with the box of the motions of the vertices in every bucket
+	// and of those within half the skin of their mean, which are marked regular; the motion of every
+	// vertex relative to the cells around it, and the centre (at the end, then at the start of the
+	// step) and half diagonal of the box of their motions
+	std::vector<unsigned int> m_cellKeys;
+	std::vector<int> m_cellVertices;
+	std::vector<int> m_bucketStart;
+	std::vector<AABB> m_bucketMotion;
+	std::vector<char> m_regular;
+	std::vector<float> m_threadMaximum;
+	std::vector<float> m_motion;
+	std::vector<glm::vec3> m_shift;
+	std::vector<float> m_spread;
+
+	ClothCCD m_ccd;
+
+	std::vector<std::vector<Proximity> > m_threadProximities;
+	std::vector<Proximity> m_proximities;
+
+	// position and velocity change of every proximity corner, gathered per particle
+	std::vector<glm::vec3> m_dx, m_dv;
+	std::vector<unsigned int> m_entryParticle;
+	std::vector<int> m_entry;
+	std::vector<int> m_entryStart;
+};
@@ -0,0 +1,590 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+#include "ContactSolver.h"
+
+
+// a b + c
+static inline __m128 madd(__m128 a, __m128 b, __m128 c)
+{
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+// two unit tangents completing a right handed basis with the normal
+static void tangents(const glm::vec3 &n, glm::vec3 &t1, glm::vec3 &t2)
+{
+	if (std::fabs(n.x) >= 0.57735f)
+	{
+		t1 = glm::normalize(glm::vec3(n.y, -n.x, 0.0f));
+	}
+	else
+	{
+		t1 = glm::normalize(glm::vec3(0.0f, n.z, -n.y));
+	}
+	t2 = glm::cross(n, t1);
+}
+
+
+ContactSolver::ContactSolver()
+{
+	m_iterations = 10;
+	m_friction = 0.5f;
+	m_restitution = 0.0f;
+	m_restitutionThreshold = 1.0f;
+	m_baumgarte = 0.2f;
+	m_slop = 0.005f;
+	m_warmStarting = true;
+	m_taskSize = 128;
+	m_splitSize = 4096;
+	m_islandCount = 0;
+	m_taskCount = 0;
+}
+
+
+ContactSolver::~ContactSolver()
+{
+}
+
+int ContactSolver::getIsland(int body) const
+{
+	if (body >= (int)m_solverBody.size() || m_solverBody[body] <= 0)
+	{
+		return -1;
+	}
+	// island 0 is the static world's
+	return m_islands.getIsland(m_solverBody[body]) - 1;
+}
+
+int ContactSolver::getColorCount() const
+{
+	int colors = 0;
+	for (int t = 0; t < m_taskCount; t++)
+	{
+		colors = std::max(colors, (int)m_tasks[t].colorStart.size() - 1);
+	}
+	return colors;
+}
+
+int ContactSolver::getBatchCount() const
+{
+	int batches = 0;
+	for (int t = 0; t < m_taskCount; t++)
+	{
+		batches += (int)m_tasks[t].batches.size();
+	}
+	return batches;
+}
+
+int ContactSolver::solverBody(const RigidBodySystem &rb, int body)
+{
+	// fixed bodies all share the static world
+	if (rb.getInvMass(body) == 0.0f)
+	{
+		return 0;
+	}
+
+	if (m_solverBody[body] < 0)
+	{
+		glm::vec3 v = rb.getVel(body);
+		glm::vec3 w = rb.getAngularVel(body);
+		m_solverBody[body] = (int)m_body.size();
+		m_body.push_back(body);
+		m_vx.push_back(v.x); m_vy.push_back(v.y); m_vz.push_back(v.z);
+		m_wx.push_back(w.x); m_wy.push_back(w.y); m_wz.push_back(w.z);
+	}
+	return m_solverBody[body];
+}
+
+void ContactSolver::buildTasks(const std::vector<Contact> &contacts)
+{
+	int m = (int)contacts.size();
+	int bodies = (int)m_body.size();
+
+	// the static world joins nothing, so it is an island of its own without contacts
+	m_edges.resize(m + m_joints.size());
+	for (int c = 0; c < m; c++)
+	{
+		int a = m_solverBody[contacts[c].bodyA];
+		int b = m_solverBody[contacts[c].bodyB];
+		m_edges[c].bodyA = a > 0 ? a : -1;
+		m_edges[c].bodyB = b > 0 ? b : -1;
+	}
+	for (int j = 0; j < (int)m_joints.size(); j++)
+	{
+		int a = m_solverBody[m_joints[j].bodyA];
+		int b = m_solverBody[m_joints[j].bodyB];
+		m_edges[m + j].bodyA = a > 0 ? a : -1;
+		m_edges[m + j].bodyB = b > 0 ? b : -1;
+	}
+	m_islands.build(bodies, m_edges);
+	int islands = m_islands.getIslandCount();
+	m_islandCount = islands - 1;
+
+	// contacts grouped by island, in contact order within each
+	std::vector<int> start(islands + 1, 0);
+	m_contactTask.resize(m);
+	for (int c = 0; c < m; c++)
+	{
+		int a = m_solverBody[contacts[c].bodyA];
+		m_contactTask[c] = m_islands.getIsland(a > 0 ? a : m_solverBody[contacts[c].bodyB]);
+		start[m_contactTask[c] + 1]++;
+	}
+	for (int i = 0; i < islands; i++)
+	{
+		start[i + 1] += start[i];
+	}
+	m_order.resize(m);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (int c = 0; c < m; c++)
+	{
+		m_order[fill[m_contactTask[c]]++] = c;
+	}
+
+	// consecutive small islands gathered until a task has enough contacts to be worth a thread;
+	// an island past the split size goes alone
+	m_taskCount = 0;
+	std::vector<int> task(islands);
+	for (int i = 0; i < islands; i++)
+	{
+		int count = start[i + 1] - start[i];
+		if (count == 0)
+		{
+			continue;
+		}
+		bool split = count >= m_splitSize;
+		bool open = m_taskCount > 0 && !m_tasks[m_taskCount - 1].split
+			&& m_tasks[m_taskCount - 1].end - m_tasks[m_taskCount - 1].begin < m_taskSize;
+		if (split || !open)
+		{
+			if ((int)m_tasks.size() == m_taskCount)
+			{
+				m_tasks.push_back(Task());
+			}
+			Task &added = m_tasks[m_taskCount++];
+			added.begin = start[i];
+			added.split = split;
+		}
+		m_tasks[m_taskCount - 1].end = start[i + 1];
+		task[i] = m_taskCount - 1;
+	}
+	for (int c = 0; c < m; c++)
+	{
+		m_contactTask[c] = task[m_contactTask[c]];
+	}
+}
+
+void ContactSolver::buildBatches(const std::vector<Contact> &contacts, int index)
+{
+	Task &task = m_tasks[index];
+
+	// greedy colouring on the moving bodies, a 64 bit mask of the colours used per body; tasks
+	// share no moving body, so they share no mask
+	int count[65] = { 0 };
+	for (int i = task.begin; i < task.end; i++)
+	{
+		const Contact &contact = contacts[m_order[i]];
+		int a = m_solverBody[contact.bodyA];
+		int b = m_solverBody[contact.bodyB];
+		unsigned long long taken = (a > 0 ? m_used[a] : 0ull) | (b > 0 ? m_used[b] : 0ull);
+		int k = 0;
+		while (k < 64 && (taken >> k) & 1ull)
+		{
+			k++;
+		}
+		// the rare contact that finds all 64 colours taken goes to a last colour solved serially
+		if (k < 64)
+		{
+			if (a > 0)
+			{
+				m_used[a] |= 1ull << k;
+			}
+			if (b > 0)
+			{
+				m_used[b] |= 1ull << k;
+			}
+		}
+		m_color[i] = k;
+		count[k]++;
+	}
+
+	// batches per colour: four contacts each, one per batch in the serial colour
+	int batches[65];
+	task.colorStart.clear();
+	task.colorStart.push_back(0);
+	for (int k = 0; k < 65; k++)
+	{
+		batches[k] = task.colorStart.back();
+		if (count[k] > 0)
+		{
+			task.colorStart.push_back(task.colorStart.back() + (k < 64 ? (count[k] + 3) / 4 : count[k]));
+		}
+	}
+	task.serialColor = count[64] > 0;
+
+	// empty lanes belong to the static world and have no effect
+	Batch empty;
+	memset(&empty, 0, sizeof(Batch));
+	task.batches.assign(task.colorStart.back(), empty);
+
+	int fill[65] = { 0 };
+	for (int i = task.begin; i < task.end; i++)
+	{
+		int k = m_color[i];
+		m_contactBatch[m_order[i]] = k < 64 ? 4 * batches[k] + fill[k] : 4 * (batches[k] + fill[k]);
+		fill[k]++;
+	}
+}
+
+void ContactSolver::prepare(const RigidBodySystem &rb, const Contact &contact, Batch &batch, int lane, float dt)
+{
+	int bodyA = contact.bodyA, bodyB = contact.bodyB;
+	int a = m_solverBody[bodyA] < 0 ? 0 : m_solverBody[bodyA];
+	int b = m_solverBody[bodyB] < 0 ? 0 : m_solverBody[bodyB];
+	batch.a[lane] = a;
+	batch.b[lane] = b;
+
+	glm::vec3 rA = contact.point - rb.getPos(bodyA);
+	glm::vec3 rB = contact.point - rb.getPos(bodyB);
+	float wA = a > 0 ? rb.getInvMass(bodyA) : 0.0f;
+	float wB = b > 0 ? rb.getInvMass(bodyB) : 0.0f;
+	glm::mat3 invIA = a > 0 ? rb.getInvInertiaWorld(bodyA) : glm::mat3(0.0f);
+	glm::mat3 invIB = b > 0 ? rb.getInvInertiaWorld(bodyB) : glm::mat3(0.0f);
+	batch.invMassA[lane] = wA;
+	batch.invMassB[lane] = wB;
+
+	glm::vec3 d[3];
+	d[0] = contact.normal;
+	tangents(contact.normal, d[1], d[2]);
+	for (int r = 0; r < 3; r++)
+	{
+		glm::vec3 angA = glm::cross(rA, d[r]);
+		glm::vec3 angB = glm::cross(rB, d[r]);
+		glm::vec3 iA = invIA * angA;
+		glm::vec3 iB = invIB * angB;
+		float k = wA + wB + glm::dot(angA, iA) + glm::dot(angB, iB);
+
+		batch.dx[r][lane] = d[r].x; batch.dy[r][lane] = d[r].y; batch.dz[r][lane] = d[r].z;
+		batch.angAx[r][lane] = angA.x; batch.angAy[r][lane] = angA.y; batch.angAz[r][lane] = angA.z;
+		batch.angBx[r][lane] = angB.x; batch.angBy[r][lane] = angB.y; batch.angBz[r][lane] = angB.z;
+		batch.invIAx[r][lane] = iA.x; batch.invIAy[r][lane] = iA.y; batch.invIAz[r][lane] = iA.z;
+		batch.invIBx[r][lane] = iB.x; batch.invIBy[r][lane] = iB.y; batch.invIBz[r][lane] = iB.z;
+		batch.mass[r][lane] = k > 0.0f ? 1.0f / k : 0.0f;
+	}
+
+	// warm start, the friction impulse projected on the current tangents
+	batch.lambda[0][lane] = m_warmStarting ? contact.normalImpulse : 0.0f;
+	batch.lambda[1][lane] = m_warmStarting ? glm::dot(contact.frictionImpulse, d[1]) : 0.0f;
+	batch.lambda[2][lane] = m_warmStarting ? glm::dot(contact.frictionImpulse, d[2]) : 0.0f;
+
+	// target normal velocity: close a gap in one step, push out a fraction of the penetration
+	// past the slop, bounce if approaching fast enough to touch within the step
+	float bias = contact.depth < 0.0f ? contact.depth / dt : m_baumgarte / dt * std::max(contact.depth - m_slop, 0.0f);
+	glm::vec3 vA = a > 0 ? rb.getVel(bodyA) + glm::cross(rb.getAngularVel(bodyA), rA) : glm::vec3(0.0f);
+	glm::vec3 vB = b > 0 ? rb.getVel(bodyB) + glm::cross(rb.getAngularVel(bodyB), rB) : glm::vec3(0.0f);
+	float vn = glm::dot(vB - vA, contact.normal);
+	if (vn < -m_restitutionThreshold && contact.depth - vn * dt >= 0.0f)
+	{
+		bias = std::max(bias, -m_restitution * vn);
+	}
+	batch.bias[lane] = bias;
+	batch.friction[lane] = m_friction;
+}
+
+void ContactSolver::warmStart(const Batch &batch)
+{
+	for (int k = 0; k < 4; k++)
+	{
+		int a = batch.a[k], b = batch.b[k];
+		for (int r = 0; r < 3; r++)
+		{
+			float l = batch.lambda[r][k];
+			if (a > 0)
+			{
+				m_vx[a] -= batch.invMassA[k] * batch.dx[r][k] * l;
+				m_vy[a] -= batch.invMassA[k] * batch.dy[r][k] * l;
+				m_vz[a] -= batch.invMassA[k] * batch.dz[r][k] * l;
+				m_wx[a] -= batch.invIAx[r][k] * l;
+				m_wy[a] -= batch.invIAy[r][k] * l;
+				m_wz[a] -= batch.invIAz[r][k] * l;
+			}
+			if (b > 0)
+			{
+				m_vx[b] += batch.invMassB[k] * batch.dx[r][k] * l;
+				m_vy[b] += batch.invMassB[k] * batch.dy[r][k] * l;
+				m_vz[b] += batch.invMassB[k] * batch.dz[r][k] * l;
+				m_wx[b] += batch.invIBx[r][k] * l;
+				m_wy[b] += batch.invIBy[r][k] * l;
+				m_wz[b] += batch.invIBz[r][k] * l;
+			}
+		}
+	}
+}
+
+// for a row: rel = d . (vB - vA) + angB . wB - angA . wA, dlambda = mass (bias - rel), then
+// vA -= wA d dlambda, wA -= IA^-1 angA dlambda, vB += wB d dlambda, wB += IB^-1 angB dlambda
+float ContactSolver::solveBatch(Batch &batch)
+{
+	const int *a = batch.a;
+	const int *b = batch.b;
+
+	__m128 vAx = _mm_set_ps(m_vx[a[3]], m_vx[a[2]], m_vx[a[1]], m_vx[a[0]]);
+	__m128 vAy = _mm_set_ps(m_vy[a[3]], m_vy[a[2]], m_vy[a[1]], m_vy[a[0]]);
+	__m128 vAz = _mm_set_ps(m_vz[a[3]], m_vz[a[2]], m_vz[a[1]], m_vz[a[0]]);
+	__m128 wAx = _mm_set_ps(m_wx[a[3]], m_wx[a[2]], m_wx[a[1]], m_wx[a[0]]);
+	__m128 wAy = _mm_set_ps(m_wy[a[3]], m_wy[a[2]], m_wy[a[1]], m_wy[a[0]]);
+	__m128 wAz = _mm_set_ps(m_wz[a[3]], m_wz[a[2]], m_wz[a[1]], m_wz[a[0]]);
+	__m128 vBx = _mm_set_ps(m_vx[b[3]], m_vx[b[2]], m_vx[b[1]], m_vx[b[0]]);
+	__m128 vBy = _mm_set_ps(m_vy[b[3]], m_vy[b[2]], m_vy[b[1]], m_vy[b[0]]);
+	__m128 vBz = _mm_set_ps(m_vz[b[3]], m_vz[b[2]], m_vz[b[1]], m_vz[b[0]]);
+	__m128 wBx = _mm_set_ps(m_wx[b[3]], m_wx[b[2]], m_wx[b[1]], m_wx[b[0]]);
+	__m128 wBy = _mm_set_ps(m_wy[b[3]], m_wy[b[2]], m_wy[b[1]], m_wy[b[0]]);
+	__m128 wBz = _mm_set_ps(m_wz[b[3]], m_wz[b[2]], m_wz[b[1]], m_wz[b[0]]);
+	__m128 invMassA = _mm_loadu_ps(batch.invMassA);
+	__m128 invMassB = _mm_loadu_ps(batch.invMassB);
+	__m128 zero = _mm_setzero_ps();
+	__m128 residual = zero;
+
+	// friction first, both tangents against the same velocities, then clamped to the cone of
+	// the current normal impulse
+	__m128 delta[3];
+	for (int r = 1; r < 3; r++)
+	{
+		__m128 dx = _mm_loadu_ps(batch.dx[r]), dy = _mm_loadu_ps(batch.dy[r]), dz = _mm_loadu_ps(batch.dz[r]);
+		__m128 rel = madd(dx, _mm_sub_ps(vBx, vAx), madd(dy, _mm_sub_ps(vBy, vAy), _mm_mul_ps(dz, _mm_sub_ps(vBz, vAz))));
+		rel = madd(_mm_loadu_ps(batch.angBx[r]), wBx, madd(_mm_loadu_ps(batch.angBy[r]), wBy, madd(_mm_loadu_ps(batch.angBz[r]), wBz, rel)));
+		rel = _mm_sub_ps(rel, madd(_mm_loadu_ps(batch.angAx[r]), wAx, madd(_mm_loadu_ps(batch.angAy[r]), wAy, _mm_mul_ps(_mm_loadu_ps(batch.angAz[r]), wAz))));
+		delta[r] = _mm_sub_ps(zero, _mm_mul_ps(_mm_loadu_ps(batch.mass[r]), rel));
+	}
+	__m128 old1 = _mm_loadu_ps(batch.lambda[1]);
+	__m128 old2 = _mm_loadu_ps(batch.lambda[2]);
+	__m128 new1 = _mm_add_ps(old1, delta[1]);
+	__m128 new2 = _mm_add_ps(old2, delta[2]);
+	__m128 limit = _mm_mul_ps(_mm_loadu_ps(batch.friction), _mm_loadu_ps(batch.lambda[0]));
+	__m128 length = _mm_sqrt_ps(madd(new1, new1, _mm_mul_ps(new2, new2)));
+	__m128 scale = _mm_min_ps(_mm_set1_ps(1.0f), _mm_div_ps(limit, _mm_max_ps(length, _mm_set1_ps(1e-12f))));
+	new1 = _mm_mul_ps(new1, scale);
+	new2 = _mm_mul_ps(new2, scale);
+	delta[1] = _mm_sub_ps(new1, old1);
+	delta[2] = _mm_sub_ps(new2, old2);
+	_mm_storeu_ps(batch.lambda[1], new1);
+	_mm_storeu_ps(batch.lambda[2], new2);
+
+	for (int r = 1; r < 3; r++)
+	{
+		__m128 dA = _mm_mul_ps(invMassA, delta[r]);
+		__m128 dB = _mm_mul_ps(invMassB, delta[r]);
+		__m128 dx = _mm_loadu_ps(batch.dx[r]), dy = _mm_loadu_ps(batch.dy[r]), dz = _mm_loadu_ps(batch.dz[r]);
+		vAx = _mm_sub_ps(vAx, _mm_mul_ps(dx, dA)); vAy = _mm_sub_ps(vAy, _mm_mul_ps(dy, dA)); vAz = _mm_sub_ps(vAz, _mm_mul_ps(dz, dA));
+		vBx = madd(dx, dB, vBx); vBy = madd(dy, dB, vBy); vBz = madd(dz, dB, vBz);
+		wAx = _mm_sub_ps(wAx, _mm_mul_ps(_mm_loadu_ps(batch.invIAx[r]), delta[r]));
+		wAy = _mm_sub_ps(wAy, _mm_mul_ps(_mm_loadu_ps(batch.invIAy[r]), delta[r]));
+		wAz = _mm_sub_ps(wAz, _mm_mul_ps(_mm_loadu_ps(batch.invIAz[r]), delta[r]));
+		wBx = madd(_mm_loadu_ps(batch.invIBx[r]), delta[r], wBx);
+		wBy = madd(_mm_loadu_ps(batch.invIBy[r]), delta[r], wBy);
+		wBz = madd(_mm_loadu_ps(batch.invIBz[r]), delta[r], wBz);
+		residual = madd(delta[r], delta[r], residual);
+	}
+
+	// non-penetration, the accumulated impulse only pushes
+	{
+		__m128 dx = _mm_loadu_ps(batch.dx[0]), dy = _mm_loadu_ps(batch.dy[0]), dz = _mm_loadu_ps(batch.dz[0]);
+		__m128 rel = madd(dx, _mm_sub_ps(vBx, vAx), madd(dy, _mm_sub_ps(vBy, vAy), _mm_mul_ps(dz, _mm_sub_ps(vBz, vAz))));
+		rel = madd(_mm_loadu_ps(batch.angBx[0]), wBx, madd(_mm_loadu_ps(batch.angBy[0]), wBy, madd(_mm_loadu_ps(batch.angBz[0]), wBz, rel)));
+		rel = _mm_sub_ps(rel, madd(_mm_loadu_ps(batch.angAx[0]), wAx, madd(_mm_loadu_ps(batch.angAy[0]), wAy, _mm_mul_ps(_mm_loadu_ps(batch.angAz[0]), wAz))));
+		__m128 old = _mm_loadu_ps(batch.lambda[0]);
+		__m128 lambda = _mm_max_ps(zero, madd(_mm_loadu_ps(batch.mass[0]), _mm_sub_ps(_mm_loadu_ps(batch.bias), rel), old));
+		__m128 d = _mm_sub_ps(lambda, old);
+		_mm_storeu_ps(batch.lambda[0], lambda);
+
+		__m128 dA = _mm_mul_ps(invMassA, d);
+		__m128 dB = _mm_mul_ps(invMassB, d);
+		vAx = _mm_sub_ps(vAx, _mm_mul_ps(dx, dA)); vAy = _mm_sub_ps(vAy, _mm_mul_ps(dy, dA)); vAz = _mm_sub_ps(vAz, _mm_mul_ps(dz, dA));
+		vBx = madd(dx, dB, vBx); vBy = madd(dy, dB, vBy); vBz = madd(dz, dB, vBz);
+		wAx = _mm_sub_ps(wAx, _mm_mul_ps(_mm_loadu_ps(batch.invIAx[0]), d));
+		wAy = _mm_sub_ps(wAy, _mm_mul_ps(_mm_loadu_ps(batch.invIAy[0]), d));
+		wAz = _mm_sub_ps(wAz, _mm_mul_ps(_mm_loadu_ps(batch.invIAz[0]), d));
+		wBx = madd(_mm_loadu_ps(batch.invIBx[0]), d, wBx);
+		wBy = madd(_mm_loadu_ps(batch.invIBy[0]), d, wBy);
+		wBz = madd(_mm_loadu_ps(batch.invIBz[0]), d, wBz);
+		residual = madd(d, d, residual);
+	}
+
+	// the lanes share no moving body, so the scatter is conflict free; the world is never written
+	float v[12][4];
+	_mm_storeu_ps(v[0], vAx); _mm_storeu_ps(v[1], vAy); _mm_storeu_ps(v[2], vAz);
+	_mm_storeu_ps(v[3], wAx); _mm_storeu_ps(v[4], wAy); _mm_storeu_ps(v[5], wAz);
+	_mm_storeu_ps(v[6], vBx); _mm_storeu_ps(v[7], vBy); _mm_storeu_ps(v[8], vBz);
+	_mm_storeu_ps(v[9], wBx); _mm_storeu_ps(v[10], wBy); _mm_storeu_ps(v[11], wBz);
+	for (int k = 0; k < 4; k++)
+	{
+		if (a[k] > 0)
+		{
+			m_vx[a[k]] = v[0][k]; m_vy[a[k]] = v[1][k]; m_vz[a[k]] = v[2][k];
+			m_wx[a[k]] = v[3][k]; m_wy[a[k]] = v[4][k]; m_wz[a[k]] = v[5][k];
+		}
+		if (b[k] > 0)
+		{
+			m_vx[b[k]] = v[6][k]; m_vy[b[k]] = v[7][k]; m_vz[b[k]] = v[8][k];
+			m_wx[b[k]] = v[9][k]; m_wy[b[k]] = v[10][k]; m_wz[b[k]] = v[11][k];
+		}
+	}
+
+	float sum[4];
+	_mm_storeu_ps(sum, residual);
+	return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+void ContactSolver::solveTask(Task &task)
+{
+	// a split task runs each colour on every thread; the others run inside the loop over
+	// the tasks, where the if clause keeps them on their own thread
+	int colors = (int)task.colorStart.size() - 1;
+	bool split = task.split;
+	if (m_warmStarting)
+	{
+		for (int k = 0; k < colors; k++)
+		{
+			int start = task.colorStart[k], end = task.colorStart[k + 1];
+			if (task.serialColor && k == colors - 1)
+			{
+				for (int i = start; i < end; i++)
+				{
+					warmStart(task.batches[i]);
+				}
+			}
+			else
+			{
+				#pragma omp parallel for if(split)
+				for (int i = start; i < end; i++)
+				{
+					warmStart(task.batches[i]);
+				}
+			}
+		}
+	}
+
+	task.residuals.assign(m_iterations, 0.0f);
+	for (int iteration = 0; iteration < m_iterations; iteration++)
+	{
+		float residual = 0.0f;
+		for (int k = 0; k < colors; k++)
+		{
+			int start = task.colorStart[k], end = task.colorStart[k + 1];
+			if (task.serialColor && k == colors - 1)
+			{
+				for (int i = start; i < end; i++)
+				{
+					residual += solveBatch(task.batches[i]);
+				}
+			}
+			else
+			{
+				float sum = 0.0f;
+				#pragma omp parallel for reduction(+:sum) if(split)
+				for (int i = start; i < end; i++)
+				{
+					sum += solveBatch(task.batches[i]);
+				}
+				residual += sum;
+			}
+		}
+		task.residuals[iteration] = residual;
+	}
+}
+
+void ContactSolver::solve(RigidBodySystem &rb, std::vector<Contact> &contacts, float dt)
+{
+	m_residuals.clear();
+	m_islandCount = 0;
+	m_taskCount = 0;
+	int m = (int)contacts.size();
+	if (m == 0)
+	{
+		m_solverBody.clear();
+		return;
+	}
+
+	// solver bodies: the static world, then the moving bodies touched by contacts and joints
+	m_solverBody.assign(rb.getCount(), -1);
+	m_body.assign(1, -1);
+	m_vx.assign(1, 0.0f); m_vy.assign(1, 0.0f); m_vz.assign(1, 0.0f);
+	m_wx.assign(1, 0.0f); m_wy.assign(1, 0.0f); m_wz.assign(1, 0.0f);
+	for (int c = 0; c < m; c++)
+	{
+		solverBody(rb, contacts[c].bodyA);
+		solverBody(rb, contacts[c].bodyB);
+	}
+	for (int j = 0; j < (int)m_joints.size(); j++)
+	{
+		solverBody(rb, m_joints[j].bodyA);
+		solverBody(rb, m_joints[j].bodyB);
+	}
+
+	buildTasks(contacts);
+
+	m_used.assign(m_body.size(), 0ull);
+	m_color.resize(m);
+	m_contactBatch.resize(m);
+	int tasks = m_taskCount;
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < tasks; t++)
+	{
+		buildBatches(contacts, t);
+	}
+
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		int slot = m_contactBatch[c];
+		prepare(rb, contacts[c], m_tasks[m_contactTask[c]].batches[slot / 4], slot % 4, dt);
+	}
+
+	// the small tasks one per thread, then the split islands with every thread on each
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < tasks; t++)
+	{
+		if (!m_tasks[t].split)
+		{
+			solveTask(m_tasks[t]);
+		}
+	}
+	for (int t = 0; t < tasks; t++)
+	{
+		if (m_tasks[t].split)
+		{
+			solveTask(m_tasks[t]);
+		}
+	}
+
+	for (int iteration = 0; iteration < m_iterations; iteration++)
+	{
+		float residual = 0.0f;
+		for (int t = 0; t < tasks; t++)
+		{
+			residual += m_tasks[t].residuals[iteration];
+		}
+		m_residuals.push_back(std::sqrt(residual / (3 * m)));
+	}
+
+	// accumulated impulses back to the contacts for the next warm start
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		const Batch &batch = m_tasks[m_contactTask[c]].batches[m_contactBatch[c] / 4];
+		int lane = m_contactBatch[c] % 4;
+		contacts[c].normalImpulse = batch.lambda[0][lane];
+		contacts[c].frictionImpulse = batch.lambda[1][lane] * glm::vec3(batch.dx[1][lane], batch.dy[1][lane], batch.dz[1][lane])
+			+ batch.lambda[2][lane] * glm::vec3(batch.dx[2][lane], batch.dy[2][lane], batch.dz[2][lane]);
+	}
+
+	// and the velocities back to the bodies
+	int bodies = (int)m_body.size();
+	#pragma omp parallel for
+	for (int s = 1; s < bodies; s++)
+	{
+		rb.setVel(m_body[s], glm::vec3(m_vx[s], m_vy[s], m_vz[s]));
+		rb.setAngularVel(m_body[s], glm::vec3(m_wx[s], m_wy[s], m_wz[s]));
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "RigidBodySystem.h"
+#include "Islands.h"
+
+// contact point between two rigid bodies, found by the narrowphase
+struct Contact
+{
+	int bodyA;
+	int bodyB;
+	glm::vec3 point; // world position, halfway between the surfaces
+	glm::vec3 normal; // unit, from A to B
+	float depth; // penetration, negative while the surfaces are still apart
+
+	// accumulated impulses: the warm start on input, the result of the solve on output
+	float normalImpulse;
+	glm::vec3 frictionImpulse; // world axes
+
+	// where the narrowphase keeps the point between steps (pair cache index and point)
+	int pair;
+	int cachePoint;
+};
+
+/*
+** CONTACT SOLVER
+** Sequential impulses (projected Gauss-Seidel on the velocities) for rigid body
+** contacts with Coulomb friction: every contact has a non-penetration row along the
+** normal, clamped to push only, and two friction rows whose impulse is clamped to the
+** friction cone of the normal impulse. Penetration is removed by a Baumgarte velocity
+** bias, contacts that are still apart (speculative) allow the approach that closes the
+** gap, and restitution applies above a threshold speed.
+** The contacts are coloured like the XPBD cloth constraints, so that the contacts of a
+** colour share no moving body, and stored colour by colour in batches of four, one
+** float array of four per quantity, so every row of a batch is solved in SSE registers
+** and the batches of a colour in parallel. Gauss-Seidel ordering holds between colours.
+** Accumulated impulses are warm started from the previous step (the pair cache keeps
+** them) and the change of impulse is tracked per iteration as a residual.
+** The moving bodies fall into islands, joined by contacts and joints; islands share no
+** moving body, so each is solved on its own. Small islands are gathered into tasks of
+** at least a task size of contacts, solved one task per thread with their colours in
+** order; an island past the split size is a task of its own, its colours split over
+** every thread as above.
+*/
+class ContactSolver
+{
+public:
+	ContactSolver();
+	~ContactSolver();
+
+	/*
+	** GET METHODS
+	*/
+	int getIterations() const { return m_iterations; }
+	// root mean square impulse change of every row in each iteration of the last solve
+	const std::vector<float>& getResiduals() const { return m_residuals; }
+	// islands of moving bodies that have contacts or joints, and the tasks solving them
+	int getIslandCount() const { return m_islandCount; }
+	int getTaskCount() const { return m_taskCount; }
+	// island of a body in the last solve, -1 for a body without contacts or joints, or fixed
+	int getIsland(int body) const;
+	// the most colours of any task, and the batches of all
+	int getColorCount() const;
+	int getBatchCount() const;
+
+	/*
+	** SET METHODS
+	*/
+	void setIterations(int iterations) { m_iterations = iterations; }
+	void setFriction(float mu) { m_friction = mu; }
+	void setRestitution(float e) { m_restitution = e; }
+	// approach speed under which contacts don't bounce
+	void setRestitutionThreshold(float speed) { m_restitutionThreshold = speed; }
+	// fraction of the penetration removed per step, and the penetration left alone
+	void setBaumgarte(float beta) { m_baumgarte = beta; }
+	void setSlop(float slop) { m_slop = slop; }
+	void setWarmStarting(bool warmStarting) { m_warmStarting = warmStarting; }
+	// pairs of bodies held together by joints, which put them in the same island
+	void setJoints(const std::vector<BodyPair> &joints) { m_joints = joints; }
+	// contacts gathered into a task of small islands, and those of an island solved by every thread
+	void setTaskSize(int contacts) { m_taskSize = contacts; }
+	void setSplitSize(int contacts) { m_splitSize = contacts; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// solve the contacts on the velocities of the bodies (after the velocity half of the step)
+	// and write the accumulated impulses back into the contacts
+	void solve(RigidBodySystem &rb, std::vector<Contact> &contacts, float dt);
+
+private:
+	// rows of four contacts: one float per contact for every quantity
+	struct Batch
+	{
+		int a[4], b[4]; // solver bodies, 0 is the static world
+		float dx[3][4], dy[3][4], dz[3][4]; // row directions: normal, tangent 1, tangent 2
+		float angAx[3][4], angAy[3][4], angAz[3][4]; // rA x d
+		float angBx[3][4], angBy[3][4], angBz[3][4]; // rB x d
+		float invIAx[3][4], invIAy[3][4], invIAz[3][4]; // IA^-1 (rA x d)
+		float invIBx[3][4], invIBy[3][4], invIBz[3][4]; // IB^-1 (rB x d)
+		float mass[3][4]; // effective mass of the row
+		float lambda[3][4]; // accumulated impulse
+		float invMassA[4], invMassB[4];
+		float bias[4]; // target normal velocity
+		float friction[4];
+	};
+
+	// islands solved together, their contacts coloured and in batches
+	struct Task
+	{
+		int begin, end; // contacts at [begin, end) of m_order
+		bool split; // colours solved by every thread
+		std::vector<Batch> batches;
+		std::vector<int> colorStart; // batches of colour k at [colorStart[k], colorStart[k + 1])
+		bool serialColor; // the last colour holds the contacts that found no free colour
+		std::vector<float> residuals; // sum of the squared impulse changes per iteration
+	};
+
+	// solver body of a body, adding it the first time
+	int solverBody(const RigidBodySystem &rb, int body);
+	// islands of the solver bodies, the contacts grouped by island and the islands into tasks
+	void buildTasks(const std::vector<Contact> &contacts);
+	// colour the contacts of a task and lay them out in batches
+	void buildBatches(const std::vector<Contact> &contacts, int task);
+	// fill the rows of a batch lane from a contact
+	void prepare(const RigidBodySystem &rb, const Contact &contact, Batch &batch, int lane, float dt);
+	// apply the accumulated impulses of a batch (warm start)
+	void warmStart(const Batch &batch);
+	// one Gauss-Seidel sweep over a batch, returns the sum of the squared impulse changes
+	float solveBatch(Batch &batch);
+	// warm start and iterations of a task
+	void solveTask(Task &task);
+
+	int m_iterations;
+	float m_friction;
+	float m_restitution;
+	float m_restitutionThreshold;
+	float m_baumgarte;
+	float m_slop;
+	bool m_warmStarting;
+	int m_taskSize;
+	int m_splitSize;
+	std::vector<float> m_residuals;
+	std::vector<BodyPair> m_joints;
+
+	// velocities of the bodies touched by contacts
+	std::vector<int> m_solverBody; // per body, -1 if not touched
+	std::vector<int> m_body; // per solver body
+	std::vector<float> m_vx, m_vy, m_vz, m_wx, m_wy, m_wz;
+
+	// islands over the solver bodies, from the contacts and joints
+	Islands m_islands;
+	std::vector<BodyPair> m_edges;
+	int m_islandCount;
+
+	// contacts in island order, the tasks over them (kept with their storage between solves),
+	// and the task, batch and lane of every contact
+	std::vector<int> m_order;
+	std::vector<Task> m_tasks;
+	int m_taskCount;
+	std::vector<int> m_contactTask;
+	std::vector<int> m_contactBatch;
+	std::vector<int> m_color;
+	std::vector<unsigned long long> m_used; // colours taken per solver body
+};
@@ -0,0 +1,527 @@
+#include <algorithm>
+
+#include "DynamicTree.h"
+
+
+DynamicTree::DynamicTree()
+{
+	m_root = NULL_NODE;
+	m_freeList = NULL_NODE;
+	m_proxyCount = 0;
+
+	m_margin = 0.1f;
+	m_displacementMultiplier = 2.0f;
+}
+
+
+DynamicTree::~DynamicTree()
+{
+}
+
+
+/*
+** NODE ALLOCATION
+*/
+
+// take a node from the free list, growing the pool when it is empty
+int DynamicTree::allocateNode()
+{
+	if (m_freeList == NULL_NODE)
+	{
+		TreeNode node;
+		node.parent = NULL_NODE;
+		node.left = NULL_NODE;
+		node.right = NULL_NODE;
+		node.height = -1;
+		node.bodyId = -1;
+		node.moved = false;
+		m_nodes.push_back(node);
+		m_freeList = (int)m_nodes.size() - 1;
+	}
+
+	int nodeId = m_freeList;
+	m_freeList = m_nodes[nodeId].parent;
+
+	TreeNode &node = m_nodes[nodeId];
+	node.parent = NULL_NODE;
+	node.left = NULL_NODE;
+	node.right = NULL_NODE;
+	node.height = 0;
+	node.bodyId = -1;
+	node.moved = false;
+	return nodeId;
+}
+
+void DynamicTree::freeNode(int nodeId)
+{
+	m_nodes[nodeId].parent = m_freeList;
+	m_nodes[nodeId].height = -1;
+	m_freeList = nodeId;
+}
+
+
+/*
+** PROXY METHODS
+*/
+
+int DynamicTree::createProxy(const AABB &aabb, int bodyId)
+{
+	int proxyId = allocateNode();
+
+	m_nodes[proxyId].aabb = aabb;
+	m_nodes[proxyId].aabb.fatten(m_margin);
+	m_nodes[proxyId].bodyId = bodyId;
+
+	insertLeaf(proxyId);
+	bufferMove(proxyId);
+	m_proxyCount++;
+
+	return proxyId;
+}
+
+void DynamicTree::destroyProxy(int proxyId)
+{
+	unbufferMove(proxyId);
+	removeLeaf(proxyId);
+	freeNode(proxyId);
+	m_proxyCount--;
+}
+
+bool DynamicTree::moveProxy(int proxyId, const AABB &aabb, const glm::vec3 &displacement)
+{
+	// still inside the fat box: nothing to do
+	if (m_nodes[proxyId].aabb.contains(aabb))
+	{
+		return false;
+	}
+
+	removeLeaf(proxyId);
+
+	// fatten the box and stretch it in the direction of motion
+	AABB fat = aabb;
+	fat.fatten(m_margin);
+	glm::vec3 d = m_displacementMultiplier * displacement;
+	for (int j = 0; j < 3; j++)
+	{
+		if (d[j] < 0.0f)
+		{
+			fat.min[j] += d[j];
+		}
+		else
+		{
+			fat.max[j] += d[j];
+		}
+	}
+	m_nodes[proxyId].aabb = fat;
+
+	insertLeaf(proxyId);
+	bufferMove(proxyId);
+
+	return true;
+}
+
+void DynamicTree::bufferMove(int proxyId)
+{
+	if (!m_nodes[proxyId].moved)
+	{
+		m_nodes[proxyId].moved = true;
+		m_moveBuffer.push_back(proxyId);
+	}
+}
+
+void DynamicTree::unbufferMove(int proxyId)
+{
+	if (m_nodes[proxyId].moved)
+	{
+		m_nodes[proxyId].moved = false;
+		m_moveBuffer.erase(std::remove(m_moveBuffer.begin(), m_moveBuffer.end(), proxyId), m_moveBuffer.end());
+	}
+}
+
+
+/*
+** TREE MAINTENANCE
+*/
+
+// insert a leaf, choosing the sibling that gives the smallest increase in surface area
+void DynamicTree::insertLeaf(int leaf)
+{
+	if (m_root == NULL_NODE)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// find the best sibling
+	AABB leafAABB = m_nodes[leaf].aabb;
+	int index = m_root;
+	while (!m_nodes[index].isLeaf())
+	{
+		int left = m_nodes[index].left;
+		int right = m_nodes[index].right;
+
+		float area = m_nodes[index].aabb.getSurfaceArea();
+		float combinedArea = AABB::combine(m_nodes[index].aabb, leafAABB).getSurfaceArea();
+
+		// cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f * combinedArea;
+		// minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float costLeft = AABB::combine(leafAABB, m_nodes[left].aabb).getSurfaceArea() + inheritanceCost;
+		if (!m_nodes[left].isLeaf())
+		{
+			costLeft -= m_nodes[left].aabb.getSurfaceArea();
+		}
+
+		float costRight = AABB::combine(leafAABB, m_nodes[right].aabb).getSurfaceArea() + inheritanceCost;
+		if (!m_nodes[right].isLeaf())
+		{
+			costRight -= m_nodes[right].aabb.getSurfaceArea();
+		}
+
+		if (cost < costLeft && cost < costRight)
+		{
+			break;
+		}
+
+		index = costLeft < costRight ? left : right;
+	}
+
+	int sibling = index;
+
+	// create a new parent
+	int oldParent = m_nodes[sibling].parent;
+	int newParent = allocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].aabb = AABB::combine(leafAABB, m_nodes[sibling].aabb);
+	m_nodes[newParent].height = m_nodes[sibling].height + 1;
+	m_nodes[newParent].left = sibling;
+	m_nodes[newParent].right = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	if (oldParent != NULL_NODE)
+	{
+		if (m_nodes[oldParent].left == sibling)
+		{
+			m_nodes[oldParent].left = newParent;
+		}
+		else
+		{
+			m_nodes[oldParent].right = newParent;
+		}
+	}
+	else
+	{
+		m_root = newParent;
+	}
+
+	// walk back up fixing heights and boxes
+	index = m_nodes[leaf].parent;
+	while (index != NULL_NODE)
+	{
+		index = balance(index);
+
+		int left = m_nodes[index].left;
+		int right = m_nodes[index].right;
+		m_nodes[index].height = 1 + std::max(m_nodes[left].height, m_nodes[right].height);
+		m_nodes[index].aabb = AABB::combine(m_nodes[left].aabb, m_nodes[right].aabb);
+
+		index = m_nodes[index].parent;
+	}
+}
+
+void DynamicTree::removeLeaf(int leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = NULL_NODE;
+		return;
+	}
+
+	int parent = m_nodes[leaf].parent;
+	int grandParent = m_nodes[parent].parent;
+	int sibling = m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left;
+
+	if (grandParent == NULL_NODE)
+	{
+		m_root = sibling;
+		m_nodes[sibling].parent = NULL_NODE;
+		freeNode(parent);
+		return;
+	}
+
+	// replace the parent by the sibling
+	if (m_nodes[grandParent].left == parent)
+	{
+		m_nodes[grandParent].left = sibling;
+	}
+	else
+	{
+		m_nodes[grandParent].right = sibling;
+	}
+	m_nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	int index = grandParent;
+	while (index != NULL_NODE)
+	{
+		index = balance(index);
+
+		int left = m_nodes[index].left;
+		int right = m_nodes[index].right;
+		m_nodes[index].aabb = AABB::combine(m_nodes[left].aabb, m_nodes[right].aabb);
+		m_nodes[index].height = 1 + std::max(m_nodes[left].height, m_nodes[right].height);
+
+		index = m_nodes[index].parent;
+	}
+}
+
+// perform a left or right rotation if node A is imbalanced, returns the new root of the subtree
+int DynamicTree::balance(int iA)
+{
+	TreeNode *A = &m_nodes[iA];
+	if (A->isLeaf() || A->height < 2)
+	{
+		return iA;
+	}
+
+	int iB = A->left;
+	int iC = A->right;
+	TreeNode *B = &m_nodes[iB];
+	TreeNode *C = &m_nodes[iC];
+
+	int bal = C->height - B->height;
+
+	// rotate C up
+	if (bal > 1)
+	{
+		int iF = C->left;
+		int iG = C->right;
+		TreeNode *F = &m_nodes[iF];
+		TreeNode *G = &m_nodes[iG];
+
+		// swap A and C
+		C->left = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if (C->parent != NULL_NODE)
+		{
+			if (m_nodes[C->parent].left == iA)
+			{
+				m_nodes[C->parent].left = iC;
+			}
+			else
+			{
+				m_nodes[C->parent].right = iC;
+			}
+		}
+		else
+		{
+			m_root = iC;
+		}
+
+		// keep the taller of F and G under C
+		if (F->height > G->height)
+		{
+			C->right = iF;
+			A->right = iG;
+			G->parent = iA;
+			A->aabb = AABB::combine(B->aabb, G->aabb);
+			C->aabb = AABB::combine(A->aabb, F->aabb);
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else
+		{
+			C->right = iG;
+			A->right = iF;
+			F->parent = iA;
+			A->aabb = AABB::combine(B->aabb, F->aabb);
+			C->aabb = AABB::combine(A->aabb, G->aabb);
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if (bal < -1)
+	{
+		int iD = B->left;
+		int iE = B->right;
+		TreeNode *D = &m_nodes[iD];
+		TreeNode *E = &m_nodes[iE];
+
+		// swap A and B
+		B->left = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if (B->parent != NULL_NODE)
+		{
+			if (m_nodes[B->parent].left == iA)
+			{
+				m_nodes[B->parent].left = iB;
+			}
+			else
+			{
+				m_nodes[B->parent].right = iB;
+			}
+		}
+		else
+		{
+			m_root = iB;
+		}
+
+		// keep the taller of D and E under B
+		if (D->height > E->height)
+		{
+			B->right = iD;
+			A->left = iE;
+			E->parent = iA;
+			A->aabb = AABB::combine(C->aabb, E->aabb);
+			B->aabb = AABB::combine(A->aabb, D->aabb);
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else
+		{
+			B->right = iE;
+			A->left = iD;
+			D->parent = iA;
+			A->aabb = AABB::combine(C->aabb, D->aabb);
+			B->aabb = AABB::combine(A->aabb, E->aabb);
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+
+/*
+** QUERY METHODS
+*/
+
+void DynamicTree::query(const AABB &aabb, std::vector<int> &proxies) const
+{
+	if (m_root == NULL_NODE)
+	{
+		return;
+	}
+
+	std::vector<int> stack;
+	stack.push_back(m_root);
+	while (!stack.empty())
+	{
+		int nodeId = stack.back();
+		stack.pop_back();
+
+		const TreeNode &node = m_nodes[nodeId];
+		if (!node.aabb.overlaps(aabb))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			proxies.push_back(nodeId);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+// only proxies in the move buffer are queried, so resting bodies cost nothing
+void DynamicTree::updatePairs(std::vector<BodyPair> &pairs)
+{
+	pairs.clear();
+
+	for (int i = 0; i < (int)m_moveBuffer.size(); i++)
+	{
+		int proxyId = m_moveBuffer[i];
+		const AABB &fat = m_nodes[proxyId].aabb;
+
+		m_queryStack.clear();
+		if (m_root != NULL_NODE)
+		{
+			m_queryStack.push_back(m_root);
+		}
+
+		while (!m_queryStack.empty())
+		{
+			int nodeId = m_queryStack.back();
+			m_queryStack.pop_back();
+
+			const TreeNode &node = m_nodes[nodeId];
+			if (!node.aabb.overlaps(fat))
+			{
+				continue;
+			}
+
+			if (!node.isLeaf())
+			{
+				m_queryStack.push_back(node.left);
+				m_queryStack.push_back(node.right);
+				continue;
+			}
+
+			if (nodeId == proxyId || node.bodyId == m_nodes[proxyId].bodyId)
+			{
+				continue;
+			}
+
+			// both proxies moved: only report the pair once
+			if (node.moved && nodeId > proxyId)
+			{
+				continue;
+			}
+
+			BodyPair pair;
+			pair.bodyA = std::min(m_nodes[proxyId].bodyId, node.bodyId);
+			pair.bodyB = std::max(m_nodes[proxyId].bodyId, node.bodyId);
+			pairs.push_back(pair);
+		}
+	}
+
+	for (int i = 0; i < (int)m_moveBuffer.size(); i++)
+	{
+		m_nodes[m_moveBuffer[i]].moved = false;
+	}
+	m_moveBuffer.clear();
+
+	// a body can own several proxies, so remove duplicates
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+float DynamicTree::getAreaRatio() const
+{
+	if (m_root == NULL_NODE)
+	{
+		return 0.0f;
+	}
+
+	float rootArea = m_nodes[m_root].aabb.getSurfaceArea();
+	float totalArea = 0.0f;
+	for (int i = 0; i < (int)m_nodes.size(); i++)
+	{
+		if (m_nodes[i].height > 0)
+		{
+			totalArea += m_nodes[i].aabb.getSurfaceArea();
+		}
+	}
+
+	return rootArea > 0.0f ? totalArea / rootArea : 0.0f;
+}
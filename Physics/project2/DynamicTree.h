@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "Broadphase.h"
+
+/*
+** DYNAMIC AABB TREE
+** Incremental bounding volume hierarchy used as a broadphase. Each proxy stores a
+** fat AABB so that small movements don't require the tree to be updated, and the
+** tree is kept balanced with AVL style rotations.
+*/
+class DynamicTree : public Broadphase
+{
+public:
+	DynamicTree();
+	~DynamicTree();
+
+	static const int NULL_NODE = -1;
+
+	/*
+	** GET METHODS
+	*/
+	int getBodyId(int proxyId) const { return m_nodes[proxyId].bodyId; }
+	const AABB& getFatAABB(int proxyId) const { return m_nodes[proxyId].aabb; }
+	int getHeight() const { return m_root == NULL_NODE ? 0 : m_nodes[m_root].height; }
+	const char* getName() const { return "dynamic tree"; }
+	int getProxyCount() const { return m_proxyCount; }
+	float getMargin() const { return m_margin; }
+
+	/*
+	** SET METHODS
+	*/
+	// margin added around each proxy AABB
+	void setMargin(float margin) { m_margin = margin; }
+	// how far ahead (in multiples of the displacement) the fat AABB is extended when a proxy moves
+	void setDisplacementMultiplier(float mult) { m_displacementMultiplier = mult; }
+
+	/*
+	** PROXY METHODS
+	*/
+	// add a proxy for the body with the given handle, returns the proxy id
+	int createProxy(const AABB &aabb, int bodyId);
+	// remove a proxy from the tree
+	void destroyProxy(int proxyId);
+	// move a proxy. Returns true if the fat AABB had to be reinserted.
+	bool moveProxy(int proxyId, const AABB &aabb, const glm::vec3 &displacement);
+
+	/*
+	** QUERY METHODS
+	*/
+	// collect all proxies whose fat AABB overlaps the box
+	void query(const AABB &aabb, std::vector<int> &proxies) const;
+	// find the new candidate pairs of the proxies that moved since the last call
+	void updatePairs(std::vector<BodyPair> &pairs);
+
+	// sum of the surface area of all internal nodes relative to the root, a measure of tree quality
+	float getAreaRatio() const;
+
+private:
+	struct TreeNode
+	{
+		AABB aabb;
+		int parent; // also used as next pointer in the free list
+		int left;
+		int right;
+		int height; // leaf = 0, free node = -1
+		int bodyId;
+		bool moved;
+
+		bool isLeaf() const { return left == NULL_NODE; }
+	};
+
+	int allocateNode();
+	void freeNode(int nodeId);
+
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int nodeId);
+
+	void bufferMove(int proxyId);
+	void unbufferMove(int proxyId);
+
+	std::vector<TreeNode> m_nodes;
+	int m_root;
+	int m_freeList;
+	int m_proxyCount;
+
+	float m_margin;
+	float m_displacementMultiplier;
+
+	std::vector<int> m_moveBuffer; // proxies that moved since the last pair update
+	std::vector<int> m_queryStack;
+};
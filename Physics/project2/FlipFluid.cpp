@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FlipFluid.h"
+#include "Parallel.h"
+
+
+FlipFluid::FlipFluid()
+{
+	m_mode = PIC_FLIP;
+	m_flipRatio = 0.95f;
+	m_tolerance = 1e-4f;
+	m_maxIterations = 200;
+	m_pressureIterations = 0;
+
+	setDomain(Cube(), 0.1f);
+}
+
+
+FlipFluid::~FlipFluid()
+{
+}
+
+void FlipFluid::setDomain(const Cube &cube, float cellSize)
+{
+	m_origin = cube.origin;
+	m_bound = cube.bound;
+	m_h = cellSize;
+	m_dims = glm::max(glm::ivec3(glm::ceil((cube.bound - cube.origin) / cellSize)), glm::ivec3(1));
+
+	for (int c = 0; c < 3; c++)
+	{
+		m_faceDims[c] = m_dims;
+		m_faceDims[c][c] += 1;
+		int faces = m_faceDims[c].x * m_faceDims[c].y * m_faceDims[c].z;
+		m_vel[c].assign(faces, 0.0f);
+		m_old[c].assign(faces, 0.0f);
+		m_weight[c].assign(faces, 0.0f);
+	}
+
+	int cells = m_dims.x * m_dims.y * m_dims.z;
+	m_fluid.assign(cells, 0);
+	m_p.assign(cells, 0.0f);
+	m_r.assign(cells, 0.0f);
+	m_z.assign(cells, 0.0f);
+	m_d.assign(cells, 0.0f);
+	m_q.assign(cells, 0.0f);
+	m_diag.assign(cells, 0.0f);
+
+	m_grid.setDomain(cube.origin, cube.bound, cellSize);
+}
+
+void FlipFluid::addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi)
+{
+	float spacing = 0.5f * m_h;
+	float mass = 1000.0f * spacing * spacing * spacing;
+	for (float z = lo.z + 0.5f * spacing; z < hi.z; z += spacing)
+	{
+		for (float y = lo.y + 0.5f * spacing; y < hi.y; y += spacing)
+		{
+			for (float x = lo.x + 0.5f * spacing; x < hi.x; x += spacing)
+			{
+				ps.addParticle(glm::vec3(x, y, z), glm::vec3(0.0f), mass);
+			}
+		}
+	}
+}
+
+void FlipFluid::faceWeights(int c, const glm::vec3 &p, glm::ivec3 &base, glm::vec3 &t) const
+{
+	// component c is stored on the faces normal to axis c, half a cell off along the other two axes
+	glm::vec3 offset(0.5f);
+	offset[c] = 0.0f;
+
+	glm::ivec3 dims = m_faceDims[c];
+	glm::vec3 g = (p - m_origin) / m_h - offset;
+	g = glm::clamp(g, glm::vec3(0.0f), glm::vec3(dims - 1));
+
+	base = glm::min(glm::ivec3(g), glm::max(dims - 2, glm::ivec3(0)));
+	t = g - glm::vec3(base);
+}
+
+
+/*
+** PARTICLE TO GRID
+*/
+
+// external forces act on the particles before the transfer
+void FlipFluid::applyForces(ParticleSystem &ps, float dt)
+{
+	ps.clearForces();
+	ps.applyForces();
+
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &invMass = ps.getInvMass();
+	int n = ps.getCount();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		vel[i] += force[i] * invMass[i] * dt;
+	}
+}
+
+void FlipFluid::particlesToGrid(const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	const std::vector<unsigned int> &cells = m_grid.getSortedCells();
+	int n = ps.getCount();
+	int slab = m_dims.x * m_dims.y;
+	bool apic = m_mode == APIC;
+
+	int threads = getMaxThreads();
+	m_tileK0.assign(threads, 0);
+	m_tileK1.assign(threads, 0);
+	for (int c = 0; c < 3; c++)
+	{
+		m_tileMom[c].resize(threads);
+		m_tileWeight[c].resize(threads);
+	}
+
+	#pragma omp parallel
+	{
+		int t = getThreadNum();
+		int nt = getNumThreads();
+		int begin = (int)((long long)n * t / nt);
+		int end = (int)((long long)n * (t + 1) / nt);
+
+		// the particles are in cell order so the chunk covers the z slabs of its first and last cell,
+		// the trilinear stencils reach one slab below and two face slabs above
+		if (begin < end)
+		{
+			m_tileK0[t] = std::max((int)(cells[begin] / slab) - 1, 0);
+			m_tileK1[t] = std::min((int)(cells[end - 1] / slab) + 2, m_dims.z + 1);
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			int faceSlab = m_faceDims[c].x * m_faceDims[c].y;
+			int k0 = m_tileK0[t];
+			std::vector<float> &mom = m_tileMom[c][t];
+			std::vector<float> &weight = m_tileWeight[c][t];
+			mom.assign((m_tileK1[t] - k0) * faceSlab, 0.0f);
+			weight.assign(mom.size(), 0.0f);
+
+			glm::vec3 offset(0.5f);
+			offset[c] = 0.0f;
+
+			for (int s = begin; s < end; s++)
+			{
+				int i = order[s];
+				glm::ivec3 base;
+				glm::vec3 f;
+				faceWeights(c, pos[i], base, f);
+
+				for (int dz = 0; dz < 2; dz++)
+				{
+					int k = std::min(base.z + dz, m_faceDims[c].z - 1);
+					float wz = dz ? f.z : 1.0f - f.z;
+					for (int dy = 0; dy < 2; dy++)
+					{
+						int j = std::min(base.y + dy, m_faceDims[c].y - 1);
+						float wy = dy ? f.y : 1.0f - f.y;
+						for (int dx = 0; dx < 2; dx++)
+						{
+							int l = std::min(base.x + dx, m_faceDims[c].x - 1);
+							float w = mass[i] * wz * wy * (dx ? f.x : 1.0f - f.x);
+
+							float v = vel[i][c];
+							if (apic)
+							{
+								glm::vec3 face = m_origin + (glm::vec3(l, j, k) + offset) * m_h;
+								v += glm::dot(m_affine[c][i], face - pos[i]);
+							}
+
+							int index = l + m_faceDims[c].x * (j + m_faceDims[c].y * (k - k0));
+							mom[index] += w * v;
+							weight[index] += w;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// sum the tiles slab by slab, every face slab is written by one thread only
+	for (int c = 0; c < 3; c++)
+	{
+		int faceSlab = m_faceDims[c].x * m_faceDims[c].y;
+		int slabs = m_faceDims[c].z;
+
+		#pragma omp parallel for
+		for (int k = 0; k < slabs; k++)
+		{
+			float *vel = &m_vel[c][k * faceSlab];
+			float *weight = &m_weight[c][k * faceSlab];
+			for (int f = 0; f < faceSlab; f++)
+			{
+				vel[f] = 0.0f;
+				weight[f] = 0.0f;
+			}
+
+			for (int t = 0; t < threads; t++)
+			{
+				if (k < m_tileK0[t] || k >= m_tileK1[t])
+				{
+					continue;
+				}
+				const float *tileMom = &m_tileMom[c][t][(k - m_tileK0[t]) * faceSlab];
+				const float *tileWeight = &m_tileWeight[c][t][(k - m_tileK0[t]) * faceSlab];
+				for (int f = 0; f < faceSlab; f++)
+				{
+					vel[f] += tileMom[f];
+					weight[f] += tileWeight[f];
+				}
+			}
+
+			for (int f = 0; f < faceSlab; f++)
+			{
+				vel[f] = weight[f] > 0.0f ? vel[f] / weight[f] : 0.0f;
+			}
+		}
+	}
+}
+
+
+/*
+** PRESSURE
+*/
+
+// a cell is liquid when it holds a particle, solid walls close the border faces
+void FlipFluid::markCells()
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int cell = cIndex(i, j, k);
+				m_fluid[cell] = m_grid.getCellEnd(cell) > m_grid.getCellStart(cell) ? 1 : 0;
+
+				// every open face (liquid or air neighbour) adds to the diagonal
+				int open = (i > 0) + (i < nx - 1) + (j > 0) + (j < ny - 1) + (k > 0) + (k < nz - 1);
+				m_diag[cell] = m_fluid[cell] ? (float)open : 0.0f;
+			}
+		}
+	}
+
+	// no flow through the walls
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			m_vel[0][fIndex(0, 0, j, k)] = 0.0f;
+			m_vel[0][fIndex(0, nx, j, k)] = 0.0f;
+		}
+		for (int i = 0; i < nx; i++)
+		{
+			m_vel[1][fIndex(1, i, 0, k)] = 0.0f;
+			m_vel[1][fIndex(1, i, ny, k)] = 0.0f;
+		}
+	}
+	#pragma omp parallel for
+	for (int j = 0; j < ny; j++)
+	{
+		for (int i = 0; i < nx; i++)
+		{
+			m_vel[2][fIndex(2, i, j, 0)] = 0.0f;
+			m_vel[2][fIndex(2, i, j, nz)] = 0.0f;
+		}
+	}
+}
+
+// y = A x over the liquid cells, air cells are zero pressure
+void FlipFluid::applyPressureMatrix(const std::vector<float> &x, std::vector<float> &y) const
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int cell = cIndex(i, j, k);
+				if (!m_fluid[cell])
+				{
+					y[cell] = 0.0f;
+					continue;
+				}
+
+				float sum = m_diag[cell] * x[cell];
+				if (i > 0 && m_fluid[cell - 1]) sum -= x[cell - 1];
+				if (i < nx - 1 && m_fluid[cell + 1]) sum -= x[cell + 1];
+				if (j > 0 && m_fluid[cell - nx]) sum -= x[cell - nx];
+				if (j < ny - 1 && m_fluid[cell + nx]) sum -= x[cell + nx];
+				if (k > 0 && m_fluid[cell - nx * ny]) sum -= x[cell - nx * ny];
+				if (k < nz - 1 && m_fluid[cell + nx * ny]) sum -= x[cell + nx * ny];
+				y[cell] = sum;
+			}
+		}
+	}
+}
+
+// Jacobi preconditioned conjugate gradients, warm started from the last pressure.
+// The pressure is scaled by dt / (rho h) so the face update is a plain difference.
+void FlipFluid::solvePressure()
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+	int cells = nx * ny * nz;
+	const std::vector<float> &u = m_vel[0], &v = m_vel[1], &w = m_vel[2];
+
+	// r = -div u - A p
+	applyPressureMatrix(m_p, m_q);
+
+	double bNorm = 0.0;
+	#pragma omp parallel for reduction(+:bNorm)
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int cell = cIndex(i, j, k);
+				if (!m_fluid[cell])
+				{
+					m_p[cell] = 0.0f;
+					m_r[cell] = 0.0f;
+					continue;
+				}
+				float div = u[fIndex(0, i + 1, j, k)] - u[fIndex(0, i, j, k)]
+					+ v[fIndex(1, i, j + 1, k)] - v[fIndex(1, i, j, k)]
+					+ w[fIndex(2, i, j, k + 1)] - w[fIndex(2, i, j, k)];
+				m_r[cell] = -div - m_q[cell];
+				bNorm += (double)div * div;
+			}
+		}
+	}
+
+	double rz = 0.0;
+	#pragma omp parallel for reduction(+:rz)
+	for (int c = 0; c < cells; c++)
+	{
+		m_z[c] = m_diag[c] > 0.0f ? m_r[c] / m_diag[c] : 0.0f;
+		m_d[c] = m_z[c];
+		rz += (double)m_r[c] * m_z[c];
+	}
+
+	double tol2 = (double)m_tolerance * m_tolerance * bNorm;
+	m_pressureIterations = 0;
+
+	while (m_pressureIterations < m_maxIterations)
+	{
+		applyPressureMatrix(m_d, m_q);
+
+		double dq = 0.0;
+		#pragma omp parallel for reduction(+:dq)
+		for (int c = 0; c < cells; c++)
+		{
+			dq += (double)m_d[c] * m_q[c];
+		}
+		if (dq <= 0.0)
+		{
+			break;
+		}
+		float alpha = (float)(rz / dq);
+
+		double rNorm = 0.0;
+		#pragma omp parallel for reduction(+:rNorm)
+		for (int c = 0; c < cells; c++)
+		{
+			m_p[c] += alpha * m_d[c];
+			m_r[c] -= alpha * m_q[c];
+			rNorm += (double)m_r[c] * m_r[c];
+		}
+		m_pressureIterations++;
+		if (rNorm <= tol2)
+		{
+			break;
+		}
+
+		double rzNew = 0.0;
+		#pragma omp parallel for reduction(+:rzNew)
+		for (int c = 0; c < cells; c++)
+		{
+			m_z[c] = m_diag[c] > 0.0f ? m_r[c] / m_diag[c] : 0.0f;
+			rzNew += (double)m_r[c] * m_z[c];
+		}
+		float beta = (float)(rzNew / rz);
+		rz = rzNew;
+
+		#pragma omp parallel for
+		for (int c = 0; c < cells; c++)
+		{
+			m_d[c] = m_z[c] + beta * m_d[c];
+		}
+	}
+
+	// subtract the pressure gradient on the inner faces next to liquid
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int cell = cIndex(i, j, k);
+				if (i > 0 && (m_fluid[cell] || m_fluid[cell - 1]))
+				{
+					m_vel[0][fIndex(0, i, j, k)] -= m_p[cell] - m_p[cell - 1];
+				}
+				if (j > 0 && (m_fluid[cell] || m_fluid[cell - nx]))
+				{
+					m_vel[1][fIndex(1, i, j, k)] -= m_p[cell] - m_p[cell - nx];
+				}
+				if (k > 0 && (m_fluid[cell] || m_fluid[cell - nx * ny]))
+				{
+					m_vel[2][fIndex(2, i, j, k)] -= m_p[cell] - m_p[cell - nx * ny];
+				}
+			}
+		}
+	}
+}
+
+
+/*
+** GRID TO PARTICLE
+*/
+
+void FlipFluid::gridToParticles(ParticleSystem &ps, float dt)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	int n = ps.getCount();
+	bool apic = m_mode == APIC;
+	float flip = m_flipRatio;
+	float invH = 1.0f / m_h;
+
+	// keep the particles a little inside the walls so they stay in the border cells
+	float eps = 1e-3f * m_h;
+	glm::vec3 lo = m_origin + eps;
+	glm::vec3 hi = m_bound - eps;
+
+	// in cell order for cache locality
+	#pragma omp parallel for
+	for (int s = 0; s < n; s++)
+	{
+		int i = order[s];
+		glm::vec3 v;
+
+		for (int c = 0; c < 3; c++)
+		{
+			glm::ivec3 base;
+			glm::vec3 f;
+			faceWeights(c, pos[i], base, f);
+
+			float pic = 0.0f;
+			float delta = 0.0f;
+			glm::vec3 affine(0.0f);
+
+			for (int dz = 0; dz < 2; dz++)
+			{
+				int k = std::min(base.z + dz, m_faceDims[c].z - 1);
+				float wz = dz ? f.z : 1.0f - f.z;
+				float gz = dz ? invH : -invH;
+				for (int dy = 0; dy < 2; dy++)
+				{
+					int j = std::min(base.y + dy, m_faceDims[c].y - 1);
+					float wy = dy ? f.y : 1.0f - f.y;
+					float gy = dy ? invH : -invH;
+					for (int dx = 0; dx < 2; dx++)
+					{
+						int l = std::min(base.x + dx, m_faceDims[c].x - 1);
+						float wx = dx ? f.x : 1.0f - f.x;
+						float gx = dx ? invH : -invH;
+
+						int index = fIndex(c, l, j, k);
+						float u = m_vel[c][index];
+						pic += wx * wy * wz * u;
+						delta += wx * wy * wz * (u - m_old[c][index]);
+						// gradient of the trilinear weight
+						affine += glm::vec3(gx * wy * wz, wx * gy * wz, wx * wy * gz) * u;
+					}
+				}
+			}
+
+			if (apic)
+			{
+				v[c] = pic;
+				m_affine[c][i] = affine;
+			}
+			else
+			{
+				v[c] = flip * (vel[i][c] + delta) + (1.0f - flip) * pic;
+			}
+		}
+
+		glm::vec3 p = pos[i] + v * dt;
+		for (int c = 0; c < 3; c++)
+		{
+			if (p[c] < lo[c] || p[c] > hi[c])
+			{
+				p[c] = glm::clamp(p[c], lo[c], hi[c]);
+				v[c] = 0.0f;
+			}
+		}
+		pos[i] = p;
+		vel[i] = v;
+	}
+}
+
+void FlipFluid::step(ParticleSystem &ps, float dt)
+{
+	int n = ps.getCount();
+	if (n == 0)
+	{
+		return;
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		m_affine[c].resize(n, glm::vec3(0.0f));
+	}
+
+	applyForces(ps, dt);
+
+	m_grid.build(ps.getPos());
+	particlesToGrid(ps);
+	markCells();
+
+	for (int c = 0; c < 3; c++)
+	{
+		m_old[c] = m_vel[c];
+	}
+
+	solvePressure();
+	gridToParticles(ps, dt);
+}
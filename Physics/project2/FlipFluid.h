@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "UniformGrid.h"
+
+// particle <-> grid velocity transfer scheme
+enum TransferMode
+{
+	PIC_FLIP, // blend of PIC and FLIP set by the FLIP ratio
+	APIC // affine particle-in-cell
+};
+
+/*
+** FLIP FLUID
+** Hybrid particle-grid liquid: the particles of the system carry the liquid, a MAC
+** grid over the cube is used for the pressure solve. The walls of the cube are solid
+** and cells without particles are air (zero pressure).
+** Particle to grid transfer is done in parallel without atomics: the particles are
+** sorted by cell, each thread splats a contiguous chunk into its own tile covering
+** only the z slabs of that chunk, and the tiles are summed slab by slab afterwards.
+*/
+class FlipFluid
+{
+public:
+	FlipFluid();
+	~FlipFluid();
+
+	/*
+	** GET METHODS
+	*/
+	const glm::ivec3& getDims() const { return m_dims; }
+	int getPressureIterations() const { return m_pressureIterations; }
+
+	/*
+	** SET METHODS
+	*/
+	// grid over the cube with cubic cells of the given size
+	void setDomain(const Cube &cube, float cellSize);
+	void setTransferMode(TransferMode mode) { m_mode = mode; }
+	// share of FLIP in the PIC/FLIP blend, 1 = pure FLIP (noisy), 0 = pure PIC (viscous)
+	void setFlipRatio(float ratio) { m_flipRatio = ratio; }
+	void setTolerance(float tol) { m_tolerance = tol; }
+	void setMaxIterations(int iterations) { m_maxIterations = iterations; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// fill a box with 8 particles per cell
+	void addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi);
+
+	// advance the particles of the system by dt
+	void step(ParticleSystem &ps, float dt);
+
+private:
+	int cIndex(int i, int j, int k) const { return i + m_dims.x * (j + m_dims.y * k); }
+	int fIndex(int c, int i, int j, int k) const { return i + m_faceDims[c].x * (j + m_faceDims[c].y * k); }
+
+	void applyForces(ParticleSystem &ps, float dt);
+	void particlesToGrid(const ParticleSystem &ps);
+	void markCells();
+	void solvePressure();
+	void gridToParticles(ParticleSystem &ps, float dt);
+
+	// trilinear weights of the 8 faces of component c around p
+	void faceWeights(int c, const glm::vec3 &p, glm::ivec3 &base, glm::vec3 &t) const;
+
+	void applyPressureMatrix(const std::vector<float> &x, std::vector<float> &y) const;
+
+	glm::vec3 m_origin;
+	glm::vec3 m_bound;
+	glm::ivec3 m_dims;
+	glm::ivec3 m_faceDims[3];
+	float m_h;
+
+	TransferMode m_mode;
+	float m_flipRatio;
+	float m_tolerance;
+	int m_maxIterations;
+	int m_pressureIterations;
+
+	UniformGrid m_grid;
+
+	std::vector<float> m_vel[3]; // face velocities
+	std::vector<float> m_old[3]; // face velocities before the pressure solve
+	std::vector<float> m_weight[3];
+
+	// per thread P2G tiles
+	std::vector<int> m_tileK0, m_tileK1;
+	std::vector<std::vector<float> > m_tileMom[3], m_tileWeight[3];
+
+	// pressure solve over the fluid cells
+	std::vector<char> m_fluid;
+	std::vector<float> m_p, m_r, m_z, m_d, m_q, m_diag;
+
+	// APIC affine velocity per particle, one row per velocity component
+	std::vector<glm::vec3> m_affine[3];
+};
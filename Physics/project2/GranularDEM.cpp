@@ -0,0 +1,412 @@
+// Math constants
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+
+#include "GranularDEM.h"
+#include "RadixSort.h"
+#include "Parallel.h"
+
+
+GranularDEM::GranularDEM()
+{
+	m_substeps = 10;
+	m_density = 2500.0f;
+	m_youngsModulus = 1e6f;
+	m_poissonRatio = 0.3f;
+	m_restitution = 0.5f;
+	m_friction = 0.5f;
+	m_rollingFriction = 0.05f;
+	m_skin = 0.01f;
+	m_touching = 0;
+
+	m_gridOrigin = glm::vec3(0.0f);
+	m_gridBound = glm::vec3(0.0f);
+	m_gridCellSize = 0.0f;
+}
+
+
+GranularDEM::~GranularDEM()
+{
+}
+
+int GranularDEM::addGrain(ParticleSystem &ps, const glm::vec3 &pos, float radius)
+{
+	float mass = m_density * 4.0f / 3.0f * (float)M_PI * radius * radius * radius;
+	int i = ps.addParticle(pos, glm::vec3(0.0f), mass);
+
+	m_radius.resize(ps.getCount(), radius);
+	m_omega.resize(ps.getCount(), glm::vec3(0.0f));
+	m_radius[i] = radius;
+	return i;
+}
+
+void GranularDEM::addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi, float radius)
+{
+	// the jitter keeps the lattice from standing as a perfectly stacked column
+	float spacing = 2.0f * radius * 1.05f;
+	unsigned int seed = 12345u;
+	for (float z = lo.z + radius; z <= hi.z - radius; z += spacing)
+	{
+		for (float y = lo.y + radius; y <= hi.y - radius; y += spacing)
+		{
+			for (float x = lo.x + radius; x <= hi.x - radius; x += spacing)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				float jitter = 0.02f * radius * ((float)(seed >> 8) / 16777216.0f - 0.5f);
+				addGrain(ps, glm::vec3(x + jitter, y, z - jitter), radius);
+			}
+		}
+	}
+}
+
+float GranularDEM::getMaxTimeStep() const
+{
+	if (m_radius.empty())
+	{
+		return 0.0f;
+	}
+
+	// a fraction of the Rayleigh wave time step of the smallest grain
+	float r = *std::min_element(m_radius.begin(), m_radius.end());
+	float shear = m_youngsModulus / (2.0f * (1.0f + m_poissonRatio));
+	float rayleigh = (float)M_PI * r * sqrtf(m_density / shear) / (0.1631f * m_poissonRatio + 0.8766f);
+	return 0.3f * rayleigh;
+}
+
+
+/*
+** CANDIDATES
+*/
+
+// pairs whose boxes, grown by half the skin, overlap are kept in the pair cache for the whole step
+void GranularDEM::findCandidates(const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	int n = ps.getCount();
+	m_radius.resize(n, m_radius.empty() ? 0.05f : m_radius.back());
+	m_omega.resize(n, glm::vec3(0.0f));
+
+	float maxRadius = *std::max_element(m_radius.begin(), m_radius.end());
+	float cellSize = 2.0f * maxRadius + m_skin;
+	const Cube &cube = ps.getCube();
+	if (cube.origin != m_gridOrigin || cube.bound != m_gridBound || cellSize != m_gridCellSize)
+	{
+		m_grid.setDomain(cube.origin, cube.bound, cellSize);
+		m_gridOrigin = cube.origin;
+		m_gridBound = cube.bound;
+		m_gridCellSize = cellSize;
+	}
+
+	m_bounds.resize(n);
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		glm::vec3 extent(m_radius[i] + 0.5f * m_skin);
+		m_bounds[i] = AABB(pos[i] - extent, pos[i] + extent);
+	}
+
+	m_grid.build(pos);
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	const std::vector<unsigned int> &cells = m_grid.getSortedCells();
+	const glm::ivec3 &dims = m_grid.getDims();
+
+	// per thread pair lists, joined in thread order so the result doesn't depend on timing
+	m_threadPairs.resize(getMaxThreads());
+	#pragma omp parallel
+	{
+		std::vector<BodyPair> &pairs = m_threadPairs[getThreadNum()];
+		pairs.clear();
+
+		#pragma omp for schedule(static)
+		for (int s = 0; s < n; s++)
+		{
+			int i = order[s];
+			int cell = (int)cells[s];
+			glm::ivec3 c(cell % dims.x, (cell / dims.x) % dims.y, cell / (dims.x * dims.y));
+
+			for (int dz = -1; dz <= 1; dz++)
+			{
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					int begin, end;
+					m_grid.getRowRange(c, dy, dz, begin, end);
+					for (int t = std::max(begin, s + 1); t < end; t++)
+					{
+						int j = order[t];
+						if (m_bounds[i].overlaps(m_bounds[j]))
+						{
+							BodyPair pair = { std::min(i, j), std::max(i, j) };
+							pairs.push_back(pair);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	m_candidates.clear();
+	for (size_t t = 0; t < m_threadPairs.size(); t++)
+	{
+		m_candidates.insert(m_candidates.end(), m_threadPairs[t].begin(), m_threadPairs[t].end());
+	}
+
+	// new pairs start with no friction history, separated pairs are dropped with theirs
+	m_pairCache.beginStep();
+	m_pairCache.addPairs(m_candidates);
+	m_pairCache.endStep(m_bounds);
+
+	int m = (int)m_candidates.size();
+	m_contacts.resize(m);
+	m_force.resize(m);
+	m_torqueA.resize(m);
+	m_torqueB.resize(m);
+	m_endGrain.resize(2 * m);
+	m_endContact.resize(2 * m);
+
+	// the cache doesn't change until the next step so the pair pointers stay valid
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		Contact &contact = m_contacts[c];
+		contact.a = m_candidates[c].bodyA;
+		contact.b = m_candidates[c].bodyB;
+		contact.pair = m_pairCache.findPair(contact.a, contact.b);
+
+		m_endGrain[2 * c] = (unsigned int)contact.a;
+		m_endGrain[2 * c + 1] = (unsigned int)contact.b;
+		m_endContact[2 * c] = 2 * c;
+		m_endContact[2 * c + 1] = 2 * c + 1;
+	}
+
+	// sort the contact ends by grain so every grain gathers a contiguous range
+	int keyBits = 1;
+	while ((1 << keyBits) < n)
+	{
+		keyBits++;
+	}
+	radixSort(m_endGrain, m_endContact, keyBits);
+
+	m_endStart.assign(n + 1, 2 * m);
+	#pragma omp parallel for
+	for (int e = 0; e < 2 * m; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_endGrain[e - 1] + 1;
+		for (int g = first; g <= (int)m_endGrain[e]; g++)
+		{
+			m_endStart[g] = e;
+		}
+	}
+}
+
+
+/*
+** CONTACT FORCES
+*/
+
+void GranularDEM::computeContacts(const ParticleSystem &ps, float dt)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &mass = ps.getMass();
+	int m = (int)m_contacts.size();
+
+	// effective material constants of two grains of the same material
+	float nu = m_poissonRatio;
+	float youngs = m_youngsModulus / (2.0f * (1.0f - nu * nu));
+	float shear = m_youngsModulus / (4.0f * (2.0f - nu) * (1.0f + nu));
+	float logE = logf(std::max(m_restitution, 1e-3f));
+	float beta = logE / sqrtf(logE * logE + (float)(M_PI * M_PI));
+	float dampScale = -2.0f * sqrtf(5.0f / 6.0f) * beta;
+	int touching = 0;
+
+	#pragma omp parallel for schedule(dynamic, 1024) reduction(+:touching)
+	for (int c = 0; c < m; c++)
+	{
+		Contact &contact = m_contacts[c];
+		int a = contact.a, b = contact.b;
+		float ra = m_radius[a], rb = m_radius[b];
+
+		glm::vec3 d = pos[b] - pos[a];
+		float dist2 = glm::dot(d, d);
+		float overlap = ra + rb - sqrtf(dist2);
+		if (overlap <= 0.0f || dist2 < 1e-12f)
+		{
+			// separated: the friction history is forgotten
+			contact.pair->tangent = glm::vec3(0.0f);
+			m_force[c] = glm::vec3(0.0f);
+			m_torqueA[c] = glm::vec3(0.0f);
+			m_torqueB[c] = glm::vec3(0.0f);
+			continue;
+		}
+		touching++;
+
+		glm::vec3 n = d / sqrtf(dist2);
+		float radius = ra * rb / (ra + rb);
+		float effMass = mass[a] * mass[b] / (mass[a] + mass[b]);
+
+		// relative velocity of the contact point, positive normal part = approaching
+		glm::vec3 vrel = vel[a] - vel[b] + glm::cross(ra * m_omega[a] + rb * m_omega[b], n);
+		float vn = glm::dot(vrel, n);
+		glm::vec3 vt = vrel - vn * n;
+
+		// Hertz normal force with the damping matched to the restitution
+		float contactRadius = sqrtf(radius * overlap);
+		float sn = 2.0f * youngs * contactRadius;
+		float st = 8.0f * shear * contactRadius;
+		float fn = 4.0f / 3.0f * youngs * contactRadius * overlap + dampScale * sqrtf(sn * effMass) * vn;
+		fn = std::max(fn, 0.0f);
+
+		// Mindlin tangential spring, rotated into the current tangent plane and capped by Coulomb
+		float gammaT = dampScale * sqrtf(st * effMass);
+		glm::vec3 xi = contact.pair->tangent;
+		xi -= glm::dot(xi, n) * n;
+		xi += vt * dt;
+		glm::vec3 ft = -st * xi - gammaT * vt;
+		float ftLength = glm::length(ft);
+		if (ftLength > m_friction * fn)
+		{
+			// sliding: the spring is stretched only as far as the friction force allows
+			ft *= m_friction * fn / ftLength;
+			xi = -(ft + gammaT * vt) / st;
+		}
+		contact.pair->tangent = xi;
+
+		m_force[c] = -fn * n + ft;
+		glm::vec3 torque = glm::cross(n, ft);
+		m_torqueA[c] = ra * torque;
+		m_torqueB[c] = rb * torque;
+
+		// rolling resistance against the relative spin, never strong enough to reverse it
+		glm::vec3 spin = m_omega[a] - m_omega[b];
+		float spinLength = glm::length(spin);
+		if (spinLength > 1e-9f)
+		{
+			float ia = 0.4f * mass[a] * ra * ra, ib = 0.4f * mass[b] * rb * rb;
+			float maxTorque = ia * ib / (ia + ib) * spinLength / dt;
+			glm::vec3 roll = -std::min(m_rollingFriction * radius * fn, maxTorque) / spinLength * spin;
+			m_torqueA[c] += roll;
+			m_torqueB[c] -= roll;
+		}
+	}
+
+	m_touching = touching;
+}
+
+// gather the contact forces per grain, add the walls and integrate
+void GranularDEM::integrate(ParticleSystem &ps, float dt)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<float> &invMass = ps.getInvMass();
+	const Cube &cube = ps.getCube();
+	int n = ps.getCount();
+
+	float nu = m_poissonRatio;
+	float youngs = m_youngsModulus / (1.0f - nu * nu); // rigid, infinitely heavy wall
+	float logE = logf(std::max(m_restitution, 1e-3f));
+	float beta = logE / sqrtf(logE * logE + (float)(M_PI * M_PI));
+	float dampScale = -2.0f * sqrtf(5.0f / 6.0f) * beta;
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		glm::vec3 f = force[i];
+		glm::vec3 torque(0.0f);
+
+		for (int e = m_endStart[i]; e < m_endStart[i + 1]; e++)
+		{
+			int c = m_endContact[e] >> 1;
+			if (m_endContact[e] & 1)
+			{
+				f -= m_force[c];
+				torque += m_torqueB[c];
+			}
+			else
+			{
+				f += m_force[c];
+				torque += m_torqueA[c];
+			}
+		}
+
+		float r = m_radius[i];
+		float inertia = 0.4f * mass[i] * r * r;
+
+		// walls: Hertz normal force, friction that can at most stop the sliding within the substep
+		for (int w = 0; w < 6; w++)
+		{
+			int axis = w >> 1;
+			glm::vec3 n(0.0f);
+			float overlap;
+			if (w & 1)
+			{
+				n[axis] = 1.0f;
+				overlap = r - (cube.bound[axis] - pos[i][axis]);
+			}
+			else
+			{
+				n[axis] = -1.0f;
+				overlap = r - (pos[i][axis] - cube.origin[axis]);
+			}
+			if (overlap <= 0.0f)
+			{
+				continue;
+			}
+
+			glm::vec3 vrel = vel[i] + glm::cross(r * m_omega[i], n);
+			float vn = glm::dot(vrel, n);
+			glm::vec3 vt = vrel - vn * n;
+
+			float contactRadius = sqrtf(r * overlap);
+			float sn = 2.0f * youngs * contactRadius;
+			float fn = 4.0f / 3.0f * youngs * contactRadius * overlap + dampScale * sqrtf(sn * mass[i]) * vn;
+			fn = std::max(fn, 0.0f);
+			f -= fn * n;
+
+			float vtLength = glm::length(vt);
+			if (vtLength > 1e-9f)
+			{
+				// 2/7 m is the effective mass of a rolling sphere
+				float ft = std::min(m_friction * fn, 2.0f / 7.0f * mass[i] * vtLength / dt);
+				glm::vec3 friction = -ft / vtLength * vt;
+				f += friction;
+				torque += r * glm::cross(n, friction);
+			}
+
+			float spinLength = glm::length(m_omega[i]);
+			if (spinLength > 1e-9f)
+			{
+				float roll = std::min(m_rollingFriction * r * fn, inertia * spinLength / dt);
+				torque -= roll / spinLength * m_omega[i];
+			}
+		}
+
+		vel[i] += f * invMass[i] * dt;
+		pos[i] += vel[i] * dt;
+		if (invMass[i] > 0.0f)
+		{
+			m_omega[i] += torque / inertia * dt;
+		}
+	}
+}
+
+void GranularDEM::step(ParticleSystem &ps, float dt)
+{
+	if (ps.getCount() == 0)
+	{
+		return;
+	}
+
+	findCandidates(ps);
+
+	float h = dt / m_substeps;
+	for (int s = 0; s < m_substeps; s++)
+	{
+		ps.clearForces();
+		ps.applyForces();
+		computeContacts(ps, h);
+		integrate(ps, h);
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "UniformGrid.h"
+#include "PairCache.h"
+
+/*
+** GRANULAR DEM
+** Discrete element model for sand and gravel: the particles of the system are
+** spherical grains in Hertz-Mindlin contact, with Coulomb friction, rolling
+** resistance and the cube walls as a frictional container.
+** Contact candidates (pairs closer than the skin) are found once per step from the
+** uniform grid and kept in the pair cache, which also stores the tangential spring
+** of every contact between steps. The step is split in substeps that only evaluate
+** the candidates: one parallel pass computes the force of every contact, a second
+** pass gathers them per grain through a list sorted by grain, so no atomics are used.
+*/
+class GranularDEM
+{
+public:
+	GranularDEM();
+	~GranularDEM();
+
+	/*
+	** GET METHODS
+	*/
+	const std::vector<float>& getRadius() const { return m_radius; }
+	const std::vector<glm::vec3>& getAngularVelocity() const { return m_omega; }
+	int getSubsteps() const { return m_substeps; }
+	// candidates of the last step and how many of them were touching in the last substep
+	int getCandidateCount() const { return (int)m_contacts.size(); }
+	int getContactCount() const { return m_touching; }
+	const PairCache& getPairCache() const { return m_pairCache; }
+	// largest stable substep for the smallest grain (Rayleigh wave time step)
+	float getMaxTimeStep() const;
+
+	/*
+	** SET METHODS
+	*/
+	void setSubsteps(int substeps) { m_substeps = substeps; }
+	void setDensity(float rho) { m_density = rho; }
+	void setYoungsModulus(float e) { m_youngsModulus = e; }
+	void setPoissonRatio(float nu) { m_poissonRatio = nu; }
+	void setRestitution(float e) { m_restitution = e; }
+	// sliding friction coefficient of grain-grain and grain-wall contacts
+	void setFriction(float mu) { m_friction = mu; }
+	// rolling resistance coefficient (dimensionless)
+	void setRollingFriction(float mu) { m_rollingFriction = mu; }
+	// extra distance at which pairs become candidates, the grains may move half of it per step
+	void setSkin(float skin) { m_skin = skin; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a grain to the system, its mass comes from the density, returns its index
+	int addGrain(ParticleSystem &ps, const glm::vec3 &pos, float radius);
+	// fill a box with grains on a slightly jittered lattice
+	void addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi, float radius);
+
+	// advance the grains of the system by dt in m_substeps substeps
+	void step(ParticleSystem &ps, float dt);
+
+private:
+	struct Contact
+	{
+		int a, b;
+		CachedPair *pair; // friction history
+	};
+
+	void findCandidates(const ParticleSystem &ps);
+	void computeContacts(const ParticleSystem &ps, float dt);
+	void integrate(ParticleSystem &ps, float dt);
+
+	int m_substeps;
+	float m_density;
+	float m_youngsModulus;
+	float m_poissonRatio;
+	float m_restitution;
+	float m_friction;
+	float m_rollingFriction;
+	float m_skin;
+	int m_touching;
+
+	// per grain state
+	std::vector<float> m_radius;
+	std::vector<glm::vec3> m_omega; // angular velocity
+
+	UniformGrid m_grid;
+	glm::vec3 m_gridOrigin, m_gridBound;
+	float m_gridCellSize;
+
+	PairCache m_pairCache;
+	std::vector<AABB> m_bounds;
+	std::vector<std::vector<BodyPair> > m_threadPairs;
+	std::vector<BodyPair> m_candidates;
+
+	// candidates and the force / torques each one applies in the current substep
+	std::vector<Contact> m_contacts;
+	std::vector<glm::vec3> m_force; // on grain a, grain b gets the opposite
+	std::vector<glm::vec3> m_torqueA, m_torqueB;
+
+	// contact ends sorted by grain: value = 2 * contact + (1 if the grain is b)
+	std::vector<unsigned int> m_endGrain;
+	std::vector<int> m_endContact;
+	std::vector<int> m_endStart;
+};
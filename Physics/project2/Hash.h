@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+
+// 64-bit FNV-1a hash of a block of memory, chain calls by passing the previous hash as the seed
+inline unsigned long long fnv1a(const void *data, size_t size, unsigned long long seed = 14695981039346656037ull)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	unsigned long long hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ImplicitCloth.h"
+
+
+ImplicitCloth::ImplicitCloth()
+{
+	m_stretchK = 5000.0f;
+	m_stretchD = 1.0f;
+	m_bendK = 50.0f;
+	m_bendD = 0.1f;
+	m_tolerance = 1e-3f;
+	m_maxIterations = 200;
+	m_iterations = 0;
+	m_residual = 0.0f;
+}
+
+
+ImplicitCloth::~ImplicitCloth()
+{
+}
+
+void ImplicitCloth::addSpring(int a, int b, float restLength, float stiffness, float damping)
+{
+	m_a.push_back(a);
+	m_b.push_back(b);
+	m_restLength.push_back(restLength);
+	m_stiffness.push_back(stiffness);
+	m_damping.push_back(damping);
+}
+
+void ImplicitCloth::setMesh(const ClothMesh &mesh, const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::ivec2> &edges = mesh.getEdges();
+	const std::vector<glm::ivec4> &bendEdges = mesh.getBendEdges();
+
+	m_a.clear();
+	m_b.clear();
+	m_restLength.clear();
+	m_stiffness.clear();
+	m_damping.clear();
+
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		int a = edges[e].x, b = edges[e].y;
+		addSpring(a, b, glm::length(pos[b] - pos[a]), m_stretchK, m_stretchD);
+	}
+	// bending springs join the two vertices opposite to an inner edge
+	for (size_t e = 0; e < bendEdges.size(); e++)
+	{
+		int a = bendEdges[e].z, b = bendEdges[e].w;
+		addSpring(a, b, glm::length(pos[b] - pos[a]), m_bendK, m_bendD);
+	}
+
+	buildPattern(ps.getCount());
+}
+
+// sparsity pattern: every particle row holds its diagonal and one block per distinct spring neighbour
+void ImplicitCloth::buildPattern(int particleCount)
+{
+	int n = particleCount;
+	int m = getSpringCount();
+
+	m_incidenceStart.assign(n + 1, 0);
+	for (int s = 0; s < m; s++)
+	{
+		m_incidenceStart[m_a[s] + 1]++;
+		m_incidenceStart[m_b[s] + 1]++;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		m_incidenceStart[i + 1] += m_incidenceStart[i];
+	}
+	std::vector<int> fill(m_incidenceStart.begin(), m_incidenceStart.end() - 1);
+	m_incidence.resize(2 * m);
+	for (int s = 0; s < m; s++)
+	{
+		m_incidence[fill[m_a[s]]++] = 2 * s;
+		m_incidence[fill[m_b[s]]++] = 2 * s + 1;
+	}
+
+	m_rowStart.assign(n + 1, 0);
+	m_column.clear();
+	m_diagonal.resize(n);
+	m_incidenceBlock.resize(2 * m);
+
+	std::vector<int> columns;
+	for (int i = 0; i < n; i++)
+	{
+		columns.clear();
+		columns.push_back(i);
+		for (int k = m_incidenceStart[i]; k < m_incidenceStart[i + 1]; k++)
+		{
+			int s = m_incidence[k] >> 1;
+			columns.push_back((m_incidence[k] & 1) ? m_a[s] : m_b[s]);
+		}
+		std::sort(columns.begin(), columns.end());
+		columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+		int start = (int)m_column.size();
+		m_column.insert(m_column.end(), columns.begin(), columns.end());
+		m_rowStart[i + 1] = (int)m_column.size();
+		m_diagonal[i] = start + (int)(std::lower_bound(columns.begin(), columns.end(), i) - columns.begin());
+
+		for (int k = m_incidenceStart[i]; k < m_incidenceStart[i + 1]; k++)
+		{
+			int s = m_incidence[k] >> 1;
+			int other = (m_incidence[k] & 1) ? m_a[s] : m_b[s];
+			m_incidenceBlock[k] = start + (int)(std::lower_bound(columns.begin(), columns.end(), other) - columns.begin());
+		}
+	}
+
+	m_blocks.resize(m_column.size());
+	m_springForce.resize(m);
+	m_springBlock.resize(m);
+	m_springK.resize(m);
+
+	m_rhs.resize(n);
+	m_dv.assign(n, glm::vec3(0.0f));
+	m_r.resize(n);
+	m_z.resize(n);
+	m_d.resize(n);
+	m_q.resize(n);
+	m_invDiagonal.resize(n);
+}
+
+
+/*
+** ASSEMBLY
+*/
+
+// force, stiffness and matrix block of every spring
+void ImplicitCloth::computeSprings(const ParticleSystem &ps, float dt)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	int m = getSpringCount();
+	glm::mat3 identity(1.0f);
+
+	#pragma omp parallel for
+	for (int s = 0; s < m; s++)
+	{
+		int a = m_a[s], b = m_b[s];
+		glm::vec3 d = pos[b] - pos[a];
+		float length = glm::length(d);
+		glm::vec3 n = d / (length + 1e-12f);
+		glm::mat3 nn = glm::outerProduct(n, n);
+
+		float k = m_stiffness[s], c = m_damping[s];
+		m_springForce[s] = (k * (length - m_restLength[s]) + c * glm::dot(vel[b] - vel[a], n)) * n;
+
+		// the transverse term is dropped under compression so the matrix stays positive definite
+		float transverse = std::max(1.0f - m_restLength[s] / (length + 1e-12f), 0.0f);
+		m_springK[s] = k * (nn + transverse * (identity - nn));
+		m_springBlock[s] = dt * c * nn + dt * dt * m_springK[s];
+	}
+}
+
+// every row is written by one thread only: diagonal, off-diagonal blocks and right hand side
+void ImplicitCloth::assemble(const ParticleSystem &ps, float dt)
+{
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<float> &invMass = ps.getInvMass();
+	int n = ps.getCount();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		for (int k = m_rowStart[i]; k < m_rowStart[i + 1]; k++)
+		{
+			m_blocks[k] = glm::mat3(0.0f);
+		}
+
+		glm::mat3 diagonal(mass[i]);
+		glm::vec3 f = force[i];
+		glm::vec3 kv(0.0f);
+
+		for (int k = m_incidenceStart[i]; k < m_incidenceStart[i + 1]; k++)
+		{
+			int s = m_incidence[k] >> 1;
+			bool isB = (m_incidence[k] & 1) != 0;
+			int other = isB ? m_a[s] : m_b[s];
+
+			diagonal += m_springBlock[s];
+			m_blocks[m_incidenceBlock[k]] -= m_springBlock[s];
+			f += isB ? -m_springForce[s] : m_springForce[s];
+			kv += m_springK[s] * (vel[other] - vel[i]);
+		}
+
+		m_blocks[m_diagonal[i]] = diagonal;
+		m_invDiagonal[i] = glm::inverse(diagonal);
+
+		// fixed particles don't take part in the solve
+		m_rhs[i] = invMass[i] > 0.0f ? dt * (f + dt * kv) : glm::vec3(0.0f);
+	}
+}
+
+
+/*
+** SOLVE
+*/
+
+void ImplicitCloth::multiply(const std::vector<glm::vec3> &x, std::vector<glm::vec3> &y) const
+{
+	int n = (int)x.size();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		glm::vec3 sum(0.0f);
+		for (int k = m_rowStart[i]; k < m_rowStart[i + 1]; k++)
+		{
+			sum += m_blocks[k] * x[m_column[k]];
+		}
+		y[i] = sum;
+	}
+}
+
+// block Jacobi preconditioned CG, the fixed particles are filtered out of every vector
+void ImplicitCloth::solve(const ParticleSystem &ps)
+{
+	const std::vector<float> &invMass = ps.getInvMass();
+	int n = ps.getCount();
+
+	multiply(m_dv, m_q);
+
+	double bNorm = 0.0, rz = 0.0;
+	#pragma omp parallel for reduction(+:bNorm, rz)
+	for (int i = 0; i < n; i++)
+	{
+		if (invMass[i] > 0.0f)
+		{
+			m_r[i] = m_rhs[i] - m_q[i];
+			m_z[i] = m_invDiagonal[i] * m_r[i];
+		}
+		else
+		{
+			m_dv[i] = glm::vec3(0.0f);
+			m_r[i] = glm::vec3(0.0f);
+			m_z[i] = glm::vec3(0.0f);
+		}
+		m_d[i] = m_z[i];
+		bNorm += glm::dot(m_rhs[i], m_rhs[i]);
+		rz += glm::dot(m_r[i], m_z[i]);
+	}
+
+	double tol2 = (double)m_tolerance * m_tolerance * bNorm;
+	double rNorm = 0.0;
+	m_iterations = 0;
+
+	while (m_iterations < m_maxIterations)
+	{
+		multiply(m_d, m_q);
+
+		double dq = 0.0;
+		#pragma omp parallel for reduction(+:dq)
+		for (int i = 0; i < n; i++)
+		{
+			if (invMass[i] == 0.0f)
+			{
+				m_q[i] = glm::vec3(0.0f);
+			}
+			dq += glm::dot(m_d[i], m_q[i]);
+		}
+		if (dq <= 0.0)
+		{
+			break;
+		}
+		float alpha = (float)(rz / dq);
+
+		rNorm = 0.0;
+		#pragma omp parallel for reduction(+:rNorm)
+		for (int i = 0; i < n; i++)
+		{
+			m_dv[i] += alpha * m_d[i];
+			m_r[i] -= alpha * m_q[i];
+			rNorm += glm::dot(m_r[i], m_r[i]);
+		}
+		m_iterations++;
+		if (rNorm <= tol2)
+		{
+			break;
+		}
+
+		double rzNew = 0.0;
+		#pragma omp parallel for reduction(+:rzNew)
+		for (int i = 0; i < n; i++)
+		{
+			m_z[i] = m_invDiagonal[i] * m_r[i];
+			rzNew += glm::dot(m_r[i], m_z[i]);
+		}
+		float beta = (float)(rzNew / rz);
+		rz = rzNew;
+
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			m_d[i] = m_z[i] + beta * m_d[i];
+		}
+	}
+
+	m_residual = bNorm > 0.0 ? (float)sqrt(rNorm / bNorm) : 0.0f;
+}
+
+void ImplicitCloth::step(ParticleSystem &ps, float dt)
+{
+	int n = ps.getCount();
+	if (n == 0)
+	{
+		return;
+	}
+	if ((int)m_rowStart.size() != n + 1)
+	{
+		buildPattern(n);
+	}
+
+	ps.clearForces();
+	ps.applyForces();
+
+	computeSprings(ps, dt);
+	assemble(ps, dt);
+	solve(ps);
+
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		vel[i] += m_dv[i];
+		pos[i] += vel[i] * dt;
+	}
+}
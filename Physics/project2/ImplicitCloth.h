@@ -0,0 +1,98 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+
+/*
+** IMPLICIT CLOTH
+** Backward Euler cloth (Baraff and Witkin 1998): stretch springs on the mesh edges
+** and bending springs across the inner edges, integrated with
+**     (M - h df/dv - h^2 df/dx) dv = h (f + h df/dx v)
+** The system matrix is stored as 3x3 block sparse rows (one row per particle,
+** columns are the particle and its spring neighbours). Each row is assembled by its
+** own thread from per-spring blocks, and the system is solved with block Jacobi
+** preconditioned conjugate gradients, warm started with the last step's dv.
+** Fixed particles (zero inverse mass) are filtered out of the solve.
+*/
+class ImplicitCloth
+{
+public:
+	ImplicitCloth();
+	~ImplicitCloth();
+
+	/*
+	** GET METHODS
+	*/
+	int getSpringCount() const { return (int)m_a.size(); }
+	// CG iterations and relative residual of the last solve
+	int getIterations() const { return m_iterations; }
+	float getResidual() const { return m_residual; }
+
+	/*
+	** SET METHODS
+	*/
+	// stretch and bending stiffness (N/m) and damping (Ns/m), used by the next setMesh
+	void setStretch(float stiffness, float damping) { m_stretchK = stiffness; m_stretchD = damping; }
+	void setBending(float stiffness, float damping) { m_bendK = stiffness; m_bendD = damping; }
+	void setTolerance(float tol) { m_tolerance = tol; }
+	void setMaxIterations(int iterations) { m_maxIterations = iterations; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// springs and sparsity pattern for a mesh, the rest lengths are the current distances
+	void setMesh(const ClothMesh &mesh, const ParticleSystem &ps);
+
+	// one implicit step of the whole system, the force generators of the system are explicit
+	void step(ParticleSystem &ps, float dt);
+
+private:
+	void addSpring(int a, int b, float restLength, float stiffness, float damping);
+	void buildPattern(int particleCount);
+
+	void computeSprings(const ParticleSystem &ps, float dt);
+	void assemble(const ParticleSystem &ps, float dt);
+	void solve(const ParticleSystem &ps);
+
+	// y = A x
+	void multiply(const std::vector<glm::vec3> &x, std::vector<glm::vec3> &y) const;
+
+	float m_stretchK, m_stretchD;
+	float m_bendK, m_bendD;
+	float m_tolerance;
+	int m_maxIterations;
+	int m_iterations;
+	float m_residual;
+
+	// springs
+	std::vector<int> m_a, m_b;
+	std::vector<float> m_restLength;
+	std::vector<float> m_stiffness;
+	std::vector<float> m_damping;
+
+	// per spring: force on a and the matrix block h c d d^T + h^2 K, row a gets +S on the
+	// diagonal and -S at column b, and the other way round for row b
+	std::vector<glm::vec3> m_springForce;
+	std::vector<glm::mat3> m_springBlock;
+	std::vector<glm::mat3> m_springK; // df_a/dx_b, needed for the right hand side
+
+	// particle -> spring incidence (2 * spring + 1 if the particle is b) and the block of the
+	// other particle's column in this particle's row
+	std::vector<int> m_incidenceStart;
+	std::vector<int> m_incidence;
+	std::vector<int> m_incidenceBlock;
+
+	// block sparse rows
+	std::vector<int> m_rowStart;
+	std::vector<int> m_column;
+	std::vector<int> m_diagonal; // index of the diagonal block of every row
+	std::vector<glm::mat3> m_blocks;
+
+	// solver vectors, one entry per particle
+	std::vector<glm::vec3> m_rhs;
+	std::vector<glm::vec3> m_dv; // kept between steps as the warm start
+	std::vector<glm::vec3> m_r, m_z, m_d, m_q;
+	std::vector<glm::mat3> m_invDiagonal;
+};
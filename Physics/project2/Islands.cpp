@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#include "Islands.h"
+#include "Parallel.h"
+
+
+Islands::Islands()
+{
+	m_islandStart.assign(1, 0);
+}
+
+
+Islands::~Islands()
+{
+}
+
+int Islands::find(int forest, int node)
+{
+	std::vector<int> &parent = m_parent[forest];
+	if (parent[node] < 0)
+	{
+		parent[node] = node;
+		m_touched[forest].push_back(node);
+		return node;
+	}
+	while (parent[node] != node)
+	{
+		parent[node] = parent[parent[node]];
+		node = parent[node];
+	}
+	return node;
+}
+
+void Islands::join(int forest, int a, int b)
+{
+	int ra = find(forest, a);
+	int rb = find(forest, b);
+	if (ra < rb)
+	{
+		m_parent[forest][rb] = ra;
+	}
+	else if (rb < ra)
+	{
+		m_parent[forest][ra] = rb;
+	}
+}
+
+void Islands::build(int nodeCount, const std::vector<BodyPair> &edges)
+{
+	int threads = getMaxThreads();
+	m_parent.resize(threads);
+	m_touched.resize(threads);
+	for (int t = 0; t < threads; t++)
+	{
+		// untouched forests are all -1, so only a change of size needs a fill
+		if ((int)m_parent[t].size() != nodeCount)
+		{
+			m_parent[t].assign(nodeCount, -1);
+		}
+	}
+	int edgeCount = (int)edges.size();
+	int used = 1;
+
+	// a forest per thread over a contiguous share of the edges
+	#pragma omp parallel
+	{
+		int t = getThreadNum();
+		int count = getNumThreads();
+		#pragma omp single
+		used = count;
+
+		int begin = (int)((long long)edgeCount * t / count);
+		int end = (int)((long long)edgeCount * (t + 1) / count);
+		for (int e = begin; e < end; e++)
+		{
+			if (edges[e].bodyA >= 0 && edges[e].bodyB >= 0)
+			{
+				join(t, edges[e].bodyA, edges[e].bodyB);
+			}
+		}
+	}
+
+	// merge forest t + step into forest t, halving the forests every round; a merged forest is
+	// left all -1 again
+	for (int step = 1; step < used; step *= 2)
+	{
+		int merges = (used + 2 * step - 1) / (2 * step);
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int k = 0; k < merges; k++)
+		{
+			int t = 2 * step * k;
+			int s = t + step;
+			if (s >= used)
+			{
+				continue;
+			}
+			std::vector<int> &touched = m_touched[s];
+			for (int i = 0; i < (int)touched.size(); i++)
+			{
+				int node = touched[i];
+				int root = find(s, node);
+				if (root != node)
+				{
+					join(t, node, root);
+				}
+			}
+			for (int i = 0; i < (int)touched.size(); i++)
+			{
+				m_parent[s][touched[i]] = -1;
+			}
+			touched.clear();
+		}
+	}
+
+	// the root of an island is its smallest node, so numbering the roots in node order
+	// numbers every island before any of its other nodes is reached
+	std::vector<int> &parent = m_parent[0];
+	m_island.resize(nodeCount);
+	int islands = 0;
+	for (int i = 0; i < nodeCount; i++)
+	{
+		int root = parent[i] < 0 ? i : find(0, i);
+		m_island[i] = root == i ? islands++ : m_island[root];
+	}
+	for (int i = 0; i < (int)m_touched[0].size(); i++)
+	{
+		parent[m_touched[0][i]] = -1;
+	}
+	m_touched[0].clear();
+
+	// nodes grouped by island, in node order within each
+	m_islandStart.assign(islands + 1, 0);
+	for (int i = 0; i < nodeCount; i++)
+	{
+		m_islandStart[m_island[i] + 1]++;
+	}
+	for (int k = 0; k < islands; k++)
+	{
+		m_islandStart[k + 1] += m_islandStart[k];
+	}
+	m_nodes.resize(nodeCount);
+	std::vector<int> fill(m_islandStart.begin(), m_islandStart.end() - 1);
+	for (int i = 0; i < nodeCount; i++)
+	{
+		m_nodes[fill[m_island[i]]++] = i;
+	}
+}
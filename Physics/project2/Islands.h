@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+
+#include "Broadphase.h"
+
+/*
+** ISLANDS
+** Connected components (simulation islands) of a graph of bodies, from its edges
+** (contacts and joints). Union-find runs in parallel without atomics: every thread
+** builds a forest over its share of the edges, with the smaller index as the root,
+** and the forests are merged pairwise in a parallel tree reduction, so the result
+** does not depend on timing. The nodes are then grouped island by island, islands
+** numbered in the order of their smallest node.
+*/
+class Islands
+{
+public:
+	Islands();
+	~Islands();
+
+	/*
+	** GET METHODS
+	*/
+	int getIslandCount() const { return (int)m_islandStart.size() - 1; }
+	int getIsland(int node) const { return m_island[node]; }
+	// nodes of island i at [getIslandStart(i), getIslandStart(i + 1)) of getNodes()
+	int getIslandStart(int island) const { return m_islandStart[island]; }
+	int getIslandSize(int island) const { return m_islandStart[island + 1] - m_islandStart[island]; }
+	const std::vector<int>& getNodes() const { return m_nodes; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// islands of nodes 0 to nodeCount - 1 joined by the edges; edges with a negative end are skipped
+	void build(int nodeCount, const std::vector<BodyPair> &edges);
+
+private:
+	// root in the forest of a thread, halving the path
+	int find(int forest, int node);
+	// join two trees of a forest under the smaller root
+	void join(int forest, int a, int b);
+
+	// per thread forests: parent, -1 for nodes not touched, and the nodes touched
+	std::vector<std::vector<int> > m_parent;
+	std::vector<std::vector<int> > m_touched;
+
+	std::vector<int> m_island; // per node
+	std::vector<int> m_islandStart;
+	std::vector<int> m_nodes;
+};
@@ -0,0 +1,262 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "MassProperties.h"
+#include "Hash.h"
+#include "Parallel.h"
+
+
+// eigenvalues and eigenvectors (columns of V, a rotation) of a symmetric matrix, by cyclic Jacobi rotations
+static void jacobiEigen(const glm::mat3 &A, glm::vec3 &values, glm::mat3 &V)
+{
+	double a[3][3], v[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			a[i][j] = A[j][i];
+			v[i][j] = i == j ? 1.0 : 0.0;
+		}
+	}
+
+	for (int sweep = 0; sweep < 32; sweep++)
+	{
+		double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		double scale = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+		if (off <= 1e-24 * scale || off == 0.0)
+		{
+			break;
+		}
+
+		for (int p = 0; p < 2; p++)
+		{
+			for (int q = p + 1; q < 3; q++)
+			{
+				if (a[p][q] == 0.0)
+				{
+					continue;
+				}
+
+				// rotation in the pq plane that zeroes a[p][q]
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+				double c = 1.0 / std::sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < 3; k++)
+				{
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		values[i] = (float)a[i][i];
+		for (int j = 0; j < 3; j++)
+		{
+			V[j][i] = (float)v[i][j];
+		}
+	}
+
+	// a rotation, not a reflection
+	if (glm::determinant(V) < 0.0f)
+	{
+		V[2] = -V[2];
+	}
+}
+
+
+MassProperties::MassProperties()
+{
+	m_mass = 0.0f;
+	m_volume = 0.0f;
+	m_centre = glm::vec3(0.0f);
+	m_covariance = glm::mat3(0.0f);
+	m_principal = glm::vec3(0.0f);
+	m_axes = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+
+MassProperties::~MassProperties()
+{
+}
+
+std::string& MassProperties::cacheDirectory()
+{
+	static std::string directory = "resources/";
+	return directory;
+}
+
+glm::mat3 MassProperties::getInertia() const
+{
+	float trace = m_covariance[0][0] + m_covariance[1][1] + m_covariance[2][2];
+	return glm::mat3(trace) - m_covariance;
+}
+
+void MassProperties::compute(const IndexedModel &model, float density)
+{
+	const std::vector<glm::vec3> &x = model.positions;
+	const std::vector<unsigned int> &indices = model.indices;
+	int n = (int)indices.size() / 3;
+
+	// per thread sums over the tetrahedra (origin, a, b, c) of det = a . (b x c), det (a + b + c)
+	// and det (S S^T + a a^T + b b^T + c c^T) with S = a + b + c (upper triangle), added in thread order
+	int threads = getMaxThreads();
+	std::vector<double> sums(threads * 10, 0.0);
+
+	#pragma omp parallel
+	{
+		double *sum = &sums[getThreadNum() * 10];
+
+		#pragma omp for schedule(static)
+		for (int t = 0; t < n; t++)
+		{
+			glm::dvec3 a = glm::dvec3(x[indices[3 * t]]);
+			glm::dvec3 b = glm::dvec3(x[indices[3 * t + 1]]);
+			glm::dvec3 c = glm::dvec3(x[indices[3 * t + 2]]);
+			double det = glm::dot(a, glm::cross(b, c));
+			glm::dvec3 S = a + b + c;
+
+			sum[0] += det;
+			sum[1] += det * S.x;
+			sum[2] += det * S.y;
+			sum[3] += det * S.z;
+			sum[4] += det * (S.x * S.x + a.x * a.x + b.x * b.x + c.x * c.x);
+			sum[5] += det * (S.y * S.y + a.y * a.y + b.y * b.y + c.y * c.y);
+			sum[6] += det * (S.z * S.z + a.z * a.z + b.z * b.z + c.z * c.z);
+			sum[7] += det * (S.x * S.y + a.x * a.y + b.x * b.y + c.x * c.y);
+			sum[8] += det * (S.x * S.z + a.x * a.z + b.x * b.z + c.x * c.z);
+			sum[9] += det * (S.y * S.z + a.y * a.z + b.y * b.z + c.y * c.z);
+		}
+	}
+
+	double total[10] = { 0.0 };
+	for (int k = 0; k < threads; k++)
+	{
+		for (int j = 0; j < 10; j++)
+		{
+			total[j] += sums[k * 10 + j];
+		}
+	}
+
+	// volume det / 6, first moment det S / 24, covariance det (...) / 120 of every tetrahedron;
+	// an inward wound mesh has all of them negated
+	double volume = total[0] / 6.0;
+	double sign = volume < 0.0 ? -1.0 : 1.0;
+	volume *= sign;
+	if (volume <= 0.0)
+	{
+		*this = MassProperties();
+		return;
+	}
+
+	glm::dvec3 centre = sign * glm::dvec3(total[1], total[2], total[3]) / (24.0 * volume);
+	double cxx = sign * total[4] / 120.0 - volume * centre.x * centre.x;
+	double cyy = sign * total[5] / 120.0 - volume * centre.y * centre.y;
+	double czz = sign * total[6] / 120.0 - volume * centre.z * centre.z;
+	double cxy = sign * total[7] / 120.0 - volume * centre.x * centre.y;
+	double cxz = sign * total[8] / 120.0 - volume * centre.x * centre.z;
+	double cyz = sign * total[9] / 120.0 - volume * centre.y * centre.z;
+
+	m_volume = (float)volume;
+	m_mass = density * m_volume;
+	m_centre = glm::vec3(centre);
+	m_covariance = density * glm::mat3((float)cxx, (float)cxy, (float)cxz,
+		(float)cxy, (float)cyy, (float)cyz,
+		(float)cxz, (float)cyz, (float)czz);
+	diagonalise();
+}
+
+bool MassProperties::load(const std::string &fileName, float density)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Unable to load mesh: " << fileName << std::endl;
+		return false;
+	}
+	std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	unsigned long long key = fnv1a(bytes.data(), bytes.size());
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.mass", key);
+	std::string cacheName = cacheDirectory() + name;
+
+	// cached at unit density
+	std::ifstream cache(cacheName.c_str());
+	unsigned long long cachedKey = 0;
+	float volume;
+	glm::vec3 centre;
+	glm::mat3 covariance;
+	if (cache >> std::hex >> cachedKey >> std::dec && cachedKey == key && cache >> volume
+		>> centre.x >> centre.y >> centre.z
+		>> covariance[0][0] >> covariance[0][1] >> covariance[0][2]
+		>> covariance[1][1] >> covariance[1][2] >> covariance[2][2])
+	{
+		covariance[1][0] = covariance[0][1];
+		covariance[2][0] = covariance[0][2];
+		covariance[2][1] = covariance[1][2];
+		m_volume = volume;
+		m_mass = density * volume;
+		m_centre = centre;
+		m_covariance = density * covariance;
+		diagonalise();
+		return true;
+	}
+
+	compute(OBJModel(fileName).ToIndexedModel(), 1.0f);
+
+	// a cache that can't be written only costs the computation next time
+	std::ofstream out(cacheName.c_str());
+	if (out)
+	{
+		out.precision(9);
+		out << std::hex << key << std::dec << "\n" << m_volume << "\n"
+			<< m_centre.x << " " << m_centre.y << " " << m_centre.z << "\n"
+			<< m_covariance[0][0] << " " << m_covariance[0][1] << " " << m_covariance[0][2] << " "
+			<< m_covariance[1][1] << " " << m_covariance[1][2] << " " << m_covariance[2][2] << "\n";
+	}
+
+	m_mass = density * m_volume;
+	m_covariance = density * m_covariance;
+	diagonalise();
+	return true;
+}
+
+void MassProperties::scale(const glm::vec3 &s)
+{
+	// r -> S r: volume by det S, covariance by det S * S C S
+	float det = std::fabs(s.x * s.y * s.z);
+	glm::mat3 S = glm::mat3(s.x, 0.0f, 0.0f, 0.0f, s.y, 0.0f, 0.0f, 0.0f, s.z);
+	m_volume *= det;
+	m_mass *= det;
+	m_centre *= s;
+	m_covariance = det * S * m_covariance * S;
+	diagonalise();
+}
+
+void MassProperties::diagonalise()
+{
+	glm::mat3 V;
+	jacobiEigen(getInertia(), m_principal, V);
+	m_axes = glm::normalize(glm::quat_cast(V));
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "OBJLoader.h"
+
+/*
+** MASS PROPERTIES
+** Mass, centre of mass and inertia tensor of a closed triangle mesh of uniform density,
+** integrated exactly over the enclosed polyhedron with the divergence theorem: every
+** triangle makes a tetrahedron with the origin, and the signed volume, first moments and
+** second moments (covariance) of the tetrahedra add up to those of the solid (Blow and
+** Binstock 2004). Bounding box approximations get the spin of anything but a box wrong.
+** The triangles are summed in parallel, per thread in double precision.
+** Properties loaded from .obj files are cached on disk at unit density, in a file named
+** after the FNV-1a hash of the .obj contents, so loading the same model again (under any
+** name) only hashes the file.
+** The principal moments and axes are what RigidBodySystem takes: the body axes of a
+** rigid body made from a mesh are the principal axes, rotated by getAxes from the mesh axes.
+*/
+class MassProperties
+{
+public:
+	MassProperties();
+	~MassProperties();
+
+	/*
+	** GET METHODS
+	*/
+	float getMass() const { return m_mass; }
+	float getVolume() const { return m_volume; }
+	// in the mesh axes
+	const glm::vec3& getCentre() const { return m_centre; }
+	// inertia tensor about the centre of mass, in the mesh axes
+	glm::mat3 getInertia() const;
+	// principal moments of inertia and the rotation from the principal axes to the mesh axes
+	const glm::vec3& getPrincipal() const { return m_principal; }
+	const glm::quat& getAxes() const { return m_axes; }
+
+	// directory of the cache files, with a trailing separator; it has to exist
+	static const std::string& getCacheDirectory() { return cacheDirectory(); }
+
+	/*
+	** SET METHODS
+	*/
+	static void setCacheDirectory(const std::string &directory) { cacheDirectory() = directory; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// integrate over the triangles of a closed mesh (either winding)
+	void compute(const IndexedModel &model, float density);
+	// from an .obj file, through the disk cache; returns false if the file can't be read
+	bool load(const std::string &fileName, float density);
+
+	// the properties of the mesh scaled by s in its own axes, as Mesh::scale does
+	void scale(const glm::vec3 &s);
+
+private:
+	static std::string& cacheDirectory();
+	// principal moments and axes from the covariance
+	void diagonalise();
+
+	float m_mass;
+	float m_volume;
+	glm::vec3 m_centre;
+	glm::mat3 m_covariance; // integral of density r r^T about the centre; I = tr(C) 1 - C
+	glm::vec3 m_principal;
+	glm::quat m_axes;
+};
@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include "MembraneCoupling.h"
+#include "ClosestPoint.h"
+#include "Parallel.h"
+
+
+// cloth substeps per step a body needs for the square root of its mass over that of the free membrane,
+// measured on a 41 x 41 membrane at 100 Hz, where 13 times the membrane mass needs 12 substeps, 26 times
+// 20 and 53 times 28, with some margin
+static const float SUBSTEPS_PER_ROOT_RATIO = 4.5f;
+
+MembraneCoupling::MembraneCoupling()
+{
+	m_friction = 0.5f;
+	m_restitution = 0.0f;
+	m_restitutionThreshold = 1.0f;
+	m_margin = 0.01f;
+	m_maxSubsteps = 64;
+	m_substeps = 0;
+	m_touching = 0;
+}
+
+
+MembraneCoupling::~MembraneCoupling()
+{
+}
+
+void MembraneCoupling::setMembrane(const ClothMesh &mesh, const ParticleSystem &membrane)
+{
+	m_triangles = mesh.getTriangles();
+	m_tree.build(m_triangles, membrane.getPos());
+	m_bounds.resize(m_triangles.size());
+}
+
+void MembraneCoupling::addParticles(ParticleSystem &ps, float radius)
+{
+	m_systems.push_back(&ps);
+	m_systemRadius.push_back(radius);
+}
+
+void MembraneCoupling::addBody(RigidBodySystem &rb, int body, float radius)
+{
+	if (std::find(m_bodySystems.begin(), m_bodySystems.end(), &rb) == m_bodySystems.end())
+	{
+		m_bodySystems.push_back(&rb);
+	}
+	m_bodySystem.push_back(&rb);
+	m_body.push_back(body);
+	m_bodyRadius.push_back(radius);
+}
+
+
+/*
+** SIMULATION STEPS
+*/
+
+void MembraneCoupling::gatherSpheres()
+{
+	m_spheres.clear();
+	for (size_t b = 0; b < m_body.size(); b++)
+	{
+		RigidBodySystem &rb = *m_bodySystem[b];
+		int i = m_body[b];
+		Sphere s = { &rb, 0, i, rb.getInvMass(i), m_bodyRadius[b], rb.getPos(i), glm::vec3(0.0f) };
+		m_spheres.push_back(s);
+	}
+	for (size_t k = 0; k < m_systems.size(); k++)
+	{
+		ParticleSystem &ps = *m_systems[k];
+		for (int i = 0; i < ps.getCount(); i++)
+		{
+			if (ps.getInvMass()[i] > 0.0f)
+			{
+				Sphere s = { 0, &ps, i, ps.getInvMass()[i], m_systemRadius[k], ps.getPos()[i], glm::vec3(0.0f) };
+				m_spheres.push_back(s);
+			}
+		}
+	}
+}
+
+// a body much heavier than the membrane pushes the vertices under it further in a substep than
+// the cloth constraints pull them back, and goes through; the substeps are raised with the mass
+// ratio up to the limit, and a body heavier than the limit allows is seen by the contacts at that
+// mass (mass scaling), so it sinks as deep as the heaviest body the limit holds
+int MembraneCoupling::fitSubsteps(const XPBDCloth &cloth, const ParticleSystem &membrane)
+{
+	const std::vector<float> &mass = membrane.getMass();
+	const std::vector<float> &invMass = membrane.getInvMass();
+	float membraneMass = 0.0f;
+	for (int i = 0; i < membrane.getCount(); i++)
+	{
+		if (invMass[i] > 0.0f)
+		{
+			membraneMass += mass[i];
+		}
+	}
+
+	float heaviest = FLT_MAX;
+	for (size_t s = 0; s < m_spheres.size(); s++)
+	{
+		if (m_spheres[s].invMass > 0.0f)
+		{
+			heaviest = std::min(heaviest, m_spheres[s].invMass);
+		}
+	}
+	int substeps = cloth.getSubsteps();
+	if (membraneMass <= 0.0f || heaviest == FLT_MAX)
+	{
+		return substeps;
+	}
+
+	int most = std::max(substeps, m_maxSubsteps);
+	float limit = (most / SUBSTEPS_PER_ROOT_RATIO) * (most / SUBSTEPS_PER_ROOT_RATIO) * membraneMass;
+	for (size_t s = 0; s < m_spheres.size(); s++)
+	{
+		if (m_spheres[s].invMass > 0.0f)
+		{
+			m_spheres[s].invMass = std::max(m_spheres[s].invMass, 1.0f / limit);
+		}
+	}
+
+	float ratio = 1.0f / (heaviest * membraneMass);
+	int needed = (int)std::ceil(SUBSTEPS_PER_ROOT_RATIO * std::sqrt(ratio));
+	return std::min(std::max(needed, substeps), most);
+}
+
+void MembraneCoupling::refit(const ParticleSystem &membrane, float dt)
+{
+	const std::vector<glm::vec3> &pos = membrane.getPos();
+	const std::vector<glm::vec3> &vel = membrane.getVel();
+	int triangles = (int)m_triangles.size();
+
+	// triangles bounded over the coming step
+	#pragma omp parallel for
+	for (int t = 0; t < triangles; t++)
+	{
+		const glm::ivec3 &tri = m_triangles[t];
+		AABB box(pos[tri.x], pos[tri.x]);
+		for (int k = 0; k < 3; k++)
+		{
+			box.extend(pos[tri[k]]);
+			box.extend(pos[tri[k]] + dt * vel[tri[k]]);
+		}
+		box.fatten(m_margin);
+		m_bounds[t] = box;
+	}
+	m_tree.refit(m_bounds);
+}
+
+void MembraneCoupling::findContacts(const ParticleSystem &membrane, float dt)
+{
+	const std::vector<glm::vec3> &pos = membrane.getPos();
+	int spheres = (int)m_spheres.size();
+
+	#pragma omp parallel
+	{
+		std::vector<Contact> &result = m_threadContacts[getThreadNum()];
+		std::vector<int> candidates, stack;
+
+		#pragma omp for schedule(dynamic, 16)
+		for (int s = 0; s < spheres; s++)
+		{
+			const Sphere &sphere = m_spheres[s];
+			glm::vec3 vel = sphere.rb ? sphere.rb->getVel(sphere.index) : sphere.ps->getVel()[sphere.index];
+			glm::vec3 start = sphere.pos, end = start + dt * vel;
+			AABB box(glm::min(start, end), glm::max(start, end));
+			box.fatten(sphere.radius + m_margin);
+			candidates.clear();
+			m_tree.query(box, candidates, stack);
+
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				const glm::ivec3 &tri = m_triangles[candidates[c]];
+				glm::vec3 x[3];
+				for (int k = 0; k < 3; k++)
+				{
+					x[k] = pos[tri[k]];
+				}
+				glm::vec3 normal = glm::cross(x[1] - x[0], x[2] - x[0]);
+				float area2 = glm::length(normal);
+				if (area2 < 1e-12f)
+				{
+					continue;
+				}
+				normal /= area2;
+
+				// the side is the one the centre starts on, so a sphere that goes through the
+				// membrane in the step is still pushed back
+				Contact contact;
+				contact.side = glm::dot(start - x[0], normal) >= 0.0f ? 1.0f : -1.0f;
+				contact.sphere = s;
+				glm::vec3 w = closestPointTriangle(start, x[0], x[1], x[2]);
+				for (int j = 0; j < 3; j++)
+				{
+					contact.v[j] = tri[j];
+					contact.w[j] = w[j];
+				}
+				contact.n = contact.side * normal;
+				contact.lambda = 0.0f;
+				contact.vn = 0.0f;
+				result.push_back(contact);
+			}
+		}
+	}
+}
+
+void MembraneCoupling::step(XPBDCloth &cloth, ParticleSystem &membrane, float dt)
+{
+	gatherSpheres();
+	m_substeps = fitSubsteps(cloth, membrane);
+	m_contacts.clear();
+	if (!m_tree.isEmpty())
+	{
+		int threads = getMaxThreads();
+		m_threadContacts.resize(threads);
+		for (int t = 0; t < threads; t++)
+		{
+			m_threadContacts[t].clear();
+		}
+
+		refit(membrane, dt);
+		findContacts(membrane, dt);
+		for (int t = 0; t < threads; t++)
+		{
+			m_contacts.insert(m_contacts.end(), m_threadContacts[t].begin(), m_threadContacts[t].end());
+		}
+	}
+
+	for (size_t k = 0; k < m_bodySystems.size(); k++)
+	{
+		m_bodySystems[k]->wakeOnForces();
+	}
+	int substeps = cloth.getSubsteps();
+	cloth.setSubsteps(m_substeps);
+	cloth.step(membrane, dt, this);
+	cloth.setSubsteps(substeps);
+	for (size_t k = 0; k < m_bodySystems.size(); k++)
+	{
+		m_bodySystems[k]->updateSleep(dt);
+		m_bodySystems[k]->clearForces();
+	}
+}
+
+
+/*
+** CLOTH SOLVER CONSTRAINTS
+*/
+
+glm::vec3 MembraneCoupling::getSphereVel(const Sphere &sphere, const glm::vec3 &arm) const
+{
+	if (sphere.rb)
+	{
+		return sphere.rb->getVel(sphere.index) + glm::cross(sphere.rb->getAngularVel(sphere.index), arm);
+	}
+	return sphere.ps->getVel()[sphere.index];
+}
+
+void MembraneCoupling::applyImpulse(Sphere &sphere, const glm::vec3 &impulse, const glm::vec3 &arm)
+{
+	if (sphere.rb)
+	{
+		sphere.rb->applyImpulse(sphere.index, impulse, sphere.pos + arm);
+	}
+	else
+	{
+		sphere.ps->getVel()[sphere.index] += sphere.invMass * impulse;
+	}
+}
+
+void MembraneCoupling::beginSubstep(const ParticleSystem &ps, float h)
+{
+	for (size_t k = 0; k < m_systems.size(); k++)
+	{
+		m_systems[k]->step(h);
+	}
+	for (size_t k = 0; k < m_bodySystems.size(); k++)
+	{
+		RigidBodySystem &rb = *m_bodySystems[k];
+		rb.integrate(h);
+		if (rb.hasCube())
+		{
+			rb.collideCube();
+		}
+	}
+
+	for (size_t s = 0; s < m_spheres.size(); s++)
+	{
+		Sphere &sphere = m_spheres[s];
+		sphere.pos = sphere.rb ? sphere.rb->getPos(sphere.index) : sphere.ps->getPos()[sphere.index];
+		sphere.dx = glm::vec3(0.0f);
+	}
+
+	// approach speeds before the solve, for the restitution
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	for (size_t c = 0; c < m_contacts.size(); c++)
+	{
+		Contact &contact = m_contacts[c];
+		const Sphere &sphere = m_spheres[contact.sphere];
+		glm::vec3 v = getSphereVel(sphere, -sphere.radius * contact.n);
+		for (int k = 0; k < 3; k++)
+		{
+			v -= contact.w[k] * vel[contact.v[k]];
+		}
+		contact.vn = glm::dot(v, contact.n);
+		contact.lambda = 0.0f;
+	}
+}
+
+void MembraneCoupling::project(std::vector<float> &x, std::vector<float> &y, std::vector<float> &z, const std::vector<float> &w)
+{
+	int contacts = (int)m_contacts.size();
+
+	// Gauss-Seidel over all contacts, so corrections travel through the membrane and between bodies
+	for (int c = 0; c < contacts; c++)
+	{
+		Contact &contact = m_contacts[c];
+		Sphere &sphere = m_spheres[contact.sphere];
+		glm::vec3 p[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int v = contact.v[k];
+			p[k] = glm::vec3(x[v], y[v], z[v]);
+		}
+		glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+		float area2 = glm::length(normal);
+		if (area2 < 1e-12f)
+		{
+			continue;
+		}
+		normal /= area2;
+
+		glm::vec3 b = closestPointTriangle(sphere.pos, p[0], p[1], p[2]);
+		glm::vec3 d = sphere.pos - (b.x * p[0] + b.y * p[1] + b.z * p[2]);
+		float distance = glm::length(d);
+		// the centre has gone through the triangle if it is behind it on the wrong side; behind
+		// the plane of a curved membrane beside the triangle, the closest point is still the way out
+		bool behind = glm::dot(sphere.pos - p[0], normal) * contact.side <= 0.0f && b.x > 0.0f && b.y > 0.0f && b.z > 0.0f;
+		if (!behind && distance > 1e-6f)
+		{
+			contact.n = d / distance;
+		}
+		else
+		{
+			contact.n = contact.side * normal;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			contact.w[k] = b[k];
+		}
+
+		float separation = glm::dot(d, contact.n) - sphere.radius;
+		if (separation >= 0.0f)
+		{
+			continue;
+		}
+		float k = sphere.invMass + b.x * b.x * w[contact.v[0]] + b.y * b.y * w[contact.v[1]] + b.z * b.z * w[contact.v[2]];
+		if (k <= 0.0f)
+		{
+			continue;
+		}
+
+		// contacts are hard constraints, no compliance
+		float dLambda = -separation / k;
+		contact.lambda += dLambda;
+		glm::vec3 dx = (sphere.invMass * dLambda) * contact.n;
+		sphere.pos += dx;
+		sphere.dx += dx;
+		for (int j = 0; j < 3; j++)
+		{
+			int v = contact.v[j];
+			float s = contact.w[j] * w[v] * dLambda;
+			x[v] -= s * contact.n.x;
+			y[v] -= s * contact.n.y;
+			z[v] -= s * contact.n.z;
+		}
+	}
+}
+
+void MembraneCoupling::solveVelocities(ParticleSystem &membrane, float h)
+{
+	std::vector<glm::vec3> &vel = membrane.getVel();
+	const std::vector<float> &invMass = membrane.getInvMass();
+	int contacts = (int)m_contacts.size();
+	m_touching = 0;
+
+	for (int c = 0; c < contacts; c++)
+	{
+		Contact &contact = m_contacts[c];
+		if (contact.lambda <= 0.0f)
+		{
+			continue;
+		}
+		m_touching++;
+		Sphere &sphere = m_spheres[contact.sphere];
+		glm::vec3 arm = -sphere.radius * contact.n;
+		float membraneMass = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			membraneMass += contact.w[k] * contact.w[k] * invMass[contact.v[k]];
+		}
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			glm::vec3 v = getSphereVel(sphere, arm);
+			for (int k = 0; k < 3; k++)
+			{
+				v -= contact.w[k] * vel[contact.v[k]];
+			}
+			float vn = glm::dot(v, contact.n);
+
+			glm::vec3 impulse;
+			if (pass == 0)
+			{
+				// the approach of a fast contact comes back with the restitution, any other ends
+				// at rest, so removing a penetration doesn't throw the pair apart
+				float target = contact.vn < -m_restitutionThreshold ? -m_restitution * contact.vn : 0.0f;
+				float k = sphere.invMass + membraneMass;
+				if (k <= 0.0f)
+				{
+					break;
+				}
+				impulse = ((target - vn) / k) * contact.n;
+			}
+			else
+			{
+				// Coulomb friction, limited by the normal impulse of the substep
+				glm::vec3 vt = v - vn * contact.n;
+				float speed = glm::length(vt);
+				if (speed < 1e-9f)
+				{
+					break;
+				}
+				glm::vec3 t = vt / speed;
+				float k = sphere.invMass + membraneMass;
+				if (sphere.rb)
+				{
+					glm::vec3 rt = glm::cross(arm, t);
+					k += glm::dot(rt, sphere.rb->getInvInertiaWorld(sphere.index) * rt);
+				}
+				impulse = -std::min(speed / k, m_friction * contact.lambda / h) * t;
+			}
+
+			applyImpulse(sphere, impulse, arm);
+			for (int k = 0; k < 3; k++)
+			{
+				vel[contact.v[k]] -= contact.w[k] * invMass[contact.v[k]] * impulse;
+			}
+		}
+	}
+}
+
+void MembraneCoupling::endSubstep(ParticleSystem &ps, float h)
+{
+	// the contacts moved the spheres, which changes their velocities as it does the cloth's
+	for (size_t s = 0; s < m_spheres.size(); s++)
+	{
+		Sphere &sphere = m_spheres[s];
+		if (sphere.dx == glm::vec3(0.0f))
+		{
+			continue;
+		}
+		if (sphere.rb)
+		{
+			RigidBodySystem &rb = *sphere.rb;
+			rb.setPos(sphere.index, sphere.pos);
+			rb.setVel(sphere.index, rb.getVel(sphere.index) + sphere.dx / h);
+			if (rb.isSleeping(sphere.index))
+			{
+				rb.wake(sphere.index);
+			}
+		}
+		else
+		{
+			ParticleSystem &other = *sphere.ps;
+			other.getPos()[sphere.index] = sphere.pos;
+			other.getVel()[sphere.index] += sphere.dx / h;
+			if (other.isSleeping(sphere.index))
+			{
+				other.wake(sphere.index);
+			}
+		}
+	}
+
+	solveVelocities(ps, h);
+}
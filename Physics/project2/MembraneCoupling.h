@@ -0,0 +1,139 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "ParticleSystem.h"
+#include "RigidBodySystem.h"
+#include "ClothMesh.h"
+#include "TriangleTree.h"
+#include "XPBDCloth.h"
+
+/*
+** MEMBRANE COUPLING
+** Two-way coupling of a cloth membrane (a trampoline) with the particles of other
+** systems and with the bodies of rigid body systems, each colliding as a sphere.
+** The coupling runs the whole scene in one step of the cloth solver: at the start
+** of the step the candidate pairs of a sphere and a membrane triangle are found
+** through a BVH over the triangles, refitted to their motion over the step, and in
+** every substep of the cloth the particles and the bodies are moved with it, and
+** the contacts are projected as constraints in the cloth solver's iterations, on
+** the sphere and, through the barycentric weights of the closest point, on the
+** three membrane vertices. The membrane is pushed down as much as the body is held
+** up within the substep and later throws it back. A body much heavier than the
+** membrane pushes the vertices under it through faster than the cloth constraints
+** carry its weight to the frame, so the cloth substeps of the step are raised with
+** the square root of the mass ratio (e.g. 32 for a body of 50 times the mass of the
+** free membrane), up to a limit; the contacts see heavier bodies at the mass the
+** limit holds.
+** The position changes of the spheres become velocity changes at the end of the
+** substep, those of the bodies through their velocity API, and a velocity pass then
+** applies Coulomb friction, limited by the normal impulse of the substep, and the
+** restitution of the contacts that approached faster than a threshold; the friction
+** impulse acts at the contact point, so it spins a body.
+*/
+class MembraneCoupling : public ExternalConstraints
+{
+public:
+	MembraneCoupling();
+	~MembraneCoupling();
+
+	/*
+	** GET METHODS
+	*/
+	// candidate pairs of the last step, and the contacts pushing in its last substep
+	int getCandidateCount() const { return (int)m_contacts.size(); }
+	int getContactCount() const { return m_touching; }
+	// cloth substeps of the last step, raised for heavy bodies
+	int getSubsteps() const { return m_substeps; }
+
+	/*
+	** SET METHODS
+	*/
+	void setFriction(float friction) { m_friction = friction; }
+	void setRestitution(float restitution) { m_restitution = restitution; }
+	// approach speed under which contacts don't bounce
+	void setRestitutionThreshold(float speed) { m_restitutionThreshold = speed; }
+	// candidates are kept this far ahead of touching
+	void setMargin(float margin) { m_margin = margin; }
+	// the most cloth substeps a step is raised to for heavy bodies, which sets the heaviest body
+	// the membrane holds: about (substeps / 4.5)^2 times its mass, 200 times for 64
+	void setMaxSubsteps(int substeps) { m_maxSubsteps = substeps; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// the membrane triangles, with the BVH built at the current positions
+	void setMembrane(const ClothMesh &mesh, const ParticleSystem &membrane);
+	// particles of another system, all of the given radius; the system is not owned and is
+	// stepped by the coupling
+	void addParticles(ParticleSystem &ps, float radius);
+	// a body of a rigid body system, colliding as a sphere of the given radius around its centre
+	// of mass; the system is not owned and is stepped by the coupling, without body contacts
+	void addBody(RigidBodySystem &rb, int body, float radius);
+
+	// step the membrane with the cloth solver, and the particles and bodies in its substeps
+	void step(XPBDCloth &cloth, ParticleSystem &membrane, float dt);
+
+	// the constraints of the cloth solver
+	void beginSubstep(const ParticleSystem &ps, float h);
+	void project(std::vector<float> &x, std::vector<float> &y, std::vector<float> &z, const std::vector<float> &w);
+	void endSubstep(ParticleSystem &ps, float h);
+
+private:
+	// a sphere taking part in the step: a rigid body, or a particle without rotation
+	struct Sphere
+	{
+		RigidBodySystem *rb; // 0 for a particle
+		ParticleSystem *ps;
+		int index;
+		float invMass, radius;
+		glm::vec3 pos; // predicted centre during a substep
+		glm::vec3 dx; // moved by the contacts in the substep
+	};
+
+	struct Contact
+	{
+		int sphere;
+		int v[3];
+		float side; // side of the membrane the centre started the step on
+		float w[3]; // barycentric weights of the membrane point, from the last projection
+		glm::vec3 n; // from the membrane to the sphere, from the last projection
+		float lambda; // position impulse of the substep
+		float vn; // normal velocity at the start of the substep
+	};
+
+	void gatherSpheres();
+	// substeps for the heaviest sphere, whose mass the contacts see at most at the limit
+	int fitSubsteps(const XPBDCloth &cloth, const ParticleSystem &membrane);
+	void refit(const ParticleSystem &membrane, float dt);
+	void findContacts(const ParticleSystem &membrane, float dt);
+	glm::vec3 getSphereVel(const Sphere &sphere, const glm::vec3 &arm) const;
+	void applyImpulse(Sphere &sphere, const glm::vec3 &impulse, const glm::vec3 &arm);
+	void solveVelocities(ParticleSystem &membrane, float h);
+
+	float m_friction;
+	float m_restitution;
+	float m_restitutionThreshold;
+	float m_margin;
+	int m_maxSubsteps;
+	int m_substeps;
+	int m_touching;
+
+	// membrane
+	std::vector<glm::ivec3> m_triangles;
+	TriangleTree m_tree;
+	std::vector<AABB> m_bounds;
+
+	// particle systems and rigid bodies, not owned
+	std::vector<ParticleSystem*> m_systems;
+	std::vector<float> m_systemRadius;
+	std::vector<RigidBodySystem*> m_bodySystems;
+	std::vector<RigidBodySystem*> m_bodySystem;
+	std::vector<int> m_body;
+	std::vector<float> m_bodyRadius;
+
+	std::vector<Sphere> m_spheres;
+	std::vector<std::vector<Contact> > m_threadContacts;
+	std::vector<Contact> m_contacts;
+};
@@ -68,6 +68,8 @@ public:
 	}
 	// set i_th coordinate of mesh center to float p (x: i=0, y: i=1, z: i=2)
 	void setPos(int i, float p) { m_translate[3][i] = p; }
+	// set the rotation matrix, e.g. from the orientation of a rigid body
+	void setRotate(const glm::mat4 &rotate) { m_rotate = rotate; }
 
 	// allocate shader to mesh
 	void setShader(const Shader &shader) {
@@ -0,0 +1,276 @@
+// Math constants
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "PBFFluid.h"
+
+
+PBFFluid::PBFFluid()
+{
+	m_iterations = 4;
+	m_h = 0.1f;
+	m_restDensity = 1000.0f;
+	m_relaxation = 100.0f;
+	m_viscosity = 0.01f;
+	m_tensileK = 0.0001f;
+	m_densityError = 0.0f;
+
+	m_gridOrigin = glm::vec3(0.0f);
+	m_gridBound = glm::vec3(0.0f);
+	m_gridCellSize = 0.0f;
+}
+
+
+PBFFluid::~PBFFluid()
+{
+}
+
+void PBFFluid::addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi) const
+{
+	float spacing = 0.5f * m_h;
+	float mass = m_restDensity * spacing * spacing * spacing;
+	for (float z = lo.z + 0.5f * spacing; z < hi.z; z += spacing)
+	{
+		for (float y = lo.y + 0.5f * spacing; y < hi.y; y += spacing)
+		{
+			for (float x = lo.x + 0.5f * spacing; x < hi.x; x += spacing)
+			{
+				ps.addParticle(glm::vec3(x, y, z), glm::vec3(0.0f), mass);
+			}
+		}
+	}
+}
+
+// apply the external forces, predict the positions and sort them into the grid
+void PBFFluid::predict(ParticleSystem &ps, float dt)
+{
+	ps.clearForces();
+	ps.applyForces();
+
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &invMass = ps.getInvMass();
+	const std::vector<float> &mass = ps.getMass();
+	int n = ps.getCount();
+
+	// the predicted positions are sorted, the neighbourhoods are kept for the whole step
+	m_predicted.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		vel[i] += force[i] * invMass[i] * dt;
+		m_predicted[i] = pos[i] + vel[i] * dt;
+	}
+
+	const Cube &cube = ps.getCube();
+	if (cube.origin != m_gridOrigin || cube.bound != m_gridBound || m_h != m_gridCellSize)
+	{
+		m_grid.setDomain(cube.origin, cube.bound, m_h);
+		m_gridOrigin = cube.origin;
+		m_gridBound = cube.bound;
+		m_gridCellSize = m_h;
+	}
+	m_grid.build(m_predicted);
+
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	const std::vector<unsigned int> &cells = m_grid.getSortedCells();
+	const glm::ivec3 &dims = m_grid.getDims();
+
+	m_cell.resize(n);
+	m_x.resize(n); m_y.resize(n); m_z.resize(n);
+	m_nx.resize(n); m_ny.resize(n); m_nz.resize(n);
+	m_vx.resize(n); m_vy.resize(n); m_vz.resize(n);
+	m_m.resize(n); m_lambda.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		int p = order[i];
+		int cell = (int)cells[i];
+		m_cell[i] = glm::ivec3(cell % dims.x, (cell / dims.x) % dims.y, cell / (dims.x * dims.y));
+		m_x[i] = m_predicted[p].x; m_y[i] = m_predicted[p].y; m_z[i] = m_predicted[p].z;
+		m_m[i] = mass[p];
+	}
+}
+
+// lambda_i = -C_i / (sum_k |grad_k C_i|^2 + eps) with C_i = rho_i / rho0 - 1
+void PBFFluid::computeLambda()
+{
+	int n = (int)m_x.size();
+	float h = m_h;
+	float h2 = h * h;
+	float poly6 = 315.0f / (64.0f * (float)M_PI * powf(h, 9.0f));
+	float spiky = -45.0f / ((float)M_PI * powf(h, 6.0f));
+	float invRho0 = 1.0f / m_restDensity;
+	float error = 0.0f;
+
+	#pragma omp parallel for schedule(dynamic, 256) reduction(+:error)
+	for (int i = 0; i < n; i++)
+	{
+		float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+		float rho = 0.0f;
+		float gx = 0.0f, gy = 0.0f, gz = 0.0f; // gradient with respect to particle i
+		float sumGrad2 = 0.0f;
+
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				int begin, end;
+				m_grid.getRowRange(m_cell[i], dy, dz, begin, end);
+				for (int j = begin; j < end; j++)
+				{
+					float rx = xi - m_x[j], ry = yi - m_y[j], rz = zi - m_z[j];
+					float r2 = rx * rx + ry * ry + rz * rz;
+					float r = sqrtf(r2);
+					float d = h2 - r2;
+					d = d > 0.0f ? d : 0.0f;
+					rho += m_m[j] * d * d * d;
+
+					float inside = (r < h && r > 1e-6f) ? 1.0f : 0.0f;
+					float q = inside * (h - r);
+					float g = invRho0 * m_m[j] * spiky * q * q / (r + 1e-6f);
+					gx += g * rx;
+					gy += g * ry;
+					gz += g * rz;
+					sumGrad2 += g * g * r2;
+				}
+			}
+		}
+
+		float C = poly6 * rho * invRho0 - 1.0f;
+		sumGrad2 += gx * gx + gy * gy + gz * gz;
+		m_lambda[i] = -C / (sumGrad2 + m_relaxation);
+		error += C > 0.0f ? C : 0.0f;
+	}
+
+	m_densityError = n > 0 ? error / n : 0.0f;
+}
+
+// delta p_i = 1/rho0 sum_j (lambda_i + lambda_j + s_corr) grad W, written to a second buffer (Jacobi)
+void PBFFluid::applyCorrection(const Cube &cube)
+{
+	int n = (int)m_x.size();
+	float h = m_h;
+	float h2 = h * h;
+	float spiky = -45.0f / ((float)M_PI * powf(h, 6.0f));
+	float invRho0 = 1.0f / m_restDensity;
+
+	// s_corr = -k (W(r) / W(0.2 h))^4
+	float dq = h2 - 0.04f * h2;
+	float invWdq = 1.0f / (dq * dq * dq);
+
+	#pragma omp parallel for schedule(dynamic, 256)
+	for (int i = 0; i < n; i++)
+	{
+		float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+		float li = m_lambda[i];
+		float dx = 0.0f, dy = 0.0f, dz = 0.0f;
+
+		for (int oz = -1; oz <= 1; oz++)
+		{
+			for (int oy = -1; oy <= 1; oy++)
+			{
+				int begin, end;
+				m_grid.getRowRange(m_cell[i], oy, oz, begin, end);
+				for (int j = begin; j < end; j++)
+				{
+					float rx = xi - m_x[j], ry = yi - m_y[j], rz = zi - m_z[j];
+					float r2 = rx * rx + ry * ry + rz * rz;
+					float r = sqrtf(r2);
+					float inside = (r < h && r > 1e-6f) ? 1.0f : 0.0f;
+					float q = inside * (h - r);
+
+					float w = inside * (h2 - r2);
+					float ratio = w * w * w * invWdq;
+					float ratio2 = ratio * ratio;
+					float sCorr = -m_tensileK * ratio2 * ratio2;
+
+					float s = invRho0 * m_m[j] * (li + m_lambda[j] + sCorr) * spiky * q * q / (r + 1e-6f);
+					dx += s * rx;
+					dy += s * ry;
+					dz += s * rz;
+				}
+			}
+		}
+
+		// keep the corrected position inside the container
+		m_nx[i] = glm::clamp(xi + dx, cube.origin.x, cube.bound.x);
+		m_ny[i] = glm::clamp(yi + dy, cube.origin.y, cube.bound.y);
+		m_nz[i] = glm::clamp(zi + dz, cube.origin.z, cube.bound.z);
+	}
+
+	m_x.swap(m_nx);
+	m_y.swap(m_ny);
+	m_z.swap(m_nz);
+}
+
+// v = (x* - x) / dt, then XSPH smoothing v_i += c sum_j (v_j - v_i) W_ij
+void PBFFluid::updateVelocities(ParticleSystem &ps, float dt)
+{
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	int n = (int)m_x.size();
+	float h2 = m_h * m_h;
+	float poly6 = 315.0f / (64.0f * (float)M_PI * powf(m_h, 9.0f));
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		int p = order[i];
+		m_vx[i] = (m_x[i] - pos[p].x) / dt;
+		m_vy[i] = (m_y[i] - pos[p].y) / dt;
+		m_vz[i] = (m_z[i] - pos[p].z) / dt;
+	}
+
+	#pragma omp parallel for schedule(dynamic, 256)
+	for (int i = 0; i < n; i++)
+	{
+		float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+		float vx = 0.0f, vy = 0.0f, vz = 0.0f;
+
+		for (int oz = -1; oz <= 1; oz++)
+		{
+			for (int oy = -1; oy <= 1; oy++)
+			{
+				int begin, end;
+				m_grid.getRowRange(m_cell[i], oy, oz, begin, end);
+				for (int j = begin; j < end; j++)
+				{
+					float rx = xi - m_x[j], ry = yi - m_y[j], rz = zi - m_z[j];
+					float d = h2 - (rx * rx + ry * ry + rz * rz);
+					d = d > 0.0f ? d : 0.0f;
+					float w = m_m[j] / m_restDensity * poly6 * d * d * d;
+					vx += (m_vx[j] - m_vx[i]) * w;
+					vy += (m_vy[j] - m_vy[i]) * w;
+					vz += (m_vz[j] - m_vz[i]) * w;
+				}
+			}
+		}
+
+		int p = order[i];
+		pos[p] = glm::vec3(xi, yi, zi);
+		vel[p] = glm::vec3(m_vx[i], m_vy[i], m_vz[i]) + m_viscosity * glm::vec3(vx, vy, vz);
+	}
+}
+
+void PBFFluid::step(ParticleSystem &ps, float dt)
+{
+	if (ps.getCount() == 0)
+	{
+		return;
+	}
+
+	predict(ps, dt);
+
+	for (int k = 0; k < m_iterations; k++)
+	{
+		computeLambda();
+		applyCorrection(ps.getCube());
+	}
+
+	updateVelocities(ps, dt);
+}
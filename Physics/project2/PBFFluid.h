@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "UniformGrid.h"
+
+/*
+** POSITION BASED FLUID
+** Density constraints projected with Jacobi iterations (Macklin and Mueller 2013).
+** Every iteration is two passes over flat cell-ordered arrays: the constraint
+** multipliers, then the position corrections. Each pass only reads the previous
+** pass and writes its own particle, so it runs in parallel without atomics.
+** Velocities are smoothed with XSPH viscosity at the end of the step.
+*/
+class PBFFluid
+{
+public:
+	PBFFluid();
+	~PBFFluid();
+
+	/*
+	** GET METHODS
+	*/
+	int getIterations() const { return m_iterations; }
+	float getSmoothingLength() const { return m_h; }
+	float getRestDensity() const { return m_restDensity; }
+	// average density error (rho / rho0 - 1) of the last iteration
+	float getDensityError() const { return m_densityError; }
+
+	/*
+	** SET METHODS
+	*/
+	// number of Jacobi iterations per step
+	void setIterations(int iterations) { m_iterations = iterations; }
+	void setSmoothingLength(float h) { m_h = h; }
+	void setRestDensity(float rho) { m_restDensity = rho; }
+	// constraint force mixing, softens the constraints and avoids divisions by zero
+	void setRelaxation(float eps) { m_relaxation = eps; }
+	// XSPH viscosity coefficient
+	void setViscosity(float c) { m_viscosity = c; }
+	// artificial pressure strength (s_corr), reduces clustering at the free surface
+	void setTensileStrength(float k) { m_tensileK = k; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// fill a box with particles at rest spaced half a smoothing length apart
+	void addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi) const;
+
+	// advance the particles of the system by dt: forces, prediction, projection, velocity update
+	void step(ParticleSystem &ps, float dt);
+
+private:
+	void predict(ParticleSystem &ps, float dt);
+	void computeLambda();
+	void applyCorrection(const Cube &cube);
+	void updateVelocities(ParticleSystem &ps, float dt);
+
+	int m_iterations;
+	float m_h;
+	float m_restDensity;
+	float m_relaxation;
+	float m_viscosity;
+	float m_tensileK;
+	float m_densityError;
+
+	UniformGrid m_grid;
+	glm::vec3 m_gridOrigin, m_gridBound;
+	float m_gridCellSize;
+
+	std::vector<glm::vec3> m_predicted; // predicted positions in particle order
+
+	// particle data in cell order
+	std::vector<glm::ivec3> m_cell;
+	std::vector<float> m_x, m_y, m_z; // predicted positions
+	std::vector<float> m_nx, m_ny, m_nz; // positions written by the current iteration
+	std::vector<float> m_m, m_lambda;
+	std::vector<float> m_vx, m_vy, m_vz;
+};
@@ -0,0 +1,264 @@
+#include <algorithm>
+
+#include "PairCache.h"
+
+
+PairCache::PairCache()
+{
+	m_table.assign(64, -1);
+	m_mask = 63;
+}
+
+
+PairCache::~PairCache()
+{
+}
+
+
+/*
+** HASH TABLE
+*/
+
+// murmur3 style finaliser on the packed pair
+unsigned int PairCache::hash(int bodyA, int bodyB)
+{
+	unsigned int h = (unsigned int)bodyA * 0x9E3779B1u ^ (unsigned int)bodyB;
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// slot holding the pair, or -1
+int PairCache::findSlot(int bodyA, int bodyB) const
+{
+	unsigned int slot = hash(bodyA, bodyB) & m_mask;
+	while (m_table[slot] != -1)
+	{
+		const CachedPair &p = m_pairs[m_table[slot]];
+		if (p.bodyA == bodyA && p.bodyB == bodyB)
+		{
+			return (int)slot;
+		}
+		slot = (slot + 1) & m_mask;
+	}
+	return -1;
+}
+
+// empty a slot and shift the following entries back so that no tombstones are needed
+void PairCache::eraseSlot(int slot)
+{
+	unsigned int i = (unsigned int)slot;
+	unsigned int j = i;
+	m_table[i] = -1;
+
+	while (true)
+	{
+		j = (j + 1) & m_mask;
+		if (m_table[j] == -1)
+		{
+			return;
+		}
+
+		const CachedPair &p = m_pairs[m_table[j]];
+		unsigned int home = hash(p.bodyA, p.bodyB) & m_mask;
+
+		// the entry at j may move to i only if its home slot is not cyclically in (i, j]
+		bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+		if (!between)
+		{
+			m_table[i] = m_table[j];
+			m_table[j] = -1;
+			i = j;
+		}
+	}
+}
+
+// double the table, only happens while the pair count is still growing
+void PairCache::grow()
+{
+	unsigned int size = (m_mask + 1) * 2;
+	m_table.assign(size, -1);
+	m_mask = size - 1;
+
+	for (int i = 0; i < (int)m_pairs.size(); i++)
+	{
+		unsigned int slot = hash(m_pairs[i].bodyA, m_pairs[i].bodyB) & m_mask;
+		while (m_table[slot] != -1)
+		{
+			slot = (slot + 1) & m_mask;
+		}
+		m_table[slot] = i;
+	}
+}
+
+void PairCache::reserve(int pairCount)
+{
+	m_pairs.reserve(pairCount);
+	m_begin.reserve(pairCount);
+	m_persist.reserve(pairCount);
+	m_end.reserve(pairCount);
+
+	// keep the load factor under one half
+	while ((int)(m_mask + 1) < 2 * pairCount)
+	{
+		grow();
+	}
+}
+
+
+/*
+** PAIR METHODS
+*/
+
+void PairCache::beginStep()
+{
+	m_begin.clear();
+	m_persist.clear();
+	m_end.clear();
+}
+
+CachedPair& PairCache::addPair(int bodyA, int bodyB)
+{
+	if (bodyA > bodyB)
+	{
+		std::swap(bodyA, bodyB);
+	}
+
+	unsigned int slot = hash(bodyA, bodyB) & m_mask;
+	while (m_table[slot] != -1)
+	{
+		CachedPair &p = m_pairs[m_table[slot]];
+		if (p.bodyA == bodyA && p.bodyB == bodyB)
+		{
+			return p;
+		}
+		slot = (slot + 1) & m_mask;
+	}
+
+	// new pair
+	CachedPair p;
+	p.bodyA = bodyA;
+	p.bodyB = bodyB;
+	p.age = 0;
+	p.impulse = glm::vec3(0.0f);
+	p.tangent = glm::vec3(0.0f);
+	p.pointCount = 0;
+
+	m_table[slot] = (int)m_pairs.size();
+	m_pairs.push_back(p);
+
+	BodyPair event = { bodyA, bodyB };
+	m_begin.push_back(event);
+
+	if (2 * m_pairs.size() > m_mask + 1)
+	{
+		grow();
+	}
+
+	return m_pairs.back();
+}
+
+void PairCache::addPairs(const std::vector<BodyPair> &pairs)
+{
+	for (int i = 0; i < (int)pairs.size(); i++)
+	{
+		addPair(pairs[i].bodyA, pairs[i].bodyB);
+	}
+}
+
+void PairCache::endStep(const std::vector<AABB> &bodyBounds)
+{
+	int i = 0;
+	while (i < (int)m_pairs.size())
+	{
+		CachedPair &p = m_pairs[i];
+		if (bodyBounds[p.bodyA].overlaps(bodyBounds[p.bodyB]))
+		{
+			// pairs added this step already raised a begin event
+			if (p.age > 0)
+			{
+				BodyPair event = { p.bodyA, p.bodyB };
+				m_persist.push_back(event);
+			}
+			p.age++;
+			i++;
+		}
+		else
+		{
+			// removal swaps the last pair into slot i, so don't advance
+			BodyPair event = { p.bodyA, p.bodyB };
+			m_end.push_back(event);
+			removePair(event.bodyA, event.bodyB);
+		}
+	}
+}
+
+CachedPair* PairCache::findPair(int bodyA, int bodyB)
+{
+	if (bodyA > bodyB)
+	{
+		std::swap(bodyA, bodyB);
+	}
+
+	int slot = findSlot(bodyA, bodyB);
+	return slot == -1 ? NULL : &m_pairs[m_table[slot]];
+}
+
+bool PairCache::removePair(int bodyA, int bodyB)
+{
+	if (bodyA > bodyB)
+	{
+		std::swap(bodyA, bodyB);
+	}
+
+	int slot = findSlot(bodyA, bodyB);
+	if (slot == -1)
+	{
+		return false;
+	}
+
+	int index = m_table[slot];
+	eraseSlot(slot);
+
+	// move the last pair into the hole to keep the storage dense
+	int last = (int)m_pairs.size() - 1;
+	if (index != last)
+	{
+		int lastSlot = findSlot(m_pairs[last].bodyA, m_pairs[last].bodyB);
+		m_pairs[index] = m_pairs[last];
+		m_table[lastSlot] = index;
+	}
+	m_pairs.pop_back();
+
+	return true;
+}
+
+void PairCache::removeBody(int bodyId)
+{
+	int i = 0;
+	while (i < (int)m_pairs.size())
+	{
+		if (m_pairs[i].bodyA == bodyId || m_pairs[i].bodyB == bodyId)
+		{
+			BodyPair event = { m_pairs[i].bodyA, m_pairs[i].bodyB };
+			m_end.push_back(event);
+			removePair(event.bodyA, event.bodyB);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void PairCache::clear()
+{
+	m_pairs.clear();
+	m_begin.clear();
+	m_persist.clear();
+	m_end.clear();
+	std::fill(m_table.begin(), m_table.end(), -1);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "AABB.h"
+#include "Broadphase.h"
+
+// contact point of a rigid body pair kept between steps
+struct CachedPoint
+{
+	glm::vec3 localA, localB; // in the axes of each body, relative to its centre
+	float depth; // penetration when the narrowphase found the point
+	float normalImpulse; // accumulated impulses of the last step, for warm starting
+	glm::vec3 frictionImpulse; // in world axes, so it carries over when the tangents turn
+};
+
+// persistent data kept for an overlapping pair of bodies between steps
+struct CachedPair
+{
+	int bodyA;
+	int bodyB;
+	int age; // number of steps the pair has existed
+
+	glm::vec3 impulse; // accumulated contact impulse (normal, tangent1, tangent2) used for warm starting
+	glm::vec3 tangent; // tangential spring displacement of a DEM contact (friction history)
+
+	// contact manifold of a rigid body pair: the points, the normal in the axes of A and the
+	// orientation of B relative to A when the narrowphase last ran
+	int pointCount;
+	CachedPoint points[4];
+	glm::vec3 localNormal;
+	glm::quat relative;
+};
+
+/*
+** PAIR CACHE
+** Stores the overlapping pairs reported by the broadphase together with their
+** per-pair solver data. Pairs live in a dense array and are found through an
+** open addressing (linear probing) hash table of indices, so steady state pairs
+** cost no allocation and no rehashing.
+*/
+class PairCache
+{
+public:
+	PairCache();
+	~PairCache();
+
+	/*
+	** GET METHODS
+	*/
+	int getPairCount() const { return (int)m_pairs.size(); }
+	CachedPair& getPair(int i) { return m_pairs[i]; }
+	const CachedPair& getPair(int i) const { return m_pairs[i]; }
+
+	// events of the last step
+	const std::vector<BodyPair>& getBeginEvents() const { return m_begin; }
+	const std::vector<BodyPair>& getPersistEvents() const { return m_persist; }
+	const std::vector<BodyPair>& getEndEvents() const { return m_end; }
+
+	/*
+	** PAIR METHODS
+	*/
+	// start a new step: clears the event lists
+	void beginStep();
+	// add a pair reported by the broadphase, returns the cached pair (new or existing)
+	CachedPair& addPair(int bodyA, int bodyB);
+	// add all the pairs reported by the broadphase this step
+	void addPairs(const std::vector<BodyPair> &pairs);
+	// finish the step: pairs whose body bounds no longer overlap are removed
+	void endStep(const std::vector<AABB> &bodyBounds);
+
+	// find a pair, returns NULL if it isn't cached
+	CachedPair* findPair(int bodyA, int bodyB);
+	// remove a pair explicitly (e.g. when a body is destroyed)
+	bool removePair(int bodyA, int bodyB);
+	// remove every pair that involves a body
+	void removeBody(int bodyId);
+	void clear();
+
+	// reserve space for a number of pairs so that the table never grows during a run
+	void reserve(int pairCount);
+
+private:
+	static unsigned int hash(int bodyA, int bodyB);
+
+	int findSlot(int bodyA, int bodyB) const;
+	void eraseSlot(int slot);
+	void grow();
+
+	std::vector<CachedPair> m_pairs; // dense pair storage
+	std::vector<int> m_table; // open addressing table of indices into m_pairs, -1 = empty
+	unsigned int m_mask; // table size - 1, table size is a power of two
+
+	std::vector<BodyPair> m_begin;
+	std::vector<BodyPair> m_persist;
+	std::vector<BodyPair> m_end;
+};
@@ -0,0 +1,35 @@
+#pragma once
+// Thin wrappers around OpenMP so that the project still builds when /openmp is turned off.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// number of threads used by the next parallel region
+inline int getMaxThreads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// index of the calling thread inside a parallel region
+inline int getThreadNum()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+// number of threads in the current parallel region
+inline int getNumThreads()
+{
+#ifdef _OPENMP
+	return omp_get_num_threads();
+#else
+	return 1;
+#endif
+}
@@ -0,0 +1,267 @@
+#include "ParticleSystem.h"
+
+
+/*
+** FORCE GENERATORS
+*/
+
+void Gravity::applyForce(ParticleSystem &ps)
+{
+	std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &mass = ps.getMass();
+	int n = ps.getCount();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		force[i] += mass[i] * m_g;
+	}
+}
+
+
+/*
+** PARTICLE SYSTEM
+*/
+
+ParticleSystem::ParticleSystem()
+{
+	m_cor = 1.0f;
+	m_hasCube = false;
+	m_massVersion = 0;
+	m_sleeping = false;
+	m_sleepEnergy = 0.01f;
+	m_sleepTime = 0.5f;
+	m_wakeAcceleration = 1.0f;
+	m_activeDirty = false;
+}
+
+
+ParticleSystem::~ParticleSystem()
+{
+}
+
+int ParticleSystem::addParticle(const glm::vec3 &pos, const glm::vec3 &vel, float mass)
+{
+	m_pos.push_back(pos);
+	m_vel.push_back(vel);
+	m_force.push_back(glm::vec3(0.0f));
+	m_mass.push_back(mass);
+	m_invMass.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+	m_asleep.push_back(0);
+	m_sleepTimer.push_back(0.0f);
+	m_sleepForce.push_back(glm::vec3(0.0f));
+	m_active.push_back((int)m_pos.size() - 1);
+	m_massVersion++;
+	return (int)m_pos.size() - 1;
+}
+
+void ParticleSystem::reserve(int count)
+{
+	m_pos.reserve(count);
+	m_vel.reserve(count);
+	m_force.reserve(count);
+	m_mass.reserve(count);
+	m_invMass.reserve(count);
+	m_asleep.reserve(count);
+	m_sleepTimer.reserve(count);
+	m_sleepForce.reserve(count);
+	m_active.reserve(count);
+}
+
+void ParticleSystem::clear()
+{
+	m_pos.clear();
+	m_vel.clear();
+	m_force.clear();
+	m_mass.clear();
+	m_invMass.clear();
+	m_asleep.clear();
+	m_sleepTimer.clear();
+	m_sleepForce.clear();
+	m_active.clear();
+	m_inactive.clear();
+	m_activeDirty = false;
+	m_massVersion++;
+}
+
+void ParticleSystem::setSleeping(bool sleeping)
+{
+	m_sleeping = sleeping;
+	if (!sleeping && !m_inactive.empty())
+	{
+		for (int k = 0; k < (int)m_inactive.size(); k++)
+		{
+			m_asleep[m_inactive[k]] = 0;
+			m_sleepTimer[m_inactive[k]] = 0.0f;
+		}
+		m_activeDirty = true;
+	}
+}
+
+void ParticleSystem::wake(int i)
+{
+	m_sleepTimer[i] = 0.0f;
+	if (m_asleep[i])
+	{
+		m_asleep[i] = 0;
+		m_activeDirty = true;
+	}
+}
+
+void ParticleSystem::buildActive()
+{
+	if (!m_activeDirty)
+	{
+		return;
+	}
+
+	int n = getCount();
+	m_active.clear();
+	m_inactive.clear();
+	for (int i = 0; i < n; i++)
+	{
+		if (m_asleep[i])
+		{
+			m_inactive.push_back(i);
+		}
+		else
+		{
+			m_active.push_back(i);
+		}
+	}
+	m_activeDirty = false;
+}
+
+void ParticleSystem::clearForces()
+{
+	int n = getCount();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		m_force[i] = glm::vec3(0.0f);
+	}
+}
+
+void ParticleSystem::applyForces()
+{
+	for (int i = 0; i < (int)m_forceGenerators.size(); i++)
+	{
+		m_forceGenerators[i]->applyForce(*this);
+	}
+}
+
+// Semi-Implicit Euler integration of the particles awake
+void ParticleSystem::integrate(float dt)
+{
+	buildActive();
+	int n = (int)m_active.size();
+
+	#pragma omp parallel for
+	for (int k = 0; k < n; k++)
+	{
+		int i = m_active[k];
+		m_vel[i] += m_force[i] * m_invMass[i] * dt;
+		m_pos[i] += m_vel[i] * dt;
+	}
+}
+
+// reflect particles that left the cube back inside and bounce their velocity
+void ParticleSystem::collideCube()
+{
+	buildActive();
+	int n = (int)m_active.size();
+
+	#pragma omp parallel for
+	for (int k = 0; k < n; k++)
+	{
+		int i = m_active[k];
+		for (int j = 0; j < 3; j++)
+		{
+			if (m_pos[i][j] < m_cube.origin[j])
+			{
+				m_pos[i][j] = m_cube.origin[j] + (m_cube.origin[j] - m_pos[i][j]);
+				m_vel[i][j] *= -m_cor;
+			}
+
+			if (m_pos[i][j] > m_cube.bound[j])
+			{
+				m_pos[i][j] = m_cube.bound[j] - (m_pos[i][j] - m_cube.bound[j]);
+				m_vel[i][j] *= -m_cor;
+			}
+		}
+	}
+}
+
+void ParticleSystem::wakeOnForces()
+{
+	buildActive();
+	int n = (int)m_inactive.size();
+	int woken = 0;
+
+	#pragma omp parallel for reduction(+:woken)
+	for (int k = 0; k < n; k++)
+	{
+		int i = m_inactive[k];
+		glm::vec3 change = (m_force[i] - m_sleepForce[i]) * m_invMass[i];
+		if (glm::dot(change, change) > m_wakeAcceleration * m_wakeAcceleration)
+		{
+			m_asleep[i] = 0;
+			m_sleepTimer[i] = 0.0f;
+			woken++;
+		}
+	}
+
+	if (woken > 0)
+	{
+		m_activeDirty = true;
+	}
+}
+
+void ParticleSystem::updateSleep(float dt)
+{
+	if (!m_sleeping)
+	{
+		return;
+	}
+
+	buildActive();
+	int n = (int)m_active.size();
+	int slept = 0;
+
+	#pragma omp parallel for reduction(+:slept)
+	for (int k = 0; k < n; k++)
+	{
+		int i = m_active[k];
+		if (m_invMass[i] == 0.0f)
+		{
+			continue;
+		}
+		m_sleepTimer[i] = 0.5f * glm::dot(m_vel[i], m_vel[i]) < m_sleepEnergy ? m_sleepTimer[i] + dt : 0.0f;
+		if (m_sleepTimer[i] >= m_sleepTime)
+		{
+			m_asleep[i] = 1;
+			m_vel[i] = glm::vec3(0.0f);
+			m_sleepForce[i] = m_force[i];
+			slept++;
+		}
+	}
+
+	if (slept > 0)
+	{
+		m_activeDirty = true;
+	}
+}
+
+void ParticleSystem::step(float dt)
+{
+	clearForces();
+	applyForces();
+	wakeOnForces();
+	integrate(dt);
+	if (m_hasCube)
+	{
+		collideCube();
+	}
+	updateSleep(dt);
+}
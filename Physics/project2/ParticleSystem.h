@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+class ParticleSystem;
+
+// box shaped container the particles are kept in
+struct Cube
+{
+	glm::vec3 origin = glm::vec3(-2.5f, 0.0f, -2.5f);
+	glm::vec3 bound = glm::vec3(2.5f, 5.0f, 2.5f);
+};
+
+/*
+** FORCE GENERATOR
+** Adds a force to the particles of a system once per step.
+*/
+class ForceGenerator
+{
+public:
+	virtual ~ForceGenerator() {}
+
+	virtual void applyForce(ParticleSystem &ps) = 0;
+};
+
+// uniform gravitational field
+class Gravity : public ForceGenerator
+{
+public:
+	Gravity(const glm::vec3 &g) : m_g(g) {}
+
+	const glm::vec3& getGravity() const { return m_g; }
+	void setGravity(const glm::vec3 &g) { m_g = g; }
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	glm::vec3 m_g;
+};
+
+/*
+** PARTICLE SYSTEM
+** Particle state stored as structure of arrays so that the simulation loops run
+** over contiguous memory. The Particle objects are only used for rendering and
+** are synced from these arrays after each step.
+** With sleeping on, a particle whose kinetic energy per unit mass stays under a
+** threshold for a time window is put to sleep: its velocity is zeroed and the
+** integrator and the cube collision skip it. The particles awake are kept as a
+** compact list of indices, rebuilt only when a particle falls asleep or wakes, and
+** at most once per loop that reads it however many woke, so those loops stay
+** dense. A particle has no contacts with others here, so it is an island of its
+** own; it wakes when the force on it changes (a force generator starts pushing
+** it), or through wake().
+*/
+class ParticleSystem
+{
+public:
+	ParticleSystem();
+	~ParticleSystem();
+
+	/*
+	** GET METHODS
+	*/
+	int getCount() const { return (int)m_pos.size(); }
+
+	// dynamic variables
+	std::vector<glm::vec3>& getPos() { return m_pos; }
+	std::vector<glm::vec3>& getVel() { return m_vel; }
+	std::vector<glm::vec3>& getForce() { return m_force; }
+	const std::vector<glm::vec3>& getPos() const { return m_pos; }
+	const std::vector<glm::vec3>& getVel() const { return m_vel; }
+	const std::vector<glm::vec3>& getForce() const { return m_force; }
+
+	// physical properties, changed through setMass and setFixed
+	const std::vector<float>& getMass() const { return m_mass; }
+	const std::vector<float>& getInvMass() const { return m_invMass; }
+	float getCor() const { return m_cor; }
+	const Cube& getCube() const { return m_cube; }
+	// changes whenever a particle is added or a mass or pin changes, so that solvers that factor
+	// the masses know when to do it again (change them through setMass and setFixed)
+	unsigned int getMassVersion() const { return m_massVersion; }
+
+	// sleeping
+	bool isSleeping(int i) const { return m_asleep[i] != 0; }
+	int getAwakeCount() const { return (int)m_active.size(); }
+	// indices of the particles awake, in order, as of the last simulation step
+	const std::vector<int>& getActive() const { return m_active; }
+
+	/*
+	** SET METHODS
+	*/
+	void setCor(float cor) { m_cor = cor; }
+	void setCube(const Cube &cube) { m_cube = cube; m_hasCube = true; }
+	void setMass(int i, float mass) { m_mass[i] = mass; m_invMass[i] = mass > 0.0f ? 1.0f / mass : 0.0f; m_massVersion++; }
+	// pin a particle in place, it keeps its mass for the solvers that need it
+	void setFixed(int i) { m_invMass[i] = 0.0f; m_vel[i] = glm::vec3(0.0f); m_massVersion++; }
+	// sleeping is off by default; turning it off wakes every particle
+	void setSleeping(bool sleeping);
+	// kinetic energy per unit mass under which a particle may sleep, and the time it must stay under
+	void setSleepEnergy(float energy) { m_sleepEnergy = energy; }
+	void setSleepTime(float time) { m_sleepTime = time; }
+	// change of the force per unit mass since falling asleep that wakes a particle
+	void setWakeAcceleration(float acceleration) { m_wakeAcceleration = acceleration; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a particle, returns its index
+	int addParticle(const glm::vec3 &pos, const glm::vec3 &vel, float mass);
+	void reserve(int count);
+	void clear();
+	// wake a sleeping particle, e.g. after moving it or setting its velocity
+	void wake(int i);
+
+	// force generators are not owned by the system
+	void addForceGenerator(ForceGenerator *fg) { m_forceGenerators.push_back(fg); }
+
+	// simulation steps
+	void clearForces();
+	void applyForces();
+	void integrate(float dt);
+	void collideCube();
+	// wake the sleeping particles whose force changed, and put to sleep those that stayed slow
+	void wakeOnForces();
+	void updateSleep(float dt);
+	// clear forces, apply the force generators, integrate, keep the particles inside the cube
+	// and update the sleeping
+	void step(float dt);
+
+private:
+	// lists of the particles awake and asleep from the flags, if they changed
+	void buildActive();
+
+	std::vector<glm::vec3> m_pos; // position
+	std::vector<glm::vec3> m_vel; // velocity
+	std::vector<glm::vec3> m_force; // force accumulator
+	std::vector<float> m_mass; // mass
+	std::vector<float> m_invMass; // inverse mass, 0 for fixed particles
+	unsigned int m_massVersion;
+
+	std::vector<ForceGenerator*> m_forceGenerators;
+
+	// sleeping
+	bool m_sleeping;
+	float m_sleepEnergy;
+	float m_sleepTime;
+	float m_wakeAcceleration;
+	std::vector<char> m_asleep;
+	std::vector<float> m_sleepTimer; // time spent under the energy threshold
+	std::vector<glm::vec3> m_sleepForce; // force when falling asleep
+	std::vector<int> m_active; // particles awake
+	std::vector<int> m_inactive; // particles asleep
+	bool m_activeDirty; // the flags changed since the lists were built
+
+	float m_cor; // coefficient of restitution for the cube walls
+	Cube m_cube;
+	bool m_hasCube;
+};
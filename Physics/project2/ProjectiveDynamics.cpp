@@ -0,0 +1,320 @@
+#include <algorithm>
+
+#include "ProjectiveDynamics.h"
+#include "Hash.h"
+
+
+// recently used factorizations shared by every solver, found by the hash of the system matrix
+// and kept with the matrix, which is compared whole before its factor is reused so a hash
+// collision can't hand out the factor of another system; every solver holds on to its own
+// factor, so only a few more are kept for reuse
+struct CachedFactor
+{
+	unsigned long long key;
+	unsigned int lastUse;
+	std::vector<int> rowStart, columns;
+	std::vector<float> values;
+	std::shared_ptr<const SparseCholesky> factor;
+};
+
+static const int FACTOR_CACHE_SIZE = 8;
+
+static std::vector<CachedFactor>& factorCache()
+{
+	static std::vector<CachedFactor> cache;
+	return cache;
+}
+
+static std::shared_ptr<const SparseCholesky> findFactor(unsigned long long key, const std::vector<int> &rowStart,
+	const std::vector<int> &columns, const std::vector<float> &values, unsigned int use)
+{
+	std::vector<CachedFactor> &cache = factorCache();
+	for (size_t i = 0; i < cache.size(); i++)
+	{
+		CachedFactor &entry = cache[i];
+		if (entry.key == key && entry.rowStart == rowStart && entry.columns == columns && entry.values == values)
+		{
+			entry.lastUse = use;
+			return entry.factor;
+		}
+	}
+	return std::shared_ptr<const SparseCholesky>();
+}
+
+// add a factorization, replacing the least recently used one when the cache is full
+static void addFactor(unsigned long long key, const std::vector<int> &rowStart, const std::vector<int> &columns,
+	const std::vector<float> &values, unsigned int use, const std::shared_ptr<const SparseCholesky> &factor)
+{
+	std::vector<CachedFactor> &cache = factorCache();
+	CachedFactor entry = { key, use, rowStart, columns, values, factor };
+	if ((int)cache.size() < FACTOR_CACHE_SIZE)
+	{
+		cache.push_back(entry);
+		return;
+	}
+	size_t oldest = 0;
+	for (size_t i = 1; i < cache.size(); i++)
+	{
+		if (cache[i].lastUse < cache[oldest].lastUse)
+		{
+			oldest = i;
+		}
+	}
+	cache[oldest] = entry;
+}
+
+// clock of the cache uses
+static unsigned int nextFactorUse()
+{
+	static unsigned int use = 0;
+	return ++use;
+}
+
+ProjectiveDynamics::ProjectiveDynamics()
+{
+	m_stretchK = 5000.0f;
+	m_bendK = 50.0f;
+	m_iterations = 10;
+	m_dirty = true;
+	m_dt = 0.0f;
+	m_massVersion = 0;
+}
+
+
+ProjectiveDynamics::~ProjectiveDynamics()
+{
+}
+
+void ProjectiveDynamics::clearCache()
+{
+	factorCache().clear();
+}
+
+void ProjectiveDynamics::addSpring(int a, int b, float restLength, float stiffness)
+{
+	m_a.push_back(a);
+	m_b.push_back(b);
+	m_restLength.push_back(restLength);
+	m_stiffness.push_back(stiffness);
+}
+
+void ProjectiveDynamics::setMesh(const ClothMesh &mesh, const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::ivec2> &edges = mesh.getEdges();
+	const std::vector<glm::ivec4> &bendEdges = mesh.getBendEdges();
+
+	m_a.clear();
+	m_b.clear();
+	m_restLength.clear();
+	m_stiffness.clear();
+
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		int a = edges[e].x, b = edges[e].y;
+		addSpring(a, b, glm::length(pos[b] - pos[a]), m_stretchK);
+	}
+	// bending springs join the two vertices opposite to an inner edge
+	for (size_t e = 0; e < bendEdges.size(); e++)
+	{
+		int a = bendEdges[e].z, b = bendEdges[e].w;
+		addSpring(a, b, glm::length(pos[b] - pos[a]), m_bendK);
+	}
+
+	int n = ps.getCount();
+	int m = getSpringCount();
+	m_incidenceStart.assign(n + 1, 0);
+	for (int s = 0; s < m; s++)
+	{
+		m_incidenceStart[m_a[s] + 1]++;
+		m_incidenceStart[m_b[s] + 1]++;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		m_incidenceStart[i + 1] += m_incidenceStart[i];
+	}
+	std::vector<int> fill(m_incidenceStart.begin(), m_incidenceStart.end() - 1);
+	m_incidence.resize(2 * m);
+	for (int s = 0; s < m; s++)
+	{
+		m_incidence[fill[m_a[s]]++] = 2 * s;
+		m_incidence[fill[m_b[s]]++] = 2 * s + 1;
+	}
+
+	m_projection.resize(m);
+	m_dirty = true;
+	m_factor.reset();
+}
+
+void ProjectiveDynamics::prepare(const ParticleSystem &ps, float dt)
+{
+	if (m_factor && !m_dirty && dt == m_dt && ps.getMassVersion() == m_massVersion)
+	{
+		return;
+	}
+	m_dirty = false;
+	m_dt = dt;
+	m_massVersion = ps.getMassVersion();
+	unsigned int use = nextFactorUse();
+
+	// rows of the free particles
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<float> &invMass = ps.getInvMass();
+	int n = ps.getCount();
+	m_row.assign(n, -1);
+	m_free.clear();
+	for (int i = 0; i < n; i++)
+	{
+		if (invMass[i] > 0.0f)
+		{
+			m_row[i] = (int)m_free.size();
+			m_free.push_back(i);
+		}
+	}
+	m_rhs.resize(m_free.size());
+
+	// M / h^2 + sum_s k_s (e_a - e_b)(e_a - e_b)^T over the free particles
+	int rows = (int)m_free.size();
+	std::vector<int> rowStart(rows + 1, 0);
+	std::vector<int> columns;
+	std::vector<float> values;
+	std::vector<std::pair<int, float> > entries;
+	for (int r = 0; r < rows; r++)
+	{
+		int i = m_free[r];
+		entries.clear();
+		float diagonal = mass[i] / (dt * dt);
+		for (int k = m_incidenceStart[i]; k < m_incidenceStart[i + 1]; k++)
+		{
+			int s = m_incidence[k] >> 1;
+			int other = (m_incidence[k] & 1) ? m_a[s] : m_b[s];
+			diagonal += m_stiffness[s];
+			if (m_row[other] != -1)
+			{
+				entries.push_back(std::make_pair(m_row[other], -m_stiffness[s]));
+			}
+		}
+		entries.push_back(std::make_pair(r, diagonal));
+		std::sort(entries.begin(), entries.end());
+
+		for (size_t e = 0; e < entries.size(); e++)
+		{
+			if (e > 0 && entries[e].first == entries[e - 1].first)
+			{
+				values.back() += entries[e].second;
+				continue;
+			}
+			columns.push_back(entries[e].first);
+			values.push_back(entries[e].second);
+		}
+		rowStart[r + 1] = (int)columns.size();
+	}
+
+	// the matrix holds everything the factor depends on: springs, stiffness, masses, pins and dt
+	unsigned long long key = fnv1a(rowStart.data(), rowStart.size() * sizeof(int));
+	key = fnv1a(columns.data(), columns.size() * sizeof(int), key);
+	key = fnv1a(values.data(), values.size() * sizeof(float), key);
+	m_factor = findFactor(key, rowStart, columns, values, use);
+	if (m_factor)
+	{
+		return;
+	}
+
+	std::shared_ptr<SparseCholesky> factor(new SparseCholesky());
+	factor->analyze(rows, rowStart, columns);
+	// a failed factorization is not cached, the next step tries again
+	if (!factor->factorize(values))
+	{
+		m_dirty = true;
+		return;
+	}
+	addFactor(key, rowStart, columns, values, use, factor);
+	m_factor = factor;
+}
+
+void ProjectiveDynamics::step(ParticleSystem &ps, float dt)
+{
+	int n = ps.getCount();
+	int m = getSpringCount();
+	if (n == 0 || (int)m_incidenceStart.size() != n + 1)
+	{
+		return;
+	}
+
+	prepare(ps, dt);
+	if (!m_factor)
+	{
+		return;
+	}
+
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<float> &invMass = ps.getInvMass();
+
+	ps.clearForces();
+	ps.applyForces();
+	const std::vector<glm::vec3> &force = ps.getForce();
+
+	m_inertia.resize(n);
+	m_current.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		m_inertia[i] = pos[i] + dt * vel[i] + dt * dt * invMass[i] * force[i];
+		m_current[i] = invMass[i] > 0.0f ? m_inertia[i] : pos[i];
+	}
+
+	int rows = (int)m_free.size();
+	float invDt2 = 1.0f / (dt * dt);
+
+	for (int it = 0; it < m_iterations; it++)
+	{
+		// local step: project every spring onto its rest length
+		#pragma omp parallel for
+		for (int s = 0; s < m; s++)
+		{
+			glm::vec3 d = m_current[m_a[s]] - m_current[m_b[s]];
+			float length = glm::length(d);
+			m_projection[s] = length > 1e-12f ? d * (m_restLength[s] / length) : d;
+		}
+
+		// right hand side gathered per row: M / h^2 s + sum k (+-d), fixed neighbours move to this side
+		#pragma omp parallel for
+		for (int r = 0; r < rows; r++)
+		{
+			int i = m_free[r];
+			glm::vec3 b = mass[i] * invDt2 * m_inertia[i];
+			for (int k = m_incidenceStart[i]; k < m_incidenceStart[i + 1]; k++)
+			{
+				int s = m_incidence[k] >> 1;
+				bool isB = (m_incidence[k] & 1) != 0;
+				int other = isB ? m_a[s] : m_b[s];
+				b += m_stiffness[s] * (isB ? -m_projection[s] : m_projection[s]);
+				if (m_row[other] == -1)
+				{
+					b += m_stiffness[s] * m_current[other];
+				}
+			}
+			m_rhs[r] = b;
+		}
+
+		// global step: two triangular solves with the cached factor
+		m_factor->solve(m_rhs);
+
+		#pragma omp parallel for
+		for (int r = 0; r < rows; r++)
+		{
+			m_current[m_free[r]] = m_rhs[r];
+		}
+	}
+
+	#pragma omp parallel for
+	for (int r = 0; r < rows; r++)
+	{
+		int i = m_free[r];
+		vel[i] = (m_current[i] - pos[i]) / dt;
+		pos[i] = m_current[i];
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+#include "SparseCholesky.h"
+
+/*
+** PROJECTIVE DYNAMICS
+** Implicit cloth as in Liu et al. 2013 / Bouaziz et al. 2014: every iteration
+** projects the springs onto their rest lengths in parallel (local step), then
+** solves the constant system (M / h^2 + L) x = M / h^2 s + J d (global step).
+** The system matrix only depends on the mesh, the stiffness, the masses, the
+** fixed particles and the time step, so its sparse Cholesky factorization is only
+** redone when one of them changes: setMesh marks the solver dirty and the particle
+** system counts its mass and pin changes. The last few factorizations are kept in a
+** small cache shared by all solvers with the matrices they factor, so other scenes
+** with the same cloth, or a time step that switches between a few values, only
+** assemble the matrix and run the two triangular solves.
+** Fixed particles are removed from the system and enter the right hand side.
+*/
+class ProjectiveDynamics
+{
+public:
+	ProjectiveDynamics();
+	~ProjectiveDynamics();
+
+	/*
+	** GET METHODS
+	*/
+	int getSpringCount() const { return (int)m_a.size(); }
+	int getIterations() const { return m_iterations; }
+	// non-zeros of the Cholesky factor in use
+	int getFactorNonZeros() const { return m_factor ? m_factor->getFactorNonZeros() : 0; }
+
+	/*
+	** SET METHODS
+	*/
+	// spring stiffness (N/m) of the mesh edges and bending edges, used by the next setMesh
+	void setStretch(float stiffness) { m_stretchK = stiffness; }
+	void setBending(float stiffness) { m_bendK = stiffness; }
+	// local / global iterations per step
+	void setIterations(int iterations) { m_iterations = iterations; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// springs of a mesh, the rest lengths are the current distances
+	void setMesh(const ClothMesh &mesh, const ParticleSystem &ps);
+
+	void step(ParticleSystem &ps, float dt);
+
+	// drop all the cached factorizations
+	static void clearCache();
+
+private:
+	void addSpring(int a, int b, float restLength, float stiffness);
+	// get the factorization from the cache or compute it, if anything it depends on changed
+	void prepare(const ParticleSystem &ps, float dt);
+
+	float m_stretchK;
+	float m_bendK;
+	int m_iterations;
+
+	// springs
+	std::vector<int> m_a, m_b;
+	std::vector<float> m_restLength;
+	std::vector<float> m_stiffness;
+
+	// particle -> spring incidence, 2 * spring + 1 if the particle is b
+	std::vector<int> m_incidenceStart;
+	std::vector<int> m_incidence;
+
+	// row of every particle in the system, -1 for fixed particles
+	std::vector<int> m_row;
+	std::vector<int> m_free; // particle of every row
+	std::shared_ptr<const SparseCholesky> m_factor; // null if the last factorization failed
+
+	// what the factor was computed for: the mesh is dirty after setMesh
+	bool m_dirty;
+	float m_dt;
+	unsigned int m_massVersion;
+
+	std::vector<glm::vec3> m_inertia; // s = x + h v + h^2 M^-1 f
+	std::vector<glm::vec3> m_current; // current iterate of the positions
+	std::vector<glm::vec3> m_projection; // projected spring vectors d
+	std::vector<glm::vec3> m_rhs;
+};
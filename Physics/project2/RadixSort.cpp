@@ -0,0 +1,63 @@
+#include "RadixSort.h"
+#include "Parallel.h"
+
+
+void radixSort(std::vector<unsigned int> &keys, std::vector<int> &values, int keyBits)
+{
+	const int RADIX_BITS = 8;
+	const int BUCKETS = 1 << RADIX_BITS;
+
+	int n = (int)keys.size();
+	std::vector<unsigned int> tmpKeys(n);
+	std::vector<int> tmpValues(n);
+
+	int threads = getMaxThreads();
+	std::vector<int> histogram(threads * BUCKETS);
+
+	for (int shift = 0; shift < keyBits; shift += RADIX_BITS)
+	{
+		std::fill(histogram.begin(), histogram.end(), 0);
+
+		#pragma omp parallel num_threads(threads)
+		{
+			int t = getThreadNum();
+			int nt = getNumThreads();
+			int begin = (int)((long long)n * t / nt);
+			int end = (int)((long long)n * (t + 1) / nt);
+
+			// count the digits of this thread's chunk
+			int *h = &histogram[t * BUCKETS];
+			for (int i = begin; i < end; i++)
+			{
+				h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+			}
+
+			#pragma omp barrier
+			#pragma omp single
+			{
+				// exclusive prefix sum ordered by (digit, thread) keeps the sort stable
+				int sum = 0;
+				for (int d = 0; d < BUCKETS; d++)
+				{
+					for (int k = 0; k < nt; k++)
+					{
+						int c = histogram[k * BUCKETS + d];
+						histogram[k * BUCKETS + d] = sum;
+						sum += c;
+					}
+				}
+			}
+
+			// scatter, each thread writes to its own offsets
+			for (int i = begin; i < end; i++)
+			{
+				int dst = h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+				tmpKeys[dst] = keys[i];
+				tmpValues[dst] = values[i];
+			}
+		}
+
+		keys.swap(tmpKeys);
+		values.swap(tmpValues);
+	}
+}
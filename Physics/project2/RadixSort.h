@@ -0,0 +1,6 @@
+#pragma once
+#include <vector>
+
+// Stable parallel LSD radix sort of (key, value) pairs on the lowest keyBits bits of the keys.
+// Each pass builds one histogram per thread so the scatter needs no atomics.
+void radixSort(std::vector<unsigned int> &keys, std::vector<int> &values, int keyBits);
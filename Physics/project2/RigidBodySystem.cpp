@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <cfloat>
+#include <xmmintrin.h>
+
+#include "RigidBodySystem.h"
+#include "RigidCollision.h"
+#include "ContactSolver.h"
+
+
+// append a batch of four entries of the same value
+static void grow(std::vector<float> &v, float value)
+{
+	v.insert(v.end(), 4, value);
+}
+
+
+RigidBodySystem::RigidBodySystem()
+{
+	m_count = 0;
+	m_gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	m_cor = 1.0f;
+	m_hasCube = false;
+	m_sleeping = false;
+	m_sleepEnergy = 0.01f;
+	m_sleepTime = 0.5f;
+	m_wakeAcceleration = 1.0f;
+	m_sleepingCount = 0;
+	m_activeDirty = true;
+}
+
+
+RigidBodySystem::~RigidBodySystem()
+{
+}
+
+int RigidBodySystem::addBody(const glm::vec3 &pos, const glm::quat &orientation, float mass, const glm::vec3 &inertia)
+{
+	// a new batch of padding bodies: no mass, no inertia, identity orientation
+	if (m_count == (int)m_posX.size())
+	{
+		grow(m_posX, 0.0f); grow(m_posY, 0.0f); grow(m_posZ, 0.0f);
+		grow(m_velX, 0.0f); grow(m_velY, 0.0f); grow(m_velZ, 0.0f);
+		grow(m_forceX, 0.0f); grow(m_forceY, 0.0f); grow(m_forceZ, 0.0f);
+		grow(m_invMass, 0.0f);
+		grow(m_rotW, 1.0f); grow(m_rotX, 0.0f); grow(m_rotY, 0.0f); grow(m_rotZ, 0.0f);
+		grow(m_momX, 0.0f); grow(m_momY, 0.0f); grow(m_momZ, 0.0f);
+		grow(m_torqueX, 0.0f); grow(m_torqueY, 0.0f); grow(m_torqueZ, 0.0f);
+		grow(m_invInertiaX, 0.0f); grow(m_invInertiaY, 0.0f); grow(m_invInertiaZ, 0.0f);
+		grow(m_invIxx, 0.0f); grow(m_invIyy, 0.0f); grow(m_invIzz, 0.0f);
+		grow(m_invIxy, 0.0f); grow(m_invIxz, 0.0f); grow(m_invIyz, 0.0f);
+		grow(m_omegaX, 0.0f); grow(m_omegaY, 0.0f); grow(m_omegaZ, 0.0f);
+		grow(m_awake, 1.0f);
+	}
+
+	int i = m_count++;
+	m_sleepIsland.push_back(-1);
+	m_sleepTimer.push_back(0.0f);
+	m_sleepForce.push_back(glm::vec3(0.0f));
+	m_sleepTorque.push_back(glm::vec3(0.0f));
+	m_activeDirty = true;
+	setPos(i, pos);
+	setMass(i, mass);
+	m_invInertiaX[i] = inertia.x > 0.0f ? 1.0f / inertia.x : 0.0f;
+	m_invInertiaY[i] = inertia.y > 0.0f ? 1.0f / inertia.y : 0.0f;
+	m_invInertiaZ[i] = inertia.z > 0.0f ? 1.0f / inertia.z : 0.0f;
+	setOrientation(i, orientation);
+	return i;
+}
+
+int RigidBodySystem::addBody(const glm::vec3 &pos, const glm::quat &orientation, const MassProperties &properties)
+{
+	return addBody(pos + orientation * properties.getCentre(), orientation * properties.getAxes(), properties.getMass(), properties.getPrincipal());
+}
+
+void RigidBodySystem::reserve(int count)
+{
+	int size = (count + 3) / 4 * 4;
+	std::vector<float> *arrays[] = {
+		&m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_forceX, &m_forceY, &m_forceZ, &m_invMass,
+		&m_rotW, &m_rotX, &m_rotY, &m_rotZ, &m_momX, &m_momY, &m_momZ, &m_torqueX, &m_torqueY, &m_torqueZ,
+		&m_invInertiaX, &m_invInertiaY, &m_invInertiaZ,
+		&m_invIxx, &m_invIyy, &m_invIzz, &m_invIxy, &m_invIxz, &m_invIyz, &m_omegaX, &m_omegaY, &m_omegaZ, &m_awake };
+	for (int k = 0; k < (int)(sizeof(arrays) / sizeof(arrays[0])); k++)
+	{
+		arrays[k]->reserve(size);
+	}
+	m_sleepIsland.reserve(count);
+	m_sleepTimer.reserve(count);
+	m_sleepForce.reserve(count);
+	m_sleepTorque.reserve(count);
+}
+
+void RigidBodySystem::clear()
+{
+	std::vector<float> *arrays[] = {
+		&m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_forceX, &m_forceY, &m_forceZ, &m_invMass,
+		&m_rotW, &m_rotX, &m_rotY, &m_rotZ, &m_momX, &m_momY, &m_momZ, &m_torqueX, &m_torqueY, &m_torqueZ,
+		&m_invInertiaX, &m_invInertiaY, &m_invInertiaZ,
+		&m_invIxx, &m_invIyy, &m_invIzz, &m_invIxy, &m_invIxz, &m_invIyz, &m_omegaX, &m_omegaY, &m_omegaZ, &m_awake };
+	for (int k = 0; k < (int)(sizeof(arrays) / sizeof(arrays[0])); k++)
+	{
+		arrays[k]->clear();
+	}
+	m_count = 0;
+	m_sleepIsland.clear();
+	m_sleepTimer.clear();
+	m_sleepForce.clear();
+	m_sleepTorque.clear();
+	m_islandBodies.clear();
+	m_freeIslands.clear();
+	m_sleepingCount = 0;
+	m_activeDirty = true;
+}
+
+void RigidBodySystem::setSleeping(bool sleeping)
+{
+	m_sleeping = sleeping;
+	if (!sleeping)
+	{
+		for (int g = 0; g < (int)m_islandBodies.size(); g++)
+		{
+			if (!m_islandBodies[g].empty())
+			{
+				wake(m_islandBodies[g][0]);
+			}
+		}
+	}
+}
+
+void RigidBodySystem::wake(int i)
+{
+	int island = m_sleepIsland[i];
+	if (island < 0)
+	{
+		m_sleepTimer[i] = 0.0f;
+		return;
+	}
+
+	std::vector<int> &bodies = m_islandBodies[island];
+	for (int k = 0; k < (int)bodies.size(); k++)
+	{
+		m_sleepIsland[bodies[k]] = -1;
+		m_sleepTimer[bodies[k]] = 0.0f;
+		m_awake[bodies[k]] = 1.0f;
+	}
+	m_sleepingCount -= (int)bodies.size();
+	bodies.clear();
+	m_freeIslands.push_back(island);
+	m_activeDirty = true;
+}
+
+void RigidBodySystem::buildActive()
+{
+	if (!m_activeDirty)
+	{
+		return;
+	}
+
+	// a batch runs whole if any of its bodies is awake, the sleeping lanes masked
+	int batches = (int)m_posX.size() / 4;
+	m_activeBatches.clear();
+	for (int b = 0; b < batches; b++)
+	{
+		for (int i = 4 * b; i < 4 * b + 4 && i < m_count; i++)
+		{
+			if (m_sleepIsland[i] < 0)
+			{
+				m_activeBatches.push_back(b);
+				break;
+			}
+		}
+	}
+	m_activeDirty = false;
+}
+
+glm::vec3 RigidBodySystem::getInertia(int i) const
+{
+	return glm::vec3(m_invInertiaX[i] > 0.0f ? 1.0f / m_invInertiaX[i] : 0.0f,
+		m_invInertiaY[i] > 0.0f ? 1.0f / m_invInertiaY[i] : 0.0f,
+		m_invInertiaZ[i] > 0.0f ? 1.0f / m_invInertiaZ[i] : 0.0f);
+}
+
+glm::mat3 RigidBodySystem::getInvInertiaWorld(int i) const
+{
+	return glm::mat3(m_invIxx[i], m_invIxy[i], m_invIxz[i],
+		m_invIxy[i], m_invIyy[i], m_invIyz[i],
+		m_invIxz[i], m_invIyz[i], m_invIzz[i]);
+}
+
+void RigidBodySystem::setOrientation(int i, const glm::quat &q)
+{
+	glm::quat n = glm::normalize(q);
+	m_rotW[i] = n.w;
+	m_rotX[i] = n.x;
+	m_rotY[i] = n.y;
+	m_rotZ[i] = n.z;
+	updateDerived(i);
+}
+
+void RigidBodySystem::setAngularVel(int i, const glm::vec3 &omega)
+{
+	// L = R I R^T omega
+	glm::mat3 R = glm::mat3_cast(getOrientation(i));
+	glm::vec3 local = glm::transpose(R) * omega;
+	setAngularMomentum(i, R * (getInertia(i) * local));
+}
+
+void RigidBodySystem::setInertia(int i, const glm::vec3 &principal)
+{
+	m_invInertiaX[i] = principal.x > 0.0f ? 1.0f / principal.x : 0.0f;
+	m_invInertiaY[i] = principal.y > 0.0f ? 1.0f / principal.y : 0.0f;
+	m_invInertiaZ[i] = principal.z > 0.0f ? 1.0f / principal.z : 0.0f;
+	updateDerived(i);
+}
+
+void RigidBodySystem::updateDerived(int i)
+{
+	glm::mat3 R = glm::mat3_cast(getOrientation(i));
+	glm::mat3 invInertia = R * glm::mat3(m_invInertiaX[i], 0.0f, 0.0f, 0.0f, m_invInertiaY[i], 0.0f, 0.0f, 0.0f, m_invInertiaZ[i]) * glm::transpose(R);
+	m_invIxx[i] = invInertia[0][0];
+	m_invIyy[i] = invInertia[1][1];
+	m_invIzz[i] = invInertia[2][2];
+	m_invIxy[i] = invInertia[0][1];
+	m_invIxz[i] = invInertia[0][2];
+	m_invIyz[i] = invInertia[1][2];
+
+	// fixed bodies do not turn either
+	glm::vec3 omega = m_invMass[i] > 0.0f ? invInertia * getAngularMomentum(i) : glm::vec3(0.0f);
+	m_omegaX[i] = omega.x;
+	m_omegaY[i] = omega.y;
+	m_omegaZ[i] = omega.z;
+}
+
+void RigidBodySystem::addForceAtPoint(int i, const glm::vec3 &force, const glm::vec3 &point)
+{
+	addForce(i, force);
+	addTorque(i, glm::cross(point - getPos(i), force));
+}
+
+void RigidBodySystem::applyImpulse(int i, const glm::vec3 &impulse, const glm::vec3 &point)
+{
+	if (m_invMass[i] == 0.0f)
+	{
+		return;
+	}
+	setVel(i, getVel(i) + m_invMass[i] * impulse);
+	setAngularMomentum(i, getAngularMomentum(i) + glm::cross(point - getPos(i), impulse));
+}
+
+float RigidBodySystem::getKineticEnergy() const
+{
+	float energy = 0.0f;
+	for (int i = 0; i < m_count; i++)
+	{
+		if (m_invMass[i] > 0.0f)
+		{
+			energy += 0.5f * glm::dot(getVel(i), getVel(i)) / m_invMass[i] + 0.5f * glm::dot(getAngularMomentum(i), getAngularVel(i));
+		}
+	}
+	return energy;
+}
+
+void RigidBodySystem::clearForces()
+{
+	int size = (int)m_posX.size();
+
+	#pragma omp parallel for
+	for (int i = 0; i < size; i++)
+	{
+		m_forceX[i] = 0.0f; m_forceY[i] = 0.0f; m_forceZ[i] = 0.0f;
+		m_torqueX[i] = 0.0f; m_torqueY[i] = 0.0f; m_torqueZ[i] = 0.0f;
+	}
+}
+
+// first half of a Semi-Implicit Euler step: the momenta and velocities, four bodies per iteration
+void RigidBodySystem::integrateVelocities(float dt)
+{
+	buildActive();
+	int batches = (int)m_activeBatches.size();
+
+	#pragma omp parallel for
+	for (int b = 0; b < batches; b++)
+	{
+		int i = 4 * m_activeBatches[b];
+		__m128 zero = _mm_setzero_ps();
+		__m128 dtv = _mm_set1_ps(dt);
+
+		// linear: v += dt (F / m + g), for bodies with mass that are awake
+		__m128 w = _mm_loadu_ps(&m_invMass[i]);
+		__m128 moving = _mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_cmpgt_ps(_mm_loadu_ps(&m_awake[i]), zero));
+		_mm_storeu_ps(&m_velX[i], _mm_add_ps(_mm_loadu_ps(&m_velX[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_add_ps(_mm_mul_ps(w, _mm_loadu_ps(&m_forceX[i])), _mm_set1_ps(m_gravity.x))))));
+		_mm_storeu_ps(&m_velY[i], _mm_add_ps(_mm_loadu_ps(&m_velY[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_add_ps(_mm_mul_ps(w, _mm_loadu_ps(&m_forceY[i])), _mm_set1_ps(m_gravity.y))))));
+		_mm_storeu_ps(&m_velZ[i], _mm_add_ps(_mm_loadu_ps(&m_velZ[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_add_ps(_mm_mul_ps(w, _mm_loadu_ps(&m_forceZ[i])), _mm_set1_ps(m_gravity.z))))));
+
+		// angular: L += dt torque, omega = I^-1 L at the current orientation
+		__m128 Lx = _mm_add_ps(_mm_loadu_ps(&m_momX[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_loadu_ps(&m_torqueX[i]))));
+		__m128 Ly = _mm_add_ps(_mm_loadu_ps(&m_momY[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_loadu_ps(&m_torqueY[i]))));
+		__m128 Lz = _mm_add_ps(_mm_loadu_ps(&m_momZ[i]), _mm_and_ps(moving, _mm_mul_ps(dtv, _mm_loadu_ps(&m_torqueZ[i]))));
+		__m128 Ixx = _mm_loadu_ps(&m_invIxx[i]), Iyy = _mm_loadu_ps(&m_invIyy[i]), Izz = _mm_loadu_ps(&m_invIzz[i]);
+		__m128 Ixy = _mm_loadu_ps(&m_invIxy[i]), Ixz = _mm_loadu_ps(&m_invIxz[i]), Iyz = _mm_loadu_ps(&m_invIyz[i]);
+		_mm_storeu_ps(&m_momX[i], Lx);
+		_mm_storeu_ps(&m_momY[i], Ly);
+		_mm_storeu_ps(&m_momZ[i], Lz);
+		_mm_storeu_ps(&m_omegaX[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixx, Lx), _mm_mul_ps(Ixy, Ly)), _mm_mul_ps(Ixz, Lz))));
+		_mm_storeu_ps(&m_omegaY[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixy, Lx), _mm_mul_ps(Iyy, Ly)), _mm_mul_ps(Iyz, Lz))));
+		_mm_storeu_ps(&m_omegaZ[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixz, Lx), _mm_mul_ps(Iyz, Ly)), _mm_mul_ps(Izz, Lz))));
+	}
+}
+
+// second half: the positions and orientations with the new velocities, then the world inverse
+// inertia and the angular velocity at the new orientations
+void RigidBodySystem::integratePositions(float dt)
+{
+	buildActive();
+	int batches = (int)m_activeBatches.size();
+
+	#pragma omp parallel for
+	for (int b = 0; b < batches; b++)
+	{
+		int i = 4 * m_activeBatches[b];
+		__m128 zero = _mm_setzero_ps();
+		__m128 dtv = _mm_set1_ps(dt);
+		__m128 halfDt = _mm_set1_ps(0.5f * dt);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+		__m128 moving = _mm_cmpgt_ps(_mm_loadu_ps(&m_invMass[i]), zero);
+
+		_mm_storeu_ps(&m_posX[i], _mm_add_ps(_mm_loadu_ps(&m_posX[i]), _mm_mul_ps(dtv, _mm_loadu_ps(&m_velX[i]))));
+		_mm_storeu_ps(&m_posY[i], _mm_add_ps(_mm_loadu_ps(&m_posY[i]), _mm_mul_ps(dtv, _mm_loadu_ps(&m_velY[i]))));
+		_mm_storeu_ps(&m_posZ[i], _mm_add_ps(_mm_loadu_ps(&m_posZ[i]), _mm_mul_ps(dtv, _mm_loadu_ps(&m_velZ[i]))));
+
+		__m128 Lx = _mm_loadu_ps(&m_momX[i]), Ly = _mm_loadu_ps(&m_momY[i]), Lz = _mm_loadu_ps(&m_momZ[i]);
+		__m128 wx = _mm_loadu_ps(&m_omegaX[i]), wy = _mm_loadu_ps(&m_omegaY[i]), wz = _mm_loadu_ps(&m_omegaZ[i]);
+
+		// q += dt / 2 (0, omega) q = dt / 2 (-omega . v, s omega + omega x v)
+		__m128 qw = _mm_loadu_ps(&m_rotW[i]), qx = _mm_loadu_ps(&m_rotX[i]), qy = _mm_loadu_ps(&m_rotY[i]), qz = _mm_loadu_ps(&m_rotZ[i]);
+		__m128 dw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, qx), _mm_mul_ps(wy, qy)), _mm_mul_ps(wz, qz));
+		__m128 dx = _mm_add_ps(_mm_mul_ps(qw, wx), _mm_sub_ps(_mm_mul_ps(wy, qz), _mm_mul_ps(wz, qy)));
+		__m128 dy = _mm_add_ps(_mm_mul_ps(qw, wy), _mm_sub_ps(_mm_mul_ps(wz, qx), _mm_mul_ps(wx, qz)));
+		__m128 dz = _mm_add_ps(_mm_mul_ps(qw, wz), _mm_sub_ps(_mm_mul_ps(wx, qy), _mm_mul_ps(wy, qx)));
+		qw = _mm_sub_ps(qw, _mm_mul_ps(halfDt, dw));
+		qx = _mm_add_ps(qx, _mm_mul_ps(halfDt, dx));
+		qy = _mm_add_ps(qy, _mm_mul_ps(halfDt, dy));
+		qz = _mm_add_ps(qz, _mm_mul_ps(halfDt, dz));
+
+		// renormalise: reciprocal square root estimate refined by a Newton step
+		__m128 n2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, qw), _mm_mul_ps(qx, qx)), _mm_add_ps(_mm_mul_ps(qy, qy), _mm_mul_ps(qz, qz)));
+		__m128 r = _mm_rsqrt_ps(n2);
+		r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(n2, _mm_mul_ps(r, r))));
+		qw = _mm_mul_ps(qw, r);
+		qx = _mm_mul_ps(qx, r);
+		qy = _mm_mul_ps(qy, r);
+		qz = _mm_mul_ps(qz, r);
+		_mm_storeu_ps(&m_rotW[i], qw);
+		_mm_storeu_ps(&m_rotX[i], qx);
+		_mm_storeu_ps(&m_rotY[i], qy);
+		_mm_storeu_ps(&m_rotZ[i], qz);
+
+		// rotation matrix, then the world inverse inertia R diag(d) R^T
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wxq = _mm_mul_ps(qw, qx), wyq = _mm_mul_ps(qw, qy), wzq = _mm_mul_ps(qw, qz);
+		__m128 R00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 R01 = _mm_mul_ps(two, _mm_sub_ps(xy, wzq));
+		__m128 R02 = _mm_mul_ps(two, _mm_add_ps(xz, wyq));
+		__m128 R10 = _mm_mul_ps(two, _mm_add_ps(xy, wzq));
+		__m128 R11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 R12 = _mm_mul_ps(two, _mm_sub_ps(yz, wxq));
+		__m128 R20 = _mm_mul_ps(two, _mm_sub_ps(xz, wyq));
+		__m128 R21 = _mm_mul_ps(two, _mm_add_ps(yz, wxq));
+		__m128 R22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		__m128 d0 = _mm_loadu_ps(&m_invInertiaX[i]), d1 = _mm_loadu_ps(&m_invInertiaY[i]), d2 = _mm_loadu_ps(&m_invInertiaZ[i]);
+		// rows of R scaled by d
+		__m128 s00 = _mm_mul_ps(R00, d0), s01 = _mm_mul_ps(R01, d1), s02 = _mm_mul_ps(R02, d2);
+		__m128 s10 = _mm_mul_ps(R10, d0), s11 = _mm_mul_ps(R11, d1), s12 = _mm_mul_ps(R12, d2);
+		__m128 Ixx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s00, R00), _mm_mul_ps(s01, R01)), _mm_mul_ps(s02, R02));
+		__m128 Ixy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s00, R10), _mm_mul_ps(s01, R11)), _mm_mul_ps(s02, R12));
+		__m128 Ixz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s00, R20), _mm_mul_ps(s01, R21)), _mm_mul_ps(s02, R22));
+		__m128 Iyy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s10, R10), _mm_mul_ps(s11, R11)), _mm_mul_ps(s12, R12));
+		__m128 Iyz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s10, R20), _mm_mul_ps(s11, R21)), _mm_mul_ps(s12, R22));
+		__m128 Izz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(R20, d0), R20), _mm_mul_ps(_mm_mul_ps(R21, d1), R21)), _mm_mul_ps(_mm_mul_ps(R22, d2), R22));
+		_mm_storeu_ps(&m_invIxx[i], Ixx);
+		_mm_storeu_ps(&m_invIyy[i], Iyy);
+		_mm_storeu_ps(&m_invIzz[i], Izz);
+		_mm_storeu_ps(&m_invIxy[i], Ixy);
+		_mm_storeu_ps(&m_invIxz[i], Ixz);
+		_mm_storeu_ps(&m_invIyz[i], Iyz);
+
+		// angular velocity at the new orientation
+		_mm_storeu_ps(&m_omegaX[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixx, Lx), _mm_mul_ps(Ixy, Ly)), _mm_mul_ps(Ixz, Lz))));
+		_mm_storeu_ps(&m_omegaY[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixy, Lx), _mm_mul_ps(Iyy, Ly)), _mm_mul_ps(Iyz, Lz))));
+		_mm_storeu_ps(&m_omegaZ[i], _mm_and_ps(moving, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ixz, Lx), _mm_mul_ps(Iyz, Ly)), _mm_mul_ps(Izz, Lz))));
+	}
+}
+
+// reflect bodies whose centre left the cube back inside and bounce their velocity
+void RigidBodySystem::collideCube()
+{
+	if (m_count == 0)
+	{
+		return;
+	}
+
+	buildActive();
+	float *pos[3] = { &m_posX[0], &m_posY[0], &m_posZ[0] };
+	float *vel[3] = { &m_velX[0], &m_velY[0], &m_velZ[0] };
+	int n = 4 * (int)m_activeBatches.size();
+
+	#pragma omp parallel for
+	for (int k = 0; k < n; k++)
+	{
+		int i = 4 * m_activeBatches[k / 4] + k % 4;
+		if (i >= m_count || m_sleepIsland[i] >= 0)
+		{
+			continue;
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			if (pos[j][i] < m_cube.origin[j])
+			{
+				pos[j][i] = m_cube.origin[j] + (m_cube.origin[j] - pos[j][i]);
+				vel[j][i] *= -m_cor;
+			}
+
+			if (pos[j][i] > m_cube.bound[j])
+			{
+				pos[j][i] = m_cube.bound[j] - (pos[j][i] - m_cube.bound[j]);
+				vel[j][i] *= -m_cor;
+			}
+		}
+	}
+}
+
+void RigidBodySystem::integrate(float dt)
+{
+	integrateVelocities(dt);
+	integratePositions(dt);
+}
+
+void RigidBodySystem::wakeOnForces()
+{
+	if (m_sleepingCount == 0)
+	{
+		return;
+	}
+
+	for (int g = 0; g < (int)m_islandBodies.size(); g++)
+	{
+		const std::vector<int> &bodies = m_islandBodies[g];
+		for (int k = 0; k < (int)bodies.size(); k++)
+		{
+			int i = bodies[k];
+			glm::vec3 linear = (glm::vec3(m_forceX[i], m_forceY[i], m_forceZ[i]) - m_sleepForce[i]) * m_invMass[i];
+			glm::vec3 angular = getInvInertiaWorld(i) * (glm::vec3(m_torqueX[i], m_torqueY[i], m_torqueZ[i]) - m_sleepTorque[i]);
+			float limit = m_wakeAcceleration * m_wakeAcceleration;
+			if (glm::dot(linear, linear) > limit || glm::dot(angular, angular) > limit)
+			{
+				wake(i);
+				break;
+			}
+		}
+	}
+}
+
+void RigidBodySystem::updateSleep(float dt, const ContactSolver *solver)
+{
+	if (!m_sleeping)
+	{
+		return;
+	}
+	buildActive();
+
+	// islands of the solver first, then one per body for the bodies it didn't see
+	int islands = solver != NULL ? solver->getIslandCount() : 0;
+	int keys = islands + m_count;
+	m_islandEnergy.assign(keys, 0.0f);
+	m_islandMass.assign(keys, 0.0f);
+	m_islandTimer.assign(keys, FLT_MAX);
+	m_islandSleep.assign(keys, -1);
+
+	// energy, mass and the shortest time under the threshold of every island
+	int n = 4 * (int)m_activeBatches.size();
+	for (int k = 0; k < n; k++)
+	{
+		int i = 4 * m_activeBatches[k / 4] + k % 4;
+		if (i >= m_count || !isAwake(i))
+		{
+			continue;
+		}
+		int island = solver != NULL ? solver->getIsland(i) : -1;
+		int key = island >= 0 ? island : islands + i;
+		m_islandEnergy[key] += 0.5f * glm::dot(getVel(i), getVel(i)) / m_invMass[i] + 0.5f * glm::dot(getAngularMomentum(i), getAngularVel(i));
+		m_islandMass[key] += 1.0f / m_invMass[i];
+		m_islandTimer[key] = std::min(m_islandTimer[key], m_sleepTimer[i]);
+	}
+
+	// the island sleeps together once it has been slow long enough; its bodies stop
+	for (int k = 0; k < n; k++)
+	{
+		int i = 4 * m_activeBatches[k / 4] + k % 4;
+		if (i >= m_count || !isAwake(i))
+		{
+			continue;
+		}
+		int island = solver != NULL ? solver->getIsland(i) : -1;
+		int key = island >= 0 ? island : islands + i;
+		bool slow = m_islandEnergy[key] < m_sleepEnergy * m_islandMass[key];
+		m_sleepTimer[i] = slow ? m_islandTimer[key] + dt : 0.0f;
+		if (m_sleepTimer[i] < m_sleepTime)
+		{
+			continue;
+		}
+
+		if (m_islandSleep[key] < 0)
+		{
+			if (m_freeIslands.empty())
+			{
+				m_freeIslands.push_back((int)m_islandBodies.size());
+				m_islandBodies.push_back(std::vector<int>());
+			}
+			m_islandSleep[key] = m_freeIslands.back();
+			m_freeIslands.pop_back();
+		}
+		m_sleepIsland[i] = m_islandSleep[key];
+		m_islandBodies[m_sleepIsland[i]].push_back(i);
+		m_sleepingCount++;
+		m_awake[i] = 0.0f;
+		m_sleepForce[i] = glm::vec3(m_forceX[i], m_forceY[i], m_forceZ[i]);
+		m_sleepTorque[i] = glm::vec3(m_torqueX[i], m_torqueY[i], m_torqueZ[i]);
+		setVel(i, glm::vec3(0.0f));
+		setAngularMomentum(i, glm::vec3(0.0f));
+		m_activeDirty = true;
+	}
+}
+
+void RigidBodySystem::step(float dt)
+{
+	wakeOnForces();
+	integrate(dt);
+	if (m_hasCube)
+	{
+		collideCube();
+	}
+	updateSleep(dt);
+	clearForces();
+}
+
+void RigidBodySystem::step(float dt, RigidCollision &collision, ContactSolver &solver)
+{
+	wakeOnForces();
+	collision.findContacts(*this);
+	integrateVelocities(dt);
+	solver.solve(*this, collision.getContacts(), dt);
+	collision.storeImpulses();
+	integratePositions(dt);
+	if (m_hasCube)
+	{
+		collideCube();
+	}
+	updateSleep(dt, &solver);
+	clearForces();
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "ParticleSystem.h"
+#include "MassProperties.h"
+
+class RigidCollision;
+class ContactSolver;
+
+/*
+** RIGID BODY SYSTEM
+** Free rigid bodies stored as structure of arrays, one float array per component,
+** so the integrator runs four bodies at a time in SSE registers. The state of a body
+** is its position and velocity, its orientation as a unit quaternion and its
+** angular momentum; the inertia is given by the principal moments in the body axes,
+** and the world inverse inertia tensor R I^-1 R^T and the angular velocity
+** I^-1 L are derived from them after every step. Integrating the angular momentum
+** instead of the angular velocity gets the torque-free precession (and the flips
+** about the intermediate axis) without any gyroscopic term. The quaternions are
+** renormalised every step.
+** The arrays are padded to a multiple of four with bodies of no mass, which the
+** integrator leaves alone. Render matrices are built from the quaternions only when
+** asked for by the transform sync (getRotate).
+** With sleeping on, bodies sleep island by island (the islands of the contact solver,
+** a body without contacts on its own): when the kinetic energy per unit mass of an
+** island stays under a threshold for a time window, its bodies are stopped and put
+** to sleep together. The integrator runs over a compact list of the batches of four
+** that hold a body awake, and the collision skips sleeping bodies in the broadphase
+** and the narrowphase. A sleeping island wakes as a whole when a body awake touches
+** it or when the force or torque on one of its bodies changes.
+*/
+class RigidBodySystem
+{
+public:
+	RigidBodySystem();
+	~RigidBodySystem();
+
+	/*
+	** GET METHODS
+	*/
+	int getCount() const { return m_count; }
+
+	// dynamic variables
+	glm::vec3 getPos(int i) const { return glm::vec3(m_posX[i], m_posY[i], m_posZ[i]); }
+	glm::vec3 getVel(int i) const { return glm::vec3(m_velX[i], m_velY[i], m_velZ[i]); }
+	glm::quat getOrientation(int i) const { return glm::quat(m_rotW[i], m_rotX[i], m_rotY[i], m_rotZ[i]); }
+	glm::vec3 getAngularMomentum(int i) const { return glm::vec3(m_momX[i], m_momY[i], m_momZ[i]); }
+	glm::vec3 getAngularVel(int i) const { return glm::vec3(m_omegaX[i], m_omegaY[i], m_omegaZ[i]); }
+
+	// physical properties
+	float getMass(int i) const { return m_invMass[i] > 0.0f ? 1.0f / m_invMass[i] : 0.0f; }
+	float getInvMass(int i) const { return m_invMass[i]; }
+	// principal moments of inertia in the body axes
+	glm::vec3 getInertia(int i) const;
+	glm::mat3 getInvInertiaWorld(int i) const;
+	float getCor() const { return m_cor; }
+	const glm::vec3& getGravity() const { return m_gravity; }
+
+	// rotation matrix of a body, for rendering
+	glm::mat4 getRotate(int i) const { return glm::mat4_cast(getOrientation(i)); }
+
+	// kinetic energy of all the bodies
+	float getKineticEnergy() const;
+
+	bool hasCube() const { return m_hasCube; }
+
+	// sleeping: a body awake is neither fixed nor asleep
+	bool isSleeping(int i) const { return m_sleepIsland[i] >= 0; }
+	bool isAwake(int i) const { return m_invMass[i] > 0.0f && m_sleepIsland[i] < 0; }
+	int getSleepingCount() const { return m_sleepingCount; }
+
+	/*
+	** SET METHODS
+	*/
+	void setPos(int i, const glm::vec3 &pos) { m_posX[i] = pos.x; m_posY[i] = pos.y; m_posZ[i] = pos.z; }
+	void setVel(int i, const glm::vec3 &vel) { m_velX[i] = vel.x; m_velY[i] = vel.y; m_velZ[i] = vel.z; }
+	void setOrientation(int i, const glm::quat &q);
+	void setAngularMomentum(int i, const glm::vec3 &L) { m_momX[i] = L.x; m_momY[i] = L.y; m_momZ[i] = L.z; updateDerived(i); }
+	// sets the angular momentum that gives this angular velocity at the current orientation
+	void setAngularVel(int i, const glm::vec3 &omega);
+	// a mass of 0 fixes the body
+	void setMass(int i, float mass) { m_invMass[i] = mass > 0.0f ? 1.0f / mass : 0.0f; }
+	void setInertia(int i, const glm::vec3 &principal);
+	void setCor(float cor) { m_cor = cor; }
+	void setGravity(const glm::vec3 &gravity) { m_gravity = gravity; }
+	void setCube(const Cube &cube) { m_cube = cube; m_hasCube = true; }
+	// sleeping is off by default; turning it off wakes every body
+	void setSleeping(bool sleeping);
+	// kinetic energy per unit mass under which an island may sleep, and the time it must stay under
+	void setSleepEnergy(float energy) { m_sleepEnergy = energy; }
+	void setSleepTime(float time) { m_sleepTime = time; }
+	// change of the linear or angular acceleration from the applied loads that wakes a body
+	void setWakeAcceleration(float acceleration) { m_wakeAcceleration = acceleration; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a body with the given principal moments of inertia, returns its index
+	int addBody(const glm::vec3 &pos, const glm::quat &orientation, float mass, const glm::vec3 &inertia);
+	// add a body made from a mesh whose origin and axes are at pos and orientation; the body is at
+	// the centre of mass in the principal axes, so the mesh renders with getRotate(i) times the
+	// inverse of properties.getAxes(), at getPos(i) minus the rotated centre
+	int addBody(const glm::vec3 &pos, const glm::quat &orientation, const MassProperties &properties);
+	void reserve(int count);
+	void clear();
+	// wake the sleeping island of a body, e.g. after moving it or setting its velocity
+	void wake(int i);
+
+	// force at the centre of mass and torque, in world axes
+	void addForce(int i, const glm::vec3 &force) { m_forceX[i] += force.x; m_forceY[i] += force.y; m_forceZ[i] += force.z; }
+	void addTorque(int i, const glm::vec3 &torque) { m_torqueX[i] += torque.x; m_torqueY[i] += torque.y; m_torqueZ[i] += torque.z; }
+	// force at a world point of a body
+	void addForceAtPoint(int i, const glm::vec3 &force, const glm::vec3 &point);
+	// impulse at a world point of a body, changing its velocity and angular momentum at once
+	void applyImpulse(int i, const glm::vec3 &impulse, const glm::vec3 &point);
+
+	// simulation steps
+	void clearForces();
+	// Semi-Implicit Euler in two halves, so that contacts can be solved between them
+	void integrateVelocities(float dt);
+	void integratePositions(float dt);
+	void integrate(float dt);
+	void collideCube();
+	// integrate the applied forces and gravity, keep the centres inside the cube, update the
+	// sleeping and clear the forces
+	void step(float dt);
+	// the same with contacts: found at the current poses and solved between the velocity and the
+	// position halves of the step
+	void step(float dt, RigidCollision &collision, ContactSolver &solver);
+	// wake the sleeping islands whose loads changed, and put to sleep the islands that stayed slow;
+	// without a solver every body is an island
+	void wakeOnForces();
+	void updateSleep(float dt, const ContactSolver *solver = NULL);
+
+private:
+	// world inverse inertia and angular velocity of one body from its orientation and momentum
+	void updateDerived(int i);
+	// the batches with a body not asleep
+	void buildActive();
+
+	int m_count;
+
+	// position, velocity and force
+	std::vector<float> m_posX, m_posY, m_posZ;
+	std::vector<float> m_velX, m_velY, m_velZ;
+	std::vector<float> m_forceX, m_forceY, m_forceZ;
+	std::vector<float> m_invMass;
+
+	// orientation, angular momentum and torque
+	std::vector<float> m_rotW, m_rotX, m_rotY, m_rotZ;
+	std::vector<float> m_momX, m_momY, m_momZ;
+	std::vector<float> m_torqueX, m_torqueY, m_torqueZ;
+	std::vector<float> m_invInertiaX, m_invInertiaY, m_invInertiaZ; // principal, body axes
+
+	// derived: world inverse inertia (symmetric) and angular velocity
+	std::vector<float> m_invIxx, m_invIyy, m_invIzz, m_invIxy, m_invIxz, m_invIyz;
+	std::vector<float> m_omegaX, m_omegaY, m_omegaZ;
+
+	// sleeping
+	bool m_sleeping;
+	float m_sleepEnergy;
+	float m_sleepTime;
+	float m_wakeAcceleration;
+	std::vector<float> m_awake; // per body, 1 unless asleep, masks the integrator
+	std::vector<int> m_sleepIsland; // per body, -1 if awake
+	std::vector<float> m_sleepTimer; // time the island of the body spent under the threshold
+	std::vector<glm::vec3> m_sleepForce, m_sleepTorque; // loads when falling asleep
+	std::vector<std::vector<int> > m_islandBodies; // bodies of every sleeping island
+	std::vector<int> m_freeIslands;
+	int m_sleepingCount;
+	std::vector<int> m_activeBatches;
+	bool m_activeDirty;
+	// per island of the last update: energy, mass and time under the threshold
+	std::vector<float> m_islandEnergy, m_islandMass, m_islandTimer;
+	std::vector<int> m_islandSleep;
+
+	glm::vec3 m_gravity;
+	float m_cor; // coefficient of restitution for the cube walls
+	Cube m_cube;
+	bool m_hasCube;
+};
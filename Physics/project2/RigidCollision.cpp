@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "RigidCollision.h"
+#include "ClosestPoint.h"
+
+
+// clip a convex polygon to the half space n . x <= offset (Sutherland-Hodgman)
+static int clipPolygon(const glm::vec3 *in, int count, const glm::vec3 &n, float offset, glm::vec3 *out)
+{
+	int outCount = 0;
+	for (int k = 0; k < count; k++)
+	{
+		const glm::vec3 &p = in[k];
+		const glm::vec3 &q = in[(k + 1) % count];
+		float dp = glm::dot(n, p) - offset;
+		float dq = glm::dot(n, q) - offset;
+		if (dp <= 0.0f)
+		{
+			out[outCount++] = p;
+		}
+		if ((dp < 0.0f && dq > 0.0f) || (dp > 0.0f && dq < 0.0f))
+		{
+			out[outCount++] = p + dp / (dp - dq) * (q - p);
+		}
+	}
+	return outCount;
+}
+
+// keep the four points of a planar set that span the largest area: the one farthest from their
+// centre, the one farthest from it, the one making the largest triangle with them and the one
+// adding the most to it; the widest support matters once the points persist over several steps
+static int reducePoints(glm::vec3 *points, float *depths, int count, const glm::vec3 &n)
+{
+	if (count <= 4)
+	{
+		return count;
+	}
+
+	int keep[4];
+	glm::vec3 centre(0.0f);
+	for (int k = 0; k < count; k++)
+	{
+		centre += points[k] / (float)count;
+	}
+	keep[0] = 0;
+	for (int k = 1; k < count; k++)
+	{
+		if (glm::dot(points[k] - centre, points[k] - centre) > glm::dot(points[keep[0]] - centre, points[keep[0]] - centre))
+		{
+			keep[0] = k;
+		}
+	}
+
+	keep[1] = -1;
+	float best = -1.0f;
+	for (int k = 0; k < count; k++)
+	{
+		float d = glm::dot(points[k] - points[keep[0]], points[k] - points[keep[0]]);
+		if (k != keep[0] && d > best)
+		{
+			best = d;
+			keep[1] = k;
+		}
+	}
+
+	keep[2] = -1;
+	best = -1.0f;
+	glm::vec3 e = points[keep[1]] - points[keep[0]];
+	for (int k = 0; k < count; k++)
+	{
+		float area = std::fabs(glm::dot(glm::cross(e, points[k] - points[keep[0]]), n));
+		if (k != keep[0] && k != keep[1] && area > best)
+		{
+			best = area;
+			keep[2] = k;
+		}
+	}
+
+	// the fourth point must lie outside an edge of the triangle
+	glm::vec3 t[3] = { points[keep[0]], points[keep[1]], points[keep[2]] };
+	float orientation = glm::dot(glm::cross(t[1] - t[0], t[2] - t[0]), n);
+	keep[3] = -1;
+	best = 0.0f;
+	for (int k = 0; k < count; k++)
+	{
+		if (k == keep[0] || k == keep[1] || k == keep[2])
+		{
+			continue;
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			float s = glm::dot(glm::cross(t[(j + 1) % 3] - t[j], points[k] - t[j]), n);
+			if (s * orientation < 0.0f && std::fabs(s) > best)
+			{
+				best = std::fabs(s);
+				keep[3] = k;
+			}
+		}
+	}
+
+	int kept = keep[3] < 0 ? 3 : 4;
+	glm::vec3 p[4];
+	float d[4];
+	for (int k = 0; k < kept; k++)
+	{
+		p[k] = points[keep[k]];
+		d[k] = depths[keep[k]];
+	}
+	for (int k = 0; k < kept; k++)
+	{
+		points[k] = p[k];
+		depths[k] = d[k];
+	}
+	return kept;
+}
+
+
+RigidCollision::RigidCollision(BroadphaseType type)
+{
+	m_broadphase = createBroadphase(type);
+	m_margin = 0.02f;
+	m_matchDistance = 0.02f;
+	m_driftDistance = 0.01f;
+	m_driftAngle = 0.02f;
+	m_narrowphaseCount = 0;
+	m_refreshCount = 0;
+}
+
+
+RigidCollision::~RigidCollision()
+{
+}
+
+void RigidCollision::setBox(int body, const glm::vec3 &halfExtents)
+{
+	if (body >= (int)m_halfExtents.size())
+	{
+		m_halfExtents.resize(body + 1, glm::vec3(0.0f));
+		m_proxy.resize(body + 1, -1);
+		m_lastPos.resize(body + 1, glm::vec3(0.0f));
+		m_bounds.resize(body + 1);
+	}
+	m_halfExtents[body] = halfExtents;
+}
+
+int RigidCollision::collideBoxes(const glm::vec3 &posA, const glm::mat3 &rotA, const glm::vec3 &halfA,
+	const glm::vec3 &posB, const glm::mat3 &rotB, const glm::vec3 &halfB, float margin,
+	glm::vec3 points[4], glm::vec3 &normal, float depths[4])
+{
+	glm::vec3 d = posB - posA;
+
+	// C[i][j] = a_i . b_j, with an epsilon against the near parallel edge axes
+	float C[3][3], absC[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			C[i][j] = glm::dot(rotA[i], rotB[j]);
+			absC[i][j] = std::fabs(C[i][j]) + 1e-6f;
+		}
+	}
+
+	// separation along the face axes of A and B: the largest is the least penetration
+	float faceA = -FLT_MAX, faceB = -FLT_MAX;
+	int axisA = 0, axisB = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float s = std::fabs(glm::dot(d, rotA[i])) - halfA[i] - (halfB[0] * absC[i][0] + halfB[1] * absC[i][1] + halfB[2] * absC[i][2]);
+		if (s > margin)
+		{
+			return 0;
+		}
+		if (s > faceA)
+		{
+			faceA = s;
+			axisA = i;
+		}
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		float s = std::fabs(glm::dot(d, rotB[j])) - halfB[j] - (halfA[0] * absC[0][j] + halfA[1] * absC[1][j] + halfA[2] * absC[2][j]);
+		if (s > margin)
+		{
+			return 0;
+		}
+		if (s > faceB)
+		{
+			faceB = s;
+			axisB = j;
+		}
+	}
+
+	// edge axes
+	float edge = -FLT_MAX;
+	int edgeA = 0, edgeB = 0;
+	glm::vec3 edgeAxis;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			glm::vec3 L = glm::cross(rotA[i], rotB[j]);
+			float length = glm::length(L);
+			if (length < 1e-4f)
+			{
+				continue;
+			}
+			L /= length;
+			float rA = halfA[0] * std::fabs(glm::dot(rotA[0], L)) + halfA[1] * std::fabs(glm::dot(rotA[1], L)) + halfA[2] * std::fabs(glm::dot(rotA[2], L));
+			float rB = halfB[0] * std::fabs(glm::dot(rotB[0], L)) + halfB[1] * std::fabs(glm::dot(rotB[1], L)) + halfB[2] * std::fabs(glm::dot(rotB[2], L));
+			float s = std::fabs(glm::dot(d, L)) - rA - rB;
+			if (s > margin)
+			{
+				return 0;
+			}
+			if (s > edge)
+			{
+				edge = s;
+				edgeA = i;
+				edgeB = j;
+				edgeAxis = L;
+			}
+		}
+	}
+
+	// prefer faces, and A to B, unless the other axis is clearly better: keeps the choice steady
+	const float relative = 0.95f, absolute = 0.005f;
+	bool referenceA = !(faceB > relative * faceA + absolute);
+	float face = referenceA ? faceA : faceB;
+
+	if (edge > relative * face + absolute)
+	{
+		// closest points of the two supporting edges
+		glm::vec3 L = glm::dot(d, edgeAxis) < 0.0f ? -edgeAxis : edgeAxis;
+		glm::vec3 pA = posA, pB = posB;
+		for (int k = 0; k < 3; k++)
+		{
+			if (k != edgeA)
+			{
+				pA += (glm::dot(rotA[k], L) > 0.0f ? halfA[k] : -halfA[k]) * rotA[k];
+			}
+			if (k != edgeB)
+			{
+				pB -= (glm::dot(rotB[k], L) > 0.0f ? halfB[k] : -halfB[k]) * rotB[k];
+			}
+		}
+		glm::vec3 p1 = pA - halfA[edgeA] * rotA[edgeA], q1 = pA + halfA[edgeA] * rotA[edgeA];
+		glm::vec3 p2 = pB - halfB[edgeB] * rotB[edgeB], q2 = pB + halfB[edgeB] * rotB[edgeB];
+		float s, t;
+		closestSegmentSegment(p1, q1, p2, q2, s, t);
+		points[0] = 0.5f * (p1 + s * (q1 - p1) + p2 + t * (q2 - p2));
+		depths[0] = -edge;
+		normal = L;
+		return 1;
+	}
+
+	// reference face of one box, incident face of the other (the most anti-parallel one)
+	const glm::vec3 &posR = referenceA ? posA : posB;
+	const glm::mat3 &rotR = referenceA ? rotA : rotB;
+	const glm::vec3 &halfR = referenceA ? halfA : halfB;
+	const glm::vec3 &posI = referenceA ? posB : posA;
+	const glm::mat3 &rotI = referenceA ? rotB : rotA;
+	const glm::vec3 &halfI = referenceA ? halfB : halfA;
+	int axis = referenceA ? axisA : axisB;
+	glm::vec3 toI = posI - posR;
+	glm::vec3 n = glm::dot(toI, rotR[axis]) < 0.0f ? -rotR[axis] : rotR[axis];
+
+	int m = 0;
+	float most = -1.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		float c = std::fabs(glm::dot(n, rotI[k]));
+		if (c > most)
+		{
+			most = c;
+			m = k;
+		}
+	}
+	glm::vec3 incidentNormal = glm::dot(n, rotI[m]) > 0.0f ? -rotI[m] : rotI[m];
+	glm::vec3 centre = posI + halfI[m] * incidentNormal;
+	int p = (m + 1) % 3, q = (m + 2) % 3;
+	glm::vec3 u = halfI[p] * rotI[p], v = halfI[q] * rotI[q];
+	glm::vec3 polygon[16] = { centre + u + v, centre - u + v, centre - u - v, centre + u - v };
+	glm::vec3 clipped[16];
+	int count = 4;
+
+	// clip against the four side planes of the reference face
+	for (int k = 0; k < 3 && count > 0; k++)
+	{
+		if (k == axis)
+		{
+			continue;
+		}
+		float c = glm::dot(rotR[k], posR);
+		count = clipPolygon(polygon, count, rotR[k], c + halfR[k], clipped);
+		count = clipPolygon(clipped, count, -rotR[k], -c + halfR[k], polygon);
+	}
+
+	// points within the margin of the reference face, halfway between the faces
+	float faceOffset = glm::dot(n, posR) + halfR[axis];
+	glm::vec3 found[16];
+	float depth[16];
+	int kept = 0;
+	for (int k = 0; k < count; k++)
+	{
+		float separation = glm::dot(n, polygon[k]) - faceOffset;
+		if (separation <= margin)
+		{
+			found[kept] = polygon[k] - 0.5f * separation * n;
+			depth[kept] = -separation;
+			kept++;
+		}
+	}
+
+	kept = reducePoints(found, depth, kept, n);
+	for (int k = 0; k < kept; k++)
+	{
+		points[k] = found[k];
+		depths[k] = depth[k];
+	}
+	normal = referenceA ? n : -n;
+	return kept;
+}
+
+void RigidCollision::updatePairs(const RigidBodySystem &rb)
+{
+	int n = std::min(rb.getCount(), (int)m_halfExtents.size());
+	for (int i = 0; i < n; i++)
+	{
+		// sleeping bodies don't move, nor do their proxies
+		if (m_halfExtents[i] == glm::vec3(0.0f) || (m_proxy[i] >= 0 && rb.isSleeping(i)))
+		{
+			continue;
+		}
+
+		// bounds of the box grown by the margin
+		glm::vec3 pos = rb.getPos(i);
+		glm::mat3 R = glm::mat3_cast(rb.getOrientation(i));
+		glm::vec3 h = m_halfExtents[i];
+		glm::vec3 extent = glm::abs(R[0]) * h.x + glm::abs(R[1]) * h.y + glm::abs(R[2]) * h.z + glm::vec3(m_margin);
+		AABB aabb(pos - extent, pos + extent);
+
+		if (m_proxy[i] < 0)
+		{
+			m_proxy[i] = m_broadphase->createProxy(aabb, i);
+		}
+		else
+		{
+			m_broadphase->moveProxy(m_proxy[i], aabb, pos - m_lastPos[i]);
+		}
+		m_lastPos[i] = pos;
+		m_bounds[i] = m_broadphase->getFatAABB(m_proxy[i]);
+	}
+
+	m_broadphase->updatePairs(m_newPairs);
+	m_pairCache.beginStep();
+	m_pairCache.addPairs(m_newPairs);
+	m_pairCache.endStep(m_bounds);
+}
+
+void RigidCollision::collidePair(const RigidBodySystem &rb, CachedPair &pair, glm::vec3 &normal, float depths[4])
+{
+	int a = pair.bodyA, b = pair.bodyB;
+	if (rb.getInvMass(a) == 0.0f && rb.getInvMass(b) == 0.0f)
+	{
+		pair.pointCount = 0;
+		return;
+	}
+
+	glm::vec3 posA = rb.getPos(a), posB = rb.getPos(b);
+	glm::mat3 rotA = glm::mat3_cast(rb.getOrientation(a));
+	glm::mat3 rotB = glm::mat3_cast(rb.getOrientation(b));
+	glm::vec3 points[4];
+	int count = collideBoxes(posA, rotA, m_halfExtents[a], posB, rotB, m_halfExtents[b], m_margin, points, normal, depths);
+
+	// a new point close to an old one (in the axes of A) inherits its impulses
+	CachedPoint updated[4];
+	for (int k = 0; k < count; k++)
+	{
+		CachedPoint &point = updated[k];
+		point.localA = glm::transpose(rotA) * (points[k] - posA);
+		point.localB = glm::transpose(rotB) * (points[k] - posB);
+		point.depth = depths[k];
+		point.normalImpulse = 0.0f;
+		point.frictionImpulse = glm::vec3(0.0f);
+		float best = m_matchDistance * m_matchDistance;
+		for (int j = 0; j < pair.pointCount; j++)
+		{
+			glm::vec3 d = pair.points[j].localA - point.localA;
+			if (glm::dot(d, d) < best)
+			{
+				best = glm::dot(d, d);
+				point.normalImpulse = pair.points[j].normalImpulse;
+				point.frictionImpulse = pair.points[j].frictionImpulse;
+			}
+		}
+	}
+
+	pair.pointCount = count;
+	for (int k = 0; k < count; k++)
+	{
+		pair.points[k] = updated[k];
+	}
+	pair.localNormal = glm::transpose(rotA) * normal;
+	pair.relative = glm::conjugate(rb.getOrientation(a)) * rb.getOrientation(b);
+}
+
+bool RigidCollision::refreshPair(const RigidBodySystem &rb, const CachedPair &pair, float minCos, glm::vec3 &normal, float depths[4]) const
+{
+	if (pair.pointCount == 0)
+	{
+		return false;
+	}
+
+	// the relative orientation decides the shape of the manifold, so it must have barely turned
+	glm::quat qA = rb.getOrientation(pair.bodyA), qB = rb.getOrientation(pair.bodyB);
+	if (std::fabs(glm::dot(glm::conjugate(qA) * qB, pair.relative)) < minCos)
+	{
+		return false;
+	}
+
+	// the anchors of a point on the two bodies move apart by the relative motion at the point;
+	// along the normal it changes the depth
+	glm::vec3 posA = rb.getPos(pair.bodyA), posB = rb.getPos(pair.bodyB);
+	glm::mat3 rotA = glm::mat3_cast(qA), rotB = glm::mat3_cast(qB);
+	glm::vec3 n = rotA * pair.localNormal;
+	float depth[4];
+	for (int k = 0; k < pair.pointCount; k++)
+	{
+		glm::vec3 drift = (posB + rotB * pair.points[k].localB) - (posA + rotA * pair.points[k].localA);
+		depth[k] = pair.points[k].depth - glm::dot(drift, n);
+		if (!(glm::dot(drift, drift) < m_driftDistance * m_driftDistance) || depth[k] < -m_margin)
+		{
+			return false;
+		}
+	}
+
+	normal = n;
+	for (int k = 0; k < pair.pointCount; k++)
+	{
+		depths[k] = depth[k];
+	}
+	return true;
+}
+
+void RigidCollision::findContacts(RigidBodySystem &rb)
+{
+	if ((int)m_halfExtents.size() < rb.getCount())
+	{
+		setBox(rb.getCount() - 1, glm::vec3(0.0f));
+	}
+	updatePairs(rb);
+
+	int pairs = m_pairCache.getPairCount();
+	m_pairNormal.resize(pairs);
+	m_pairDepth.resize(4 * pairs);
+
+	// only the pairs with a body awake; the others keep their points for when they wake
+	m_pairActive.assign(pairs, 0);
+	m_pending.clear();
+	for (int i = 0; i < pairs; i++)
+	{
+		const CachedPair &pair = m_pairCache.getPair(i);
+		if (rb.isAwake(pair.bodyA) || rb.isAwake(pair.bodyB))
+		{
+			m_pairActive[i] = 1;
+			m_pending.push_back(i);
+		}
+	}
+
+	// cosine of half the drift angle bounds the dot product of the relative orientations
+	float minCos = std::cos(0.5f * m_driftAngle);
+	int refreshed = 0;
+	m_narrowphaseCount = 0;
+	while (!m_pending.empty())
+	{
+		int count = (int)m_pending.size();
+
+		#pragma omp parallel for schedule(dynamic, 64) reduction(+:refreshed)
+		for (int k = 0; k < count; k++)
+		{
+			int i = m_pending[k];
+			CachedPair &pair = m_pairCache.getPair(i);
+			if (refreshPair(rb, pair, minCos, m_pairNormal[i], &m_pairDepth[4 * i]))
+			{
+				refreshed++;
+			}
+			else
+			{
+				collidePair(rb, pair, m_pairNormal[i], &m_pairDepth[4 * i]);
+			}
+		}
+		m_narrowphaseCount += count;
+
+		// a sleeping body touched wakes its island, whose pairs then need the narrowphase too
+		bool woken = false;
+		for (int k = 0; k < count; k++)
+		{
+			const CachedPair &pair = m_pairCache.getPair(m_pending[k]);
+			if (pair.pointCount > 0 && (rb.isSleeping(pair.bodyA) || rb.isSleeping(pair.bodyB)))
+			{
+				rb.wake(pair.bodyA);
+				rb.wake(pair.bodyB);
+				woken = true;
+			}
+		}
+		m_pending.clear();
+		if (woken)
+		{
+			for (int i = 0; i < pairs; i++)
+			{
+				const CachedPair &pair = m_pairCache.getPair(i);
+				if (!m_pairActive[i] && (rb.isAwake(pair.bodyA) || rb.isAwake(pair.bodyB)))
+				{
+					m_pairActive[i] = 1;
+					m_pending.push_back(i);
+				}
+			}
+		}
+	}
+
+	m_refreshCount = refreshed;
+	m_narrowphaseCount -= refreshed;
+
+	// contacts of every pair, in pair order
+	m_contactStart.resize(pairs + 1);
+	m_contactStart[0] = 0;
+	for (int i = 0; i < pairs; i++)
+	{
+		m_contactStart[i + 1] = m_contactStart[i] + (m_pairActive[i] ? m_pairCache.getPair(i).pointCount : 0);
+	}
+	m_contacts.resize(m_contactStart[pairs]);
+
+	#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < pairs; i++)
+	{
+		const CachedPair &pair = m_pairCache.getPair(i);
+		if (!m_pairActive[i])
+		{
+			continue;
+		}
+		glm::vec3 posA = rb.getPos(pair.bodyA), posB = rb.getPos(pair.bodyB);
+		glm::mat3 rotA = glm::mat3_cast(rb.getOrientation(pair.bodyA));
+		glm::mat3 rotB = glm::mat3_cast(rb.getOrientation(pair.bodyB));
+		for (int k = 0; k < pair.pointCount; k++)
+		{
+			Contact &contact = m_contacts[m_contactStart[i] + k];
+			contact.bodyA = pair.bodyA;
+			contact.bodyB = pair.bodyB;
+			// halfway between the anchors, which only differ once the manifold has been carried
+			contact.point = 0.5f * (posA + rotA * pair.points[k].localA + posB + rotB * pair.points[k].localB);
+			contact.normal = m_pairNormal[i];
+			contact.depth = m_pairDepth[4 * i + k];
+			contact.normalImpulse = pair.points[k].normalImpulse;
+			contact.frictionImpulse = pair.points[k].frictionImpulse;
+			contact.pair = i;
+			contact.cachePoint = k;
+		}
+	}
+}
+
+void RigidCollision::storeImpulses()
+{
+	int m = (int)m_contacts.size();
+
+	#pragma omp parallel for
+	for (int c = 0; c < m; c++)
+	{
+		const Contact &contact = m_contacts[c];
+		CachedPoint &point = m_pairCache.getPair(contact.pair).points[contact.cachePoint];
+		point.normalImpulse = contact.normalImpulse;
+		point.frictionImpulse = contact.frictionImpulse;
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "Broadphase.h"
+#include "PairCache.h"
+#include "RigidBodySystem.h"
+#include "ContactSolver.h"
+
+/*
+** RIGID COLLISION
+** Collision detection for rigid bodies shaped as boxes (oriented, one per body; a
+** fixed box makes a floor or a wall). A broadphase of the selected type finds the
+** pairs whose bounds overlap and the pair cache keeps them between steps. The
+** narrowphase runs in parallel over the cached pairs: separating axis test on the
+** 15 axes of two boxes, then the incident face clipped against the side planes of the
+** reference face (or the closest points of two edges), with the points reduced to
+** the four that span the largest area. Points within the margin are kept as
+** speculative contacts.
+** Every point is stored in the pair in the axes of both bodies, with the impulses
+** of the solve, and a new point near an old one inherits its impulses for warm
+** starting.
+** The points persist: every step they are carried along by the new poses of the two
+** bodies, the depth updated by their relative motion along the normal, and the full
+** narrowphase only runs again once the anchors of a point on the two bodies drift
+** apart by more than a drift distance, the bodies turn relative to each other by
+** more than a drift angle, or a point separates past the margin.
+** Sleeping bodies keep their proxies still and their pairs out of the narrowphase,
+** with the points cached for when they wake. A body awake touching a sleeping one
+** wakes its island, and the narrowphase runs again over the pairs that woke.
+*/
+class RigidCollision
+{
+public:
+	RigidCollision(BroadphaseType type = DYNAMIC_TREE);
+	~RigidCollision();
+
+	/*
+	** GET METHODS
+	*/
+	std::vector<Contact>& getContacts() { return m_contacts; }
+	const PairCache& getPairCache() const { return m_pairCache; }
+	const glm::vec3& getHalfExtents(int body) const { return m_halfExtents[body]; }
+	float getMargin() const { return m_margin; }
+	// pairs of the last step whose manifold ran the full narrowphase, and those only refreshed
+	int getNarrowphaseCount() const { return m_narrowphaseCount; }
+	int getRefreshCount() const { return m_refreshCount; }
+
+	/*
+	** SET METHODS
+	*/
+	// give a body a box shape; bodies without one don't collide
+	void setBox(int body, const glm::vec3 &halfExtents);
+	// distance under which points are kept as (speculative) contacts
+	void setMargin(float margin) { m_margin = margin; }
+	// distance within which a new point takes the impulses of an old one
+	void setMatchDistance(float distance) { m_matchDistance = distance; }
+	// drift of the points (0 runs the full narrowphase every step) and turn, in radians, after which
+	// a manifold is found again
+	void setDriftDistance(float distance) { m_driftDistance = distance; }
+	void setDriftAngle(float angle) { m_driftAngle = angle; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// find the contacts at the current poses, warm started from the last step, waking the
+	// sleeping islands that are touched
+	void findContacts(RigidBodySystem &rb);
+	// keep the impulses of the solved contacts for the next step
+	void storeImpulses();
+
+	// contact points of two boxes (normal from A to B), at most four; returns their number
+	static int collideBoxes(const glm::vec3 &posA, const glm::mat3 &rotA, const glm::vec3 &halfA,
+		const glm::vec3 &posB, const glm::mat3 &rotB, const glm::vec3 &halfB, float margin,
+		glm::vec3 points[4], glm::vec3 &normal, float depths[4]);
+
+private:
+	// bounds of the broadphase proxies and the pair cache
+	void updatePairs(const RigidBodySystem &rb);
+	// narrowphase of one cached pair
+	void collidePair(const RigidBodySystem &rb, CachedPair &pair, glm::vec3 &normal, float depths[4]);
+	// carry the manifold of a pair to the current poses; false if it drifted and needs the narrowphase
+	bool refreshPair(const RigidBodySystem &rb, const CachedPair &pair, float minCos, glm::vec3 &normal, float depths[4]) const;
+
+	std::unique_ptr<Broadphase> m_broadphase;
+	float m_margin;
+	float m_matchDistance;
+	float m_driftDistance;
+	float m_driftAngle;
+	int m_narrowphaseCount;
+	int m_refreshCount;
+
+	// per body
+	std::vector<glm::vec3> m_halfExtents; // zero: no shape
+	std::vector<int> m_proxy;
+	std::vector<glm::vec3> m_lastPos;
+	std::vector<AABB> m_bounds; // fat bounds of the proxies
+
+	PairCache m_pairCache;
+	std::vector<BodyPair> m_newPairs;
+
+	// narrowphase results per cached pair, and the contacts in pair order
+	std::vector<char> m_pairActive; // has a body awake
+	std::vector<int> m_pending; // pairs waiting for the narrowphase
+	std::vector<glm::vec3> m_pairNormal;
+	std::vector<float> m_pairDepth; // four per pair
+	std::vector<int> m_contactStart;
+	std::vector<Contact> m_contacts;
+};
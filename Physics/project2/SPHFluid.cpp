@@ -0,0 +1,182 @@
+// Math constants
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "SPHFluid.h"
+
+
+SPHFluid::SPHFluid()
+{
+	m_h = 0.1f;
+	m_restDensity = 1000.0f;
+	m_soundSpeed = 30.0f;
+	m_viscosity = 0.01f;
+
+	m_gridOrigin = glm::vec3(0.0f);
+	m_gridBound = glm::vec3(0.0f);
+	m_gridCellSize = 0.0f;
+}
+
+
+SPHFluid::~SPHFluid()
+{
+}
+
+void SPHFluid::addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi) const
+{
+	float spacing = 0.5f * m_h;
+	float mass = m_restDensity * spacing * spacing * spacing;
+	for (float z = lo.z + 0.5f * spacing; z < hi.z; z += spacing)
+	{
+		for (float y = lo.y + 0.5f * spacing; y < hi.y; y += spacing)
+		{
+			for (float x = lo.x + 0.5f * spacing; x < hi.x; x += spacing)
+			{
+				ps.addParticle(glm::vec3(x, y, z), glm::vec3(0.0f), mass);
+			}
+		}
+	}
+}
+
+// copy the particles to flat arrays in cell order
+void SPHFluid::gather(const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<float> &mass = ps.getMass();
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	int n = ps.getCount();
+
+	m_x.resize(n); m_y.resize(n); m_z.resize(n);
+	m_vx.resize(n); m_vy.resize(n); m_vz.resize(n);
+	m_m.resize(n); m_rho.resize(n); m_p.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		int p = order[i];
+		m_x[i] = pos[p].x; m_y[i] = pos[p].y; m_z[i] = pos[p].z;
+		m_vx[i] = vel[p].x; m_vy[i] = vel[p].y; m_vz[i] = vel[p].z;
+		m_m[i] = mass[p];
+	}
+}
+
+// density with the poly6 kernel, pressure from the Tait equation
+void SPHFluid::computeDensity()
+{
+	int n = (int)m_x.size();
+	float h2 = m_h * m_h;
+	float poly6 = 315.0f / (64.0f * (float)M_PI * powf(m_h, 9.0f));
+	float B = m_restDensity * m_soundSpeed * m_soundSpeed / 7.0f;
+	const std::vector<unsigned int> &cells = m_grid.getSortedCells();
+	const glm::ivec3 &dims = m_grid.getDims();
+
+	#pragma omp parallel for schedule(dynamic, 256)
+	for (int i = 0; i < n; i++)
+	{
+		int cell = (int)cells[i];
+		glm::ivec3 c(cell % dims.x, (cell / dims.x) % dims.y, cell / (dims.x * dims.y));
+		float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+		float sum = 0.0f;
+
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				int begin, end;
+				m_grid.getRowRange(c, dy, dz, begin, end);
+				for (int j = begin; j < end; j++)
+				{
+					float dx = xi - m_x[j], ddy = yi - m_y[j], ddz = zi - m_z[j];
+					float d = h2 - (dx * dx + ddy * ddy + ddz * ddz);
+					d = d > 0.0f ? d : 0.0f;
+					sum += m_m[j] * d * d * d;
+				}
+			}
+		}
+
+		float rho = poly6 * sum;
+		m_rho[i] = rho;
+		// negative pressures are clamped to avoid the tensile instability
+		float ratio = rho / m_restDensity;
+		float r2 = ratio * ratio;
+		float p = B * (r2 * r2 * r2 * ratio - 1.0f);
+		m_p[i] = p > 0.0f ? p : 0.0f;
+	}
+}
+
+// symmetric pressure force (spiky kernel) and viscosity (viscosity kernel laplacian)
+void SPHFluid::computeForces(ParticleSystem &ps)
+{
+	std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<int> &order = m_grid.getSortedIndices();
+	const std::vector<unsigned int> &cells = m_grid.getSortedCells();
+	const glm::ivec3 &dims = m_grid.getDims();
+	int n = (int)m_x.size();
+	float h = m_h;
+	float spiky = -45.0f / ((float)M_PI * powf(m_h, 6.0f));
+	float viscLap = 45.0f / ((float)M_PI * powf(m_h, 6.0f));
+
+	m_density.resize(n);
+
+	#pragma omp parallel for schedule(dynamic, 256)
+	for (int i = 0; i < n; i++)
+	{
+		int cell = (int)cells[i];
+		glm::ivec3 c(cell % dims.x, (cell / dims.x) % dims.y, cell / (dims.x * dims.y));
+		float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+		float pi = m_p[i] / (m_rho[i] * m_rho[i]);
+		float ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				int begin, end;
+				m_grid.getRowRange(c, dy, dz, begin, end);
+				for (int j = begin; j < end; j++)
+				{
+					float rx = xi - m_x[j], ry = yi - m_y[j], rz = zi - m_z[j];
+					float r = sqrtf(rx * rx + ry * ry + rz * rz);
+					// masked instead of branching so that the loop vectorises; also removes j == i
+					float inside = (r < h && r > 1e-6f) ? 1.0f : 0.0f;
+					float q = inside * (h - r);
+
+					float pressure = -m_m[j] * (pi + m_p[j] / (m_rho[j] * m_rho[j])) * spiky * q * q / (r + 1e-6f);
+					float visc = m_viscosity * m_m[j] / m_rho[j] * viscLap * q;
+
+					ax += pressure * rx + visc * (m_vx[j] - m_vx[i]);
+					ay += pressure * ry + visc * (m_vy[j] - m_vy[i]);
+					az += pressure * rz + visc * (m_vz[j] - m_vz[i]);
+				}
+			}
+		}
+
+		int p = order[i];
+		force[p] += m_m[i] * glm::vec3(ax, ay, az);
+		m_density[p] = m_rho[i];
+	}
+}
+
+void SPHFluid::applyForce(ParticleSystem &ps)
+{
+	if (ps.getCount() == 0)
+	{
+		return;
+	}
+
+	// the grid covers the cube of the system with cells one smoothing length wide
+	const Cube &cube = ps.getCube();
+	if (cube.origin != m_gridOrigin || cube.bound != m_gridBound || m_h != m_gridCellSize)
+	{
+		m_grid.setDomain(cube.origin, cube.bound, m_h);
+		m_gridOrigin = cube.origin;
+		m_gridBound = cube.bound;
+		m_gridCellSize = m_h;
+	}
+
+	m_grid.build(ps.getPos());
+	gather(ps);
+	computeDensity();
+	computeForces(ps);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "UniformGrid.h"
+
+/*
+** SPH FLUID
+** Weakly compressible SPH (Tait equation of state) as a force generator: densities,
+** pressures and the pressure and viscosity forces are computed from the particles of
+** the system, which is then integrated as usual and kept inside its cube.
+** Neighbours come from the uniform grid; the particles are processed in cell order
+** so that each neighbour row is a contiguous range of flat arrays.
+*/
+class SPHFluid : public ForceGenerator
+{
+public:
+	SPHFluid();
+	~SPHFluid();
+
+	/*
+	** GET METHODS
+	*/
+	float getSmoothingLength() const { return m_h; }
+	float getRestDensity() const { return m_restDensity; }
+	float getSoundSpeed() const { return m_soundSpeed; }
+	float getViscosity() const { return m_viscosity; }
+	// density of the particles computed by the last step (in particle order)
+	const std::vector<float>& getDensity() const { return m_density; }
+	// largest stable time step (CFL condition on the speed of sound)
+	float getMaxTimeStep() const { return 0.4f * m_h / m_soundSpeed; }
+
+	/*
+	** SET METHODS
+	*/
+	void setSmoothingLength(float h) { m_h = h; }
+	void setRestDensity(float rho) { m_restDensity = rho; }
+	// numerical speed of sound, around 10x the largest expected velocity keeps density errors near 1%
+	void setSoundSpeed(float c) { m_soundSpeed = c; }
+	// kinematic viscosity
+	void setViscosity(float nu) { m_viscosity = nu; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// fill a box with particles at rest spaced half a smoothing length apart
+	void addBlock(ParticleSystem &ps, const glm::vec3 &lo, const glm::vec3 &hi) const;
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	void gather(const ParticleSystem &ps);
+	void computeDensity();
+	void computeForces(ParticleSystem &ps);
+
+	float m_h;
+	float m_restDensity;
+	float m_soundSpeed;
+	float m_viscosity;
+
+	UniformGrid m_grid;
+	glm::vec3 m_gridOrigin, m_gridBound;
+	float m_gridCellSize;
+
+	// particle data in cell order
+	std::vector<float> m_x, m_y, m_z;
+	std::vector<float> m_vx, m_vy, m_vz;
+	std::vector<float> m_m, m_rho, m_p;
+
+	std::vector<float> m_density;
+};
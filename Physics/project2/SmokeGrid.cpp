@@ -0,0 +1,643 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SmokeGrid.h"
+
+
+SmokeGrid::SmokeGrid()
+{
+	m_vorticity = 0.5f;
+	m_tolerance = 1e-3f;
+	m_maxCycles = 10;
+	m_cycles = 0;
+	m_residual = 0.0f;
+
+	setDomain(Cube(), 0.1f);
+}
+
+
+SmokeGrid::~SmokeGrid()
+{
+}
+
+void SmokeGrid::setDomain(const Cube &cube, float cellSize)
+{
+	m_origin = cube.origin;
+	m_h = cellSize;
+	m_dims = glm::max(glm::ivec3(glm::ceil((cube.bound - cube.origin) / cellSize)), glm::ivec3(1));
+
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+	m_u.assign((nx + 1) * ny * nz, 0.0f);
+	m_v.assign(nx * (ny + 1) * nz, 0.0f);
+	m_w.assign(nx * ny * (nz + 1), 0.0f);
+	m_u0 = m_u;
+	m_v0 = m_v;
+	m_w0 = m_w;
+	m_density.assign(nx * ny * nz, 0.0f);
+	m_density0 = m_density;
+	m_curl.assign(nx * ny * nz, glm::vec3(0.0f));
+	m_confinement = m_curl;
+
+	buildLevels();
+}
+
+void SmokeGrid::addSource(const glm::vec3 &centre, float radius, const glm::vec3 &velocity, float density)
+{
+	Source s;
+	s.centre = centre;
+	s.radius = radius;
+	s.velocity = velocity;
+	s.density = density;
+	m_sources.push_back(s);
+}
+
+
+/*
+** SAMPLING
+*/
+
+float SmokeGrid::sample(const std::vector<float> &f, const glm::ivec3 &dims, const glm::vec3 &offset, const glm::vec3 &p) const
+{
+	glm::vec3 g = (p - m_origin) / m_h - offset;
+	g = glm::clamp(g, glm::vec3(0.0f), glm::vec3(dims - 1));
+
+	glm::ivec3 i0 = glm::min(glm::ivec3(g), glm::max(dims - 2, glm::ivec3(0)));
+	glm::ivec3 i1 = glm::min(i0 + 1, dims - 1);
+	glm::vec3 t = g - glm::vec3(i0);
+
+	int sx = dims.x, sxy = dims.x * dims.y;
+	float c000 = f[i0.x + sx * i0.y + sxy * i0.z], c100 = f[i1.x + sx * i0.y + sxy * i0.z];
+	float c010 = f[i0.x + sx * i1.y + sxy * i0.z], c110 = f[i1.x + sx * i1.y + sxy * i0.z];
+	float c001 = f[i0.x + sx * i0.y + sxy * i1.z], c101 = f[i1.x + sx * i0.y + sxy * i1.z];
+	float c011 = f[i0.x + sx * i1.y + sxy * i1.z], c111 = f[i1.x + sx * i1.y + sxy * i1.z];
+
+	float c00 = c000 + t.x * (c100 - c000);
+	float c10 = c010 + t.x * (c110 - c010);
+	float c01 = c001 + t.x * (c101 - c001);
+	float c11 = c011 + t.x * (c111 - c011);
+	float c0 = c00 + t.y * (c10 - c00);
+	float c1 = c01 + t.y * (c11 - c01);
+	return c0 + t.z * (c1 - c0);
+}
+
+glm::vec3 SmokeGrid::sampleVelocity(const glm::vec3 &p) const
+{
+	return glm::vec3(
+		sample(m_u, m_dims + glm::ivec3(1, 0, 0), glm::vec3(0.0f, 0.5f, 0.5f), p),
+		sample(m_v, m_dims + glm::ivec3(0, 1, 0), glm::vec3(0.5f, 0.0f, 0.5f), p),
+		sample(m_w, m_dims + glm::ivec3(0, 0, 1), glm::vec3(0.5f, 0.5f, 0.0f), p));
+}
+
+float SmokeGrid::sampleDensity(const glm::vec3 &p) const
+{
+	return sample(m_density, m_dims, glm::vec3(0.5f), p);
+}
+
+
+/*
+** SIMULATION STEPS
+*/
+
+// sources are small, so only the cells under each source's bounding box are visited, on one
+// thread: neighbouring cells share the faces they write
+void SmokeGrid::applySources()
+{
+	for (int s = 0; s < (int)m_sources.size(); s++)
+	{
+		const Source &src = m_sources[s];
+		float r2 = src.radius * src.radius;
+
+		glm::ivec3 lo = glm::max(glm::ivec3(glm::floor((src.centre - src.radius - m_origin) / m_h)), glm::ivec3(0));
+		glm::ivec3 hi = glm::min(glm::ivec3(glm::floor((src.centre + src.radius - m_origin) / m_h)), m_dims - 1);
+
+		for (int k = lo.z; k <= hi.z; k++)
+		{
+			for (int j = lo.y; j <= hi.y; j++)
+			{
+				for (int i = lo.x; i <= hi.x; i++)
+				{
+					glm::vec3 c = m_origin + m_h * glm::vec3(i + 0.5f, j + 0.5f, k + 0.5f);
+					glm::vec3 d = c - src.centre;
+					if (glm::dot(d, d) > r2)
+					{
+						continue;
+					}
+
+					// impose the velocity on the faces of the cell
+					m_u[uIndex(i, j, k)] = m_u[uIndex(i + 1, j, k)] = src.velocity.x;
+					m_v[vIndex(i, j, k)] = m_v[vIndex(i, j + 1, k)] = src.velocity.y;
+					m_w[wIndex(i, j, k)] = m_w[wIndex(i, j, k + 1)] = src.velocity.z;
+					m_density[cIndex(i, j, k)] = src.density;
+				}
+			}
+		}
+	}
+}
+
+// semi-Lagrangian advection of the velocity components and the smoke density
+void SmokeGrid::advect(float dt)
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+
+	// trace back through the current field, the results go to the second buffers
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i <= nx; i++)
+			{
+				glm::vec3 p = m_origin + m_h * glm::vec3((float)i, j + 0.5f, k + 0.5f);
+				glm::vec3 back = p - dt * sampleVelocity(p);
+				m_u0[uIndex(i, j, k)] = sample(m_u, m_dims + glm::ivec3(1, 0, 0), glm::vec3(0.0f, 0.5f, 0.5f), back);
+			}
+		}
+	}
+
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j <= ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				glm::vec3 p = m_origin + m_h * glm::vec3(i + 0.5f, (float)j, k + 0.5f);
+				glm::vec3 back = p - dt * sampleVelocity(p);
+				m_v0[vIndex(i, j, k)] = sample(m_v, m_dims + glm::ivec3(0, 1, 0), glm::vec3(0.5f, 0.0f, 0.5f), back);
+			}
+		}
+	}
+
+	#pragma omp parallel for
+	for (int k = 0; k <= nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				glm::vec3 p = m_origin + m_h * glm::vec3(i + 0.5f, j + 0.5f, (float)k);
+				glm::vec3 back = p - dt * sampleVelocity(p);
+				m_w0[wIndex(i, j, k)] = sample(m_w, m_dims + glm::ivec3(0, 0, 1), glm::vec3(0.5f, 0.5f, 0.0f), back);
+			}
+		}
+	}
+
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				glm::vec3 p = m_origin + m_h * glm::vec3(i + 0.5f, j + 0.5f, k + 0.5f);
+				glm::vec3 back = p - dt * sampleVelocity(p);
+				m_density0[cIndex(i, j, k)] = sample(m_density, m_dims, glm::vec3(0.5f), back);
+			}
+		}
+	}
+
+	m_u.swap(m_u0);
+	m_v.swap(m_v0);
+	m_w.swap(m_w0);
+	m_density.swap(m_density0);
+}
+
+// add back the small scale swirls lost by the numerical dissipation of advection
+void SmokeGrid::confineVorticity(float dt)
+{
+	if (m_vorticity <= 0.0f)
+	{
+		return;
+	}
+
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+
+	// curl of the cell centred velocity
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, nx - 1);
+				int j0 = std::max(j - 1, 0), j1 = std::min(j + 1, ny - 1);
+				int k0 = std::max(k - 1, 0), k1 = std::min(k + 1, nz - 1);
+				float dx = m_h * std::max(i1 - i0, 1);
+				float dy = m_h * std::max(j1 - j0, 1);
+				float dz = m_h * std::max(k1 - k0, 1);
+
+				float dwdy = 0.5f * (m_w[wIndex(i, j1, k)] + m_w[wIndex(i, j1, k + 1)] - m_w[wIndex(i, j0, k)] - m_w[wIndex(i, j0, k + 1)]) / dy;
+				float dvdz = 0.5f * (m_v[vIndex(i, j, k1)] + m_v[vIndex(i, j + 1, k1)] - m_v[vIndex(i, j, k0)] - m_v[vIndex(i, j + 1, k0)]) / dz;
+				float dudz = 0.5f * (m_u[uIndex(i, j, k1)] + m_u[uIndex(i + 1, j, k1)] - m_u[uIndex(i, j, k0)] - m_u[uIndex(i + 1, j, k0)]) / dz;
+				float dwdx = 0.5f * (m_w[wIndex(i1, j, k)] + m_w[wIndex(i1, j, k + 1)] - m_w[wIndex(i0, j, k)] - m_w[wIndex(i0, j, k + 1)]) / dx;
+				float dvdx = 0.5f * (m_v[vIndex(i1, j, k)] + m_v[vIndex(i1, j + 1, k)] - m_v[vIndex(i0, j, k)] - m_v[vIndex(i0, j + 1, k)]) / dx;
+				float dudy = 0.5f * (m_u[uIndex(i, j1, k)] + m_u[uIndex(i + 1, j1, k)] - m_u[uIndex(i, j0, k)] - m_u[uIndex(i + 1, j0, k)]) / dy;
+
+				m_curl[cIndex(i, j, k)] = glm::vec3(dwdy - dvdz, dudz - dwdx, dvdx - dudy);
+			}
+		}
+	}
+
+	// f = eps h (N x w) with N the normalised gradient of |w|
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				glm::vec3 f(0.0f);
+				if (i > 0 && i < nx - 1 && j > 0 && j < ny - 1 && k > 0 && k < nz - 1)
+				{
+					glm::vec3 grad(
+						glm::length(m_curl[cIndex(i + 1, j, k)]) - glm::length(m_curl[cIndex(i - 1, j, k)]),
+						glm::length(m_curl[cIndex(i, j + 1, k)]) - glm::length(m_curl[cIndex(i, j - 1, k)]),
+						glm::length(m_curl[cIndex(i, j, k + 1)]) - glm::length(m_curl[cIndex(i, j, k - 1)]));
+					float len = glm::length(grad);
+					if (len > 1e-6f)
+					{
+						f = m_vorticity * m_h * glm::cross(grad / len, m_curl[cIndex(i, j, k)]);
+					}
+				}
+				m_confinement[cIndex(i, j, k)] = f;
+			}
+		}
+	}
+
+	// every interior face gathers the force of its two cells
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				const glm::vec3 &f = m_confinement[cIndex(i, j, k)];
+				if (i > 0)
+				{
+					m_u[uIndex(i, j, k)] += 0.5f * dt * (f.x + m_confinement[cIndex(i - 1, j, k)].x);
+				}
+				if (j > 0)
+				{
+					m_v[vIndex(i, j, k)] += 0.5f * dt * (f.y + m_confinement[cIndex(i, j - 1, k)].y);
+				}
+				if (k > 0)
+				{
+					m_w[wIndex(i, j, k)] += 0.5f * dt * (f.z + m_confinement[cIndex(i, j, k - 1)].z);
+				}
+			}
+		}
+	}
+}
+
+void SmokeGrid::setBoundary()
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+
+	// solid walls: no flow through the faces on the border of the cube
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			m_u[uIndex(0, j, k)] = 0.0f;
+			m_u[uIndex(nx, j, k)] = 0.0f;
+		}
+		for (int i = 0; i < nx; i++)
+		{
+			m_v[vIndex(i, 0, k)] = 0.0f;
+			m_v[vIndex(i, ny, k)] = 0.0f;
+		}
+	}
+	for (int j = 0; j < ny; j++)
+	{
+		for (int i = 0; i < nx; i++)
+		{
+			m_w[wIndex(i, j, 0)] = 0.0f;
+			m_w[wIndex(i, j, nz)] = 0.0f;
+		}
+	}
+}
+
+void SmokeGrid::project(float dt)
+{
+	int nx = m_dims.x, ny = m_dims.y, nz = m_dims.z;
+	Level &top = m_levels[0];
+
+	// right hand side -div(u) / dt, with the mean removed so the Neumann problem is solvable
+	double sum = 0.0;
+	#pragma omp parallel for reduction(+:sum)
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				float div = (m_u[uIndex(i + 1, j, k)] - m_u[uIndex(i, j, k)]
+					+ m_v[vIndex(i, j + 1, k)] - m_v[vIndex(i, j, k)]
+					+ m_w[wIndex(i, j, k + 1)] - m_w[wIndex(i, j, k)]) / m_h;
+				top.b[cIndex(i, j, k)] = -div / dt;
+				sum += top.b[cIndex(i, j, k)];
+			}
+		}
+	}
+
+	int cells = nx * ny * nz;
+	float mean = (float)(sum / cells);
+	double norm = 0.0;
+	#pragma omp parallel for reduction(+:norm)
+	for (int c = 0; c < cells; c++)
+	{
+		top.b[c] -= mean;
+		norm += (double)top.b[c] * top.b[c];
+	}
+	norm = std::sqrt(norm);
+
+	// V-cycles, warm started from the previous pressure
+	m_cycles = 0;
+	m_residual = 0.0f;
+	if (norm > 0.0)
+	{
+		for (m_cycles = 0; m_cycles < m_maxCycles; )
+		{
+			vCycle(0);
+			m_cycles++;
+
+			residual(top);
+			double r = 0.0;
+			#pragma omp parallel for reduction(+:r)
+			for (int c = 0; c < cells; c++)
+			{
+				r += (double)top.r[c] * top.r[c];
+			}
+			m_residual = (float)(std::sqrt(r) / norm);
+			if (m_residual < m_tolerance)
+			{
+				break;
+			}
+		}
+	}
+
+	// subtract the pressure gradient from the interior faces
+	const std::vector<float> &p = top.x;
+	float scale = dt / m_h;
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 1; i < nx; i++)
+			{
+				m_u[uIndex(i, j, k)] -= scale * (p[cIndex(i, j, k)] - p[cIndex(i - 1, j, k)]);
+			}
+		}
+		for (int j = 1; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				m_v[vIndex(i, j, k)] -= scale * (p[cIndex(i, j, k)] - p[cIndex(i, j - 1, k)]);
+			}
+		}
+		if (k > 0)
+		{
+			for (int j = 0; j < ny; j++)
+			{
+				for (int i = 0; i < nx; i++)
+				{
+					m_w[wIndex(i, j, k)] -= scale * (p[cIndex(i, j, k)] - p[cIndex(i, j, k - 1)]);
+				}
+			}
+		}
+	}
+}
+
+void SmokeGrid::step(float dt)
+{
+	applySources();
+	advect(dt);
+	confineVorticity(dt);
+	applySources();
+	setBoundary();
+	project(dt);
+	setBoundary();
+}
+
+
+/*
+** MULTIGRID
+** Cell centred hierarchy: each coarse cell covers up to 2x2x2 fine cells. The operator
+** is rediscretised on every level: (A x)_c = sum over the neighbours inside the grid of
+** (x_c - x_n) / h^2, which is the negative Laplacian with Neumann walls.
+*/
+
+void SmokeGrid::buildLevels()
+{
+	m_levels.clear();
+
+	glm::ivec3 dims = m_dims;
+	float h = m_h;
+	while (true)
+	{
+		Level l;
+		l.dims = dims;
+		l.h = h;
+		int cells = dims.x * dims.y * dims.z;
+		l.x.assign(cells, 0.0f);
+		l.b.assign(cells, 0.0f);
+		l.r.assign(cells, 0.0f);
+		m_levels.push_back(l);
+
+		if (std::min(std::min(dims.x, dims.y), dims.z) <= 4)
+		{
+			break;
+		}
+		dims = (dims + 1) / 2;
+		h *= 2.0f;
+	}
+}
+
+// red-black Gauss-Seidel, each colour is updated in parallel over z slabs
+void SmokeGrid::smooth(Level &l, int iterations)
+{
+	int nx = l.dims.x, ny = l.dims.y, nz = l.dims.z;
+	float h2 = l.h * l.h;
+	float *x = l.x.data();
+	const float *b = l.b.data();
+
+	for (int it = 0; it < iterations; it++)
+	{
+		for (int colour = 0; colour < 2; colour++)
+		{
+			#pragma omp parallel for
+			for (int k = 0; k < nz; k++)
+			{
+				for (int j = 0; j < ny; j++)
+				{
+					int row = nx * (j + ny * k);
+					for (int i = (j + k + colour) & 1; i < nx; i += 2)
+					{
+						int c = row + i;
+						float sum = h2 * b[c];
+						int count = 0;
+						if (i > 0) { sum += x[c - 1]; count++; }
+						if (i < nx - 1) { sum += x[c + 1]; count++; }
+						if (j > 0) { sum += x[c - nx]; count++; }
+						if (j < ny - 1) { sum += x[c + nx]; count++; }
+						if (k > 0) { sum += x[c - nx * ny]; count++; }
+						if (k < nz - 1) { sum += x[c + nx * ny]; count++; }
+						if (count > 0)
+						{
+							x[c] = sum / count;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void SmokeGrid::residual(Level &l)
+{
+	int nx = l.dims.x, ny = l.dims.y, nz = l.dims.z;
+	float invH2 = 1.0f / (l.h * l.h);
+	const float *x = l.x.data();
+
+	#pragma omp parallel for
+	for (int k = 0; k < nz; k++)
+	{
+		for (int j = 0; j < ny; j++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				int c = i + nx * (j + ny * k);
+				float ax = 0.0f;
+				if (i > 0) ax += x[c] - x[c - 1];
+				if (i < nx - 1) ax += x[c] - x[c + 1];
+				if (j > 0) ax += x[c] - x[c - nx];
+				if (j < ny - 1) ax += x[c] - x[c + nx];
+				if (k > 0) ax += x[c] - x[c - nx * ny];
+				if (k < nz - 1) ax += x[c] - x[c + nx * ny];
+				l.r[c] = l.b[c] - ax * invH2;
+			}
+		}
+	}
+}
+
+// coarse right hand side = average of the fine residuals it covers
+void SmokeGrid::restrictResidual(const Level &fine, Level &coarse)
+{
+	int fx = fine.dims.x, fy = fine.dims.y, fz = fine.dims.z;
+	int cx = coarse.dims.x, cy = coarse.dims.y, cz = coarse.dims.z;
+
+	#pragma omp parallel for
+	for (int k = 0; k < cz; k++)
+	{
+		for (int j = 0; j < cy; j++)
+		{
+			for (int i = 0; i < cx; i++)
+			{
+				float sum = 0.0f;
+				int count = 0;
+				for (int dk = 0; dk < 2; dk++)
+				{
+					for (int dj = 0; dj < 2; dj++)
+					{
+						for (int di = 0; di < 2; di++)
+						{
+							int fi = 2 * i + di, fj = 2 * j + dj, fk = 2 * k + dk;
+							if (fi < fx && fj < fy && fk < fz)
+							{
+								sum += fine.r[fi + fx * (fj + fy * fk)];
+								count++;
+							}
+						}
+					}
+				}
+				int c = i + cx * (j + cy * k);
+				coarse.b[c] = sum / count;
+				coarse.x[c] = 0.0f;
+			}
+		}
+	}
+}
+
+// add the coarse correction with trilinear interpolation between coarse cell centres
+void SmokeGrid::prolongCorrection(const Level &coarse, Level &fine)
+{
+	int fx = fine.dims.x, fy = fine.dims.y, fz = fine.dims.z;
+	int cx = coarse.dims.x, cy = coarse.dims.y, cz = coarse.dims.z;
+
+	#pragma omp parallel for
+	for (int k = 0; k < fz; k++)
+	{
+		// fine cell centre in coarse cell coordinates
+		float gz = glm::clamp((k + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(cz - 1));
+		int k0 = std::min((int)gz, std::max(cz - 2, 0));
+		int k1 = std::min(k0 + 1, cz - 1);
+		float tz = gz - k0;
+
+		for (int j = 0; j < fy; j++)
+		{
+			float gy = glm::clamp((j + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(cy - 1));
+			int j0 = std::min((int)gy, std::max(cy - 2, 0));
+			int j1 = std::min(j0 + 1, cy - 1);
+			float ty = gy - j0;
+
+			for (int i = 0; i < fx; i++)
+			{
+				float gx = glm::clamp((i + 0.5f) * 0.5f - 0.5f, 0.0f, (float)(cx - 1));
+				int i0 = std::min((int)gx, std::max(cx - 2, 0));
+				int i1 = std::min(i0 + 1, cx - 1);
+				float tx = gx - i0;
+
+				const float *x = coarse.x.data();
+				float c00 = x[i0 + cx * (j0 + cy * k0)] * (1 - tx) + x[i1 + cx * (j0 + cy * k0)] * tx;
+				float c10 = x[i0 + cx * (j1 + cy * k0)] * (1 - tx) + x[i1 + cx * (j1 + cy * k0)] * tx;
+				float c01 = x[i0 + cx * (j0 + cy * k1)] * (1 - tx) + x[i1 + cx * (j0 + cy * k1)] * tx;
+				float c11 = x[i0 + cx * (j1 + cy * k1)] * (1 - tx) + x[i1 + cx * (j1 + cy * k1)] * tx;
+				float c0 = c00 * (1 - ty) + c10 * ty;
+				float c1 = c01 * (1 - ty) + c11 * ty;
+
+				fine.x[i + fx * (j + fy * k)] += c0 * (1 - tz) + c1 * tz;
+			}
+		}
+	}
+}
+
+void SmokeGrid::vCycle(int level)
+{
+	Level &l = m_levels[level];
+
+	// coarsest level: just smooth until converged enough
+	if (level == (int)m_levels.size() - 1)
+	{
+		smooth(l, 30);
+		return;
+	}
+
+	smooth(l, 2);
+	residual(l);
+	restrictResidual(l, m_levels[level + 1]);
+	vCycle(level + 1);
+	prolongCorrection(m_levels[level + 1], l);
+	smooth(l, 2);
+}
+
+
+/*
+** SMOKE DRAG
+*/
+
+void SmokeDrag::applyForce(ParticleSystem &ps)
+{
+	std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::vec3> &vel = ps.getVel();
+	int n = ps.getCount();
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		force[i] += m_drag * (m_grid.sampleVelocity(pos[i]) - vel[i]);
+	}
+}
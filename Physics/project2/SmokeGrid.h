@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+
+/*
+** SMOKE GRID
+** Stable fluids on a MAC grid filling the cube: semi-Lagrangian advection,
+** vorticity confinement and a pressure projection. The Poisson equation is solved
+** with geometric multigrid V-cycles (red-black Gauss-Seidel smoothing, parallel over
+** z slabs) so the solve time grows linearly with the number of cells.
+** The walls of the cube are solid.
+*/
+class SmokeGrid
+{
+public:
+	SmokeGrid();
+	~SmokeGrid();
+
+	/*
+	** GET METHODS
+	*/
+	const glm::vec3& getOrigin() const { return m_origin; }
+	const glm::ivec3& getDims() const { return m_dims; }
+	float getCellSize() const { return m_h; }
+	// number of V-cycles and relative residual of the last pressure solve
+	int getCycles() const { return m_cycles; }
+	float getResidual() const { return m_residual; }
+
+	/*
+	** SET METHODS
+	*/
+	// grid over the cube with cubic cells of the given size
+	void setDomain(const Cube &cube, float cellSize);
+	void setVorticity(float eps) { m_vorticity = eps; }
+	// pressure solve stops when the residual dropped by this factor or after maxCycles V-cycles
+	void setTolerance(float tol) { m_tolerance = tol; }
+	void setMaxCycles(int cycles) { m_maxCycles = cycles; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// blow air with the given velocity (and smoke density) through a sphere, e.g. the nozzle of a blow dryer
+	void addSource(const glm::vec3 &centre, float radius, const glm::vec3 &velocity, float density);
+	void clearSources() { m_sources.clear(); }
+
+	// advance the flow by dt
+	void step(float dt);
+
+	// velocity of the air at a point (trilinear interpolation of the staggered components)
+	glm::vec3 sampleVelocity(const glm::vec3 &p) const;
+	float sampleDensity(const glm::vec3 &p) const;
+
+private:
+	struct Source
+	{
+		glm::vec3 centre;
+		float radius;
+		glm::vec3 velocity;
+		float density;
+	};
+
+	// one level of the multigrid hierarchy
+	struct Level
+	{
+		glm::ivec3 dims;
+		float h;
+		std::vector<float> x, b, r;
+	};
+
+	int uIndex(int i, int j, int k) const { return i + (m_dims.x + 1) * (j + m_dims.y * k); }
+	int vIndex(int i, int j, int k) const { return i + m_dims.x * (j + (m_dims.y + 1) * k); }
+	int wIndex(int i, int j, int k) const { return i + m_dims.x * (j + m_dims.y * k); }
+	int cIndex(int i, int j, int k) const { return i + m_dims.x * (j + m_dims.y * k); }
+
+	// sample a field stored at offset (in cells) from the grid origin
+	float sample(const std::vector<float> &f, const glm::ivec3 &dims, const glm::vec3 &offset, const glm::vec3 &p) const;
+
+	void applySources();
+	void advect(float dt);
+	void confineVorticity(float dt);
+	void project(float dt);
+	void setBoundary();
+
+	// multigrid
+	void buildLevels();
+	void smooth(Level &l, int iterations);
+	void residual(Level &l);
+	void restrictResidual(const Level &fine, Level &coarse);
+	void prolongCorrection(const Level &coarse, Level &fine);
+	void vCycle(int level);
+
+	glm::vec3 m_origin;
+	glm::ivec3 m_dims;
+	float m_h;
+
+	float m_vorticity;
+	float m_tolerance;
+	int m_maxCycles;
+	int m_cycles;
+	float m_residual;
+
+	std::vector<float> m_u, m_v, m_w; // face velocities
+	std::vector<float> m_u0, m_v0, m_w0; // advection targets, swapped with the current velocities
+	std::vector<float> m_density, m_density0; // smoke density
+	std::vector<glm::vec3> m_curl;
+	std::vector<glm::vec3> m_confinement; // vorticity confinement force per cell
+
+	std::vector<Level> m_levels;
+	std::vector<Source> m_sources;
+};
+
+/*
+** SMOKE DRAG
+** Force generator pushing the particles towards the local air velocity.
+*/
+class SmokeDrag : public ForceGenerator
+{
+public:
+	SmokeDrag(const SmokeGrid &grid, float drag) : m_grid(grid), m_drag(drag) {}
+
+	void setDrag(float drag) { m_drag = drag; }
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	const SmokeGrid &m_grid;
+	float m_drag; // linear drag coefficient
+};
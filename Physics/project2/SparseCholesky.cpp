@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <functional>
+#include <iterator>
+
+#include "SparseCholesky.h"
+
+
+SparseCholesky::SparseCholesky()
+{
+	m_n = 0;
+	m_factorized = false;
+}
+
+
+SparseCholesky::~SparseCholesky()
+{
+}
+
+// Eliminates the node of lowest degree in the elimination graph, its neighbours become a clique.
+// The neighbours of a node when it is eliminated are the rows of its column of L.
+void SparseCholesky::minimumDegree(const std::vector<int> &rowStart, const std::vector<int> &columns,
+	std::vector<std::vector<int> > &pattern)
+{
+	int n = m_n;
+	std::vector<std::vector<int> > adjacency(n);
+	for (int i = 0; i < n; i++)
+	{
+		for (int k = rowStart[i]; k < rowStart[i + 1]; k++)
+		{
+			if (columns[k] != i)
+			{
+				adjacency[i].push_back(columns[k]);
+			}
+		}
+		std::sort(adjacency[i].begin(), adjacency[i].end());
+		adjacency[i].erase(std::unique(adjacency[i].begin(), adjacency[i].end()), adjacency[i].end());
+	}
+
+	// lazy min heap of (degree, node), stale entries are skipped
+	typedef std::pair<int, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+	for (int i = 0; i < n; i++)
+	{
+		heap.push(Entry((int)adjacency[i].size(), i));
+	}
+
+	std::vector<char> eliminated(n, 0);
+	std::vector<int> merged;
+	pattern.assign(n, std::vector<int>());
+
+	for (int k = 0; k < n; k++)
+	{
+		int v;
+		for (;;)
+		{
+			Entry e = heap.top();
+			heap.pop();
+			v = e.second;
+			if (!eliminated[v] && e.first == (int)adjacency[v].size())
+			{
+				break;
+			}
+		}
+
+		eliminated[v] = 1;
+		m_perm[k] = v;
+		const std::vector<int> &clique = adjacency[v];
+		pattern[k] = clique;
+
+		for (size_t c = 0; c < clique.size(); c++)
+		{
+			int u = clique[c];
+			std::vector<int> &adj = adjacency[u];
+
+			// adj(u) = adj(u) + clique - {u, v}
+			merged.clear();
+			std::set_union(adj.begin(), adj.end(), clique.begin(), clique.end(), std::back_inserter(merged));
+			adj.clear();
+			for (size_t m = 0; m < merged.size(); m++)
+			{
+				if (merged[m] != u && merged[m] != v)
+				{
+					adj.push_back(merged[m]);
+				}
+			}
+			heap.push(Entry((int)adj.size(), u));
+		}
+
+		std::vector<int>().swap(adjacency[v]);
+	}
+}
+
+void SparseCholesky::analyze(int n, const std::vector<int> &rowStart, const std::vector<int> &columns)
+{
+	m_n = n;
+	m_factorized = false;
+	m_rowStart = rowStart;
+	m_columns = columns;
+	m_perm.resize(n);
+	m_iperm.resize(n);
+
+	std::vector<std::vector<int> > pattern;
+	minimumDegree(rowStart, columns, pattern);
+	for (int k = 0; k < n; k++)
+	{
+		m_iperm[m_perm[k]] = k;
+	}
+
+	// columns of L in the new order, rows sorted
+	m_colStart.assign(n + 1, 0);
+	for (int k = 0; k < n; k++)
+	{
+		m_colStart[k + 1] = m_colStart[k] + (int)pattern[k].size();
+	}
+	m_row.resize(m_colStart[n]);
+	for (int k = 0; k < n; k++)
+	{
+		int *rows = &m_row[0] + m_colStart[k];
+		for (size_t p = 0; p < pattern[k].size(); p++)
+		{
+			rows[p] = m_iperm[pattern[k][p]];
+		}
+		std::sort(rows, rows + pattern[k].size());
+	}
+
+	// transpose of the pattern, visited in column order so every row list is sorted by column
+	m_rowListStart.assign(n + 1, 0);
+	for (size_t p = 0; p < m_row.size(); p++)
+	{
+		m_rowListStart[m_row[p] + 1]++;
+	}
+	for (int j = 0; j < n; j++)
+	{
+		m_rowListStart[j + 1] += m_rowListStart[j];
+	}
+	std::vector<int> fill(m_rowListStart.begin(), m_rowListStart.end() - 1);
+	m_rowListPos.resize(m_row.size());
+	for (int k = 0; k < n; k++)
+	{
+		for (int p = m_colStart[k]; p < m_colStart[k + 1]; p++)
+		{
+			m_rowListPos[fill[m_row[p]]++] = p;
+		}
+	}
+
+	m_value.assign(m_row.size(), 0.0);
+	m_diagonal.assign(n, 0.0);
+}
+
+bool SparseCholesky::factorize(const std::vector<float> &values)
+{
+	int n = m_n;
+	m_factorized = false;
+
+	// column of position p of L, found from the column starts
+	std::vector<int> column(m_row.size());
+	for (int k = 0; k < n; k++)
+	{
+		for (int p = m_colStart[k]; p < m_colStart[k + 1]; p++)
+		{
+			column[p] = k;
+		}
+	}
+
+	std::vector<double> x(n, 0.0);
+	for (int j = 0; j < n; j++)
+	{
+		// scatter column j of the permuted matrix (lower part)
+		int v = m_perm[j];
+		for (int k = m_rowStart[v]; k < m_rowStart[v + 1]; k++)
+		{
+			int i = m_iperm[m_columns[k]];
+			if (i >= j)
+			{
+				x[i] += values[k];
+			}
+		}
+
+		// subtract L(j:n, k) L(j, k) for every earlier column k with L(j, k) != 0
+		for (int r = m_rowListStart[j]; r < m_rowListStart[j + 1]; r++)
+		{
+			int pj = m_rowListPos[r];
+			int k = column[pj];
+			double ljk = m_value[pj];
+			x[j] -= ljk * ljk;
+			for (int p = pj + 1; p < m_colStart[k + 1]; p++)
+			{
+				x[m_row[p]] -= m_value[p] * ljk;
+			}
+		}
+
+		if (x[j] <= 0.0)
+		{
+			return false;
+		}
+		double d = sqrt(x[j]);
+		m_diagonal[j] = d;
+		x[j] = 0.0;
+		for (int p = m_colStart[j]; p < m_colStart[j + 1]; p++)
+		{
+			m_value[p] = x[m_row[p]] / d;
+			x[m_row[p]] = 0.0;
+		}
+	}
+
+	m_factorized = true;
+	return true;
+}
+
+void SparseCholesky::solve(std::vector<glm::vec3> &x) const
+{
+	int n = m_n;
+	// solved in double precision, a local buffer keeps solve() usable from several threads
+	std::vector<glm::dvec3> y(n);
+	for (int k = 0; k < n; k++)
+	{
+		y[k] = glm::dvec3(x[m_perm[k]]);
+	}
+
+	// L y = b
+	for (int j = 0; j < n; j++)
+	{
+		y[j] /= m_diagonal[j];
+		for (int p = m_colStart[j]; p < m_colStart[j + 1]; p++)
+		{
+			y[m_row[p]] -= m_value[p] * y[j];
+		}
+	}
+
+	// L^T x = y
+	for (int j = n - 1; j >= 0; j--)
+	{
+		glm::dvec3 sum = y[j];
+		for (int p = m_colStart[j]; p < m_colStart[j + 1]; p++)
+		{
+			sum -= m_value[p] * y[m_row[p]];
+		}
+		y[j] = sum / m_diagonal[j];
+	}
+
+	for (int k = 0; k < n; k++)
+	{
+		x[m_perm[k]] = glm::vec3(y[k]);
+	}
+}
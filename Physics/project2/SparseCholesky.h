@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+** SPARSE CHOLESKY
+** L L^T factorization of a sparse symmetric positive definite matrix. analyze()
+** picks a fill-reducing elimination order (minimum degree) and the pattern of L,
+** factorize() computes the values (left-looking, column by column), after which
+** solve() is one forward and one backward substitution. A matrix whose values
+** change but whose pattern doesn't only needs factorize() again.
+** The matrix is passed as full symmetric compressed sparse rows (both triangles
+** and the diagonal).
+*/
+class SparseCholesky
+{
+public:
+	SparseCholesky();
+	~SparseCholesky();
+
+	/*
+	** GET METHODS
+	*/
+	int getSize() const { return m_n; }
+	// non-zeros of L below the diagonal
+	int getFactorNonZeros() const { return (int)m_row.size(); }
+	bool isFactorized() const { return m_factorized; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// ordering and symbolic factorization of the pattern
+	void analyze(int n, const std::vector<int> &rowStart, const std::vector<int> &columns);
+	// numeric factorization, values are in the order of the analyzed pattern; false if not positive definite
+	bool factorize(const std::vector<float> &values);
+
+	// solve A x = b for three right hand sides at once, in place
+	void solve(std::vector<glm::vec3> &x) const;
+
+private:
+	void minimumDegree(const std::vector<int> &rowStart, const std::vector<int> &columns,
+		std::vector<std::vector<int> > &pattern);
+
+	int m_n;
+	bool m_factorized;
+
+	// input pattern
+	std::vector<int> m_rowStart;
+	std::vector<int> m_columns;
+
+	// elimination order: m_perm[k] = original index of the k-th pivot, m_iperm its inverse
+	std::vector<int> m_perm, m_iperm;
+
+	// L in compressed columns (strictly lower part) and its diagonal
+	std::vector<int> m_colStart;
+	std::vector<int> m_row;
+	std::vector<double> m_value;
+	std::vector<double> m_diagonal;
+
+	// transposed pattern of L: for row j, the columns k < j with L(j, k) != 0 and the position of L(j, k)
+	std::vector<int> m_rowListStart;
+	std::vector<int> m_rowListPos;
+};
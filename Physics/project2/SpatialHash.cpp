@@ -0,0 +1,366 @@
+#include "SpatialHash.h"
+#include "RadixSort.h"
+#include "Parallel.h"
+
+
+// the neighbours of a cell, those on one side of it first: every neighbour on the other side has
+// the cell on its own side
+static const int HALF_NEIGHBOURS = 13;
+// most cells a wide box is entered in for the queries
+static const int MAX_WIDE_CELLS = 64;
+static const int NEIGHBOURS = 26;
+static const glm::ivec3 neighbours[NEIGHBOURS] = {
+	glm::ivec3(1, 0, 0),
+	glm::ivec3(-1, 1, 0), glm::ivec3(0, 1, 0), glm::ivec3(1, 1, 0),
+	glm::ivec3(-1, -1, 1), glm::ivec3(0, -1, 1), glm::ivec3(1, -1, 1),
+	glm::ivec3(-1, 0, 1), glm::ivec3(0, 0, 1), glm::ivec3(1, 0, 1),
+	glm::ivec3(-1, 1, 1), glm::ivec3(0, 1, 1), glm::ivec3(1, 1, 1),
+	glm::ivec3(-1, 0, 0),
+	glm::ivec3(1, -1, 0), glm::ivec3(0, -1, 0), glm::ivec3(-1, -1, 0),
+	glm::ivec3(1, 1, -1), glm::ivec3(0, 1, -1), glm::ivec3(-1, 1, -1),
+	glm::ivec3(1, 0, -1), glm::ivec3(0, 0, -1), glm::ivec3(-1, 0, -1),
+	glm::ivec3(1, -1, -1), glm::ivec3(0, -1, -1), glm::ivec3(-1, -1, -1)
+};
+
+SpatialHash::SpatialHash()
+{
+	m_cellSize = 0.1f;
+	m_split = 0;
+	m_mask = 0;
+	m_keyBits = 1;
+	m_bucketStart.assign(3, 0);
+	m_wideMask = 0;
+	m_wideStart.assign(2, 0);
+}
+
+
+SpatialHash::~SpatialHash()
+{
+}
+
+unsigned int SpatialHash::hashCell(const glm::ivec3 &c, unsigned int mask) const
+{
+	// the primes of Teschner et al. 2003, summed with x unscaled so neighbours along x land in
+	// neighbouring buckets and the lookups around a cell share cache lines
+	return ((unsigned int)c.x + (unsigned int)c.y * 19349663u + (unsigned int)c.z * 83492791u) & mask;
+}
+
+void SpatialHash::build(const std::vector<AABB> &boxes, int split)
+{
+	int n = (int)boxes.size();
+	m_split = split;
+
+	m_size.resize(n);
+	float widest = 0.0f;
+	for (int i = 0; i < n; i++)
+	{
+		glm::vec3 size = boxes[i].max - boxes[i].min;
+		m_size[i] = glm::max(size.x, glm::max(size.y, size.z));
+		widest = glm::max(widest, m_size[i]);
+	}
+
+	// a histogram of the sizes gives the size all but a hundredth of the boxes fit in; the cells
+	// are a little wider, so rounding can't put the lower corners of two overlapping boxes more
+	// than one cell apart
+	const int BINS = 64;
+	int histogram[BINS] = { 0 };
+	for (int i = 0; i < n; i++)
+	{
+		histogram[widest > 0.0f ? glm::min((int)(m_size[i] / widest * BINS), BINS - 1) : 0]++;
+	}
+	int bin = 0;
+	for (int fitting = histogram[0]; fitting < n - n / 100; fitting += histogram[bin])
+	{
+		bin++;
+	}
+	float fit = widest * (bin + 1) / BINS;
+	m_cellSize = glm::max(1.001f * fit, 1e-6f);
+
+	m_wide.clear();
+	m_wideBoxes.clear();
+	for (int i = 0; i < n; i++)
+	{
+		if (m_size[i] > fit)
+		{
+			m_wide.push_back(i);
+			m_wideBoxes.push_back(boxes[i]);
+		}
+	}
+	int entries = n - (int)m_wide.size();
+
+	// for the queries the wide boxes are also entered in every cell they overlap, in a table of their
+	// own, but those reaching too many cells are tested by every query
+	m_wideKeys.clear();
+	m_wideEntries.clear();
+	m_wideCells.clear();
+	m_huge.clear();
+	for (int w = 0; w < (int)m_wide.size(); w++)
+	{
+		glm::ivec3 lo = getCell(m_wideBoxes[w].min), hi = getCell(m_wideBoxes[w].max);
+		glm::ivec3 span = hi - lo + 1;
+		if (span.x * span.y * span.z > MAX_WIDE_CELLS)
+		{
+			m_huge.push_back(w);
+			continue;
+		}
+		for (int z = lo.z; z <= hi.z; z++)
+		{
+			for (int y = lo.y; y <= hi.y; y++)
+			{
+				for (int x = lo.x; x <= hi.x; x++)
+				{
+					m_wideCells.push_back(glm::ivec3(x, y, z));
+					m_wideEntries.push_back(w);
+				}
+			}
+		}
+	}
+	int wideEntries = (int)m_wideCells.size();
+	int wideBits = 1;
+	while ((1 << wideBits) < 2 * wideEntries)
+	{
+		wideBits++;
+	}
+	m_wideMask = (1u << wideBits) - 1;
+	m_wideKeys.resize(wideEntries);
+	std::vector<int> order(wideEntries);
+	for (int e = 0; e < wideEntries; e++)
+	{
+		m_wideKeys[e] = hashCell(m_wideCells[e], m_wideMask);
+		order[e] = e;
+	}
+	radixSort(m_wideKeys, order, wideBits);
+	std::vector<glm::ivec3> cells(wideEntries);
+	std::vector<int> wide(wideEntries);
+	for (int e = 0; e < wideEntries; e++)
+	{
+		cells[e] = m_wideCells[order[e]];
+		wide[e] = m_wideEntries[order[e]];
+	}
+	m_wideCells.swap(cells);
+	m_wideEntries.swap(wide);
+	m_wideStart.assign(m_wideMask + 2, wideEntries);
+	for (int e = 0; e < wideEntries; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_wideKeys[e - 1] + 1;
+		for (int k = first; k <= (int)m_wideKeys[e]; k++)
+		{
+			m_wideStart[k] = e;
+		}
+	}
+
+	// table with at least twice as many buckets as entries, and the set in the lowest key bit
+	m_keyBits = 1;
+	while ((1 << m_keyBits) < 2 * entries)
+	{
+		m_keyBits++;
+	}
+	m_mask = (1u << m_keyBits) - 1;
+
+	m_keys.resize(entries);
+	m_values.resize(entries);
+	for (int i = 0, e = 0; i < n; i++)
+	{
+		if (m_size[i] <= fit)
+		{
+			m_keys[e] = getKey(getCell(boxes[i].min), getSet(i));
+			m_values[e] = i;
+			e++;
+		}
+	}
+
+	radixSort(m_keys, m_values, m_keyBits + 1);
+
+	// boxes copied in entry order so a bucket scan reads memory linearly
+	m_entryBoxes.resize(entries);
+	m_entryCells.resize(entries);
+	#pragma omp parallel for
+	for (int e = 0; e < entries; e++)
+	{
+		m_entryBoxes[e] = boxes[m_values[e]];
+		m_entryCells[e] = getCell(m_entryBoxes[e].min);
+	}
+
+	// every bucket start is written by the entry where its range begins
+	int keys = 2 * ((int)m_mask + 1);
+	m_bucketStart.assign(keys + 1, entries);
+	#pragma omp parallel for
+	for (int e = 0; e < entries; e++)
+	{
+		int first = e == 0 ? 0 : (int)m_keys[e - 1] + 1;
+		for (int k = first; k <= (int)m_keys[e]; k++)
+		{
+			m_bucketStart[k] = e;
+		}
+	}
+}
+
+void SpatialHash::findPairs(std::vector<std::vector<glm::ivec2> > &threadPairs) const
+{
+	int threads = getMaxThreads();
+	threadPairs.resize(threads);
+	for (int t = 0; t < threads; t++)
+	{
+		threadPairs[t].clear();
+	}
+	int entries = (int)m_values.size();
+
+	// one set: the later entries of the same cell and those of the neighbours on one side; two
+	// sets: the entries of the second set in the cell and all its neighbours
+	bool cross = m_split > 0;
+	int cells = cross ? NEIGHBOURS + 1 : HALF_NEIGHBOURS + 1;
+
+	#pragma omp parallel
+	{
+		std::vector<glm::ivec2> &pairs = threadPairs[getThreadNum()];
+
+		// entry ranges of the cell of the last entry and of its neighbours, looked up again only
+		// when the cell changes, which the sorted entries make rare
+		glm::ivec3 cell;
+		glm::ivec3 other[NEIGHBOURS + 1];
+		int begin[NEIGHBOURS + 1], end[NEIGHBOURS + 1];
+		bool found = false;
+
+		#pragma omp for schedule(dynamic, 1024)
+		for (int e = 0; e < entries; e++)
+		{
+			if (cross && (m_keys[e] & 1) != 0)
+			{
+				continue;
+			}
+			if (!found || m_entryCells[e] != cell)
+			{
+				cell = m_entryCells[e];
+				for (int k = 0; k < cells; k++)
+				{
+					other[k] = k == 0 ? cell : cell + neighbours[k - 1];
+					unsigned int key = getKey(other[k], cross ? 1 : 0);
+					begin[k] = m_bucketStart[key];
+					end[k] = m_bucketStart[key + 1];
+				}
+				found = true;
+			}
+
+			int i = m_values[e];
+			const AABB &box = m_entryBoxes[e];
+
+			// buckets are shared by colliding cells, so the entries of other cells are skipped
+			for (int k = 0; k < cells; k++)
+			{
+				int first = k == 0 && !cross ? e + 1 : begin[k];
+				for (int f = first; f < end[k]; f++)
+				{
+					const AABB &b = m_entryBoxes[f];
+					// without branches, most tests fail
+					bool overlap = (m_entryCells[f] == other[k])
+						& (b.min.x <= box.max.x) & (b.max.x >= box.min.x)
+						& (b.min.y <= box.max.y) & (b.max.y >= box.min.y)
+						& (b.min.z <= box.max.z) & (b.max.z >= box.min.z);
+					if (overlap)
+					{
+						int j = m_values[f];
+						pairs.push_back(i < j ? glm::ivec2(i, j) : glm::ivec2(j, i));
+					}
+				}
+			}
+		}
+
+		// a wide box against the entries whose lower corners are within a cell below it, then
+		// against the later wide boxes
+		int wide = (int)m_wide.size();
+		#pragma omp for schedule(dynamic, 16)
+		for (int w = 0; w < wide; w++)
+		{
+			int i = m_wide[w];
+			const AABB &box = m_wideBoxes[w];
+			int set = cross ? 1 - getSet(i) : 0;
+			glm::ivec3 lo = getCell(box.min - m_cellSize), hi = getCell(box.max);
+
+			for (int z = lo.z; z <= hi.z; z++)
+			{
+				for (int y = lo.y; y <= hi.y; y++)
+				{
+					for (int x = lo.x; x <= hi.x; x++)
+					{
+						glm::ivec3 c(x, y, z);
+						unsigned int key = getKey(c, set);
+						for (int f = m_bucketStart[key]; f < m_bucketStart[key + 1]; f++)
+						{
+							if (m_entryCells[f] == c && box.overlaps(m_entryBoxes[f]))
+							{
+								int j = m_values[f];
+								pairs.push_back(i < j ? glm::ivec2(i, j) : glm::ivec2(j, i));
+							}
+						}
+					}
+				}
+			}
+
+			for (int v = w + 1; v < wide; v++)
+			{
+				int j = m_wide[v];
+				if ((!cross || getSet(j) != getSet(i)) && box.overlaps(m_wideBoxes[v]))
+				{
+					pairs.push_back(i < j ? glm::ivec2(i, j) : glm::ivec2(j, i));
+				}
+			}
+		}
+	}
+}
+
+void SpatialHash::query(const AABB &box, int set, std::vector<int> &result) const
+{
+	// the lower corners of the boxes overlapping it are within a cell below it
+	glm::ivec3 lo = getCell(box.min - m_cellSize), hi = getCell(box.max);
+	for (int z = lo.z; z <= hi.z; z++)
+	{
+		for (int y = lo.y; y <= hi.y; y++)
+		{
+			for (int x = lo.x; x <= hi.x; x++)
+			{
+				glm::ivec3 c(x, y, z);
+				unsigned int key = getKey(c, set);
+				for (int f = m_bucketStart[key]; f < m_bucketStart[key + 1]; f++)
+				{
+					if (m_entryCells[f] == c && box.overlaps(m_entryBoxes[f]))
+					{
+						result.push_back(m_values[f]);
+					}
+				}
+			}
+		}
+	}
+
+	// the wide boxes in the cells of the box itself, each reported in the first cell it shares with it
+	glm::ivec3 first = getCell(box.min), last = getCell(box.max);
+	for (int z = first.z; z <= last.z; z++)
+	{
+		for (int y = first.y; y <= last.y; y++)
+		{
+			for (int x = first.x; x <= last.x; x++)
+			{
+				glm::ivec3 c(x, y, z);
+				unsigned int key = hashCell(c, m_wideMask);
+				for (int f = m_wideStart[key]; f < m_wideStart[key + 1]; f++)
+				{
+					int w = m_wideEntries[f];
+					const AABB &b = m_wideBoxes[w];
+					if (m_wideCells[f] == c && getSet(m_wide[w]) == set && box.overlaps(b)
+						&& glm::max(getCell(b.min), first) == c)
+					{
+						result.push_back(m_wide[w]);
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t h = 0; h < m_huge.size(); h++)
+	{
+		int w = m_huge[h];
+		if (getSet(m_wide[w]) == set && box.overlaps(m_wideBoxes[w]))
+		{
+			result.push_back(m_wide[w]);
+		}
+	}
+}
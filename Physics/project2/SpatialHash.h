@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+/*
+** SPATIAL HASH
+** Boxes (e.g. triangle bounds) hashed into the cells of an infinite uniform grid.
+** The cells are as wide as all but the widest hundredth of the boxes, and every box
+** that fits is entered once, in the cell of its lower corner, so two boxes can only
+** overlap if their cells are the same or neighbours. The (bucket, box) entries are
+** radix sorted so each bucket is a contiguous range and the build has no atomics;
+** every entry keeps its cell, so the cells colliding in a bucket are told apart.
+** All the overlapping pairs are found at once: the boxes of every cell are tested
+** against those of the same cell and of the 13 neighbours on one side of it, which
+** finds every pair exactly once. Two sets of boxes built into one hash (e.g. vertex
+** and triangle bounds) go into separate halves of every bucket, and the boxes of the
+** first set are tested against those of the second in all 27 cells around them.
+** The few wider boxes (e.g. stretched elements) are kept in a list, tested against
+** the cells they reach and against each other, so they don't grow the cells of all
+** the others. A single box of any size is queried against the cells it reaches; for
+** the queries the wide boxes are also entered in every cell they overlap.
+*/
+class SpatialHash
+{
+public:
+	SpatialHash();
+	~SpatialHash();
+
+	/*
+	** GET METHODS
+	*/
+	float getCellSize() const { return m_cellSize; }
+	int getEntryCount() const { return (int)m_values.size(); }
+	int getWideCount() const { return (int)m_wide.size(); }
+
+	/*
+	** OTHER METHODS
+	*/
+	// with split > 0 the boxes before split and those from split on are two sets, and only the
+	// pairs across them are found
+	void build(const std::vector<AABB> &boxes, int split);
+
+	// every pair (i, j), i < j, of overlapping boxes, in one list per thread
+	void findPairs(std::vector<std::vector<glm::ivec2> > &threadPairs) const;
+	// the boxes of a set overlapping the given box, added to result
+	void query(const AABB &box, int set, std::vector<int> &result) const;
+
+private:
+	glm::ivec3 getCell(const glm::vec3 &p) const { return glm::ivec3(glm::floor(p / m_cellSize)); }
+	unsigned int hashCell(const glm::ivec3 &c, unsigned int mask) const;
+	// set of a box: 1 for the second of two sets
+	int getSet(int i) const { return m_split > 0 && i >= m_split ? 1 : 0; }
+	// entries of a cell of one set are at [m_bucketStart[k], m_bucketStart[k + 1]) with this k
+	unsigned int getKey(const glm::ivec3 &c, int set) const { return hashCell(c, m_mask) << 1 | set; }
+
+	float m_cellSize;
+	int m_split;
+	unsigned int m_mask; // table size - 1
+	int m_keyBits;
+
+	std::vector<unsigned int> m_keys; // bucket and set of every entry
+	std::vector<int> m_values; // box of every entry
+	std::vector<AABB> m_entryBoxes;
+	std::vector<glm::ivec3> m_entryCells;
+	std::vector<int> m_bucketStart;
+
+	// boxes wider than a cell
+	std::vector<int> m_wide;
+	std::vector<AABB> m_wideBoxes;
+	std::vector<float> m_size; // largest side of every box
+
+	// the wide boxes entered in every cell they overlap, for the queries, and those too wide for it
+	unsigned int m_wideMask;
+	std::vector<unsigned int> m_wideKeys;
+	std::vector<int> m_wideEntries;
+	std::vector<glm::ivec3> m_wideCells;
+	std::vector<int> m_wideStart;
+	std::vector<int> m_huge;
+};
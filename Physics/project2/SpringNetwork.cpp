@@ -0,0 +1,149 @@
+#include <cmath>
+
+#include "SpringNetwork.h"
+
+
+SpringNetwork::SpringNetwork()
+{
+	m_rowsValid = false;
+}
+
+
+SpringNetwork::~SpringNetwork()
+{
+}
+
+int SpringNetwork::addSpring(int a, int b, float restLength, float stiffness, float damping)
+{
+	m_a.push_back(a);
+	m_b.push_back(b);
+	m_restLength.push_back(restLength);
+	m_stiffness.push_back(stiffness);
+	m_damping.push_back(damping);
+	m_rowsValid = false;
+	return (int)m_a.size() - 1;
+}
+
+int SpringNetwork::addSpring(const ParticleSystem &ps, int a, int b, float stiffness, float damping)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	return addSpring(a, b, glm::length(pos[b] - pos[a]), stiffness, damping);
+}
+
+void SpringNetwork::addChain(const ParticleSystem &ps, int first, int count, float stiffness, float damping)
+{
+	for (int i = first; i < first + count - 1; i++)
+	{
+		addSpring(ps, i, i + 1, stiffness, damping);
+	}
+}
+
+void SpringNetwork::reserve(int springCount)
+{
+	m_a.reserve(springCount);
+	m_b.reserve(springCount);
+	m_restLength.reserve(springCount);
+	m_stiffness.reserve(springCount);
+	m_damping.reserve(springCount);
+}
+
+void SpringNetwork::clear()
+{
+	m_a.clear();
+	m_b.clear();
+	m_restLength.clear();
+	m_stiffness.clear();
+	m_damping.clear();
+	m_rowsValid = false;
+}
+
+// counting sort of the spring ends by particle, only redone when springs were added
+void SpringNetwork::buildRows(int particleCount)
+{
+	int m = getSpringCount();
+	m_rowStart.assign(particleCount + 1, 0);
+	for (int s = 0; s < m; s++)
+	{
+		m_rowStart[m_a[s] + 1]++;
+		m_rowStart[m_b[s] + 1]++;
+	}
+	for (int i = 0; i < particleCount; i++)
+	{
+		m_rowStart[i + 1] += m_rowStart[i];
+	}
+
+	std::vector<int> fill(m_rowStart.begin(), m_rowStart.end() - 1);
+	m_rowSpring.resize(2 * m);
+	for (int s = 0; s < m; s++)
+	{
+		m_rowSpring[fill[m_a[s]]++] = 2 * s;
+		m_rowSpring[fill[m_b[s]]++] = 2 * s + 1;
+	}
+
+	m_fx.resize(m);
+	m_fy.resize(m);
+	m_fz.resize(m);
+	m_rowsValid = true;
+}
+
+void SpringNetwork::applyForce(ParticleSystem &ps)
+{
+	int n = ps.getCount();
+	int m = getSpringCount();
+	if (m == 0)
+	{
+		return;
+	}
+	if (!m_rowsValid || (int)m_rowStart.size() != n + 1)
+	{
+		buildRows(n);
+	}
+
+	const glm::vec3 *pos = ps.getPos().data();
+	const glm::vec3 *vel = ps.getVel().data();
+	std::vector<glm::vec3> &force = ps.getForce();
+
+	const int *ia = m_a.data();
+	const int *ib = m_b.data();
+	const float *rest = m_restLength.data();
+	const float *stiffness = m_stiffness.data();
+	const float *damping = m_damping.data();
+	float *fx = m_fx.data();
+	float *fy = m_fy.data();
+	float *fz = m_fz.data();
+
+	// f_a = (k (|d| - L) + c (v_b - v_a).d / |d|) d / |d|, branch free so the loop vectorizes
+	#pragma omp parallel for
+	for (int s = 0; s < m; s++)
+	{
+		glm::vec3 pa = pos[ia[s]], pb = pos[ib[s]];
+		glm::vec3 va = vel[ia[s]], vb = vel[ib[s]];
+		float dx = pb.x - pa.x, dy = pb.y - pa.y, dz = pb.z - pa.z;
+		float length = sqrtf(dx * dx + dy * dy + dz * dz);
+		float inv = 1.0f / (length + 1e-12f);
+		dx *= inv; dy *= inv; dz *= inv;
+
+		float relVel = (vb.x - va.x) * dx + (vb.y - va.y) * dy + (vb.z - va.z) * dz;
+		float f = stiffness[s] * (length - rest[s]) + damping[s] * relVel;
+		fx[s] = f * dx;
+		fy[s] = f * dy;
+		fz[s] = f * dz;
+	}
+
+	// every particle sums its own row
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+		for (int r = m_rowStart[i]; r < m_rowStart[i + 1]; r++)
+		{
+			int e = m_rowSpring[r];
+			float sign = (e & 1) ? -1.0f : 1.0f;
+			int s = e >> 1;
+			sx += sign * fx[s];
+			sy += sign * fy[s];
+			sz += sign * fz[s];
+		}
+		force[i] += glm::vec3(sx, sy, sz);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+
+/*
+** SPRING NETWORK
+** Damped springs between the particles of a system, e.g. connected springs or a
+** chain. The springs are stored as edge arrays (structure of arrays) and the
+** particle -> spring incidence as a compressed sparse row table.
+** The force is computed in two parallel passes: one flat pass over the springs
+** writes the force of each spring, then every particle gathers the forces of its
+** springs from its CSR row, so no two threads write to the same particle.
+*/
+class SpringNetwork : public ForceGenerator
+{
+public:
+	SpringNetwork();
+	~SpringNetwork();
+
+	/*
+	** GET METHODS
+	*/
+	int getSpringCount() const { return (int)m_a.size(); }
+	int getParticleA(int s) const { return m_a[s]; }
+	int getParticleB(int s) const { return m_b[s]; }
+	float getRestLength(int s) const { return m_restLength[s]; }
+	float getStiffness(int s) const { return m_stiffness[s]; }
+	float getDamping(int s) const { return m_damping[s]; }
+
+	/*
+	** SET METHODS
+	*/
+	void setRestLength(int s, float length) { m_restLength[s] = length; }
+	void setStiffness(int s, float k) { m_stiffness[s] = k; }
+	void setDamping(int s, float d) { m_damping[s] = d; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// add a spring between particles a and b, returns its index
+	int addSpring(int a, int b, float restLength, float stiffness, float damping);
+	// spring with its rest length taken from the current positions
+	int addSpring(const ParticleSystem &ps, int a, int b, float stiffness, float damping);
+	// connect count particles starting at first one after the other
+	void addChain(const ParticleSystem &ps, int first, int count, float stiffness, float damping);
+	void reserve(int springCount);
+	void clear();
+
+	void applyForce(ParticleSystem &ps);
+
+private:
+	void buildRows(int particleCount);
+
+	// springs
+	std::vector<int> m_a, m_b;
+	std::vector<float> m_restLength;
+	std::vector<float> m_stiffness;
+	std::vector<float> m_damping;
+
+	// force of every spring on its particle a, particle b gets the opposite
+	std::vector<float> m_fx, m_fy, m_fz;
+
+	// CSR incidence: the springs of particle i are m_rowSpring[m_rowStart[i] .. m_rowStart[i + 1]),
+	// stored as 2 * spring + (1 if the particle is b)
+	std::vector<int> m_rowStart;
+	std::vector<int> m_rowSpring;
+	bool m_rowsValid;
+};
@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <iterator>
+#include <xmmintrin.h>
+
+#include "SweepAndPrune.h"
+
+
+// endpoint order: by value, with min endpoints before max endpoints of equal value so touching boxes are reported
+static bool endpointLess(const SweepAndPrune::Endpoint &a, const SweepAndPrune::Endpoint &b)
+{
+	return a.value < b.value || (a.value == b.value && a.proxy >= 0 && b.proxy < 0);
+}
+
+SweepAndPrune::SweepAndPrune()
+{
+	m_proxyCount = 0;
+	m_sweepAxis = 0;
+	m_swapCount = 0;
+}
+
+
+SweepAndPrune::~SweepAndPrune()
+{
+}
+
+
+/*
+** PROXY METHODS
+*/
+
+int SweepAndPrune::createProxy(const AABB &aabb, int bodyId)
+{
+	int proxyId;
+	if (!m_freeProxies.empty())
+	{
+		proxyId = m_freeProxies.back();
+		m_freeProxies.pop_back();
+	}
+	else
+	{
+		proxyId = (int)m_proxies.size();
+		m_proxies.push_back(Proxy());
+		m_activeSlot.push_back(-1);
+	}
+
+	m_proxies[proxyId].aabb = aabb;
+	m_proxies[proxyId].bodyId = bodyId;
+
+	// binary search the position of the new endpoints in the (nearly) sorted lists
+	for (int axis = 0; axis < 3; axis++)
+	{
+		std::vector<Endpoint> &ep = m_endpoints[axis];
+		Endpoint lo = { aabb.min[axis], proxyId };
+		Endpoint hi = { aabb.max[axis], -(proxyId + 1) };
+		ep.insert(std::lower_bound(ep.begin(), ep.end(), lo, endpointLess), lo);
+		ep.insert(std::upper_bound(ep.begin(), ep.end(), hi, endpointLess), hi);
+	}
+
+	m_proxyCount++;
+	return proxyId;
+}
+
+void SweepAndPrune::destroyProxy(int proxyId)
+{
+	// the id is only reused once its endpoints have been removed by the next update
+	m_proxies[proxyId].bodyId = -1;
+	m_removedProxies.push_back(proxyId);
+	m_proxyCount--;
+}
+
+bool SweepAndPrune::moveProxy(int proxyId, const AABB &aabb, const glm::vec3 &)
+{
+	m_proxies[proxyId].aabb = aabb;
+	return true;
+}
+
+
+/*
+** UPDATE METHODS
+*/
+
+// refresh the endpoint values from the proxies and repair the order with an insertion sort
+void SweepAndPrune::sortAxis(int axis)
+{
+	std::vector<Endpoint> &ep = m_endpoints[axis];
+	int n = (int)ep.size();
+
+	for (int i = 0; i < n; i++)
+	{
+		int proxy = ep[i].proxy;
+		if (proxy >= 0)
+		{
+			ep[i].value = m_proxies[proxy].aabb.min[axis];
+		}
+		else
+		{
+			ep[i].value = m_proxies[-proxy - 1].aabb.max[axis];
+		}
+	}
+
+	for (int i = 1; i < n; i++)
+	{
+		Endpoint key = ep[i];
+		int j = i - 1;
+		while (j >= 0 && endpointLess(key, ep[j]))
+		{
+			ep[j + 1] = ep[j];
+			j--;
+			m_swapCount++;
+		}
+		ep[j + 1] = key;
+	}
+}
+
+// the axis with the largest variance of box centres separates the boxes best
+int SweepAndPrune::chooseAxis() const
+{
+	glm::vec3 sum(0.0f);
+	glm::vec3 sum2(0.0f);
+	for (int i = 0; i < (int)m_proxies.size(); i++)
+	{
+		if (m_proxies[i].bodyId < 0)
+		{
+			continue;
+		}
+		glm::vec3 c = m_proxies[i].aabb.getCenter();
+		sum += c;
+		sum2 += c * c;
+	}
+
+	if (m_proxyCount == 0)
+	{
+		return 0;
+	}
+
+	glm::vec3 variance = sum2 / (float)m_proxyCount - (sum * sum) / ((float)m_proxyCount * (float)m_proxyCount);
+	int axis = 0;
+	if (variance[1] > variance[axis]) axis = 1;
+	if (variance[2] > variance[axis]) axis = 2;
+	return axis;
+}
+
+void SweepAndPrune::sweep(int axis, std::vector<BodyPair> &pairs)
+{
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+
+	m_activeMinU.clear();
+	m_activeMaxU.clear();
+	m_activeMinV.clear();
+	m_activeMaxV.clear();
+	m_activeProxy.clear();
+
+	const std::vector<Endpoint> &ep = m_endpoints[axis];
+	for (int i = 0; i < (int)ep.size(); i++)
+	{
+		int proxy = ep[i].proxy;
+
+		// leaving the interval: swap remove from the active list
+		if (proxy < 0)
+		{
+			proxy = -proxy - 1;
+			int slot = m_activeSlot[proxy];
+			int last = (int)m_activeProxy.size() - 1;
+			m_activeMinU[slot] = m_activeMinU[last];
+			m_activeMaxU[slot] = m_activeMaxU[last];
+			m_activeMinV[slot] = m_activeMinV[last];
+			m_activeMaxV[slot] = m_activeMaxV[last];
+			m_activeProxy[slot] = m_activeProxy[last];
+			m_activeSlot[m_activeProxy[slot]] = slot;
+			m_activeMinU.pop_back();
+			m_activeMaxU.pop_back();
+			m_activeMinV.pop_back();
+			m_activeMaxV.pop_back();
+			m_activeProxy.pop_back();
+			m_activeSlot[proxy] = -1;
+			continue;
+		}
+
+		// entering: every active box overlaps along the sweep axis, test the two other axes
+		const AABB &b = m_proxies[proxy].aabb;
+		int bodyId = m_proxies[proxy].bodyId;
+		int n = (int)m_activeProxy.size();
+		int n4 = n & ~3;
+
+		__m128 minU = _mm_set1_ps(b.min[u]);
+		__m128 maxU = _mm_set1_ps(b.max[u]);
+		__m128 minV = _mm_set1_ps(b.min[v]);
+		__m128 maxV = _mm_set1_ps(b.max[v]);
+
+		for (int k = 0; k < n4; k += 4)
+		{
+			__m128 overlap = _mm_and_ps(
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&m_activeMinU[k]), maxU), _mm_cmpge_ps(_mm_loadu_ps(&m_activeMaxU[k]), minU)),
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&m_activeMinV[k]), maxV), _mm_cmpge_ps(_mm_loadu_ps(&m_activeMaxV[k]), minV)));
+
+			int mask = _mm_movemask_ps(overlap);
+			for (int bit = 0; mask != 0; bit++, mask >>= 1)
+			{
+				if (mask & 1)
+				{
+					int other = m_proxies[m_activeProxy[k + bit]].bodyId;
+					if (other != bodyId)
+					{
+						BodyPair pair = { std::min(bodyId, other), std::max(bodyId, other) };
+						pairs.push_back(pair);
+					}
+				}
+			}
+		}
+
+		for (int k = n4; k < n; k++)
+		{
+			if (m_activeMinU[k] <= b.max[u] && m_activeMaxU[k] >= b.min[u]
+				&& m_activeMinV[k] <= b.max[v] && m_activeMaxV[k] >= b.min[v])
+			{
+				int other = m_proxies[m_activeProxy[k]].bodyId;
+				if (other != bodyId)
+				{
+					BodyPair pair = { std::min(bodyId, other), std::max(bodyId, other) };
+					pairs.push_back(pair);
+				}
+			}
+		}
+
+		m_activeSlot[proxy] = n;
+		m_activeMinU.push_back(b.min[u]);
+		m_activeMaxU.push_back(b.max[u]);
+		m_activeMinV.push_back(b.min[v]);
+		m_activeMaxV.push_back(b.max[v]);
+		m_activeProxy.push_back(proxy);
+	}
+}
+
+void SweepAndPrune::updatePairs(std::vector<BodyPair> &pairs)
+{
+	pairs.clear();
+
+	// drop the endpoints of destroyed proxies, keeping the rest in order
+	if (!m_removedProxies.empty())
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			std::vector<Endpoint> &ep = m_endpoints[axis];
+			int count = 0;
+			for (int i = 0; i < (int)ep.size(); i++)
+			{
+				int proxy = ep[i].proxy >= 0 ? ep[i].proxy : -ep[i].proxy - 1;
+				if (m_proxies[proxy].bodyId >= 0)
+				{
+					ep[count++] = ep[i];
+				}
+			}
+			ep.resize(count);
+		}
+		m_freeProxies.insert(m_freeProxies.end(), m_removedProxies.begin(), m_removedProxies.end());
+		m_removedProxies.clear();
+	}
+
+	// all three axes are kept sorted so that switching the sweep axis stays cheap
+	m_swapCount = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		sortAxis(axis);
+	}
+
+	m_sweepAxis = chooseAxis();
+	m_overlaps.clear();
+	sweep(m_sweepAxis, m_overlaps);
+
+	// a body can own several proxies, so remove duplicates
+	std::sort(m_overlaps.begin(), m_overlaps.end());
+	m_overlaps.erase(std::unique(m_overlaps.begin(), m_overlaps.end()), m_overlaps.end());
+
+	// report only the overlaps that were not there at the last update, like the tree does
+	std::set_difference(m_overlaps.begin(), m_overlaps.end(), m_lastOverlaps.begin(), m_lastOverlaps.end(), std::back_inserter(pairs));
+	m_lastOverlaps.swap(m_overlaps);
+}
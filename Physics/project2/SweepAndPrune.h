@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "Broadphase.h"
+
+/*
+** SWEEP AND PRUNE
+** Keeps the box endpoints sorted along all three axes. Because bodies move only a
+** little between steps the endpoint lists stay nearly sorted and an insertion sort
+** repairs them in close to linear time. Pairs are found by sweeping the axis along
+** which the box centres have the largest variance; the sorted overlaps are kept so
+** that only the pairs that started overlapping are reported.
+*/
+class SweepAndPrune : public Broadphase
+{
+public:
+	SweepAndPrune();
+	~SweepAndPrune();
+
+	/*
+	** GET METHODS
+	*/
+	const char* getName() const { return "sweep and prune"; }
+	int getProxyCount() const { return m_proxyCount; }
+	int getBodyId(int proxyId) const { return m_proxies[proxyId].bodyId; }
+	const AABB& getFatAABB(int proxyId) const { return m_proxies[proxyId].aabb; }
+	// axis used by the last sweep
+	int getSweepAxis() const { return m_sweepAxis; }
+	// number of endpoint swaps done by the last update, small when the scene is coherent
+	int getSwapCount() const { return m_swapCount; }
+
+	/*
+	** PROXY METHODS
+	*/
+	int createProxy(const AABB &aabb, int bodyId);
+	void destroyProxy(int proxyId);
+	bool moveProxy(int proxyId, const AABB &aabb, const glm::vec3 &displacement);
+
+	// repair the endpoint lists, sweep the best axis and report the overlaps new since the last update
+	void updatePairs(std::vector<BodyPair> &pairs);
+
+	struct Endpoint
+	{
+		float value;
+		int proxy; // proxy id, negative ids mark max endpoints: -(id + 1)
+	};
+
+private:
+
+	struct Proxy
+	{
+		AABB aabb;
+		int bodyId; // -1 when the proxy is free
+	};
+
+	void sortAxis(int axis);
+	int chooseAxis() const;
+	void sweep(int axis, std::vector<BodyPair> &pairs);
+
+	std::vector<Proxy> m_proxies;
+	std::vector<int> m_freeProxies;
+	std::vector<int> m_removedProxies; // destroyed proxies whose endpoints are still in the lists
+	int m_proxyCount;
+
+	std::vector<Endpoint> m_endpoints[3];
+
+	// active list for the sweep, stored as structure of arrays for the SIMD overlap test
+	std::vector<float> m_activeMinU, m_activeMaxU, m_activeMinV, m_activeMaxV;
+	std::vector<int> m_activeProxy;
+	std::vector<int> m_activeSlot; // position of each proxy in the active list
+
+	// sorted overlaps of this update and of the last one
+	std::vector<BodyPair> m_overlaps;
+	std::vector<BodyPair> m_lastOverlaps;
+
+	int m_sweepAxis;
+	int m_swapCount;
+};
@@ -0,0 +1,140 @@
+#include <algorithm>
+
+#include "TriangleTree.h"
+
+
+// orders triangles by one coordinate of their centroid
+struct CentroidLess
+{
+	const std::vector<glm::vec3> *centroids;
+	int axis;
+
+	bool operator()(int a, int b) const { return (*centroids)[a][axis] < (*centroids)[b][axis]; }
+};
+
+
+TriangleTree::TriangleTree()
+{
+}
+
+
+TriangleTree::~TriangleTree()
+{
+}
+
+void TriangleTree::build(const std::vector<glm::ivec3> &triangles, const std::vector<glm::vec3> &pos)
+{
+	int count = (int)triangles.size();
+	std::vector<glm::vec3> centroids(count);
+	m_order.resize(count);
+	for (int t = 0; t < count; t++)
+	{
+		const glm::ivec3 &tri = triangles[t];
+		centroids[t] = (pos[tri.x] + pos[tri.y] + pos[tri.z]) / 3.0f;
+		m_order[t] = t;
+	}
+
+	m_nodes.clear();
+	m_levels.clear();
+	m_leaf.resize(count);
+	if (count > 0)
+	{
+		m_nodes.reserve(2 * count - 1);
+		build(0, count, 0, centroids);
+	}
+}
+
+int TriangleTree::build(int first, int last, int depth, const std::vector<glm::vec3> &centroids)
+{
+	int node = (int)m_nodes.size();
+	m_nodes.push_back(Node());
+	if ((int)m_levels.size() <= depth)
+	{
+		m_levels.resize(depth + 1);
+	}
+	m_levels[depth].push_back(node);
+
+	if (last - first == 1)
+	{
+		m_nodes[node].left = -1;
+		m_nodes[node].right = -1;
+		m_nodes[node].triangle = m_order[first];
+		m_leaf[m_order[first]] = node;
+		return node;
+	}
+
+	// median split along the longest axis of the centroids
+	AABB bounds(centroids[m_order[first]], centroids[m_order[first]]);
+	for (int i = first + 1; i < last; i++)
+	{
+		bounds.extend(centroids[m_order[i]]);
+	}
+	glm::vec3 extent = bounds.max - bounds.min;
+	CentroidLess less;
+	less.centroids = &centroids;
+	less.axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	int mid = (first + last) / 2;
+	std::nth_element(m_order.begin() + first, m_order.begin() + mid, m_order.begin() + last, less);
+
+	int left = build(first, mid, depth + 1, centroids);
+	int right = build(mid, last, depth + 1, centroids);
+	m_nodes[node].left = left;
+	m_nodes[node].right = right;
+	m_nodes[node].triangle = -1;
+	return node;
+}
+
+void TriangleTree::refit(const std::vector<AABB> &boxes)
+{
+	int count = (int)m_leaf.size();
+
+	#pragma omp parallel for
+	for (int t = 0; t < count; t++)
+	{
+		m_nodes[m_leaf[t]].aabb = boxes[t];
+	}
+
+	for (int d = (int)m_levels.size() - 1; d >= 0; d--)
+	{
+		const std::vector<int> &level = m_levels[d];
+		int nodes = (int)level.size();
+		#pragma omp parallel for
+		for (int k = 0; k < nodes; k++)
+		{
+			Node &node = m_nodes[level[k]];
+			if (node.left != -1)
+			{
+				node.aabb = AABB::combine(m_nodes[node.left].aabb, m_nodes[node.right].aabb);
+			}
+		}
+	}
+}
+
+void TriangleTree::query(const AABB &box, std::vector<int> &result, std::vector<int> &stack) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node &node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (!node.aabb.overlaps(box))
+		{
+			continue;
+		}
+		if (node.left == -1)
+		{
+			result.push_back(node.triangle);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+/*
+** TRIANGLE TREE
+** Bounding volume hierarchy over the triangles of a deforming mesh. The topology
+** is built once by median splits of the rest shape; every step only the boxes are
+** refitted, the leaves in parallel and then the inner nodes a depth at a time from
+** the bottom up, which keeps the tree good enough as long as the mesh does not tear.
+*/
+class TriangleTree
+{
+public:
+	TriangleTree();
+	~TriangleTree();
+
+	/*
+	** GET METHODS
+	*/
+	bool isEmpty() const { return m_nodes.empty(); }
+	int getTriangleCount() const { return (int)m_leaf.size(); }
+	const AABB& getBounds() const { return m_nodes[0].aabb; }
+	// box of a triangle from the last refit
+	const AABB& getBox(int triangle) const { return m_nodes[m_leaf[triangle]].aabb; }
+
+	/*
+	** OTHER METHODS
+	*/
+	void build(const std::vector<glm::ivec3> &triangles, const std::vector<glm::vec3> &pos);
+
+	// set the box of every triangle and refit the inner nodes
+	void refit(const std::vector<AABB> &boxes);
+
+	// append the triangles whose boxes overlap the box; the stack is scratch space so that
+	// parallel callers can keep their own
+	void query(const AABB &box, std::vector<int> &result, std::vector<int> &stack) const;
+
+private:
+	struct Node
+	{
+		AABB aabb;
+		int left, right; // children, -1 for a leaf
+		int triangle;
+	};
+
+	int build(int first, int last, int depth, const std::vector<glm::vec3> &centroids);
+
+	std::vector<Node> m_nodes;
+	std::vector<int> m_order;
+	std::vector<int> m_leaf; // leaf node of every triangle
+	std::vector<std::vector<int> > m_levels; // nodes of every depth
+};
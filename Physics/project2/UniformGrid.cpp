@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+
+#include "UniformGrid.h"
+#include "RadixSort.h"
+
+
+UniformGrid::UniformGrid()
+{
+	setDomain(glm::vec3(0.0f), glm::vec3(1.0f), 1.0f);
+}
+
+
+UniformGrid::~UniformGrid()
+{
+}
+
+void UniformGrid::setDomain(const glm::vec3 &origin, const glm::vec3 &bound, float cellSize)
+{
+	m_origin = origin;
+	m_cellSize = cellSize;
+	m_dims = glm::max(glm::ivec3(glm::ceil((bound - origin) / cellSize)), glm::ivec3(1));
+
+	// number of key bits needed to sort by cell index
+	m_keyBits = 1;
+	while ((1 << m_keyBits) < getCellCount())
+	{
+		m_keyBits++;
+	}
+
+	m_cellStart.assign(getCellCount(), 0);
+	m_cellEnd.assign(getCellCount(), 0);
+}
+
+glm::ivec3 UniformGrid::getCellCoord(const glm::vec3 &p) const
+{
+	glm::ivec3 c = glm::ivec3(glm::floor((p - m_origin) / m_cellSize));
+	return glm::clamp(c, glm::ivec3(0), m_dims - 1);
+}
+
+void UniformGrid::build(const std::vector<glm::vec3> &pos)
+{
+	int n = (int)pos.size();
+	int cells = getCellCount();
+
+	m_cells.resize(n);
+	m_sorted.resize(n);
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		m_cells[i] = (unsigned int)getCellIndex(getCellCoord(pos[i]));
+		m_sorted[i] = i;
+	}
+
+	radixSort(m_cells, m_sorted, m_keyBits);
+
+	#pragma omp parallel for
+	for (int c = 0; c < cells; c++)
+	{
+		m_cellStart[c] = 0;
+		m_cellEnd[c] = 0;
+	}
+
+	// every cell boundary in the sorted order is found by exactly one slot
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+	{
+		unsigned int c = m_cells[i];
+		if (i == 0 || m_cells[i - 1] != c)
+		{
+			m_cellStart[c] = i;
+		}
+		if (i == n - 1 || m_cells[i + 1] != c)
+		{
+			m_cellEnd[c] = i + 1;
+		}
+	}
+}
+
+void UniformGrid::getRowRange(const glm::ivec3 &c, int dy, int dz, int &begin, int &end) const
+{
+	begin = end = 0;
+
+	int y = c.y + dy;
+	int z = c.z + dz;
+	if (y < 0 || y >= m_dims.y || z < 0 || z >= m_dims.z)
+	{
+		return;
+	}
+
+	int x0 = std::max(c.x - 1, 0);
+	int x1 = std::min(c.x + 1, m_dims.x - 1);
+	int first = getCellIndex(glm::ivec3(x0, y, z));
+	int last = getCellIndex(glm::ivec3(x1, y, z));
+
+	// empty cells have start = end = 0, find the first and last non empty cells of the row
+	for (int cell = first; cell <= last; cell++)
+	{
+		if (m_cellEnd[cell] > m_cellStart[cell])
+		{
+			begin = m_cellStart[cell];
+			break;
+		}
+	}
+	for (int cell = last; cell >= first; cell--)
+	{
+		if (m_cellEnd[cell] > m_cellStart[cell])
+		{
+			end = m_cellEnd[cell];
+			break;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+** UNIFORM GRID
+** Neighbour search for particles of similar size. The particles are counting
+** sorted by cell so that every cell is a contiguous range of the sorted order,
+** and the three cells of a grid row along x are contiguous as well.
+*/
+class UniformGrid
+{
+public:
+	UniformGrid();
+	~UniformGrid();
+
+	/*
+	** GET METHODS
+	*/
+	const glm::ivec3& getDims() const { return m_dims; }
+	int getCellCount() const { return m_dims.x * m_dims.y * m_dims.z; }
+	float getCellSize() const { return m_cellSize; }
+	const glm::vec3& getOrigin() const { return m_origin; }
+
+	// sorted slot -> particle index
+	const std::vector<int>& getSortedIndices() const { return m_sorted; }
+	// cell of every sorted slot
+	const std::vector<unsigned int>& getSortedCells() const { return m_cells; }
+	// range [start, end) of sorted slots in a cell
+	int getCellStart(int cell) const { return m_cellStart[cell]; }
+	int getCellEnd(int cell) const { return m_cellEnd[cell]; }
+
+	/*
+	** SET METHODS
+	*/
+	// grid covering the box [origin, bound] with cubic cells, particles outside are clamped to the border cells
+	void setDomain(const glm::vec3 &origin, const glm::vec3 &bound, float cellSize);
+
+	/*
+	** OTHER METHODS
+	*/
+	glm::ivec3 getCellCoord(const glm::vec3 &p) const;
+	int getCellIndex(const glm::ivec3 &c) const { return (c.z * m_dims.y + c.y) * m_dims.x + c.x; }
+
+	// sort the particles into the cells
+	void build(const std::vector<glm::vec3> &pos);
+
+	// sorted range covering the cells x-1..x+1 of row (y, z), clamped to the grid
+	void getRowRange(const glm::ivec3 &c, int dy, int dz, int &begin, int &end) const;
+
+private:
+	glm::vec3 m_origin;
+	glm::ivec3 m_dims;
+	float m_cellSize;
+	int m_keyBits;
+
+	std::vector<unsigned int> m_cells;
+	std::vector<int> m_sorted;
+	std::vector<int> m_cellStart;
+	std::vector<int> m_cellEnd;
+};
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+#include "XPBDCloth.h"
+
+
+XPBDCloth::XPBDCloth()
+{
+	m_stretchCompliance = 0.0f;
+	m_bendCompliance = 1e-4f;
+	m_substeps = 20;
+	m_iterations = 1;
+	m_colorStart.push_back(0);
+	m_serialColor = false;
+}
+
+
+XPBDCloth::~XPBDCloth()
+{
+}
+
+void XPBDCloth::setMesh(const ClothMesh &mesh, const ParticleSystem &ps)
+{
+	const std::vector<glm::vec3> &pos = ps.getPos();
+	const std::vector<glm::ivec2> &edges = mesh.getEdges();
+	const std::vector<glm::ivec4> &bendEdges = mesh.getBendEdges();
+
+	std::vector<Constraint> constraints;
+	constraints.reserve(edges.size() + bendEdges.size());
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		Constraint c = { edges[e].x, edges[e].y, glm::length(pos[edges[e].y] - pos[edges[e].x]), m_stretchCompliance };
+		constraints.push_back(c);
+	}
+	// bending keeps the distance between the two vertices opposite to an inner edge
+	for (size_t e = 0; e < bendEdges.size(); e++)
+	{
+		Constraint c = { bendEdges[e].z, bendEdges[e].w, glm::length(pos[bendEdges[e].w] - pos[bendEdges[e].z]), m_bendCompliance };
+		constraints.push_back(c);
+	}
+
+	colorConstraints(constraints, ps.getCount());
+}
+
+void XPBDCloth::colorConstraints(std::vector<Constraint> &constraints, int particleCount)
+{
+	// colours already used at every particle, a constraint takes the lowest colour free at both ends
+	std::vector<unsigned long long> used(particleCount, 0);
+	std::vector<int> color(constraints.size());
+	std::vector<int> count(65, 0);
+
+	for (size_t c = 0; c < constraints.size(); c++)
+	{
+		unsigned long long mask = used[constraints[c].a] | used[constraints[c].b];
+		int k = 0;
+		while (k < 64 && (mask >> k) & 1ull)
+		{
+			k++;
+		}
+		// the rare constraint that finds all 64 colours taken goes to a last colour projected serially
+		if (k < 64)
+		{
+			used[constraints[c].a] |= 1ull << k;
+			used[constraints[c].b] |= 1ull << k;
+		}
+		color[c] = k;
+		count[k]++;
+	}
+
+	// counting sort by colour, empty colours are dropped
+	m_colorStart.clear();
+	m_colorStart.push_back(0);
+	std::vector<int> offset(65, 0);
+	for (int k = 0; k < 65; k++)
+	{
+		offset[k] = m_colorStart.back();
+		if (count[k] > 0)
+		{
+			m_colorStart.push_back(m_colorStart.back() + count[k]);
+		}
+	}
+	m_serialColor = count[64] > 0;
+
+	int m = (int)constraints.size();
+	m_a.resize(m);
+	m_b.resize(m);
+	m_restLength.resize(m);
+	m_compliance.resize(m);
+	m_lambda.assign(m, 0.0f);
+	for (int c = 0; c < m; c++)
+	{
+		int slot = offset[color[c]]++;
+		m_a[slot] = constraints[c].a;
+		m_b[slot] = constraints[c].b;
+		m_restLength[slot] = constraints[c].restLength;
+		m_compliance[slot] = constraints[c].compliance;
+	}
+}
+
+// dlambda = (-C - alpha~ lambda) / (w_a + w_b + alpha~), x_a += w_a dlambda n, x_b -= w_b dlambda n
+void XPBDCloth::projectColor(int color, float dt)
+{
+	int start = m_colorStart[color];
+	int end = m_colorStart[color + 1];
+	float invDt2 = 1.0f / (dt * dt);
+	bool serial = m_serialColor && color == getColorCount() - 1;
+
+	if (!serial)
+	{
+		__m128 invDt2v = _mm_set1_ps(invDt2);
+		__m128 tiny = _mm_set1_ps(1e-12f);
+
+		#pragma omp parallel for
+		for (int c = start; c < end - 3; c += 4)
+		{
+			const int *a = &m_a[c];
+			const int *b = &m_b[c];
+
+			__m128 wa = _mm_set_ps(m_w[a[3]], m_w[a[2]], m_w[a[1]], m_w[a[0]]);
+			__m128 wb = _mm_set_ps(m_w[b[3]], m_w[b[2]], m_w[b[1]], m_w[b[0]]);
+			__m128 dx = _mm_sub_ps(_mm_set_ps(m_x[a[3]], m_x[a[2]], m_x[a[1]], m_x[a[0]]), _mm_set_ps(m_x[b[3]], m_x[b[2]], m_x[b[1]], m_x[b[0]]));
+			__m128 dy = _mm_sub_ps(_mm_set_ps(m_y[a[3]], m_y[a[2]], m_y[a[1]], m_y[a[0]]), _mm_set_ps(m_y[b[3]], m_y[b[2]], m_y[b[1]], m_y[b[0]]));
+			__m128 dz = _mm_sub_ps(_mm_set_ps(m_z[a[3]], m_z[a[2]], m_z[a[1]], m_z[a[0]]), _mm_set_ps(m_z[b[3]], m_z[b[2]], m_z[b[1]], m_z[b[0]]));
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 C = _mm_sub_ps(length, _mm_loadu_ps(&m_restLength[c]));
+			__m128 alpha = _mm_mul_ps(_mm_loadu_ps(&m_compliance[c]), invDt2v);
+			__m128 lambda = _mm_loadu_ps(&m_lambda[c]);
+
+			__m128 denom = _mm_max_ps(_mm_add_ps(_mm_add_ps(wa, wb), alpha), tiny);
+			__m128 dLambda = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), C), _mm_mul_ps(alpha, lambda)), denom);
+			_mm_storeu_ps(&m_lambda[c], _mm_add_ps(lambda, dLambda));
+
+			// correction along the normalised difference
+			__m128 s = _mm_div_ps(dLambda, _mm_max_ps(length, tiny));
+			float cx[4], cy[4], cz[4], fa[4], fb[4];
+			_mm_storeu_ps(cx, _mm_mul_ps(dx, s));
+			_mm_storeu_ps(cy, _mm_mul_ps(dy, s));
+			_mm_storeu_ps(cz, _mm_mul_ps(dz, s));
+			_mm_storeu_ps(fa, wa);
+			_mm_storeu_ps(fb, wb);
+
+			// the constraints of a colour share no particle, so the scatter is conflict free
+			for (int k = 0; k < 4; k++)
+			{
+				m_x[a[k]] += fa[k] * cx[k]; m_y[a[k]] += fa[k] * cy[k]; m_z[a[k]] += fa[k] * cz[k];
+				m_x[b[k]] -= fb[k] * cx[k]; m_y[b[k]] -= fb[k] * cy[k]; m_z[b[k]] -= fb[k] * cz[k];
+			}
+		}
+
+		// the last one to three constraints of the colour
+		start = std::max(start, end - (end - start) % 4);
+	}
+
+	for (int c = start; c < end; c++)
+	{
+		int a = m_a[c], b = m_b[c];
+		float dx = m_x[a] - m_x[b], dy = m_y[a] - m_y[b], dz = m_z[a] - m_z[b];
+		float length = sqrtf(dx * dx + dy * dy + dz * dz);
+		float alpha = m_compliance[c] * invDt2;
+		float denom = std::max(m_w[a] + m_w[b] + alpha, 1e-12f);
+		float dLambda = (-(length - m_restLength[c]) - alpha * m_lambda[c]) / denom;
+		m_lambda[c] += dLambda;
+
+		float s = dLambda / std::max(length, 1e-12f);
+		m_x[a] += m_w[a] * s * dx; m_y[a] += m_w[a] * s * dy; m_z[a] += m_w[a] * s * dz;
+		m_x[b] -= m_w[b] * s * dx; m_y[b] -= m_w[b] * s * dy; m_z[b] -= m_w[b] * s * dz;
+	}
+}
+
+void XPBDCloth::step(ParticleSystem &ps, float dt, ExternalConstraints *constraints)
+{
+	int n = ps.getCount();
+	if (n == 0)
+	{
+		return;
+	}
+
+	std::vector<glm::vec3> &pos = ps.getPos();
+	std::vector<glm::vec3> &vel = ps.getVel();
+	const std::vector<glm::vec3> &force = ps.getForce();
+	const std::vector<float> &invMass = ps.getInvMass();
+
+	m_x.resize(n);
+	m_y.resize(n);
+	m_z.resize(n);
+	m_w.assign(invMass.begin(), invMass.end());
+
+	// the external forces are evaluated once per step
+	ps.clearForces();
+	ps.applyForces();
+
+	float h = dt / m_substeps;
+	int colors = getColorCount();
+
+	for (int s = 0; s < m_substeps; s++)
+	{
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			vel[i] += force[i] * invMass[i] * h;
+			glm::vec3 p = pos[i] + vel[i] * h;
+			m_x[i] = p.x;
+			m_y[i] = p.y;
+			m_z[i] = p.z;
+		}
+		if (constraints)
+		{
+			constraints->beginSubstep(ps, h);
+		}
+
+		std::fill(m_lambda.begin(), m_lambda.end(), 0.0f);
+		for (int it = 0; it < m_iterations; it++)
+		{
+			for (int c = 0; c < colors; c++)
+			{
+				projectColor(c, h);
+			}
+			if (constraints)
+			{
+				constraints->project(m_x, m_y, m_z, m_w);
+			}
+		}
+
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+		{
+			glm::vec3 p(m_x[i], m_y[i], m_z[i]);
+			vel[i] = (p - pos[i]) / h;
+			pos[i] = p;
+		}
+		if (constraints)
+		{
+			constraints->endSubstep(ps, h);
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "ClothMesh.h"
+
+// constraints between the cloth and other bodies (e.g. contacts), projected in the cloth
+// solver's iterations so the cloth and the bodies answer each other within a substep
+class ExternalConstraints
+{
+public:
+	virtual ~ExternalConstraints() {}
+
+	// the cloth is at its predicted positions: move the other bodies to theirs
+	virtual void beginSubstep(const ParticleSystem &ps, float h) = 0;
+	// one pass, after the cloth constraints of an iteration, over the predicted positions
+	virtual void project(std::vector<float> &x, std::vector<float> &y, std::vector<float> &z, const std::vector<float> &w) = 0;
+	// the cloth velocities are updated: update those of the other bodies
+	virtual void endSubstep(ParticleSystem &ps, float h) = 0;
+};
+
+/*
+** XPBD CLOTH
+** Extended position based dynamics (Macklin et al. 2016) with distance constraints
+** on the mesh edges and bending constraints between the vertices opposite to every
+** inner edge. The constraints are graph coloured once in setMesh and stored colour
+** by colour, so the constraints of a colour share no particle and are projected in
+** parallel, four at a time with SSE.
+** With one iteration per substep and many substeps (the default) this is the
+** "small steps" scheme, which converges better than many iterations of one step.
+*/
+class XPBDCloth
+{
+public:
+	XPBDCloth();
+	~XPBDCloth();
+
+	/*
+	** GET METHODS
+	*/
+	int getConstraintCount() const { return (int)m_a.size(); }
+	int getColorCount() const { return (int)m_colorStart.size() - 1; }
+	int getSubsteps() const { return m_substeps; }
+	int getIterations() const { return m_iterations; }
+
+	/*
+	** SET METHODS
+	*/
+	// compliance = inverse stiffness (m/N), 0 is inextensible; used by the next setMesh
+	void setStretchCompliance(float compliance) { m_stretchCompliance = compliance; }
+	void setBendCompliance(float compliance) { m_bendCompliance = compliance; }
+	// substeps per step and iterations per substep
+	void setSubsteps(int substeps) { m_substeps = substeps; }
+	void setIterations(int iterations) { m_iterations = iterations; }
+
+	/*
+	** OTHER METHODS
+	*/
+	// build and colour the constraints of a mesh, the rest lengths are the current distances
+	void setMesh(const ClothMesh &mesh, const ParticleSystem &ps);
+
+	// the external constraints, if any, are projected after the cloth's in every iteration
+	void step(ParticleSystem &ps, float dt, ExternalConstraints *constraints = NULL);
+
+private:
+	struct Constraint
+	{
+		int a, b;
+		float restLength;
+		float compliance;
+	};
+
+	// greedy colouring, reorders the constraints colour by colour
+	void colorConstraints(std::vector<Constraint> &constraints, int particleCount);
+	void projectColor(int color, float dt);
+
+	float m_stretchCompliance;
+	float m_bendCompliance;
+	int m_substeps;
+	int m_iterations;
+
+	// constraints in colour order
+	std::vector<int> m_a, m_b;
+	std::vector<float> m_restLength;
+	std::vector<float> m_compliance;
+	std::vector<float> m_lambda;
+	std::vector<int> m_colorStart;
+	bool m_serialColor; // the last colour holds the constraints that found no free colour
+
+	// particle state during a step
+	std::vector<float> m_x, m_y, m_z; // predicted positions
+	std::vector<float> m_w; // inverse masses
+};
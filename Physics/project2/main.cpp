@@ -25,6 +25,9 @@
 #include "Mesh.h"
 #include "Particle.h"
 #include "Body.h"
+#include "ParticleSystem.h"
+#include "SmokeGrid.h"
+#include "RigidBodySystem.h"
 
 
 // time
@@ -47,6 +50,7 @@ void BlowDryer()
 
 	// create particle
 	std::vector<Particle> particles;
+	ParticleSystem ps;
 	int particleNum = 40;
 	for (int i = 0; i < particleNum; i++)
 	{
@@ -64,6 +68,9 @@ void BlowDryer()
 
 		//make ring
 		particles[i].setPos(glm::vec3(sin(i), 3.0f, cos(i)));
+
+		// simulation state lives in the particle system
+		ps.addParticle(particles[i].getPos(), particles[i].getVel(), particles[i].getMass());
 	}
 
 	//height marker particle
@@ -82,14 +89,20 @@ void BlowDryer()
 	double currentTime = (GLfloat)glfwGetTime();
 	double accumulator = 0.0f;
 
-	struct Cube
-	{
-		glm::vec3 origin = glm::vec3(-2.5f, 0.0f, -2.5f);
-		glm::vec3 bound = glm::vec3(2.5f, 5.0f, 2.5f);
-	};
-
 	Cube cube;
-	glm::vec3 gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	Gravity gravity = Gravity(glm::vec3(0.0f, -9.8f, 0.0f));
+	ps.addForceGenerator(&gravity);
+	ps.setCube(cube);
+	ps.setCor(particles[0].getCor());
+	// particles that settle on the floor sleep until the air pushes them again
+	ps.setSleeping(true);
+
+	// air flow of the blow dryer, blowing up from a nozzle near the floor
+	SmokeGrid air;
+	air.setDomain(cube, 0.25f);
+	air.addSource(glm::vec3(-1.5f, 0.5f, 0.0f), 0.4f, glm::vec3(3.0f, 6.0f, 0.0f), 1.0f);
+	SmokeDrag drag = SmokeDrag(air, 0.5f);
+	ps.addForceGenerator(&drag);
 
 	// Game loop
 	while (!glfwWindowShouldClose(app.getWindow()))
@@ -104,49 +117,24 @@ void BlowDryer()
 
 		while (accumulator >= fixedDeltaTime)
 		{
-			for (int i = 0; i < particleNum; i++)
-			{
-				/*
-				**	SIMULATION
-				*/
-				/*glm::vec3 Fg;
-				float mass = 5;
-				Fg = gravity * mass;*/
-
-
-				//set acceleration
-				particles[i].setAcc(gravity);
-
-				//Semi-Implicit Euler integration
-				particles[i].getVel() += particles[i].getAcc() * fixedDeltaTime;
-				particles[i].setPos(particles[i].getPos() + particles[i].getVel() * fixedDeltaTime);
-
-				//collisions to bound within the box
-				for (int j = 0; j < 3; j++)
-				{
-					if (particles[i].getTranslate()[3][j] < cube.origin[j])
-					{
-						glm::vec3 diff = glm::vec3(0.0f);
-						diff[j] = cube.origin[j] - particles[i].getPos()[j];
-						particles[i].setPos(j, cube.origin[j] + diff[j]);
-						particles[i].getVel()[j] *= -1.0f;
-					}
-
-					if (particles[i].getTranslate()[3][j] > cube.bound[j])
-					{
-						glm::vec3 diff = glm::vec3(0.0f);
-						diff[j] = cube.origin[j] - particles[i].getPos()[j];
-						particles[i].setPos(j, cube.bound[j] + diff[j]);
-						particles[i].getVel()[j] *= -1.0f;
-					}
-
-				}
-			}
+			/*
+			**	SIMULATION
+			*/
+			// gravity, air drag, Semi-Implicit Euler integration and collisions to bound within the box
+			air.step((float)fixedDeltaTime);
+			ps.step((float)fixedDeltaTime);
 
 			accumulator -= fixedDeltaTime;
 			physicsTime += fixedDeltaTime;
 		}
 
+		// copy the simulated state to the rendered particles
+		for (int i = 0; i < particleNum; i++)
+		{
+			particles[i].setPos(ps.getPos()[i]);
+			particles[i].setVel(ps.getVel()[i]);
+		}
+
 		// Set frame time
 		GLfloat currentFrame = (GLfloat)glfwGetTime() - firstFrame;
 		// the animation can be sped up or slowed down by multiplying currentFrame by a factor.
@@ -197,25 +185,35 @@ void RigidbodyRotate()
 	plane.setShader(Shader("resources/shaders/core.vert", "resources/shaders/core.frag"));
 
 
-	// create particle
+	// create plates: rigid bodies rendered by particles, scaled to 0.4 x 0.2 so that the three
+	// principal moments differ
 	std::vector<Particle> particles;
 	int particleNum = 40;
+	RigidBodySystem rb;
+	rb.reserve(particleNum);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
 	for (int i = 0; i < particleNum; i++)
 	{
 		Particle p = Particle::Particle();
 		particles.push_back(p);
-		//scale it down (x.1), translate it up by 2.5 and rotate it by 90 degrees around the x axis
-		//particles[i].setPos(glm::vec3(0.0f, 4.0f, 0.0f));
-		particles[i].scale(glm::vec3(0.5f, 0.5f, 0.5f));
-		//particles[i].rotate((GLfloat) M_PI_2, glm::vec3(0.0f, 1.0f, 0.0f));
+		particles[i].scale(glm::vec3(4.0f, 1.0f, 2.0f));
 		particles[i].getMesh().setShader(Shader("resources/shaders/core.vert", "resources/shaders/core_blue.frag"));
 
-
-		//initial velocty
-		//particles[i].setVel(glm::vec3(sin(i), 0.0f, cos(i)));
-
 		//make ring
 		particles[i].setPos(glm::vec3(sin(i), 3.0f, cos(i)));
+
+		// thin plate in the xz plane of the mesh, in the orientation the particle starts in
+		float a = 0.4f;
+		float c = 0.2f;
+		float mass = particles[i].getMass();
+		glm::vec3 inertia = mass / 12.0f * glm::vec3(c * c, a * a + c * c, a * a);
+		int body = rb.addBody(particles[i].getPos(), glm::angleAxis((float)M_PI_2, glm::vec3(1.0f, 0.0f, 0.0f)), mass, inertia);
+
+		// spin mostly about the intermediate axis (the plate's z), which is unstable: the plates flip
+		glm::vec3 omega = glm::vec3(0.1f * jitter(random), 0.1f * jitter(random), 10.0f);
+		rb.setAngularVel(body, glm::mat3_cast(rb.getOrientation(body)) * omega);
+		rb.setVel(body, glm::vec3(jitter(random), 0.0f, jitter(random)));
 	}
 
 	//height marker particle
@@ -234,14 +232,9 @@ void RigidbodyRotate()
 	double currentTime = (GLfloat)glfwGetTime();
 	double accumulator = 0.0f;
 
-	struct Cube
-	{
-		glm::vec3 origin = glm::vec3(-2.5f, 0.0f, -2.5f);
-		glm::vec3 bound = glm::vec3(2.5f, 5.0f, 2.5f);
-	};
-
 	Cube cube;
-	glm::vec3 gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	rb.setCube(cube);
+	rb.setCor(particles[0].getCor());
 
 	// Game loop
 	while (!glfwWindowShouldClose(app.getWindow()))
@@ -256,49 +249,25 @@ void RigidbodyRotate()
 
 		while (accumulator >= fixedDeltaTime)
 		{
-			for (int i = 0; i < particleNum; i++)
-			{
-				/*
-				**	SIMULATION
-				*/
-				/*glm::vec3 Fg;
-				float mass = 5;
-				Fg = gravity * mass;*/
-
-
-				//set acceleration
-				particles[i].setAcc(gravity);
-
-				//Semi-Implicit Euler integration
-				particles[i].getVel() += particles[i].getAcc() * fixedDeltaTime;
-				particles[i].setPos(particles[i].getPos() + particles[i].getVel() * fixedDeltaTime);
-
-				//collisions to bound within the box
-				for (int j = 0; j < 3; j++)
-				{
-					if (particles[i].getTranslate()[3][j] < cube.origin[j])
-					{
-						glm::vec3 diff = glm::vec3(0.0f);
-						diff[j] = cube.origin[j] - particles[i].getPos()[j];
-						particles[i].setPos(j, cube.origin[j] + diff[j]);
-						particles[i].getVel()[j] *= -1.0f;
-					}
-
-					if (particles[i].getTranslate()[3][j] > cube.bound[j])
-					{
-						glm::vec3 diff = glm::vec3(0.0f);
-						diff[j] = cube.origin[j] - particles[i].getPos()[j];
-						particles[i].setPos(j, cube.bound[j] + diff[j]);
-						particles[i].getVel()[j] *= -1.0f;
-					}
-
-				}
-			}
+			/*
+			**	SIMULATION
+			*/
+			// gravity, Semi-Implicit Euler integration of the momenta and orientations, and
+			// collisions to bound the centres within the box
+			rb.step((float)fixedDeltaTime);
 
 			accumulator -= fixedDeltaTime;
 			physicsTime += fixedDeltaTime;
 		}
 
+		// transform sync: the only place the render matrices are built from the bodies
+		for (int i = 0; i < particleNum; i++)
+		{
+			particles[i].setPos(rb.getPos(i));
+			particles[i].setVel(rb.getVel(i));
+			particles[i].setRotate(rb.getRotate(i));
+		}
+
 		// Set frame time
 		GLfloat currentFrame = (GLfloat)glfwGetTime() - firstFrame;
 		// the animation can be sped up or slowed down by multiplying currentFrame by a factor.